@@ -42,6 +42,8 @@ extern diskGeo DiskGeometryList[];
 
 extern const uint8_t freedos_mbr[];
 
+class imageDiskIO;
+
 class imageDisk {
 	public:
 		enum IMAGE_TYPE {
@@ -59,6 +61,9 @@ class imageDisk {
 		virtual uint8_t Write_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,const void * data,unsigned int req_sector_size=0);
 		virtual uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data);
 		virtual uint8_t Write_AbsoluteSector(uint32_t sectnum, const void * data);
+		/* count consecutive sectors at once, one sector at a time unless the image can do better */
+		virtual uint8_t Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data);
+		virtual uint8_t Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data);
 
 		virtual void UpdateFloppyType(void);
 		virtual void Set_Reserved_Cylinders(Bitu resCyl);
@@ -98,6 +103,13 @@ class imageDisk {
 		volatile int refcount = 0;
 		std::vector<bool> partition_in_use; /* used by FAT driver to prevent mounting a partition twice */
 		uint64_t current_fpos = 0;
+		imageDiskIO* io = NULL; /* how the raw image is read and written, set up on first access */
+
+		bool Open_IO(void);
+
+	protected:
+		uint8_t Read_Image(uint32_t sectnum, uint32_t count, void * data);
+		uint8_t Write_Image(uint32_t sectnum, uint32_t count, const void * data);
 
 	public:
 		int Addref() {
@@ -132,6 +144,15 @@ class imageDisk {
 		}
 };
 
+/* a raw sector image, which reads and writes runs of sectors in one request */
+class imageDiskRaw : public imageDisk {
+public:
+	imageDiskRaw(FILE *imgFile, const char *imgName, uint32_t imgSizeK, bool isHardDisk) : imageDisk(imgFile, imgName, imgSizeK, isHardDisk) { }
+	imageDiskRaw(FILE* diskimg, const char* diskName, uint32_t cylinders, uint32_t heads, uint32_t sectors, uint32_t sector_size, bool hardDrive) : imageDisk(diskimg, diskName, cylinders, heads, sectors, sector_size, hardDrive) { }
+	virtual uint8_t Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data);
+	virtual uint8_t Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data);
+};
+
 class imageDiskEmptyDrive : public imageDisk {
 public:
 	virtual uint8_t Read_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,void * data,unsigned int req_sector_size=0);
@@ -347,6 +368,8 @@ public:
     VHDTypes vhdType = VHD_TYPE_NONE;
 	virtual uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data);
 	virtual uint8_t Write_AbsoluteSector(uint32_t sectnum, const void * data);
+	virtual uint8_t Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data);
+	virtual uint8_t Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data);
 	static ErrorCodes Open(const char* fileName, const bool readOnly, imageDisk** disk);
 	static VHDTypes GetVHDType(const char* fileName);
 	VHDTypes GetVHDType(void) const;
@@ -394,10 +417,19 @@ private:
         void SetDefaults();
     };
 
+	//sector bitmaps of the most recently used allocated blocks
+	struct BlockBitmap {
+		uint32_t block = 0xFFFFFFFFul;
+		uint64_t lru = 0;
+		std::vector<uint8_t> map;
+	};
+
 	imageDiskVHD() : imageDisk(ID_VHD) { }
     static ErrorCodes TryOpenParent(const char* childFileName, const ParentLocatorEntry& entry, const uint8_t* data, const uint32_t dataLength, imageDisk** disk, const uint8_t* uniqueId);
 	static ErrorCodes Open(const char* fileName, const bool readOnly, imageDisk** disk, const uint8_t* matchUniqueId);
 	virtual bool loadBlock(const uint32_t blockNumber);
+	BlockBitmap* claimBitmap(const uint32_t blockNumber, bool& cached);
+	uint8_t readUnallocated(uint32_t sectnum, uint32_t count, uint8_t* data);
 	static bool convert_UTF16_for_fopen(std::string &string, const void* data, const uint32_t dataLength);
     bool is_zeroed_sector(const void* data);
 	bool is_block_allocated(uint32_t blockNumber);
@@ -415,7 +447,10 @@ private:
 	uint32_t currentBlock = 0xFFFFFFFF;
     bool currentBlockAllocated = false;
 	uint32_t currentBlockSectorOffset = 0;
-	uint8_t* currentBlockDirtyMap = 0;
+	uint8_t* currentBlockDirtyMap = 0;     /* points into bitmapCache */
+	std::vector<uint32_t> blockTable;      /* the BAT, in host byte order */
+	std::vector<BlockBitmap> bitmapCache;
+	uint64_t bitmapTick = 0;
 };
 
 /* C++ class implementing El Torito floppy emulation */
@@ -0,0 +1,129 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_BIOS_DISK_IO_H
+#define DOSBOX_BIOS_DISK_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+
+#if !defined(WIN32)
+# define DISK_IO_POSIX
+#endif
+
+#if defined(DISK_IO_POSIX) && !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define DISK_IO_THREADS
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+#endif
+
+/* Access to the sectors of a raw disk image file for imageDisk.
+ *
+ * The file is read and written either through its stdio FILE, with pread/pwrite on its file
+ * descriptor, or through a shared memory mapping of the whole file. The first two can put a
+ * cache of 64KB blocks in front, which takes whole blocks from the file at a time. Once reads
+ * go sequentially, the following blocks are read ahead of the guest: by a worker thread with
+ * pread, or as part of the same read with stdio. Writes go straight through to the file and
+ * update whatever is cached, so the image on disk is always current.
+ *
+ * Offsets are relative to the start of the disk within the file (image_base). */
+class imageDiskIO {
+public:
+    enum backend_t {
+        BACKEND_AUTO=0,         /* pread where available, else stdio */
+        BACKEND_STDIO,
+        BACKEND_PREAD,
+        BACKEND_MMAP
+    };
+
+    imageDiskIO(FILE *f,uint64_t base,uint64_t length,backend_t want,size_t cache_bytes,size_t readahead_bytes);
+    ~imageDiskIO();
+
+    bool read(uint64_t ofs,void *data,size_t len);
+    bool write(uint64_t ofs,const void *data,size_t len);
+
+    backend_t get_backend(void) const { return backend; }
+
+    struct stats_t {
+        uint64_t hits = 0;          /* blocks found in the cache */
+        uint64_t misses = 0;        /* blocks the guest had to wait for */
+        uint64_t readahead = 0;     /* blocks read ahead */
+    } stats;
+
+    static const size_t block_size = 64u * 1024u;
+private:
+    enum { SLOT_EMPTY=0, SLOT_LOADING, SLOT_VALID };
+
+    struct slot_t {
+        uint64_t    block = 0;
+        uint64_t    lru = 0;
+        uint8_t*    data = NULL;
+        uint8_t     state = SLOT_EMPTY;
+    };
+
+    struct piece_t {
+        void*       buf;
+        size_t      len;
+    };
+
+    bool raw_read(uint64_t pos,const piece_t *pieces,unsigned int count);
+    bool raw_write(uint64_t pos,const void *data,size_t len);
+    size_t block_length(uint64_t block) const;
+    int claim_slot(uint64_t block);
+    void release_slot(int s);
+    bool read_cached(uint64_t ofs,uint8_t *data,size_t len);
+    void start_readahead(uint64_t block);
+
+    FILE*                                   f;
+    uint64_t                                base;
+    uint64_t                                length;
+    backend_t                               backend = BACKEND_STDIO;
+    int                                     fd = -1;
+
+    uint8_t*                                map = NULL;
+    size_t                                  map_size = 0;
+    bool                                    map_writable = false;
+    uint64_t                                map_advised = 0;    /* read ahead requested up to here */
+
+    std::vector<slot_t>                     slots;
+    std::vector<uint8_t>                    slot_mem;
+    std::unordered_map<uint64_t,int>        index;      /* block -> slot */
+    uint64_t                                tick = 0;
+    uint64_t                                last_end = ~0ull;
+    unsigned int                            readahead_blocks = 0;
+
+#if defined(DISK_IO_THREADS)
+    void worker_run(void);
+
+    std::mutex                              lock;
+    std::condition_variable                 loaded;     /* a slot left SLOT_LOADING */
+    std::condition_variable                 wake;       /* work for the read-ahead thread */
+    std::deque<uint64_t>                    queue;
+    std::thread                             worker;
+    bool                                    quit = false;
+#endif
+};
+
+/* settings from [dos], used by images opened after they change */
+extern imageDiskIO::backend_t disk_image_io_backend;
+extern int disk_image_cache_kb;
+extern int disk_image_readahead_kb;
+
+#endif
@@ -25,6 +25,9 @@
 #include "support.h"
 #include "mem.h"
 
+#include <unordered_map>
+#include <vector>
+
 #define DOS_NAMELENGTH 12u
 #define DOS_NAMELENGTH_ASCII (DOS_NAMELENGTH+1)
 #define LFN_NAMELENGTH 255u
@@ -228,6 +231,8 @@ public:
 
 	void		EmptyCache			(void);
 	void		MediaChange			(void);
+	void		WatchHost			(bool enable);
+	void		CheckHostChanges	(void);
 	void		SetLabel			(const char* vname,bool cdrom,bool allowupdate);
 	char*		GetLabel			(void) { return label; };
 
@@ -242,17 +247,30 @@ public:
 			for (uint32_t i=0; i<fileList.size(); i++) delete fileList[i];
 			fileList.clear();
 			longNameList.clear();
+			ClearIndex();
 		};
+		void ClearIndex(void) {
+			shortIndex.clear(); caseIndex.clear(); longIndex.clear(); wineIndex.clear();
+			wineIndexed = false;
+		}
 		char		orgname		[CROSS_LEN];
 		char		shortname	[DOS_NAMELENGTH_ASCII];
 		bool        isOverlayDir;
 		bool		isDir;
 		uint16_t		id = MAX_OPENDIRS;
+		int			hostWatch = -1;	// inotify watch on the host directory, see WatchHost
 		Bitu		nextEntry;
 		Bitu		shortNr;
 		// contents
 		std::vector<CFileInfo*>	fileList;
 		std::vector<CFileInfo*>	longNameList;
+		// hashed lookups into fileList, where names are shared the entry sorted first wins
+		typedef std::unordered_map<std::string,CFileInfo*> NameIndex;
+		NameIndex	shortIndex;		// shortname
+		NameIndex	caseIndex;		// upper case orgname
+		NameIndex	longIndex;		// orgname of the entries in longNameList
+		NameIndex	wineIndex;		// Wine style short name, built on first use
+		bool		wineIndexed = false;
 	};
 
 private:
@@ -261,15 +279,22 @@ private:
 
 	bool		RemoveTrailingDot	(char* shortname);
 	Bits		GetLongName		(CFileInfo* curDir, char* shortName);
+	CFileInfo*	FindEntry		(CFileInfo* curDir, char* shortName);
+	CFileInfo*	FindOrgName		(CFileInfo* curDir, const char* name);
+	Bits		GetEntryIndex		(CFileInfo* curDir, CFileInfo* info);
+	void		IndexEntry		(CFileInfo* curDir, CFileInfo* info);
 	void		CreateShortName		(CFileInfo* curDir, CFileInfo* info);
 	Bitu		CreateShortNameID	(CFileInfo* curDir, const char* name);
 	int		CompareShortname	(const char* compareName, const char* shortName);
     bool        SetResult       (CFileInfo* dir, char * &result, char * &lresult, Bitu entryNr);
 	bool		IsCachedIn		(CFileInfo* curDir);
+	void		CacheOutDir		(CFileInfo* dir);
+	void		Watch			(CFileInfo* dir, const char* path);
+	void		Unwatch			(CFileInfo* dir);
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
 	bool		RemoveSpaces		(char* str);
 	bool		OpenDir			(CFileInfo* dir, const char* expand, uint16_t& id);
-    char*       CreateEntry     (CFileInfo* dir, const char* name, const char* sname, bool is_directory);
+    char*       CreateEntry     (CFileInfo* dir, const char* name, const char* sname, bool is_directory, bool sorted = true);
 	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
 	uint16_t		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
@@ -292,6 +317,9 @@ private:
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	int			watchFd = -1;
+	std::unordered_map<int,CFileInfo*>	watchDirs;	// inotify watch -> directory
 };
 
 class DOS_Drive {
@@ -327,6 +327,14 @@ public:
     bool isEmpty(size_t slot) const;
     void removeState(size_t slot) const;
     std::string getName(size_t slot, bool nl=false) const;
+    bool isSaving() const;   //a save is still being compressed/written in the background
+    void finishSave() const; //wait for a background save and report its result
+    void pollSave() const;   //report a finished background save without blocking
+
+    //rewind: in-memory ring of compressed snapshots
+    void setRewind(int frames, int memorymb); //snapshot every "frames" emulated frames (0: off) within "memorymb" MB
+    void rewindCapture();                     //called once per emulated frame
+    bool rewind();                            //go back to the most recent snapshot, false if there is none
 
     //initialization: register relevant components on program startup
     struct Component
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stdio.h> // for FILE*, for OpenCaptureFile()
+#include <atomic>
 
 class Section;
 enum OPL_Mode {
@@ -33,7 +34,10 @@ enum OPL_Mode {
 #define CAPTURE_RAWIMAGE	0x40
 #define CAPTURE_NETWORK		0x80
 
-extern Bitu CaptureState;
+extern std::atomic<Bitu> CaptureState;
+
+void CAPTURE_SetState(Bitu bits);
+void CAPTURE_ClearState(Bitu bits);
 
 void OPL_Init(Section* sec,OPL_Mode oplmode);
 void CMS_Init(Section* sec);
@@ -19,4 +19,7 @@ void IDE_Hard_Disk_Detach(unsigned char bios_disk_index);
 void IDE_ResetDiskByBIOS(unsigned char disk);
 bool IDE_controller_occupied(signed char index, bool slave);
 
+/* I/O base of the PCI bus master IDE registers, or 0 if they are disabled (pci_bus.cpp) */
+void IDE_BusMaster_SetBase(unsigned int base);
+
 #endif
@@ -51,6 +51,16 @@ void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range=1);
 
 void IO_InvalidateCachedHandler(Bitu port,Bitu range=1);
 
+/* ports more than one callout device answers to are dispatched directly once they are hot (default on) */
+void IO_EnableHotDispatch(bool enable);
+
+/* per port and width I/O access counts and host time, for profiling */
+void IO_EnableStats(bool enable);
+bool IO_StatsEnabled(void);
+void IO_ResetStats(void);
+void IO_GetStats(bool write,Bitu port,Bitu iolen,uint64_t &calls,uint64_t &ns,uint64_t &slow);
+void IO_LogStats(unsigned int max=32);
+
 void IO_WriteB(Bitu port,uint8_t val);
 void IO_WriteW(Bitu port,uint16_t val);
 void IO_WriteD(Bitu port,uint32_t val);
@@ -56,6 +56,9 @@ public:
 	template<class Type,bool stereo,bool signeddata,bool nativeorder,bool lowpass>
 	void loadCurrentSample(Bitu &len, const Type* &data);
 
+	template<class Type,bool stereo,bool signeddata>
+	void addSamplesAtMixerRate(Bitu &len, const Type* &data);
+
 	template<class Type,bool stereo,bool signeddata,bool nativeorder>
 	void AddSamples(Bitu len, const Type* data);
 	double timeSinceLastSample(void);
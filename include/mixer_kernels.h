@@ -0,0 +1,52 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_MIXER_KERNELS_H
+#define DOSBOX_MIXER_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* channel volume (volmul) and master/record volume are fixed point with this many fraction bits */
+#define MIXER_VOLSHIFT 13
+
+/* The inner loops of the mixer over whole blocks of samples. Samples are stereo frames of two
+ * int32_t (or int16_t), mono input is given both channels. Every version gives exactly the same
+ * result as the plain C one, including wraparound where the scalar code wraps. */
+struct MixerKernels {
+    const char *name;
+
+    /* dst += src, channels swapped if swap */
+    void (*accumulate)(int32_t *dst,const int32_t *src,size_t frames,bool swap);
+
+    /* dst = clip((src * vol) >> (2 * MIXER_VOLSHIFT)) to int16, for output and capture */
+    void (*scale_clip)(int16_t *dst,const int32_t *src,size_t frames,int32_t vol0,int32_t vol1);
+
+    /* dst = sample * vol, for 8-bit samples ((int8_t)(s ^ xr)) << 8, 16-bit (int16_t)(s ^ xr) and 32-bit */
+    void (*load8)(int32_t *dst,const uint8_t *src,size_t frames,bool stereo,uint8_t xr,int32_t vol0,int32_t vol1);
+    void (*load16)(int32_t *dst,const uint16_t *src,size_t frames,bool stereo,uint16_t xr,int32_t vol0,int32_t vol1);
+    void (*load32)(int32_t *dst,const uint32_t *src,size_t frames,bool stereo,int32_t vol0,int32_t vol1);
+};
+
+/* the kernels the mixer uses, the best the host CPU supports (set by MIXER_SelectKernels) */
+extern const MixerKernels *mixer_kernels;
+
+void MIXER_SelectKernels(void);
+
+/* all versions built in and usable on this CPU, plain C first. NULL past the end */
+const MixerKernels *MIXER_GetKernels(unsigned int index);
+
+#endif
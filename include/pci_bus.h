@@ -98,6 +98,8 @@ void PCI_RemoveSVGAS3_Device(void);
 
 void PCI_AddSST_Device(Bitu type);
 void PCI_RemoveSST_Device(void);
+void PCI_AddIDE_Device(void);
+void PCI_RemoveIDE_Device(void);
 
 RealPt PCI_GetPModeInterface(void);
 
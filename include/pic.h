@@ -81,6 +81,12 @@ bool PIC_RunQueue(void);
 
 //Delay in milliseconds
 void PIC_AddEvent(PIC_EventHandler handler,pic_tickindex_t delay,Bitu val=0);
+
+#if C_EVENT_PROFILE
+/* event profiler: handlers are named after the expression passed at the call site */
+void PIC_Profile_Name(void *handler,const char *name,bool timer);
+# define PIC_AddEvent(handler,...) (PIC_Profile_Name((void*)((uintptr_t)(handler)),#handler,false),PIC_AddEvent(handler,__VA_ARGS__))
+#endif
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val);
 
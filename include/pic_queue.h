@@ -0,0 +1,244 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_PIC_QUEUE_H
+#define DOSBOX_PIC_QUEUE_H
+
+#include <stdint.h>
+
+#include "pic.h"
+
+#define PIC_QUEUESIZE 8192
+
+struct PICEntry {
+    pic_tickindex_t index;
+    Bitu value;
+    PIC_EventHandler pic_event;
+    PICEntry * next;            // free list, or next in the handler chain while queued
+    PICEntry * prev;            // previous in the handler chain while queued
+    PICEntry * vnext;           // next in the handler+value chain while queued
+    PICEntry * vprev;           // previous in the handler+value chain while queued
+    uint32_t seq;               // insertion order, events due at the same time run first come first served
+    unsigned int heap_pos;      // position in the heap while queued
+};
+
+/* PIC event queue: a binary min-heap on (index, seq) over a fixed pool of entries.
+ * Queued entries are also chained by a hash of their handler and by a hash of their
+ * handler and value, so that removing the events of one handler (or one handler and
+ * value) only visits those events, plus the few that happen to share the hash bucket,
+ * instead of the whole queue. */
+class PIC_EventQueue {
+public:
+    enum { HASHSIZE = 256, VHASHSIZE = 1024 };
+
+    PIC_EventQueue() { clear(); }
+
+    /* forget all events, every entry goes back to the free list */
+    void clear(void) {
+        for (unsigned int i=0;i < PIC_QUEUESIZE-1;i++)
+            entries[i].next = &entries[i+1];
+        entries[PIC_QUEUESIZE-1].next = NULL;
+        free_entry = &entries[0];
+        clear_chains();
+        heap_size = 0;
+        seq = 0;
+    }
+
+    /* rebuild the queue from entries linked in the order they are to run, as saved states store it */
+    void restore(const uint16_t *next_idx,uint16_t first) {
+        bool queued[PIC_QUEUESIZE] = { false };
+
+        clear_chains();
+        heap_size = 0;
+        seq = 0;
+        for (uint16_t i=first;i < PIC_QUEUESIZE && !queued[i];i=next_idx[i]) {
+            queued[i] = true;
+            push(&entries[i]);
+        }
+
+        free_entry = NULL;
+        for (unsigned int i=PIC_QUEUESIZE;i-- > 0;) {
+            if (!queued[i]) release(&entries[i]);
+        }
+    }
+
+    /* entry to fill in and push(), NULL if the queue is full */
+    PICEntry *alloc(void) {
+        PICEntry *entry = free_entry;
+        if (entry != NULL) free_entry = entry->next;
+        return entry;
+    }
+
+    /* give back an entry that is not queued */
+    void release(PICEntry *entry) {
+        entry->next = free_entry;
+        free_entry = entry;
+    }
+
+    void push(PICEntry *entry) {
+        PICEntry **head = &chain[hash(entry->pic_event)];
+        entry->prev = NULL;
+        entry->next = *head;
+        if (*head != NULL) (*head)->prev = entry;
+        *head = entry;
+
+        head = &vchain[vhash(entry->pic_event,entry->value)];
+        entry->vprev = NULL;
+        entry->vnext = *head;
+        if (*head != NULL) (*head)->vprev = entry;
+        *head = entry;
+
+        entry->seq = seq++;
+        heap[heap_size] = entry;
+        entry->heap_pos = heap_size;
+        sift_up(heap_size++);
+    }
+
+    /* next event due, NULL if none */
+    PICEntry *top(void) const {
+        return heap_size != 0 ? heap[0] : NULL;
+    }
+
+    /* take the next event due off the queue, the caller release()s it when done */
+    PICEntry *pop(void) {
+        PICEntry *entry = heap[0];
+        erase(entry);
+        return entry;
+    }
+
+    void remove(PIC_EventHandler handler) {
+        PICEntry *entry = chain[hash(handler)];
+        while (entry != NULL) {
+            PICEntry *next = entry->next;
+            if (entry->pic_event == handler) {
+                erase(entry);
+                release(entry);
+            }
+            entry = next;
+        }
+    }
+
+    void remove(PIC_EventHandler handler,Bitu val) {
+        PICEntry *entry = vchain[vhash(handler,val)];
+        while (entry != NULL) {
+            PICEntry *next = entry->vnext;
+            if (entry->pic_event == handler && entry->value == val) {
+                erase(entry);
+                release(entry);
+            }
+            entry = next;
+        }
+    }
+
+    /* move every queued event by the same amount (1.0 per elapsed millisecond tick), which keeps the heap order */
+    void shift(const pic_tickindex_t delta) {
+        for (unsigned int i=0;i < heap_size;i++)
+            heap[i]->index -= delta;
+    }
+
+    unsigned int size(void) const {
+        return heap_size;
+    }
+
+    /* queued entry by heap position, for walking the queue in no particular order */
+    PICEntry *at(unsigned int i) const {
+        return heap[i];
+    }
+
+    PICEntry *first_free(void) const {
+        return free_entry;
+    }
+
+    /* earlier event first, ties in the order they were added */
+    static bool before(const PICEntry *a,const PICEntry *b) {
+        if (a->index != b->index) return a->index < b->index;
+        return (int32_t)(a->seq - b->seq) < 0;
+    }
+
+    PICEntry entries[PIC_QUEUESIZE];
+private:
+    static unsigned int hash(PIC_EventHandler handler) {
+        const uintptr_t p = (uintptr_t)handler;
+        return (unsigned int)((p >> 4u) ^ (p >> 12u)) & (HASHSIZE - 1u);
+    }
+
+    static unsigned int vhash(PIC_EventHandler handler,Bitu val) {
+        const uintptr_t p = (uintptr_t)handler;
+        return (unsigned int)((p >> 4u) ^ (p >> 12u) ^ ((uint32_t)val * 0x9E3779B1u >> 16u)) & (VHASHSIZE - 1u);
+    }
+
+    void clear_chains(void) {
+        for (unsigned int i=0;i < HASHSIZE;i++)
+            chain[i] = NULL;
+        for (unsigned int i=0;i < VHASHSIZE;i++)
+            vchain[i] = NULL;
+    }
+
+    void erase(PICEntry *entry) {
+        if (entry->prev != NULL) entry->prev->next = entry->next;
+        else chain[hash(entry->pic_event)] = entry->next;
+        if (entry->next != NULL) entry->next->prev = entry->prev;
+        if (entry->vprev != NULL) entry->vprev->vnext = entry->vnext;
+        else vchain[vhash(entry->pic_event,entry->value)] = entry->vnext;
+        if (entry->vnext != NULL) entry->vnext->vprev = entry->vprev;
+
+        const unsigned int pos = entry->heap_pos;
+        PICEntry *last = heap[--heap_size];
+        if (pos != heap_size) {
+            heap[pos] = last;
+            last->heap_pos = pos;
+            if (pos != 0 && before(last,heap[(pos-1u)/2u])) sift_up(pos);
+            else sift_down(pos);
+        }
+    }
+
+    void sift_up(unsigned int pos) {
+        PICEntry *entry = heap[pos];
+        while (pos != 0) {
+            const unsigned int parent = (pos-1u)/2u;
+            if (!before(entry,heap[parent])) break;
+            heap[pos] = heap[parent];
+            heap[pos]->heap_pos = pos;
+            pos = parent;
+        }
+        heap[pos] = entry;
+        entry->heap_pos = pos;
+    }
+
+    void sift_down(unsigned int pos) {
+        PICEntry *entry = heap[pos];
+        for (;;) {
+            unsigned int child = pos*2u+1u;
+            if (child >= heap_size) break;
+            if (child+1u < heap_size && before(heap[child+1u],heap[child])) child++;
+            if (!before(heap[child],entry)) break;
+            heap[pos] = heap[child];
+            heap[pos]->heap_pos = pos;
+            pos = child;
+        }
+        heap[pos] = entry;
+        entry->heap_pos = pos;
+    }
+
+    PICEntry * heap[PIC_QUEUESIZE];
+    PICEntry * chain[HASHSIZE];
+    PICEntry * vchain[VHASHSIZE];
+    PICEntry * free_entry;
+    unsigned int heap_size;
+    uint32_t seq;
+};
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 
 #include "bios_disk.h"
 
@@ -55,15 +56,61 @@ public:
 	
 	uint8_t read_sector(uint32_t sectnum, uint8_t* data);
 
+	uint8_t read_sectors(uint32_t sectnum, uint32_t count, uint8_t* data);
+
 	uint8_t write_sector(uint32_t sectnum, const uint8_t* data);
-	
+
+	uint8_t write_sectors(uint32_t sectnum, uint32_t count, const uint8_t* data);
+
+	//Write back cached metadata that has changed.
+	uint8_t flush();
+
+	struct CacheStats {
+		uint64_t l2_hits = 0;
+		uint64_t l2_misses = 0;
+		uint64_t refcount_hits = 0;
+		uint64_t refcount_misses = 0;
+		uint64_t cluster_hits = 0;   /* sectors served from the last data cluster read */
+		uint64_t cluster_reads = 0;  /* whole data clusters read for sequential access */
+		uint64_t writebacks = 0;     /* metadata writes to the file */
+		uint64_t compressed_hits = 0;   /* compressed clusters found already inflated */
+		uint64_t compressed_reads = 0;  /* compressed clusters read and inflated */
+	} stats;
+
 private:
 
+	//What an L2 table entry says about its cluster.
+	enum ClusterType {
+		CLUSTER_UNALLOCATED,         /* read from the backing image, or zeros */
+		CLUSTER_NORMAL,
+		CLUSTER_ZERO,                /* reads as zeros, may have a preallocated cluster (version 3) */
+		CLUSTER_COMPRESSED           /* deflated into part of a cluster shared with others */
+	};
+
+	//L2 tables and refcount blocks are kept in small LRU caches of whole clusters. Changes to
+	//them are written back when the entry is evicted or the image is flushed, one write per
+	//table covering every entry that changed.
+	struct TableCacheEntry {
+		uint64_t offset = 0;         /* file offset of the table, 0 if unused */
+		uint64_t lru = 0;
+		uint64_t dirty_lo = 0;       /* byte range changed since the last write back */
+		uint64_t dirty_hi = 0;
+		std::vector<uint8_t> data;
+	};
+
+	struct TableCache {
+		std::vector<TableCacheEntry> entries;
+		uint64_t tick = 0;
+		bool dirty = false;          /* some entry has changes to write back */
+	};
+
 	FILE* file;
 	QCow2Header header;
 	static const uint64_t copy_flag;
-	static const uint64_t empty_mask;
+	static const uint64_t compressed_flag;
+	static const uint64_t zero_flag;
 	static const uint64_t table_entry_mask;
+	static const uint64_t standard_offset_mask;
 	uint32_t sector_size;
 	uint64_t cluster_mask;
 	uint64_t cluster_size;
@@ -73,7 +120,19 @@ private:
 	uint64_t l1_bits;
 	uint64_t refcount_mask;
 	uint64_t refcount_bits;
+	uint64_t compressed_offset_mask;
+	uint64_t compressed_sectors_shift;
 	QCow2Image* backing_image;
+	bool tables_loaded;
+	std::vector<uint64_t> l1_table;
+	std::vector<uint64_t> refcount_table;
+	TableCache l2_cache;
+	TableCache refcount_cache;
+	TableCache compressed_cache;       /* inflated compressed clusters, by file offset */
+	std::vector<uint8_t> compressed_buffer;
+	std::vector<uint8_t> data_cluster;
+	uint64_t buffered_cluster_offset;  /* file offset of the cluster in data_cluster, 0 if none */
+	uint64_t last_sector;             /* for spotting sequential reads */
 
 	static uint16_t host_read16(uint16_t buffer);
 
@@ -87,24 +146,44 @@ private:
 
 	uint8_t read_allocated_data(uint64_t file_offset, uint8_t* data, uint64_t data_size);
 
+	uint8_t read_allocated_sector(uint32_t sectnum, uint64_t file_offset, uint8_t* data);
+
+	uint8_t load_tables();
+
+	ClusterType cluster_type(uint64_t l2_entry) const;
+
+	uint8_t read_compressed_cluster(uint64_t l2_entry, const uint8_t*& cluster);
+
+	TableCacheEntry* cache_lookup(TableCache& cache, uint64_t table_offset, TableCacheEntry*& victim);
+
+	TableCacheEntry* cache_get(TableCache& cache, uint64_t table_offset, bool is_new);
+
+	uint8_t cache_write_back(TableCacheEntry& entry);
+
+	uint8_t cache_flush(TableCache& cache);
+
+	void cache_set_entry(TableCache& cache, TableCacheEntry& entry, uint64_t byte_offset, const uint8_t* value, uint64_t size);
+
 	uint8_t read_cluster(uint64_t data_cluster_number, uint8_t* data);
 
 	uint8_t read_l1_table(uint64_t address, uint64_t& l2_table_offset);
 
-	uint8_t read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& data_cluster_offset);
+	uint8_t read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& l2_entry);
 
 	uint8_t read_refcount_table(uint64_t data_cluster_offset, uint64_t& refcount_cluster_offset);
 
-	uint8_t read_table(uint64_t entry_offset, uint64_t entry_mask, uint64_t& entry_value);
-
 	uint8_t read_unallocated_cluster(uint64_t data_cluster_number, uint8_t* data);
 
 	uint8_t read_unallocated_sector(uint32_t sectnum, uint8_t* data);
 
 	uint8_t update_reference_count(uint64_t cluster_offset, uint8_t* cluster_buffer);
 
+	static bool is_zero(const uint8_t* data, uint64_t data_size);
+
 	uint8_t write_data(uint64_t file_offset, const uint8_t* data, uint64_t data_size);
 
+	uint8_t write_one_sector(uint32_t sectnum, const uint8_t* data);
+
 	uint8_t write_l1_table_entry(uint64_t address, uint64_t l2_table_offset);
 
 	uint8_t write_l2_table_entry(uint64_t l2_table_offset, uint64_t address, uint64_t data_cluster_offset);
@@ -128,6 +207,10 @@ public:
 
 	virtual uint8_t Write_AbsoluteSector(uint32_t sectnum, const void* data);
 
+	virtual uint8_t Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void* data);
+
+	virtual uint8_t Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void* data);
+
 private:
 
 	QCow2Image qcowImage;
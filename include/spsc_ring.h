@@ -0,0 +1,114 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SPSC_RING_H
+#define DOSBOX_SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Byte ring buffer for exactly one producer thread and one consumer thread, without locks.
+ * The producer only moves the write position and the consumer only the read position, each
+ * published with release and picked up with acquire, so whatever was written before a
+ * position moved is visible to the other side once it sees the new position.
+ *
+ * resize() and the destructor must not run while either side is using the ring. */
+class SPSCRing {
+public:
+    SPSCRing() : buf(NULL), mask(0), wpos(0), rpos(0) { }
+    ~SPSCRing() { delete[] buf; }
+
+    /* capacity in bytes, rounded up to a power of two. empties the ring */
+    void resize(size_t bytes) {
+        size_t sz = 64;
+        while (sz < bytes) sz <<= (size_t)1u;
+        delete[] buf;
+        buf = new uint8_t[sz];
+        mask = sz - (size_t)1u;
+        wpos.store(0,std::memory_order_relaxed);
+        rpos.store(0,std::memory_order_relaxed);
+    }
+
+    size_t capacity(void) const {
+        return buf != NULL ? mask + (size_t)1u : 0;
+    }
+
+    /* producer side: room left */
+    size_t writable(void) const {
+        return capacity() - (wpos.load(std::memory_order_relaxed) - rpos.load(std::memory_order_acquire));
+    }
+
+    /* producer side: append a, then b, all or nothing. false if there is not enough room */
+    bool write(const void *a,size_t alen,const void *b=NULL,size_t blen=0) {
+        const size_t w = wpos.load(std::memory_order_relaxed);
+        if ((alen + blen) > writable()) return false;
+        copy_in(w,a,alen);
+        copy_in(w + alen,b,blen);
+        wpos.store(w + alen + blen,std::memory_order_release);
+        return true;
+    }
+
+    /* consumer side: bytes waiting */
+    size_t readable(void) const {
+        return wpos.load(std::memory_order_acquire) - rpos.load(std::memory_order_relaxed);
+    }
+
+    /* consumer side: take up to len bytes, returns how many */
+    size_t read(void *dst,size_t len) {
+        const size_t r = rpos.load(std::memory_order_relaxed);
+        const size_t avail = readable();
+        if (len > avail) len = avail;
+        copy_out(r,dst,len);
+        rpos.store(r + len,std::memory_order_release);
+        return len;
+    }
+
+    /* consumer side: drop up to len bytes, returns how many */
+    size_t skip(size_t len) {
+        const size_t r = rpos.load(std::memory_order_relaxed);
+        const size_t avail = readable();
+        if (len > avail) len = avail;
+        rpos.store(r + len,std::memory_order_release);
+        return len;
+    }
+private:
+    void copy_in(size_t pos,const void *src,size_t len) {
+        if (len == 0) return;
+        const size_t o = pos & mask;
+        const size_t first = (len < (capacity() - o)) ? len : (capacity() - o);
+        memcpy(buf + o,src,first);
+        memcpy(buf,(const uint8_t*)src + first,len - first);
+    }
+
+    void copy_out(size_t pos,void *dst,size_t len) const {
+        if (len == 0) return;
+        const size_t o = pos & mask;
+        const size_t first = (len < (capacity() - o)) ? len : (capacity() - o);
+        memcpy(dst,buf + o,first);
+        memcpy((uint8_t*)dst + first,buf,len - first);
+    }
+
+    uint8_t*                        buf;
+    size_t                          mask;
+    /* positions count up forever (mod size_t), the offset in buf is pos & mask.
+     * On separate cache lines so the two threads do not keep stealing each other's line */
+    alignas(64) std::atomic<size_t> wpos;
+    alignas(64) std::atomic<size_t> rpos;
+};
+
+#endif
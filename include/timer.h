@@ -38,6 +38,11 @@ typedef void (*TIMER_TickHandler)(void);
 void TIMER_AddTickHandler(TIMER_TickHandler handler);
 void TIMER_DelTickHandler(TIMER_TickHandler handler);
 
+#if C_EVENT_PROFILE
+void PIC_Profile_Name(void *handler,const char *name,bool timer);
+# define TIMER_AddTickHandler(handler) (PIC_Profile_Name((void*)((uintptr_t)(handler)),#handler,true),TIMER_AddTickHandler(handler))
+#endif
+
 /* This will add 1 millisecond to all timers */
 void TIMER_AddTick(void);
 
@@ -728,11 +728,34 @@ void VGA_SetCGA2Table(uint8_t val0,uint8_t val1);
 void VGA_SetCGA4Table(uint8_t val0,uint8_t val1,uint8_t val2,uint8_t val3);
 void VGA_ActivateHardwareCursor(void);
 void VGA_KillDrawing(void);
+void VGA_RenderFrameWait(void);
 
 void VGA_SetOverride(bool vga_override);
 
 extern VGA_Type vga;
 
+// video memory dirty tracking. The memory handlers the CPU writes through stamp each page of
+// video memory with the current frame, so that scanlines whose video memory did not change since
+// the renderer last drew them can skip the line handler and the scaler (see VGA_DrawSingleLine).
+#define VGA_DIRTY_PAGE_SHIFT 10u
+
+typedef struct VGA_Dirty_t {
+	uint32_t*		page_frame = NULL;	// frame of the last write to each page of video memory
+	uint32_t		frame = 1;		// counts vertical retraces
+	uint32_t		state = 1;		// changes when anything besides video memory changes how scanlines look
+	bool			exact = false;		// every CPU write to video memory goes through a handler that stamps pages
+} VGA_Dirty;
+
+extern VGA_Dirty vga_dirty;
+
+static INLINE void VGA_MarkDirty(Bitu memaddr) {
+	vga_dirty.page_frame[memaddr >> VGA_DIRTY_PAGE_SHIFT] = vga_dirty.frame;
+}
+
+static INLINE void VGA_MarkStateChanged(void) {
+	vga_dirty.state++;
+}
+
 /* Support for modular SVGA implementation */
 /* Video mode extra data to be passed to FinishSetMode_SVGA().
    This structure will be in flux until all drivers (including S3)
@@ -46,10 +46,11 @@
 #include "pic.h"
 
 #define CACHE_MAXSIZE	(4096*2)
-#define CACHE_TOTAL		(1024*1024*8)
-#define CACHE_PAGES		(512)
-#define CACHE_BLOCKS	(128*1024)
+#define CACHE_TOTAL		(cache_total)			// set from "dynamic core cache size"
+#define CACHE_PAGES		(cache_total/16384)		// 512 code pages per 8MB of cache
+#define CACHE_BLOCKS	(cache_total/64)		// 128k cache blocks per 8MB of cache
 #define CACHE_ALIGN		(16)
+#define CACHE_SPARE_TRIES	(16)				// recently used blocks skipped at most per new block
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
@@ -201,6 +202,7 @@ CacheBlockDynRec * LinkBlocks(BlockReturnDynRec ret) {
 		// see if the target is an already translated block
 		block=temp_handler->FindCacheBlock(temp_ip & 4095);
 		if (!block) return NULL;
+		block->usage++;
 
 		// found it, link the current block to
 		cache.block.running->LinkTo(ret==BR_Link2,block);
@@ -282,7 +284,8 @@ Bits CPU_Core_Dynrec_Run(void) {
 
 		// find correct Dynamic Block to run
 		CacheBlockDynRec * block=chandler->FindCacheBlock(ip_point&4095);
-		if (!block) {
+		if (block) block->usage++;
+		else {
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
 			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
@@ -428,7 +431,12 @@ void CPU_Core_Dynrec_Init(void) {
 #endif
 }
 
+extern int dynamic_core_cache_size;
+
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
+	// the size can only change before anything has been allocated
+	if (cache_blocks==NULL && cache_code_start_ptr==NULL)
+		cache_total=(Bitu)dynamic_core_cache_size*1024*1024;
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
 }
@@ -440,4 +448,26 @@ void CPU_Core_Dynrec_Cache_Close(void) {
 void CPU_Core_Dynrec_Cache_Reset(void) {
 	cache_reset();
 }
+
+void CPU_Core_Dynrec_LogStats(void) {
+	Bitu used=0,blocks=0;
+	if (cache_initialized) {
+		for (CacheBlockDynRec * block=cache.block.first;block;block=block->cache.next) {
+			if (block->page.handler) {
+				used+=block->cache.size;
+				blocks++;
+			}
+		}
+	}
+	LOG_MSG("Dynrec cache: %lu KB, %lu KB in %lu blocks",
+		(unsigned long)(cache_total/1024),(unsigned long)(used/1024),(unsigned long)blocks);
+	LOG_MSG("  compiled %llu, invalidated %llu, evicted %llu, spared %llu, code pages evicted %llu",
+		(unsigned long long)cache_stats.compiled,(unsigned long long)cache_stats.invalidated,
+		(unsigned long long)cache_stats.evicted,(unsigned long long)cache_stats.spared,
+		(unsigned long long)cache_stats.page_evictions);
+}
+
+void CPU_Core_Dynrec_ResetStats(void) {
+	memset(&cache_stats,0,sizeof(cache_stats));
+}
 #endif
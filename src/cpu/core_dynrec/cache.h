@@ -59,6 +59,7 @@ public:
 		CacheBlockDynRec * from;	// the from-block can transfer control to this block
 	} link[2];	// maximum two links (conditional jumps)
 	CacheBlockDynRec * crossblock;
+	Bitu usage;		// entries through the dispatcher, halved each time cache_openblock passes by
 };
 
 static struct {
@@ -74,6 +75,18 @@ static struct {
 	CodePageHandlerDynRec * last_page;		// the last used page
 } cache;
 
+// counters shown by the debugger (DYNREC)
+static struct {
+	uint64_t compiled;			// blocks translated
+	uint64_t invalidated;		// blocks cleared because their code was written to
+	uint64_t evicted;			// blocks cleared to make room in the cache
+	uint64_t spared;			// recently used blocks skipped over instead of being evicted
+	uint64_t page_evictions;	// code pages released because none were free
+} cache_stats;
+
+// size of the code cache, from "dynamic core cache size"
+static Bitu cache_total=1024*1024*8;
+
 
 // cache memory pointers, to be malloc'd later
 static uint8_t * cache_code_start_ptr=NULL;
@@ -134,6 +147,7 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();		// clear the block, decrements the write_map accordingly
+					cache_stats.invalidated++;
 				}
 				block=nextblock;
 			}
@@ -492,13 +506,44 @@ void CacheBlockDynRec::Clear(void) {
 
 static INLINE void *cache_rwtox(void *x);
 
+// the block the cache continues with after this one, wrapping around at the end
+static CacheBlockDynRec * cache_nextblock(CacheBlockDynRec * block) {
+	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE)))
+		return cache.block.first;
+	return block->cache.next;
+}
+
 static CacheBlockDynRec * cache_openblock(void) {
 	CacheBlockDynRec * block=cache.block.active;
+	// The cache is filled round robin. Instead of overwriting code that has been
+	// entered since the last round, skip past it and halve its usage count, so
+	// blocks that keep running survive several rounds (second chance). Give up
+	// after a few tries if most of the cache is in use.
+	for (Bitu tries=0;tries<CACHE_SPARE_TRIES;tries++) {
+		CacheBlockDynRec * hot=NULL;
+		Bitu runsize=0;
+		for (CacheBlockDynRec * run=block;run && runsize<CACHE_MAXSIZE;run=run->cache.next) {
+			runsize+=run->cache.size;
+			if (run->page.handler && run->usage) hot=run;
+		}
+		if (!hot) break;
+		for (CacheBlockDynRec * run=block;;run=run->cache.next) {
+			run->usage>>=1;
+			if (run==hot) break;
+		}
+		cache_stats.spared++;
+		block=cache_nextblock(hot);
+	}
+	cache.block.active=block;
+	cache_stats.compiled++;
+
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlockDynRec * nextblock=block->cache.next;
-	if (block->page.handler) 
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.evicted++;
+	}
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -506,8 +551,10 @@ static CacheBlockDynRec * cache_openblock(void) {
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlockDynRec * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.evicted++;
+		}
 		// block is free now
 		cache_addunusedblock(nextblock);
 		nextblock=tempblock;
@@ -516,6 +563,7 @@ skipresize:
 	// adjust parameters and open this block
 	block->cache.size=size;
 	block->cache.next=nextblock;
+	block->usage=0;
 	cache.pos=block->cache.start;
 	return block;
 }
@@ -551,12 +599,7 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	cache.block.active=cache_nextblock(block);
 }
 
 
@@ -635,7 +678,7 @@ static void cache_reset(void) {
 		}
 		memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
 		cache.block.free=&cache_blocks[0];
-		for (Bits i=0;i<CACHE_BLOCKS-1;i++) {
+		for (Bitu i=0;i<CACHE_BLOCKS-1;i++) {
 			cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
 			cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
 			cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -679,7 +722,7 @@ static void cache_reset(void) {
 
 static void cache_init(bool enable) {
 	if (enable) {
-		Bits i;
+		Bitu i;
 		// see if cache is already initialized
 		if (cache_initialized) return;
 		cache_initialized = true;
@@ -163,6 +163,7 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandlerDynRec * &cph) {
 	}
 	// find a free CodePage
 	if (!cache.free_pages) {
+		cache_stats.page_evictions++;
 		if (cache.used_pages!=decode.page.code) cache.used_pages->ClearRelease();
 		else {
 			// try another page to avoid clearing our source-crosspage
@@ -3363,6 +3363,7 @@ void CPU_Disable_SkipAutoAdjust(void) {
 extern int32_t ticksDone;
 extern uint32_t ticksScheduled;
 extern int dynamic_core_cache_block_size;
+extern int dynamic_core_cache_size;
 
 void CPU_Reset_AutoAdjust(void) {
 	CPU_IODelayRemoved = 0;
@@ -3617,6 +3618,8 @@ public:
 
 		dynamic_core_cache_block_size = section->Get_int("dynamic core cache block size");
 		if (dynamic_core_cache_block_size < 1 || dynamic_core_cache_block_size > 65536) dynamic_core_cache_block_size = 32;
+		dynamic_core_cache_size = section->Get_int("dynamic core cache size");
+		if (dynamic_core_cache_size < 2 || dynamic_core_cache_size > 64) dynamic_core_cache_size = 8;
 
 		Prop_multival* p = section->Get_multival("cycles");
 		std::string type = p->GetSection()->Get_string("type");
@@ -2302,6 +2302,12 @@ bool ParseCommand(char* str) {
             int irq = atoi(what.c_str());
             DEBUG_PICSignal(irq,true);
         }
+#if C_EVENT_PROFILE
+        else if (command == "PROFILE") { /* call counts and host time of event and tick handlers */
+            void DEBUG_LogPICProfile(void);
+            DEBUG_LogPICProfile();
+        }
+#endif
         else if (command == "") {
             DEBUG_LogPIC();
         }
@@ -3391,6 +3397,50 @@ bool ParseCommand(char* str) {
         return true;
     }
 
+    if (command == "IOSTATS") { // I/O port access statistics
+        command.clear();
+        stream >> command;
+
+        if (command == "ON" || command == "1") {
+            IO_EnableStats(true);
+            DEBUG_ShowMsg("I/O statistics enabled");
+        }
+        else if (command == "OFF" || command == "0") {
+            IO_EnableStats(false);
+            DEBUG_ShowMsg("I/O statistics disabled");
+        }
+        else if (command == "RESET") {
+            IO_ResetStats();
+        }
+        else if (command == "") {
+            DEBUG_BeginPagedContent();
+            IO_LogStats();
+            DEBUG_EndPagedContent();
+        }
+        else
+            return false;
+
+        return true;
+    }
+
+#if (C_DYNREC)
+    if (command == "DYNREC") { // dynamic_rec code cache statistics
+        command.clear();
+        stream >> command;
+
+        if (command == "RESET") {
+            CPU_Core_Dynrec_ResetStats();
+        }
+        else if (command == "") {
+            CPU_Core_Dynrec_LogStats();
+        }
+        else
+            return false;
+
+        return true;
+    }
+#endif
+
     if (command == "INP" || command == "INB") {
         uint16_t port = (uint16_t)GetHexValue(found,found);
         uint8_t r = IO_ReadB(port);
@@ -3614,6 +3664,10 @@ bool ParseCommand(char* str) {
 
 		DEBUG_ShowMsg("IN[P|W|D] [port]          - I/O port read byte/word/dword.\n");
 		DEBUG_ShowMsg("OUT[P|W|D] [port] [data]  - I/O port write byte/word/dword.\n");
+		DEBUG_ShowMsg("IOSTATS [ON|OFF|RESET]    - Show or control I/O port access statistics.\n");
+#if (C_DYNREC)
+		DEBUG_ShowMsg("DYNREC [RESET]            - Show or reset dynamic_rec code cache statistics.\n");
+#endif
 
 		DEBUG_ShowMsg("HELP                      - Help\n");
 		DEBUG_ShowMsg("Keys------------------------------------------------\n");
@@ -28,7 +28,12 @@
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 #if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#define CHD_DECODER_THREADS
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <thread>
 #endif
 
@@ -90,6 +95,10 @@ inline constexpr T1 ceil_udivide(const T1 x, const T2 y) noexcept {
 
 extern int CDROM_GetMountType(const char* path, int forceCD);
 
+/* settings from [dos], used by CHD images opened after they change */
+extern int chd_readahead_hunks;
+extern int chd_decoder_threads;
+
 //! \brief Base CD-ROM interface class
 //!
 //! \brief This provides the base C++ class for a CD-ROM interface in CD-ROM emulation
@@ -306,19 +315,53 @@ private:
         void setAudioPosition(uint32_t pos) { audio_pos = pos; }
         chd_file*       getChd() { return this->chd; }
     private:
+        enum { HUNK_EMPTY=0, HUNK_LOADING, HUNK_VALID };
+
+        struct hunk_t {
+            uint32_t    index = 0;
+            uint64_t    lru = 0;
+            uint8_t*    data = nullptr;
+            uint8_t     state = HUNK_EMPTY;
+        };
+
+        int             claim_hunk(uint32_t index);
+        void            schedule_readahead(uint32_t index);
+#ifdef CHD_DECODER_THREADS
+        void            cancel_readahead(void);
+        void            worker_run(chd_file* own);
+#endif
+
               chd_file*   chd               = nullptr;
         const chd_header* header            = nullptr; // chd header
-                /*
-                    TODO: cache more than one hunk
-                    or wait for https://github.com/rtissera/libchdr/issues/36
-                */
-              uint8_t*     hunk_buffer       = nullptr; // buffer to hold one hunk // size of hunks in CHD up to 1 MiB
-              uint8_t*     hunk_buffer_next  = nullptr; // index + 1 prefetch
-              int          hunk_buffer_index = -1;      // hunk index for buffer
-#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-              std::thread* hunk_thread       = nullptr; // used for prefetch
-              bool         hunk_thread_error = true;
+              uint32_t     readahead_hunks   = 0;       // hunks decoded ahead of the reader
+
+        /* decoded hunks, the one being read and those around it; size of hunks in CHD up to 1 MiB */
+              std::vector<hunk_t>                   hunks;
+              std::vector<uint8_t>                  hunk_mem;
+              std::unordered_map<uint32_t,int>      hunk_index; // hunk -> entry in hunks
+              uint64_t                              tick = 0;
+              uint32_t                              last_hunk = UINT32_MAX; // hunk of the previous read, for the stats
+#ifdef CHD_DECODER_THREADS
+        /* each worker decodes with its own chd_file, libchdr keeps decoder state per file */
+              std::vector<std::thread>              workers;
+              std::vector<chd_file*>                worker_chds;
+              std::mutex                            read_lock;  // one reader at a time, guards chd
+              std::mutex                            lock;       // guards the hunks and the queue
+              std::condition_variable               loaded;     // a hunk left HUNK_LOADING
+              std::condition_variable               wake;       // work for the workers
+              std::deque<uint32_t>                  queue;      // hunks waiting for a worker
+              bool                                  quit = false;
 #endif
+    public:
+        /* counted once per hunk the reader moves to, not per sector read from it */
+        struct stats_t {
+            uint64_t hits = 0;          // hunks already decoded when read
+            uint64_t waits = 0;         // hunks still being decoded ahead when read
+            uint64_t misses = 0;        // hunks decoded on the spot
+            uint64_t readahead = 0;     // hunks decoded ahead
+            uint64_t decode_us = 0;     // time spent decoding all of them
+        } stats;
+
     public:
               bool         skip_sync         = false;   // this will fail if a CHD contains 2048 and 2352 sector tracks
      };
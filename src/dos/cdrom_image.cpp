@@ -17,6 +17,7 @@
  */
 
 #include "cdrom.h"
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <chrono>
@@ -301,44 +302,156 @@ int64_t CDROM_Interface_Image::AudioFile::getLength()
 	return length;
 }
 
+int chd_readahead_hunks = 8;
+int chd_decoder_threads = 2;
+
+/* CHD hunks are decoded into a small LRU cache. Once a hunk is read, the next readahead_hunks
+ * hunks are handed to a pool of worker threads so that sequential reads, like FMV streaming off
+ * the disc, find them already decoded. A hunk the reader needs right now is decoded on the spot
+ * with the image's own chd_file, unless a worker is already busy with it. */
 CDROM_Interface_Image::CHDFile::CHDFile(const char* filename, bool& error)
     :TrackFile(RAW_SECTOR_SIZE) // CDAudioCallBack needs 2352
 {
     error = chd_open(filename, CHD_OPEN_READ, NULL, &this->chd) != CHDERR_NONE;
-    if (!error) {
-        this->header           = chd_get_header(this->chd);
-        this->hunk_buffer      = new uint8_t[this->header->hunkbytes];
-        this->hunk_buffer_next = new uint8_t[this->header->hunkbytes];
+    if (error) return;
+
+    this->header = chd_get_header(this->chd);
+
+#ifdef CHD_DECODER_THREADS
+    for (int i = 0; i < chd_decoder_threads; i++) {
+        chd_file* own = nullptr;
+        if (chd_open(filename, CHD_OPEN_READ, NULL, &own) != CHDERR_NONE) break;
+        this->worker_chds.push_back(own);
     }
+    if (!this->worker_chds.empty() && chd_readahead_hunks > 0)
+        this->readahead_hunks = (uint32_t)chd_readahead_hunks;
+#endif
+
+    // room for the read ahead window, plus what was read last so that interleaved data and audio reads do not thrash
+    const size_t count = (size_t)this->readahead_hunks * 2u + 2u;
+    this->hunks.resize(count);
+    this->hunk_mem.resize(count * this->header->hunkbytes);
+    for (size_t i = 0; i < count; i++)
+        this->hunks[i].data = &this->hunk_mem[i * this->header->hunkbytes];
+
+#ifdef CHD_DECODER_THREADS
+    if (this->readahead_hunks != 0) {
+        for (size_t i = 0; i < this->worker_chds.size(); i++)
+            this->workers.emplace_back(&CHDFile::worker_run, this, this->worker_chds[i]);
+    }
+#endif
 }
 
 CDROM_Interface_Image::CHDFile::~CHDFile()
 {
+#ifdef CHD_DECODER_THREADS
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->quit = true;
+    }
+    this->wake.notify_all();
+    for (size_t i = 0; i < this->workers.size(); i++)
+        this->workers[i].join();
+    this->workers.clear();
+    for (size_t i = 0; i < this->worker_chds.size(); i++)
+        chd_close(this->worker_chds[i]);
+    this->worker_chds.clear();
+#endif
+
+    const uint64_t reads = this->stats.hits + this->stats.waits + this->stats.misses;
+    if (reads != 0) {
+        const uint64_t decoded = this->stats.misses + this->stats.readahead;
+        LOG_MSG("CHD: %.1f%% of %llu hunks decoded ahead (%llu had to be waited for), %llu decoded on demand, %.2f ms per hunk",
+            100.0 * (double)(this->stats.hits + this->stats.waits) / (double)reads, (unsigned long long)reads,
+            (unsigned long long)this->stats.waits, (unsigned long long)this->stats.misses,
+            decoded ? (double)this->stats.decode_us / 1000.0 / (double)decoded : 0.0);
+    }
+
     // Guard: only cleanup if needed
     if (this->chd) {
         chd_close(this->chd);
         this->chd = nullptr;
     }
+}
 
-    if (this->hunk_buffer) {
-        delete[] this->hunk_buffer;
-        this->hunk_buffer = nullptr;
+// find room for a hunk: an empty entry, else the least recently used decoded one
+int CDROM_Interface_Image::CHDFile::claim_hunk(uint32_t index)
+{
+    int best = -1;
+    for (size_t i = 0; i < this->hunks.size(); i++) {
+        const hunk_t& h = this->hunks[i];
+        if (h.state == HUNK_EMPTY) { best = (int)i; break; }
+        if (h.state == HUNK_VALID && (best < 0 || h.lru < this->hunks[best].lru)) best = (int)i;
     }
+    if (best < 0) return -1;
+
+    hunk_t& h = this->hunks[best];
+    if (h.state != HUNK_EMPTY) this->hunk_index.erase(h.index);
+    h.index = index;
+    h.lru = ++this->tick;
+    h.state = HUNK_LOADING;
+    this->hunk_index[index] = best;
+    return best;
+}
 
-#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-    if (this->hunk_thread) {
-        this->hunk_thread->join();
-        delete hunk_thread;
-        this->hunk_thread = nullptr;
+void CDROM_Interface_Image::CHDFile::schedule_readahead(uint32_t index)
+{
+#ifdef CHD_DECODER_THREADS
+    bool queued = false;
+    for (uint32_t i = 1; i <= this->readahead_hunks; i++) {
+        const uint32_t next = index + i;
+        if (next >= this->header->totalhunks) break;
+        if (this->hunk_index.find(next) != this->hunk_index.end()) continue;
+        if (claim_hunk(next) < 0) break;
+        this->queue.push_back(next);
+        queued = true;
     }
+    if (queued) this->wake.notify_all();
+#else
+    (void)index;
 #endif
 }
 
-#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-void hunk_thread_func(chd_file* chd, int hunk_index, uint8_t* buffer, bool* error)
+#ifdef CHD_DECODER_THREADS
+// the reader moved elsewhere, hunks nobody started on are not needed anymore
+void CDROM_Interface_Image::CHDFile::cancel_readahead(void)
 {
-    // loads one hunk into buffer
-    *error = chd_read(chd, hunk_index, buffer) != CHDERR_NONE;
+    for (size_t i = 0; i < this->queue.size(); i++) {
+        std::unordered_map<uint32_t,int>::iterator it = this->hunk_index.find(this->queue[i]);
+        this->hunks[it->second].state = HUNK_EMPTY;
+        this->hunk_index.erase(it);
+    }
+    this->queue.clear();
+}
+
+void CDROM_Interface_Image::CHDFile::worker_run(chd_file* own)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    for (;;) {
+        while (!this->quit && this->queue.empty()) this->wake.wait(guard);
+        if (this->quit) break;
+
+        const uint32_t index = this->queue.front();
+        this->queue.pop_front();
+        hunk_t& h = this->hunks[this->hunk_index[index]];
+        guard.unlock();
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool ok = chd_read(own, index, h.data) == CHDERR_NONE;
+        const uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        guard.lock();
+        this->stats.decode_us += us;
+        if (ok) {
+            this->stats.readahead++;
+            h.state = HUNK_VALID;
+        } else {
+            // the reader tries again itself and gets to see the error
+            this->hunk_index.erase(index);
+            h.state = HUNK_EMPTY;
+        }
+        this->loaded.notify_all();
+    }
 }
 #endif
 
@@ -352,53 +465,77 @@ bool CDROM_Interface_Image::CHDFile::read(uint8_t* buffer,int64_t offset, int co
     uint64_t needed_hunk = (uint64_t)offset / (uint64_t)this->header->hunkbytes;
 
     // EOF
-    if (needed_hunk > this->header->totalhunks) {
+    if (needed_hunk >= this->header->totalhunks) {
         return false;
     }
 
-    // read new hunk if needed
-    if ((int)needed_hunk != this->hunk_buffer_index) {
-#if defined(HX_DOS) || defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR)
-        if (chd_read(this->chd, needed_hunk, this->hunk_buffer) != CHDERR_NONE)
-            return false;
-#else
-        // make sure our thread is done
-        if (this->hunk_thread) this->hunk_thread->join();
-
-        // can we use our prefetched hunk
-        if (((int)needed_hunk == (this->hunk_buffer_index + 1)) && (!this->hunk_thread_error)) {
-            // swap pointers and we're good :)
-            std::swap(this->hunk_buffer, this->hunk_buffer_next);
+    const uint32_t index = (uint32_t)needed_hunk;
+#ifdef CHD_DECODER_THREADS
+    std::lock_guard<std::mutex> reader(this->read_lock);
+    std::unique_lock<std::mutex> guard(this->lock);
+#endif
 
-        } else {
-            // read new hunk
-            bool error = true;
-            hunk_thread_func(this->chd, (int)needed_hunk, this->hunk_buffer, &error);
-            if (error) {
-                return false;
-            }
+    int slot = -1;
+    bool waited = false;
+    for (;;) {
+        std::unordered_map<uint32_t,int>::iterator it = this->hunk_index.find(index);
+        if (it == this->hunk_index.end()) break;
+        if (this->hunks[it->second].state == HUNK_VALID) { slot = it->second; break; }
+#ifdef CHD_DECODER_THREADS
+        // still queued: nobody is working on it yet, so decode it here instead of waiting
+        std::deque<uint32_t>::iterator q = std::find(this->queue.begin(), this->queue.end(), index);
+        if (q != this->queue.end()) {
+            this->queue.erase(q);
+            this->hunks[it->second].state = HUNK_EMPTY;
+            this->hunk_index.erase(it);
+            break;
         }
+        waited = true;
+        this->loaded.wait(guard);
 #endif
+    }
 
-        this->hunk_buffer_index = (int)needed_hunk;
-
-#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-        // prefetch: let our thread decode the next hunk
-        if (hunk_thread) delete this->hunk_thread;
-        this->hunk_thread = new std::thread(
-            [this, needed_hunk]() {
-                hunk_thread_func(this->chd, (int)(needed_hunk + 1), this->hunk_buffer_next, &this->hunk_thread_error);
-            }
-        );
+    if (slot >= 0) {
+        if (index != this->last_hunk) {
+            if (waited) this->stats.waits++;
+            else this->stats.hits++;
+        }
+    } else {
+#ifdef CHD_DECODER_THREADS
+        // a seek, what was queued for the old position is of no use
+        cancel_readahead();
+#endif
+        slot = claim_hunk(index);
+        if (slot < 0) return false;
+        hunk_t& h = this->hunks[slot];
+#ifdef CHD_DECODER_THREADS
+        guard.unlock();
+#endif
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool ok = chd_read(this->chd, index, h.data) == CHDERR_NONE;
+        const uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+#ifdef CHD_DECODER_THREADS
+        guard.lock();
 #endif
+        this->stats.decode_us += us;
+        this->stats.misses++;
+        if (!ok) {
+            this->hunk_index.erase(index);
+            h.state = HUNK_EMPTY;
+            return false;
+        }
+        h.state = HUNK_VALID;
     }
+    this->hunks[slot].lru = ++this->tick;
+    this->last_hunk = index;
 
     // copy data
     // the overlying read code thinks there is a sync header
     // so for 2048 sector size images we need to subtract 16 from the offset to account for the missing sync header
-    uint8_t* source = this->hunk_buffer + ((uint64_t)offset - (uint64_t)needed_hunk * this->header->hunkbytes) - ((uint64_t)16 * this->skip_sync);
+    uint8_t* source = this->hunks[slot].data + ((uint64_t)offset - (uint64_t)needed_hunk * this->header->hunkbytes) - ((uint64_t)16 * this->skip_sync);
     memcpy(buffer, source, min(count, RAW_SECTOR_SIZE));
 
+    schedule_readahead(index);
     return true;
 }
 
@@ -31,6 +31,7 @@
 #include "dosbox.h"
 #include "dos_inc.h"
 #include "bios_disk.h"
+#include "bios_disk_io.h"
 #include "bios.h"
 #include "logging.h"
 #include "mem.h"
@@ -3215,6 +3216,7 @@ static uint16_t DOS_SectorAccess(bool read) {
 
 	while (sectorCnt--) {
 		if (sectorNum >= sectorEnd) return 0x0408; // sector not found
+		drive->syncFATCache(sectorNum,!read);
 		if (read) {
 			if (drive->readSector(sectorNum++,&sectorBuf)) return 0x0408;
 			for (i=0;i<512;i++) real_writeb(bufferSeg,bufferOff++,sectorBuf[i]);
@@ -4038,6 +4040,16 @@ public:
         if(::floppy_data_rate < 0) {
             ::floppy_data_rate = 22400; // 175 kbps
         }
+
+        std::string diskio = section->Get_string("hard drive image io");
+        if (diskio == "stdio") ::disk_image_io_backend = imageDiskIO::BACKEND_STDIO;
+        else if (diskio == "pread") ::disk_image_io_backend = imageDiskIO::BACKEND_PREAD;
+        else if (diskio == "mmap") ::disk_image_io_backend = imageDiskIO::BACKEND_MMAP;
+        else ::disk_image_io_backend = imageDiskIO::BACKEND_AUTO;
+        ::disk_image_cache_kb = section->Get_int("hard drive image cache size");
+        ::disk_image_readahead_kb = section->Get_int("hard drive image read ahead");
+        ::chd_readahead_hunks = section->Get_int("chd image read ahead");
+        ::chd_decoder_threads = section->Get_int("chd image decoder threads");
         std::string prefix = section->Get_string("special operation file prefix");
         if (prefix.size()) prefix_local = prefix + prefix_local.substr(3), prefix_overlay = prefix + prefix_overlay.substr(3);
 
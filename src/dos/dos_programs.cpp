@@ -2199,7 +2199,7 @@ public:
                         newDiskSwap[i] = new imageDiskNFD(usefile, fname, floppysize, false, 1);
                     }
                     else {
-                        newDiskSwap[i] = new imageDisk(usefile, fname, floppysize, false);
+                        newDiskSwap[i] = new imageDiskRaw(usefile, fname, floppysize, false);
                     }
                     newDiskSwap[i]->Addref();
                     if (newDiskSwap[i]->active && !newDiskSwap[i]->hardDrive) incrementFDD(); //moved from imageDisk constructor
@@ -6579,7 +6579,7 @@ class IMGMOUNT : public Program {
 					sectors = (uint64_t)ftello64(newDisk) / (uint64_t)sizes[0];
 					imagesize = (uint32_t)(sectors / 2); /* orig. code wants it in KBs */
 					setbuf(newDisk, NULL);
-					newImage = new imageDisk(newDisk, fname, imagesize, (imagesize > 2880) || assumeHardDisk);
+					newImage = new imageDiskRaw(newDisk, fname, imagesize, (imagesize > 2880) || assumeHardDisk);
 				}
 			}
 
@@ -24,6 +24,7 @@
 #include "cross.h"
 
 // STL stuff
+#include <string>
 #include <vector>
 #include <iterator>
 #include <algorithm>
@@ -39,10 +40,22 @@
 #include <os2.h>
 #endif
 
+#if defined (LINUX)
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 int fileInfoCounter = 0;
 extern bool gbk;
 char * DBCS_upcase(char * str);
 bool isDBCSCP(), shiftjis_lead_byte(int c), isKanji1_gbk(uint8_t chr), filename_not_8x3(const char *n), filename_not_strict_8x3(const char *n);
+#if defined (LINUX)
+extern bool hidenonrep;
+extern std::string prefix_local;
+host_cnv_char_t *CodePageGuestToHost(const char *s);
+char *CodePageHostToGuest(const host_cnv_char_t *s), *CodePageHostToGuestL(const host_cnv_char_t *s);
+#endif
 
 bool SortByName(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFileInfo* const &b) {
     return strcmp(a->shortname,b->shortname)<0;
@@ -92,6 +105,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
     Clear();
     for (uint32_t i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=0; }
+    WatchHost(false);
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -356,6 +370,10 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
     }
 
 //  LOG_DEBUG("DIR: Caching out %s : dir %s",expand,dir->orgname);
+    CacheOutDir(dir);
+}
+
+void DOS_Drive_Cache::CacheOutDir(CFileInfo* dir) {
 //  clear cache first?
     for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
         dirSearch[i] = 0; //free[i] = true;    
@@ -369,6 +387,7 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
     // clear lists
     dir->fileList.clear();
     dir->longNameList.clear();
+    dir->ClearIndex();
     save_dir = 0;
 }
 
@@ -376,6 +395,113 @@ bool DOS_Drive_Cache::IsCachedIn(CFileInfo* curDir) {
     return (curDir->isOverlayDir || curDir->fileList.size()>0);
 }
 
+/* Host changes (Linux only)
+ * Each directory read from the host gets an inotify watch, put on before it is read so that
+ * nothing slips in between. CheckHostChanges, called before the drive looks something up,
+ * applies what happened since: a new host file or directory is added to its cached directory
+ * the same way AddEntry does, and when one goes away its directory is cached out like
+ * DeleteEntry does, to be read again when it is next used. Directories that are not cached
+ * in, or no longer, are left alone. If the kernel's queue overflowed the whole cache is
+ * emptied. */
+void DOS_Drive_Cache::WatchHost(bool enable) {
+#if defined (LINUX)
+    if (enable) {
+        if (watchFd < 0) watchFd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (watchFd < 0) LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: Cannot watch the host for changes: %s",strerror(errno));
+        return;
+    }
+    for (std::unordered_map<int,CFileInfo*>::iterator it=watchDirs.begin(); it!=watchDirs.end(); ++it)
+        it->second->hostWatch = -1;
+    watchDirs.clear();
+    if (watchFd >= 0) close(watchFd);
+    watchFd = -1;
+#else
+    (void)enable;
+#endif
+}
+
+void DOS_Drive_Cache::Watch(CFileInfo* dir, const char* path) {
+#if defined (LINUX)
+    if (watchFd < 0 || dir->hostWatch >= 0) return;
+    const host_cnv_char_t* host_name = CodePageGuestToHost(path);
+    if (host_name == NULL) return;
+    int wd = inotify_add_watch(watchFd,host_name,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR);
+    if (wd < 0) {
+        LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: Cannot watch %s for changes: %s",path,strerror(errno));
+        return;
+    }
+    // a directory reached by two paths shares one watch, the last to read it gets the events
+    CFileInfo* &owner = watchDirs[wd];
+    if (owner) owner->hostWatch = -1;
+    owner = dir;
+    dir->hostWatch = wd;
+#else
+    (void)dir; (void)path;
+#endif
+}
+
+void DOS_Drive_Cache::Unwatch(CFileInfo* dir) {
+#if defined (LINUX)
+    if (dir->hostWatch < 0) return;
+    inotify_rm_watch(watchFd,dir->hostWatch);
+    watchDirs.erase(dir->hostWatch);
+    dir->hostWatch = -1;
+#else
+    (void)dir;
+#endif
+}
+
+void DOS_Drive_Cache::CheckHostChanges(void) {
+#if defined (LINUX)
+    if (watchFd < 0) return;
+
+    alignas(struct inotify_event) char buf[4096];
+    bool overflow = false;
+    ssize_t len;
+    while ((len = read(watchFd,buf,sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + len;) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) overflow = true;
+            if (overflow) continue;
+
+            std::unordered_map<int,CFileInfo*>::iterator it = watchDirs.find(ev->wd);
+            if (it == watchDirs.end()) continue;
+            CFileInfo* dir = it->second;
+            if (ev->mask & IN_IGNORED) {
+                // the directory is gone from the host, its parent hears about it
+                dir->hostWatch = -1;
+                watchDirs.erase(it);
+                continue;
+            }
+            if (!ev->len || !IsCachedIn(dir)) continue;
+
+            // the same names read_directory_first/next would have given
+            if (hidenonrep && CodePageHostToGuest(ev->name) == NULL) continue;
+            if (strlen(ev->name) > prefix_local.size()+5 && strncmp(ev->name,prefix_local.c_str(),prefix_local.size()) == 0) continue;
+            const char* name = CodePageHostToGuestL(ev->name);
+            if (name == NULL) continue;
+
+            if (ev->mask & (IN_DELETE|IN_MOVED_FROM)) {
+                if (FindOrgName(dir,name)) CacheOutDir(dir);
+            } else if (!FindOrgName(dir,name)) {
+                CreateEntry(dir,name,"",(ev->mask & IN_ISDIR) != 0);
+                Bits index = GetEntryIndex(dir,FindOrgName(dir,name));
+                // Check if there are any open search dir that are affected by this...
+                if (index >= 0) for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
+                    if ((dirSearch[i]==dir) && ((uint32_t)index<=dirSearch[i]->nextEntry))
+                        dirSearch[i]->nextEntry++;
+                }
+            }
+        }
+    }
+    if (overflow) {
+        LOG(LOG_DOSMISC,LOG_NORMAL)("DIRCACHE: Too many changes on the host, emptying the cache");
+        EmptyCache();
+    }
+#endif
+}
+
 
 bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
     // Get Dir Info
@@ -385,21 +511,10 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
     const char* pos = strrchr_dbcs((char *)fullname,CROSS_FILESPLIT);
     if (pos) pos++; else return false;
 
-    std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-    if (GCC_UNLIKELY(filelist_size<=0)) return false;
-
-    // The orgname part of the list is not sorted (shortname is)! So we can only walk through it.
-    for(Bitu i = 0; i < filelist_size; i++) {
-#if defined (WIN32) || defined (OS2)                        /* Win 32 & OS/2*/
-        if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#else
-        if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#endif
-            strcpy(shortname,curDir->longNameList[i]->shortname);
-            return true;
-        }
-    }
-    return false;
+    CFileInfo::NameIndex::const_iterator it = curDir->longIndex.find(pos);
+    if (it == curDir->longIndex.end()) return false;
+    strcpy(shortname,it->second->shortname);
+    return true;
 }
 
 int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
@@ -474,8 +589,8 @@ bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
 #define WINE_DRIVE_SUPPORT 1
 #if WINE_DRIVE_SUPPORT
 //Changes to interact with WINE by supporting their namemangling.
-//The code is rather slow, because orglist is unordered, so it needs to be avoided if possible.
-//Hence the tests in GetLongFileName
+//The names are hashed into wineIndex the first time a directory is searched for one,
+//and only names that look like ABCD~### are looked up there (see FindEntry).
 
 
 // From the Wine project
@@ -525,55 +640,92 @@ static Bits wine_hash_short_file_name( char* name, char* buffer )
 }
 #endif
 
-Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
-    std::vector<CFileInfo*>::size_type filelist_size = curDir->fileList.size();
-    if (GCC_UNLIKELY(filelist_size<=0)) return -1;
+static std::string CaseKey(const char* name) {
+    // upper case, the same way strcasecmp() folds names
+    std::string key(name);
+    for (std::string::iterator it = key.begin(); it != key.end(); ++it)
+        *it = (char)toupper((unsigned char)*it);
+    return key;
+}
+
+static void AddToIndex(DOS_Drive_Cache::CFileInfo::NameIndex &index, const std::string &key, DOS_Drive_Cache::CFileInfo* info) {
+    // keep the entry that comes first in fileList, as the linear searches used to find
+    std::pair<DOS_Drive_Cache::CFileInfo::NameIndex::iterator,bool> res = index.emplace(key,info);
+    if (!res.second && strcmp(info->shortname,res.first->second->shortname) < 0) res.first->second = info;
+}
+
+#ifdef WINE_DRIVE_SUPPORT
+static void AddToWineIndex(DOS_Drive_Cache::CFileInfo* curDir, DOS_Drive_Cache::CFileInfo* info) {
+    char buff[CROSS_LEN];
+    Bits len = wine_hash_short_file_name(info->orgname,buff);
+    AddToIndex(curDir->wineIndex,std::string(buff,(size_t)len),info);
+}
+#endif
+
+void DOS_Drive_Cache::IndexEntry(CFileInfo* curDir, CFileInfo* info) {
+    AddToIndex(curDir->shortIndex,info->shortname,info);
+    AddToIndex(curDir->caseIndex,CaseKey(info->orgname),info);
+    if (info->shortNr) AddToIndex(curDir->longIndex,info->orgname,info);
+#ifdef WINE_DRIVE_SUPPORT
+    if (curDir->wineIndexed) AddToWineIndex(curDir,info);
+#endif
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindEntry(CFileInfo* curDir, char* shortName) {
+    if (GCC_UNLIKELY(curDir->fileList.empty())) return NULL;
 
     // Remove dot, if no extension...
     RemoveTrailingDot(shortName);
-    // Search long name and return array number of element
-    Bits res;
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			strcpy(shortName,curDir->fileList[mid]->orgname);
-			return mid;
-		};
-	}
-	if (uselfn && strlen(shortName)) {
-		for (Bitu i=0; i<filelist_size; i++) {
-			if (!strcasecmp(shortName,curDir->fileList[i]->orgname)) {
-				strcpy(shortName,curDir->fileList[i]->orgname);
-				return (Bits)i;
-		    }
-		}
-	}
+    CFileInfo* info = NULL;
+    CFileInfo::NameIndex::const_iterator it = curDir->shortIndex.find(shortName);
+    if (it != curDir->shortIndex.end()) {
+        info = it->second;
+    } else if (uselfn && strlen(shortName)) {
+        it = curDir->caseIndex.find(CaseKey(shortName));
+        if (it != curDir->caseIndex.end()) info = it->second;
+    }
 
 #ifdef WINE_DRIVE_SUPPORT
-    if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
-    // else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
-    // The above test is rather strict as the following loop can be really slow if filelist_size is large.
-    char buff[CROSS_LEN];
-    for (Bitu i = 0; i < filelist_size; i++) {
-        res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
-        buff[res] = 0;
-        if (!strcmp(shortName,buff)) {  
-            // Found
-            strcpy(shortName,curDir->fileList[i]->orgname);
-            return (Bits)i;
+    // most likely a Wine style short name ABCD~###, # = not dot  (length at least 8)
+    if (!info && strlen(shortName) >= 8 && shortName[4] == '~' && shortName[5] != '.' && shortName[6] != '.' && shortName[7] != '.') {
+        if (!curDir->wineIndexed) {
+            curDir->wineIndexed = true;
+            for (Bitu i = 0; i < curDir->fileList.size(); i++) AddToWineIndex(curDir,curDir->fileList[i]);
         }
+        it = curDir->wineIndex.find(shortName);
+        if (it != curDir->wineIndex.end()) info = it->second;
     }
 #endif
-    // not available
+    if (info) strcpy(shortName,info->orgname);
+    return info;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindOrgName(CFileInfo* curDir, const char* name) {
+    // exactly this long name, caseIndex only holds one of the names that differ in case
+    CFileInfo::NameIndex::const_iterator it = curDir->caseIndex.find(CaseKey(name));
+    if (it == curDir->caseIndex.end()) return NULL;
+    if (!strcmp(it->second->orgname,name)) return it->second;
+    for (Bitu i = 0; i < curDir->fileList.size(); i++) {
+        if (!strcmp(curDir->fileList[i]->orgname,name)) return curDir->fileList[i];
+    }
+    return NULL;
+}
+
+Bits DOS_Drive_Cache::GetEntryIndex(CFileInfo* curDir, CFileInfo* info) {
+    // fileList is sorted by shortname, entries that share one are in the order they were added
+    std::vector<CFileInfo*>::iterator it = std::lower_bound(curDir->fileList.begin(),curDir->fileList.end(),info,SortByName);
+    for (; it != curDir->fileList.end(); ++it) {
+        if (*it == info) return (Bits)(it - curDir->fileList.begin());
+    }
     return -1;
 }
 
+Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
+    // Search long name and return array number of element
+    CFileInfo* info = FindEntry(curDir,shortName);
+    return info ? GetEntryIndex(curDir,info) : -1;
+}
+
 bool DOS_Drive_Cache::RemoveSpaces(char* str) {
 // Removes all spaces
     char*   curpos  = str;
@@ -634,7 +786,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
     if (!createShort) {
         char buffer[CROSS_LEN];
         strcpy(buffer,tmpName);
-        createShort = (GetLongName(curDir,buffer)>=0);
+        createShort = (FindEntry(curDir,buffer)!=NULL);
     }
 
     if (createShort) {
@@ -671,28 +823,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
         }
 
         // keep list sorted for CreateShortNameID to work correctly
-        if (curDir->longNameList.size()>0) {
-            if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-                // append at end of list
-                curDir->longNameList.push_back(info);
-            } else {
-                // look for position where to insert this element
-                bool found=false;
-                std::vector<CFileInfo*>::iterator it;
-                for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-                    if (strcmp(info->shortname,(*it)->shortname)<0) {
-                        found = true;
-                        break;
-                    }
-                }
-                // Put it in longname list...
-                if (found) curDir->longNameList.insert(it,info);
-                else curDir->longNameList.push_back(info);
-            }
-        } else {
-            // empty file list, append
-            curDir->longNameList.push_back(info);
-        }
+        curDir->longNameList.insert(std::upper_bound(curDir->longNameList.begin(),curDir->longNameList.end(),info,SortByName),info);
     } else {
         strcpy(info->shortname,tmpName);
     }
@@ -743,7 +874,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
         else     { strcpy(dir,start); }
  
         // Path found
-        Bits nextDir = GetLongName(curDir,dir);
+        CFileInfo* nextDir = FindEntry(curDir,dir);
         strcat(expandedPath,dir);
 
         // Error check
@@ -752,8 +883,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
         };
 */
         // Follow Directory
-        if ((nextDir>=0) && curDir->fileList[(size_t)nextDir]->isDir) {
-            curDir = curDir->fileList[(size_t)nextDir];
+        if (nextDir && nextDir->isDir) {
+            curDir = nextDir;
             strcpy (curDir->orgname,dir);
             if (!IsCachedIn(curDir)) {
                 if (OpenDir(curDir,expandedPath,id)) {
@@ -825,7 +956,7 @@ bool DOS_Drive_Cache::OpenDir(CFileInfo* dir, const char* expand, uint16_t& id)
     return false;
 }
 
-char* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, const char* sname, bool is_directory) {
+char* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, const char* sname, bool is_directory, bool sorted) {
     CFileInfo* info = new CFileInfo;
     strcpy(info->shortname, sname);
 	strcpy(info->orgname, name);
@@ -835,29 +966,10 @@ char* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, const char*
     // Check for long filenames...
     if (sname[0]==0) CreateShortName(dir, info);
 
-    // keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-    if (dir->fileList.size()>0) {
-        if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-            // append at end of list
-            dir->fileList.push_back(info);
-        } else {
-            bool found = false;
-            // look for position where to insert this element
-            std::vector<CFileInfo*>::iterator it;
-            for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-                if (strcmp(info->shortname,(*it)->shortname)<0) {
-                    found = true;
-                    break;
-                }
-            }
-            // Put file in lists
-            if (found) dir->fileList.insert(it,info);
-            else dir->fileList.push_back(info);
-        }
-    } else {
-        // empty file list, append
-        dir->fileList.push_back(info);
-    }
+    // keep list sorted (so GetLongName works correctly), unless ReadDir sorts it once it has all entries
+    if (sorted) dir->fileList.insert(std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName),info);
+    else dir->fileList.push_back(info);
+    IndexEntry(dir, info);
 	static char sgenname[DOS_NAMELENGTH+1];
 	strcpy(sgenname, info->shortname);
 	return sgenname;
@@ -879,6 +991,7 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result, char * &lresult) {
     if (id>=MAX_OPENDIRS) return false;
 
     if (!IsCachedIn(dirSearch[id])) {
+        Watch(dirSearch[id], dirPath);
         // Try to open directory
         void* dirp = drive->opendir(dirPath);
         if (!dirp) {
@@ -891,11 +1004,15 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result, char * &lresult) {
         // Read complete directory
         char dir_name[CROSS_LEN], dir_sname[DOS_NAMELENGTH+1];
         bool is_directory;
+        // short names are still made in the order the host returns the entries, but the
+        // list is sorted once at the end: a stable sort keeps entries with the same
+        // short name in that order, just as inserting them one by one would
         if (drive->read_directory_first(dirp, dir_name, dir_sname, is_directory)) {
-            CreateEntry(dirSearch[id], dir_name, dir_sname, is_directory);
+            CreateEntry(dirSearch[id], dir_name, dir_sname, is_directory, false);
             while (drive->read_directory_next(dirp, dir_name, dir_sname, is_directory)) {
-                CreateEntry(dirSearch[id], dir_name, dir_sname, is_directory);
+                CreateEntry(dirSearch[id], dir_name, dir_sname, is_directory, false);
             }
+            std::stable_sort(dirSearch[id]->fileList.begin(), dirSearch[id]->fileList.end(), SortByName);
         }
 
         // close dir
@@ -1005,6 +1122,7 @@ bool DOS_Drive_Cache::FindNext(uint16_t id, char* &result, char* &lresult) {
 }
 
 void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
+    Unwatch(dir);
     for(uint32_t i=0; i<dir->fileList.size(); i++) {
         if (CFileInfo *info = dir->fileList[i])
             ClearFileInfo(info);
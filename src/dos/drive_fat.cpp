@@ -251,6 +251,7 @@ class fatFile : public DOS_File {
                 bool modified = false;
                 bool loadedSector = false;
                 fatDrive *myDrive;
+                fatDrive::clusterChainMemory chain;
 };
 
 void time_t_to_DOS_DateTime(uint16_t &t,uint16_t &d,time_t unix_time) {
@@ -349,6 +350,8 @@ void fatFile::Flush(void) {
 		modified = false;
 		newtime = false;
 	}
+
+	myDrive->flushFAT();
 }
 
 bool fatFile::Read(uint8_t * data, uint16_t *size) {
@@ -356,49 +359,55 @@ bool fatFile::Read(uint8_t * data, uint16_t *size) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-	uint16_t sizedec, sizecount;
 	if(seekpos >= filelength) {
 		*size = 0;
 		return true;
 	}
 
-	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-		if(currentSector == 0) {
-			/* EOC reached before EOF */
-			*size = 0;
+	const uint32_t sectsize = myDrive->getSectorSize();
+	uint32_t sizedec = std::min<uint32_t>(*size, filelength - seekpos);
+	uint16_t sizecount = 0;
+
+	while(sizedec != 0) {
+		/* Whole sectors are read straight into the caller's buffer, as many at a time as lie one
+		 * after another on the disk */
+		if((seekpos % sectsize) == 0 && sizedec >= sectsize) {
+			uint32_t count = sizedec / sectsize;
+			const uint32_t sect = myDrive->getAbsoluteSectRun(firstCluster, seekpos / sectsize, &count, &chain);
+			if(sect == 0 || myDrive->readSectors(sect, count, &data[sizecount]) != 0) {
+				/* EOC reached before EOF */
+				loadedSector = false;
+				break;
+			}
+
+			const uint32_t len = count * sectsize;
 			loadedSector = false;
-			return true;
+			sizecount += (uint16_t)len;
+			sizedec -= len;
+			seekpos += len;
+			continue;
 		}
-		curSectOff = seekpos % myDrive->getSectorSize();
-		myDrive->readSector(currentSector, sectorBuffer);
-		loadedSector = true;
-	}
 
-	sizedec = *size;
-	sizecount = 0;
-	while(sizedec != 0) {
-		if(seekpos >= filelength) {
-			*size = sizecount;
-			return true; 
-		}
-		data[sizecount++] = sectorBuffer[curSectOff++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		if (!loadedSector) {
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chain);
 			if(currentSector == 0) {
 				/* EOC reached before EOF */
 				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
-				*size = sizecount;
-				loadedSector = false;
-				return true;
+				break;
 			}
-			curSectOff = 0;
+			curSectOff = seekpos % sectsize;
 			myDrive->readSector(currentSector, sectorBuffer);
 			loadedSector = true;
 			//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
 		}
-		--sizedec;
+
+		const uint32_t len = std::min(sizedec, sectsize - curSectOff);
+		memcpy(&data[sizecount], &sectorBuffer[curSectOff], len);
+		sizecount += (uint16_t)len;
+		sizedec -= len;
+		seekpos += len;
+		curSectOff += len;
+		if(curSectOff >= sectsize) loadedSector = false;
 	}
 	*size =sizecount;
 	return true;
@@ -411,7 +420,9 @@ bool fatFile::Write(const uint8_t * data, uint16_t *size) {
 	}
 
     direntry tmpentry = {};
-	uint16_t sizedec, sizecount;
+	const uint32_t sectsize = myDrive->getSectorSize();
+	uint32_t sizedec;
+	uint16_t sizecount;
 	sizedec = *size;
 	sizecount = 0;
 
@@ -441,7 +452,7 @@ bool fatFile::Write(const uint8_t * data, uint16_t *size) {
 
 		/* add clusters until the file length is correct */
 		while(filelength < seekpos) {
-			if(myDrive->appendCluster(firstCluster) == 0) goto finalizeWrite; // out of space
+			if(myDrive->appendCluster(firstCluster, &chain) == 0) goto finalizeWrite; // out of space
 			filelength += clustSize;
 		}
 		assert(filelength < (seekpos+clustSize));
@@ -453,64 +464,73 @@ bool fatFile::Write(const uint8_t * data, uint16_t *size) {
 	}
 
 	while(sizedec != 0) {
-		/* Increase filesize if necessary */
-		if(seekpos >= filelength) {
-			if(filelength == 0) {
-				firstCluster = myDrive->getFirstFreeClust();
-				if(firstCluster == 0) goto finalizeWrite; // out of space
-				myDrive->allocateCluster(firstCluster, 0);
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-				if (currentSector == 0) {
-					/* I guess allocateCluster() didn't work after all. This check is necessary to prevent
-					 * this condition from treating the BOOT SECTOR as a file. */
-					LOG(LOG_DOSMISC,LOG_WARN)("FAT file write: unable to allocate first cluster, erroring out");
-					goto finalizeWrite;
-				}
-				myDrive->readSector(currentSector, sectorBuffer);
-				loadedSector = true;
+		/* The file has no allocation yet */
+		if(firstCluster == 0) {
+			firstCluster = myDrive->getFirstFreeClust();
+			if(firstCluster == 0) goto finalizeWrite; // out of space
+			myDrive->allocateCluster(firstCluster, 0);
+			if (myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chain) == 0) {
+				/* I guess allocateCluster() didn't work after all. This check is necessary to prevent
+				 * this condition from treating the BOOT SECTOR as a file. */
+				LOG(LOG_DOSMISC,LOG_WARN)("FAT file write: unable to allocate first cluster, erroring out");
+				firstCluster = 0;
+				goto finalizeWrite;
 			}
-			if (!loadedSector) {
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-				if(currentSector == 0) {
-					/* EOC reached before EOF - try to increase file allocation */
-					myDrive->appendCluster(firstCluster);
-					/* Try getting sector again */
-					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-					if(currentSector == 0) {
-						/* No can do. lets give up and go home.  We must be out of room */
-						goto finalizeWrite;
-					}
-				}
-				curSectOff = seekpos % myDrive->getSectorSize();
-					myDrive->readSector(currentSector, sectorBuffer);
-					loadedSector = true;
-				}
-			filelength = seekpos+1;
 		}
-		--sizedec;
-		modified = true;
-		sectorBuffer[curSectOff++] = data[sizecount++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			if(loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
+
+		/* Whole sectors are written straight from the caller's buffer, as many at a time as lie
+		 * one after another on the disk */
+		if((seekpos % sectsize) == 0 && sizedec >= sectsize) {
+			uint32_t count = sizedec / sectsize;
+			uint32_t sect = myDrive->getAbsoluteSectRun(firstCluster, seekpos / sectsize, &count, &chain);
+			if(sect == 0) {
+				/* EOC reached before EOF - try to increase file allocation */
+				if(myDrive->appendCluster(firstCluster, &chain) == 0) goto finalizeWrite; // out of space
+				count = sizedec / sectsize;
+				sect = myDrive->getAbsoluteSectRun(firstCluster, seekpos / sectsize, &count, &chain);
+				if(sect == 0) goto finalizeWrite;
+			}
+			if(myDrive->writeSectors(sect, count, &data[sizecount]) != 0) goto finalizeWrite;
+
+			const uint32_t len = count * sectsize;
 			loadedSector = false;
+			modified = true;
+			sizecount += (uint16_t)len;
+			sizedec -= len;
+			seekpos += len;
+			if(seekpos > filelength) filelength = seekpos;
+			continue;
+		}
 
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		if (!loadedSector) {
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chain);
 			if(currentSector == 0) {
-			    if (sizedec == 0) goto finalizeWrite;
 				/* EOC reached before EOF - try to increase file allocation */
-				myDrive->appendCluster(firstCluster);
+				myDrive->appendCluster(firstCluster, &chain);
 				/* Try getting sector again */
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chain);
 				if(currentSector == 0) {
 					/* No can do. lets give up and go home.  We must be out of room */
 					goto finalizeWrite;
 				}
 			}
-			curSectOff = 0;
+			curSectOff = seekpos % sectsize;
 			myDrive->readSector(currentSector, sectorBuffer);
 			loadedSector = true;
 		}
+
+		const uint32_t len = std::min(sizedec, sectsize - curSectOff);
+		memcpy(&sectorBuffer[curSectOff], &data[sizecount], len);
+		modified = true;
+		sizecount += (uint16_t)len;
+		sizedec -= len;
+		seekpos += len;
+		curSectOff += len;
+		if(seekpos > filelength) filelength = seekpos;
+		if(curSectOff >= sectsize) {
+			myDrive->writeSector(currentSector, sectorBuffer);
+			loadedSector = false;
+		}
 	}
 	if(curSectOff>0 && loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
 
@@ -548,7 +568,7 @@ bool fatFile::Seek(uint32_t *pos, uint32_t type) {
 
 	if(seekto<0) seekto = 0;
 	seekpos = (uint32_t)seekto;
-	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chain);
 	if (currentSector == 0) {
 		/* not within file size, thus no sector is available */
 		loadedSector = false;
@@ -586,6 +606,7 @@ bool fatFile::Close() {
 		myDrive->directoryChange(dirCluster, &tmpentry, (int32_t)dirIndex);
 	}
 
+	myDrive->flushFAT();
 	return false;
 }
 
@@ -606,10 +627,101 @@ uint32_t fatDrive::getClustFirstSect(uint32_t clustNum) {
 	return ((clustNum - 2) * BPB.v.BPB_SecPerClus) + firstDataSector;
 }
 
+uint32_t fatDrive::getFATSectors(void) const {
+	return BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16;
+}
+
+/* Where the FAT entry at byte offset fatoffset is in the FAT cache, after reading in the sectors
+ * it is in (two for a FAT12 entry that spans sectors), and marking them dirty if about to write */
+uint8_t *fatDrive::getFATEntry(uint32_t fatoffset, bool write) {
+	const uint32_t bps = BPB.v.BPB_BytsPerSec;
+	const uint32_t fatsectors = getFATSectors();
+
+	if (fatSectState.size() != fatsectors) {
+		dropFAT();
+		/* two bytes more so that the last FAT12 entry can be read as a word */
+		fatCache.assign(((size_t)fatsectors * bps) + 2u, 0);
+		fatSectState.assign(fatsectors, 0);
+	}
+
+	uint32_t sect = fatoffset / bps;
+	const uint32_t last = std::min((fatoffset + (fattype == FAT12 ? 1u : 0u)) / bps, fatsectors - 1u);
+
+	for (;sect <= last;sect++) {
+		if (!(fatSectState[sect] & FATSECT_LOADED)) {
+			readSector(BPB.v.BPB_RsvdSecCnt + sect + partSectOff, &fatCache[(size_t)sect * bps]);
+			fatSectState[sect] |= FATSECT_LOADED;
+		}
+		if (write && !(fatSectState[sect] & FATSECT_DIRTY)) {
+			fatSectState[sect] |= FATSECT_DIRTY;
+			fatDirtySectors++;
+		}
+	}
+
+	return &fatCache[fatoffset];
+}
+
+/* Write the changed sectors of the FAT cache to all copies of the FAT on disk */
+void fatDrive::flushFAT(void) {
+	if (fatDirtySectors == 0 || loadedDisk == NULL) return;
+
+	const uint32_t bps = BPB.v.BPB_BytsPerSec;
+	const uint32_t fatsectors = getFATSectors();
+
+	for (uint32_t sect = 0;sect < fatsectors && fatDirtySectors != 0;sect++) {
+		if (!(fatSectState[sect] & FATSECT_DIRTY)) continue;
+
+		for (unsigned int fc=0;fc<BPB.v.BPB_NumFATs;fc++) {
+			if (writeSector(BPB.v.BPB_RsvdSecCnt + (fc * fatsectors) + sect + partSectOff, &fatCache[(size_t)sect * bps]) != 0)
+				LOG(LOG_DOSMISC,LOG_ERROR)("FAT: unable to write sector %u of FAT #%u",(unsigned int)sect,fc+1u);
+		}
+
+		fatSectState[sect] &= ~FATSECT_DIRTY;
+		fatDirtySectors--;
+	}
+}
+
+/* Forget the FAT cache, without writing it out, so that it is read from disk again */
+void fatDrive::dropFAT(void) {
+	fatCache.clear();
+	fatSectState.clear();
+	fatDirtySectors = 0;
+	freeClusterMap.clear();
+	freeClusters = 0;
+	chainGeneration++;
+}
+
+/* INT 25h/26h and IOCTL sector access bypass the FAT cache. Before the guest reads the FAT it must
+ * be on disk, and after the guest writes it, it must be read from disk again. */
+void fatDrive::syncFATCache(uint32_t sectnum, bool write) {
+	if (unformatted) return;
+
+	const uint32_t fatstart = BPB.v.BPB_RsvdSecCnt + partSectOff;
+	if (sectnum < fatstart || sectnum >= (fatstart + ((uint32_t)BPB.v.BPB_NumFATs * getFATSectors()))) return;
+
+	flushFAT();
+	if (write) dropFAT();
+}
+
+void fatDrive::EmptyCache(void) {
+	flushFAT();
+}
+
+void fatDrive::loadFreeClusterMap(void) {
+	if (!freeClusterMap.empty() || CountOfClusters == 0) return;
+
+	freeClusterMap.assign((CountOfClusters + 63u) / 64u, 0);
+	freeClusters = 0;
+	for (uint32_t i=0;i<CountOfClusters;i++) {
+		if (!getClusterValue(i+2)) {
+			freeClusterMap[i / 64u] |= (uint64_t)1u << (i % 64u);
+			freeClusters++;
+		}
+	}
+}
+
 uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 	uint32_t fatoffset=0;
-	uint32_t fatsectnum;
-	uint32_t fatentoff;
 	uint32_t clustValue=0;
 
 	if (unformatted) return 0xFFFFFFFFu;
@@ -625,35 +737,16 @@ uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 			fatoffset = clustNum * 4;
 			break;
 	}
-	fatsectnum = BPB.v.BPB_RsvdSecCnt + (fatoffset / BPB.v.BPB_BytsPerSec) + partSectOff;
-	fatentoff = fatoffset % BPB.v.BPB_BytsPerSec;
-
-    if (BPB.is_fat32()) {
-        if (fatsectnum >= (BPB.v.BPB_RsvdSecCnt + BPB.v32.BPB_FATSz32 + partSectOff)) {
-            LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to read cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
-            return 0;
-        }
-    }
-    else {
-        if (fatsectnum >= (BPB.v.BPB_RsvdSecCnt + BPB.v.BPB_FATSz16 + partSectOff)) {
-            LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to read cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
-            return 0;
-        }
-    }
-
-    assert((BPB.v.BPB_BytsPerSec * (Bitu)2) <= sizeof(fatSectBuffer));
-
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[BPB.v.BPB_BytsPerSec]);
-		curFatSect = fatsectnum;
+	if ((fatoffset / BPB.v.BPB_BytsPerSec) >= getFATSectors()) {
+		LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to read cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
+		return 0;
 	}
 
+	uint8_t *fatentry = getFATEntry(fatoffset, false);
+
 	switch(fattype) {
 		case FAT12:
-			clustValue = var_read((uint16_t*)&fatSectBuffer[fatentoff]);
+			clustValue = var_read((uint16_t*)fatentry);
 			if(clustNum & 0x1) {
 				clustValue >>= 4;
 			} else {
@@ -661,10 +754,10 @@ uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 			}
 			break;
 		case FAT16:
-			clustValue = var_read((uint16_t*)&fatSectBuffer[fatentoff]);
+			clustValue = var_read((uint16_t*)fatentry);
 			break;
 		case FAT32:
-			clustValue = var_read((uint32_t*)&fatSectBuffer[fatentoff]) & 0x0FFFFFFFul; /* Well, actually it's FAT28. Upper 4 bits are "reserved". */
+			clustValue = var_read((uint32_t*)fatentry) & 0x0FFFFFFFul; /* Well, actually it's FAT28. Upper 4 bits are "reserved". */
 			break;
 	}
 
@@ -673,8 +766,6 @@ uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 
 void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 	uint32_t fatoffset=0;
-	uint32_t fatsectnum;
-	uint32_t fatentoff;
 
 	if (unformatted) return;
 
@@ -689,35 +780,33 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 			fatoffset = clustNum * 4;
 			break;
 	}
-	fatsectnum = BPB.v.BPB_RsvdSecCnt + (fatoffset / BPB.v.BPB_BytsPerSec) + partSectOff;
-	fatentoff = fatoffset % BPB.v.BPB_BytsPerSec;
-
-    if (BPB.is_fat32()) {
-        if (fatsectnum >= (BPB.v.BPB_RsvdSecCnt + BPB.v32.BPB_FATSz32 + partSectOff)) {
-            LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to write cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
-            return;
-        }
-    }
-    else {
-        if (fatsectnum >= (BPB.v.BPB_RsvdSecCnt + BPB.v.BPB_FATSz16 + partSectOff)) {
-            LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to write cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
-            return;
-        }
-    }
+	if ((fatoffset / BPB.v.BPB_BytsPerSec) >= getFATSectors()) {
+		LOG(LOG_DOSMISC,LOG_ERROR)("Attempt to write cluster entry from FAT that out of range (outside the FAT table) cluster %u",(unsigned int)clustNum);
+		return;
+	}
 
-    assert((BPB.v.BPB_BytsPerSec * (Bitu)2) <= sizeof(fatSectBuffer));
+	/* keep the free cluster map up to date, if there is one */
+	if (!freeClusterMap.empty() && clustNum >= 2 && (clustNum - 2) < CountOfClusters) {
+		const uint32_t i = clustNum - 2;
+		const uint64_t bit = (uint64_t)1u << (i % 64u);
+		const bool wasFree = (freeClusterMap[i / 64u] & bit) != 0;
+		const bool isFree = (fattype == FAT12 ? (clustValue & 0xfff) : fattype == FAT16 ? (clustValue & 0xffff) : (clustValue & 0x0FFFFFFFul)) == 0;
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[BPB.v.BPB_BytsPerSec]);
-		curFatSect = fatsectnum;
+		if (wasFree && !isFree) {
+			freeClusterMap[i / 64u] &= ~bit;
+			freeClusters--;
+		}
+		else if (!wasFree && isFree) {
+			freeClusterMap[i / 64u] |= bit;
+			freeClusters++;
+		}
 	}
 
+	uint8_t *fatentry = getFATEntry(fatoffset, true);
+
 	switch(fattype) {
 		case FAT12: {
-			uint16_t tmpValue = var_read((uint16_t *)&fatSectBuffer[fatentoff]);
+			uint16_t tmpValue = var_read((uint16_t *)fatentry);
 			if(clustNum & 0x1) {
 				clustValue &= 0xfff;
 				clustValue <<= 4;
@@ -729,23 +818,16 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 				tmpValue &= 0xf000;
 				tmpValue |= (uint16_t)clustValue;
 			}
-			var_write((uint16_t *)&fatSectBuffer[fatentoff], tmpValue);
+			var_write((uint16_t *)fatentry, tmpValue);
 			break;
 			}
 		case FAT16:
-			var_write(((uint16_t *)&fatSectBuffer[fatentoff]), (uint16_t)clustValue);
+			var_write(((uint16_t *)fatentry), (uint16_t)clustValue);
 			break;
 		case FAT32:
-			var_write(((uint32_t *)&fatSectBuffer[fatentoff]), clustValue);
+			var_write(((uint32_t *)fatentry), clustValue);
 			break;
 	}
-	for(unsigned int fc=0;fc<BPB.v.BPB_NumFATs;fc++) {
-		writeSector(fatsectnum + (fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[0]);
-		if (fattype==FAT12) {
-			if (fatentoff >= (BPB.v.BPB_BytsPerSec-1U))
-				writeSector(fatsectnum+1u+(fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[BPB.v.BPB_BytsPerSec]);
-		}
-	}
 }
 
 bool fatDrive::getEntryName(const char *fullname, char *entname) {
@@ -841,6 +923,7 @@ nextfile:
 			newClust = appendCluster(dirClustNumber);
 			if(newClust == 0) return;
 			zeroOutCluster(newClust);
+			flushFAT();
 			/* Try again to get tmpsector */
 			tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
 			if(tmpsector == 0) return; /* Give up if still can't get more room for directory */
@@ -1084,6 +1167,56 @@ uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
 	return loadedDisk->Write_Sector(head, cylinder, sector, data);
 }
 
+/* Several sectors at once, in one request to the disk where it can take one */
+uint8_t fatDrive::readSectors(uint32_t sectnum, uint32_t count, void * data) {
+	const uint32_t ssize = getSectorSize();
+
+#ifndef OLD_CHS_CONVERSION
+	if (!absolute && ssize == loadedDisk->getSectSize()) {
+		/* these place sectors by C/H/S themselves, everything else is the same by LBA */
+		switch (loadedDisk->class_id) {
+			case imageDisk::ID_D88:
+			case imageDisk::ID_NFD:
+			case imageDisk::ID_VFD:
+			case imageDisk::ID_EMPTY_DRIVE:
+				break;
+			default:
+				return loadedDisk->Read_AbsoluteSectors(sectnum, count, data);
+		}
+	}
+#endif
+
+	for (uint32_t i=0;i < count;i++) {
+		const uint8_t res = readSector(sectnum + i, (uint8_t*)data + ((size_t)i * ssize));
+		if (res != 0) return res;
+	}
+	return 0;
+}
+
+uint8_t fatDrive::writeSectors(uint32_t sectnum, uint32_t count, const void * data) {
+	const uint32_t ssize = getSectorSize();
+
+#ifndef OLD_CHS_CONVERSION
+	if (!absolute && ssize == loadedDisk->getSectSize()) {
+		switch (loadedDisk->class_id) {
+			case imageDisk::ID_D88:
+			case imageDisk::ID_NFD:
+			case imageDisk::ID_VFD:
+			case imageDisk::ID_EMPTY_DRIVE:
+				break;
+			default:
+				return loadedDisk->Write_AbsoluteSectors(sectnum, count, data);
+		}
+	}
+#endif
+
+	for (uint32_t i=0;i < count;i++) {
+		const uint8_t res = writeSector(sectnum + i, (uint8_t*)data + ((size_t)i * ssize));
+		if (res != 0) return res;
+	}
+	return 0;
+}
+
 uint32_t fatDrive::getSectorCount(void) {
 	if (BPB.v.BPB_TotSec16 != 0)
 		return (uint32_t)BPB.v.BPB_TotSec16;
@@ -1132,16 +1265,30 @@ uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t log
 
 	uint32_t currentClust = startClustNum;
 
-	if (ccm != NULL && ccm->current_cluster_no >= 2) {
-		/* If the cluster index is the same as last time or farther down, avoid re-reading the
-		 * entire allocation chain again and start from where we last read from. If the
-		 * cluster index is going back from current, then re-read the entire allocation chain again.
-		 * This is the nature of a singly-linked file allocation table and is the reason seek()
-		 * is faster going forward than backwards in MS-DOS, especially on FAT32 partitions. */
-		if (targClust >= ccm->current_cluster_index) {
-			indxClust = ccm->current_cluster_index;
-			currentClust = ccm->current_cluster_no;
+	if (ccm != NULL) {
+		/* Following a singly-linked file allocation table is why seek() is faster going forward
+		 * than backwards in MS-DOS, especially on FAT32 partitions. Remember the chain as it is
+		 * followed instead, so that going back costs nothing and going forward continues from
+		 * the farthest cluster known. Appending to the chain keeps what is remembered valid,
+		 * cutting it short or freeing it (a new chainGeneration) does not. */
+		if (ccm->generation != chainGeneration || ccm->clusters.empty() || ccm->clusters[0] != startClustNum) {
+			ccm->clear();
+			ccm->clusters.push_back(startClustNum);
+			ccm->generation = chainGeneration;
+		}
+
+		while (ccm->clusters.size() <= targClust) {
+			const uint32_t testvalue = getClusterValue(ccm->clusters.back());
+
+			if (iseofFAT(testvalue)) {
+				if (ccm->clusters.size() != targClust) LOG(LOG_MISC,LOG_DEBUG)("FAT: Seek past allocation chain");
+				return 0;
+			}
+
+			ccm->clusters.push_back(testvalue);
 		}
+
+		return (getClustFirstSect(ccm->clusters[targClust]) + sectClust);
 	}
 
 	while(indxClust<targClust) {
@@ -1158,17 +1305,33 @@ uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t log
 
 	assert(indxClust<=targClust);
 
-	if (ccm != NULL) {
-		ccm->current_cluster_index = currentClust;
-		ccm->current_cluster_no = indxClust;
-	}
-
 	/* this should not happen! */
 	assert(currentClust != 0);
 
 	return (getClustFirstSect(currentClust) + sectClust);
 }
 
+/* The absolute sector of logicalSector in the chain, like getAbsoluteSectFromChain(), and in *count how many
+ * sectors from there on, up to *count, follow one another on disk because their clusters do */
+uint32_t fatDrive::getAbsoluteSectRun(uint32_t startClustNum, uint32_t logicalSector, uint32_t *count,clusterChainMemory *ccm) {
+	const uint32_t maxSectors = *count;
+	*count = 0;
+
+	const uint32_t first = getAbsoluteSectFromChain(startClustNum, logicalSector, ccm);
+	if (first == 0 || maxSectors == 0) return 0;
+
+	const uint32_t spc = BPB.v.BPB_SecPerClus;
+	uint32_t run = std::min(spc - (logicalSector % spc), maxSectors);
+
+	while (run < maxSectors) {
+		if (getAbsoluteSectFromChain(startClustNum, logicalSector + run, ccm) != (first + run)) break;
+		run += std::min(spc, maxSectors - run);
+	}
+
+	*count = run;
+	return first;
+}
+
 void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 	if (unformatted) return;
 	if (startCluster < 2) return; /* do not corrupt the FAT media ID. The file has no chain. Do nothing. */
@@ -1223,6 +1386,7 @@ void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 		else if (testvalue >= eofClust)
 			return; /* No need to write EOF because EOF is already there */
 
+		chainGeneration++;
 		setClusterValue(currentClust,eofClust);
 		if (searchFreeCluster > (currentClust - 2)) searchFreeCluster = currentClust - 2;
 		currentClust = testvalue;
@@ -1230,6 +1394,7 @@ void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 	}
 
 	/* then run the rest of the chain and zero it out */
+	chainGeneration++;
 	while (1) {
 		uint32_t testvalue = getClusterValue(currentClust);
 		if (testvalue == 0) {
@@ -1249,11 +1414,15 @@ void fatDrive::deleteClustChain(uint32_t startCluster, uint32_t bytePos) {
 	}
 }
 
-uint32_t fatDrive::appendCluster(uint32_t startCluster) {
+uint32_t fatDrive::appendCluster(uint32_t startCluster,clusterChainMemory *ccm) {
 	if (unformatted) return 0;
 	if (startCluster < 2) return 0; /* do not corrupt the FAT media ID. The file has no chain. Do nothing. */
 
 	uint32_t currentClust = startCluster;
+
+	/* go to the end of the chain from as far down it as it is remembered */
+	if (ccm != NULL && ccm->generation == chainGeneration && !ccm->clusters.empty() && ccm->clusters[0] == startCluster)
+		currentClust = ccm->clusters.back();
 	uint32_t eofClust = 0;
 
 	switch(fattype) {
@@ -1324,6 +1493,7 @@ bool fatDrive::allocateCluster(uint32_t useCluster, uint32_t prevCluster) {
 }
 
 fatDrive::~fatDrive() {
+	flushFAT();
 	if (loadedDisk) {
 		if (partition_index >= 0) loadedDisk->partitionMarkUse(partition_index,false);
 		loadedDisk->Release();
@@ -1408,7 +1578,7 @@ fatDrive::fatDrive(const char* sysFilename, uint32_t bytesector, uint32_t cylsec
 		else {
 			fseeko64(diskfile, 0L, SEEK_END);
 			filesize = (uint32_t)(ftello64(diskfile) / 1024L);
-			loadedDisk = new imageDisk(diskfile, fname, filesize, (is_hdd | (filesize > 2880)));
+			loadedDisk = new imageDiskRaw(diskfile, fname, filesize, (is_hdd | (filesize > 2880)));
 		}
 	}
 
@@ -1775,8 +1945,7 @@ void fatDrive::fatDriveInit(const char *sysFilename, uint32_t bytesector, uint32
 
 				cwdDirCluster = 0;
 
-				memset(fatSectBuffer,0,1024);
-				curFatSect = 0xffffffff;
+				dropFAT();
 
 				strcpy(info, "fatDrive ");
 				strcat(info, wpcolon&&strlen(sysFilename)>1&&sysFilename[0]==':'?sysFilename+1:sysFilename);
@@ -2255,8 +2424,7 @@ void fatDrive::fatDriveInit(const char *sysFilename, uint32_t bytesector, uint32
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	dropFAT();
 
 	strcpy(info, "fatDrive ");
 	strcat(info, wpcolon&&strlen(sysFilename)>1&&sysFilename[0]==':'?sysFilename+1:sysFilename);
@@ -2271,20 +2439,14 @@ void fatDrive::fatDriveInit(const char *sysFilename, uint32_t bytesector, uint32
 #endif
 
 bool fatDrive::AllocationInfo32(uint32_t * _bytes_sector,uint32_t * _sectors_cluster,uint32_t * _total_clusters,uint32_t * _free_clusters) {
-	uint32_t countFree = 0;
-	uint32_t i;
-
 	if (unformatted) return false;
 
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2))
-			countFree++;
-	}
+	loadFreeClusterMap();
 
 	*_bytes_sector = getSectSize();
 	*_sectors_cluster = BPB.v.BPB_SecPerClus;
 	*_total_clusters = CountOfClusters;
-	*_free_clusters = countFree;
+	*_free_clusters = freeClusters;
 
 	return true;
 }
@@ -2301,13 +2463,9 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 		return false;
 	}
 	else {
-		uint32_t countFree = 0;
-		uint32_t i;
+		loadFreeClusterMap();
 
-		for(i=0;i<CountOfClusters;i++) {
-			if(!getClusterValue(i+2))
-				countFree++;
-		}
+		const uint32_t countFree = freeClusters;
 
 		/* FAT12/FAT16 should never allow more than 0xFFF6 clusters and partitions larger than 2GB */
 		*_bytes_sector = (uint16_t)getSectSize();
@@ -2320,15 +2478,30 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 }
 
 uint32_t fatDrive::getFirstFreeClust(void) {
-	uint32_t i;
-
 	if (unformatted) return 0;
 
-	for(i=searchFreeCluster;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return ((searchFreeCluster=i)+2);
-	}
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return ((searchFreeCluster=i)+2);
+	loadFreeClusterMap();
+
+	if (freeClusters != 0) {
+		/* first free cluster from searchFreeCluster on, then from the start, 64 clusters at a time */
+		const uint32_t words = (uint32_t)freeClusterMap.size();
+		if (searchFreeCluster >= CountOfClusters) searchFreeCluster = 0;
+
+		uint32_t w = searchFreeCluster / 64u;
+		uint64_t bits = freeClusterMap[w] & (~(uint64_t)0u << (searchFreeCluster % 64u));
+
+		for (uint32_t n=0;n<=words;n++) {
+			if (bits != 0) {
+				uint32_t i = w * 64u;
+				while (!(bits & 1u)) {
+					bits >>= 1u;
+					i++;
+				}
+				if (i < CountOfClusters) return ((searchFreeCluster=i)+2);
+			}
+			if (++w == words) w = 0;
+			bits = freeClusterMap[w];
+		}
 	}
 
 	/* No free cluster found */
@@ -2349,6 +2522,8 @@ const FAT_BootSector::bpb_union_t &fatDrive::GetBPB(void) { return BPB; }
 
 void fatDrive::SetBPB(const FAT_BootSector::bpb_union_t &bpb) {
 	if (readonly) return;
+	flushFAT();
+	dropFAT();
 	unformatted = false;
 	BPB.v.BPB_BytsPerSec = bpb.v.BPB_BytsPerSec;
 	BPB.v.BPB_SecPerClus = bpb.v.BPB_SecPerClus;
@@ -2531,6 +2706,7 @@ bool fatDrive::FileCreate(DOS_File **file, const char *name, uint16_t attributes
 	((fatFile *)(*file))->time = fileEntry.modTime;
 	((fatFile *)(*file))->date = fileEntry.modDate;
 
+	flushFAT();
 	dos.errorcode=save_errorcode;
 	return true;
 }
@@ -2619,6 +2795,7 @@ bool fatDrive::FileUnlink(const char * name) {
 		const uint32_t chk = BPB.is_fat32() ? fileEntry.Cluster32() : fileEntry.loFirstClust;
 		if(chk != 0) deleteClustChain(chk, 0);
 	}
+	flushFAT();
 
 	if(getFileDirEntry(name, &fileEntry, &dirClust, &subEntry)) return false;
 
@@ -2687,10 +2864,12 @@ uint32_t fatDrive::GetSectorSize(void) {
 }
 
 uint8_t fatDrive::Read_AbsoluteSector_INT25(uint32_t sectnum, void * data) {
+    syncFATCache(sectnum+partSectOff,false);
     return readSector(sectnum+partSectOff,data);
 }
 
 uint8_t fatDrive::Write_AbsoluteSector_INT25(uint32_t sectnum, void * data) {
+    syncFATCache(sectnum+partSectOff,true);
     return writeSector(sectnum+partSectOff,data);
 }
 
@@ -3393,6 +3572,7 @@ bool fatDrive::MakeDir(const char *dir) {
 	addDirectoryEntry(dummyClust, tmpentry);
 	//if(!getDirClustNum(dir, &dummyClust, false)) return false;
 
+	flushFAT();
 	return true;
 }
 
@@ -3464,6 +3644,7 @@ bool fatDrive::RemoveDir(const char *dir) {
 
 	/* delete allocation chain */
 	deleteClustChain(dummyClust, 0);
+	flushFAT();
 	return true;
 }
 
@@ -3552,6 +3733,7 @@ bool fatDrive::Rename(const char * oldname, const char * newname) {
 		}
 	}
 
+	flushFAT();
 	return true;
 }
 
@@ -3582,7 +3764,7 @@ uint32_t fatDrive::GetHighestClusterNumber(void) {
 }
 
 void fatDrive::clusterChainMemory::clear(void) {
-	current_cluster_no = 0;
-	current_cluster_index = 0;
+	clusters.clear();
+	generation = 0;
 }
 
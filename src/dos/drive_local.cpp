@@ -1264,6 +1264,7 @@ void drivezRegister(std::string const& path, std::string const& dir, bool usecp)
 
 bool localDrive::FileCreate(DOS_File * * file,const char * name,uint16_t attributes) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
     if (readonly) {
 		DOS_SetError(DOSERR_WRITE_PROTECTED);
@@ -1467,6 +1468,7 @@ bool share(int fd, int mode, uint32_t flags) {
 
 bool localDrive::FileOpen(DOS_File * * file,const char * name,uint32_t flags) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
     if (readonly) {
         if ((flags&0xf) == OPEN_WRITE || (flags&0xf) == OPEN_READWRITE) {
@@ -1697,6 +1699,7 @@ bool localDrive::FindFirst(const char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 		else tempDir[i]=toupper(tempDir[i]);
 	}
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
 	if (allocation.mediaid==0xF0 ) {
 		EmptyCache(); //rescan floppie-content on each findfirst
@@ -1964,6 +1967,7 @@ bool localDrive::SetFileAttr(const char * name,uint16_t attr) {
 
 bool localDrive::GetFileAttr(const char * name,uint16_t * attr) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
 	char newname[CROSS_LEN];
 	strcpy(newname,basedir);
@@ -2093,6 +2097,7 @@ unsigned long localDrive::GetSerial() {
 
 bool localDrive::MakeDir(const char * dir) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
     if (readonly) {
         DOS_SetError(DOSERR_WRITE_PROTECTED);
@@ -2125,6 +2130,7 @@ bool localDrive::MakeDir(const char * dir) {
 
 bool localDrive::RemoveDir(const char * dir) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
     if (readonly) {
         DOS_SetError(DOSERR_WRITE_PROTECTED);
@@ -2157,6 +2163,7 @@ bool localDrive::RemoveDir(const char * dir) {
 
 bool localDrive::TestDir(const char * dir) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
 	char newdir[CROSS_LEN];
 	strcpy(newdir,basedir);
@@ -2350,6 +2357,7 @@ bool localDrive::AllocationInfo(uint16_t * _bytes_sector,uint8_t * _sectors_clus
 
 bool localDrive::FileExists(const char* name) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
 	char newname[CROSS_LEN];
 	strcpy(newname,basedir);
@@ -2372,6 +2380,7 @@ bool localDrive::FileExists(const char* name) {
 
 bool localDrive::FileStat(const char* name, FileStat_Block * const stat_block) {
     if (nocachedir) EmptyCache();
+    else dirCache.CheckHostChanges();
 
 	char newname[CROSS_LEN];
 	strcpy(newname,basedir);
@@ -2566,6 +2575,7 @@ localDrive::localDrive(const char * startdir,uint16_t _bytes_sector,uint8_t _sec
 			remote = 0;
 	}
 
+	dirCache.WatchHost(true);
 	dirCache.SetBaseDir(basedir,this);
 }
 
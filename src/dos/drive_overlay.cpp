@@ -484,6 +484,8 @@ Overlay_Drive::Overlay_Drive(const char * startdir,const char* overlay, uint16_t
 :localDrive(startdir,_bytes_sector,_sectors_cluster,_total_clusters,_free_clusters,_mediaid,options),special_prefix(prefix_overlay.c_str()) {
 	optimize_cache_v1 = true; //Try to not reread overlay files on deletes. Ideally drive_cache should be improved to handle deletes properly.
 	//Currently this flag does nothing, as the current behavior is to not reread due to caching everything.
+	//The cache mixes both directories and keeps deleted files out of it, so host changes are not followed.
+	dirCache.WatchHost(false);
 #if defined (WIN32)	
 	if (strcasecmp(startdir,overlay) == 0) {
 #else 
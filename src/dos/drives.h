@@ -395,28 +395,36 @@ public:
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
 public:
+	/* The allocation chain of an open file as far as it has been followed, so that seeking
+	 * within the file does not have to walk the FAT from the first cluster every time. */
 	struct clusterChainMemory {
-		uint32_t	current_cluster_no = 0;
-		uint32_t	current_cluster_index = 0;
+		std::vector<uint32_t>	clusters;	/* clusters[n] is cluster n of the file */
+		uint32_t		generation = 0;	/* fatDrive::chainGeneration these were read under */
 
 		void clear(void);
 	};
 public:
 	uint8_t readSector(uint32_t sectnum, void * data);
 	uint8_t writeSector(uint32_t sectnum, void * data);
+	uint8_t readSectors(uint32_t sectnum, uint32_t count, void * data);
+	uint8_t writeSectors(uint32_t sectnum, uint32_t count, const void * data);
 	uint32_t getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos,clusterChainMemory *ccm=NULL);
 	uint32_t getSectorCount(void);
 	uint32_t getSectorSize(void);
 	uint32_t getClusterSize(void);
 	uint32_t getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t logicalSector,clusterChainMemory *ccm=NULL);
+	uint32_t getAbsoluteSectRun(uint32_t startClustNum, uint32_t logicalSector, uint32_t *count,clusterChainMemory *ccm=NULL);
 	bool allocateCluster(uint32_t useCluster, uint32_t prevCluster);
-	uint32_t appendCluster(uint32_t startCluster);
+	uint32_t appendCluster(uint32_t startCluster,clusterChainMemory *ccm=NULL);
 	void deleteClustChain(uint32_t startCluster, uint32_t bytePos);
 	uint32_t getFirstFreeClust(void);
 	bool directoryBrowse(uint32_t dirClustNumber, direntry *useEntry, int32_t entNum, int32_t start=0);
 	bool directoryChange(uint32_t dirClustNumber, const direntry *useEntry, int32_t entNum);
 	const FAT_BootSector::bpb_union_t &GetBPB(void);
 	void SetBPB(const FAT_BootSector::bpb_union_t &bpb);
+	void flushFAT(void);
+	void syncFATCache(uint32_t sectnum, bool write);
+	virtual void EmptyCache(void);
 	imageDisk *loadedDisk = NULL;
 	uint8_t req_ver_major = 0,req_ver_minor = 0;
 	bool created_successfully = true;
@@ -491,8 +499,27 @@ private:
 
 	uint32_t cwdDirCluster = 0;
 
-	uint8_t fatSectBuffer[SECTOR_SIZE_MAX * 2] = {};
-	uint32_t curFatSect = 0;
+	/* The first copy of the FAT, read in a sector at a time as it is used. Changes are made here
+	 * and the sectors marked dirty until flushFAT() writes them to every copy of the FAT. */
+	enum {
+		FATSECT_LOADED = 0x01,
+		FATSECT_DIRTY = 0x02
+	};
+	std::vector<uint8_t> fatCache;
+	std::vector<uint8_t> fatSectState;	/* FATSECT_* per sector of the FAT */
+	uint32_t fatDirtySectors = 0;
+
+	/* One bit per cluster, set if the cluster is free. Built by the first allocation or free space query */
+	std::vector<uint64_t> freeClusterMap;
+	uint32_t freeClusters = 0;
+
+	/* Changes whenever clusters may have left an allocation chain, see clusterChainMemory */
+	uint32_t chainGeneration = 0;
+
+	uint32_t getFATSectors(void) const;
+	uint8_t *getFATEntry(uint32_t fatoffset, bool write);
+	void loadFreeClusterMap(void);
+	void dropFAT(void);
 
 	DOS_Drive_Cache labelCache;
 public:
@@ -196,6 +196,7 @@ bool                ticksLocked;
 bool                mono_cga=false;
 bool                ignore_opcode_63 = true;
 int                 dynamic_core_cache_block_size = 32;
+int                 dynamic_core_cache_size = 8;
 Bitu                VGA_BIOS_Size_override = 0;
 Bitu                VGA_BIOS_SEG = 0xC000;
 Bitu                VGA_BIOS_SEG_END = 0xC800;
@@ -1027,6 +1028,8 @@ void DOSBOX_RealInit() {
     //       on the title= setting now to auto-update the titlebar when this changes.
     dosbox_title = section->Get_string("title");
 
+    SaveState::instance().setRewind(section->Get_int("rewind frames"), section->Get_int("rewind memory"));
+
     // TODO: these should be parsed by DOS kernel at startup
     dosbox_shell_env_size = (unsigned int)section->Get_int("shell environment size");
 
@@ -1268,6 +1271,7 @@ void DOSBOX_SetupConfigSections(void) {
     const char* captureformats[] = { "default", "avi-zmbv", "mpegts-h264", 0 };
     const char* blocksizes[] = {"1024", "2048", "4096", "8192", "512", "256", 0};
     const char* capturechromaformats[] = { "auto", "4:4:4", "4:2:2", "4:2:0", 0};
+    const char* capturequeuefull[] = { "block", "drop", 0};
     const char* controllertypes[] = { "auto", "at", "xt", "pcjr", "pc98", 0}; // Future work: Tandy(?) and USB
     const char* auxdevices[] = {"none","2button","3button","intellimouse","intellimouse45",0};
     const char* cputype_values[] = {"auto", "8086", "8086_prefetch", "80186", "80186_prefetch", "286", "286_prefetch", "386", "386_prefetch", "486old", "486old_prefetch", "486", "486_prefetch", "pentium", "pentium_mmx", "ppro_slow", "pentium_ii", "pentium_iii", "experimental", 0};
@@ -1337,6 +1341,7 @@ void DOSBOX_SetupConfigSections(void) {
     const char *vga_ac_mapping_settings[] = { "", "auto", "4x4", "4low", "first16", 0 };
     const char* fpu_settings[] = { "true", "false", "1", "0", "auto", "8087", "287", "387", 0};
     const char* sb_recording_sources[] = { "silence", "hiss", "1khz tone", 0};
+    const char* disk_image_io_settings[] = { "auto", "stdio", "pread", "mmap", 0};
 
     const char* hostkeys[] = {
         "ctrlalt", "ctrlshift", "altshift", "mapper", 0 };
@@ -1588,6 +1593,24 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool = secprop->Add_bool("compresssaveparts", Property::Changeable::WhenIdle,true);
     Pbool->Set_help("If set, DOSBox-X will compress components of saved states to save space.");
 
+    Pbool = secprop->Add_bool("asyncsavestate", Property::Changeable::WhenIdle,true);
+    Pbool->Set_help("If set, DOSBox-X will only take a snapshot of the emulator state when saving a state, and will compress and write it\n"
+                    "to the save slot in the background (using all host CPU cores for compression) while the emulation continues.");
+
+    Pint = secprop->Add_int("deltasavestate", Property::Changeable::WhenIdle,0);
+    Pint->SetMinMax(0,100);
+    Pint->Set_help("If set to a value N greater than 0, only every Nth saved state is a full one (keyframe). The saved states in between only\n"
+                   "store the memory pages and other parts that changed since that keyframe, which is needed to load them.");
+
+    Pint = secprop->Add_int("rewind frames", Property::Changeable::OnlyAtStart,0);
+    Pint->SetMinMax(0,3600);
+    Pint->Set_help("If set to a value N greater than 0, DOSBox-X keeps a compressed snapshot of the emulator state in memory every N emulated frames,\n"
+                   "and the \"Rewind\" mapper shortcut (Host+Z by default) goes back to them one at a time, most recent first.");
+
+    Pint = secprop->Add_int("rewind memory", Property::Changeable::OnlyAtStart,64);
+    Pint->SetMinMax(1,4096);
+    Pint->Set_help("Memory in MB to use for the rewind snapshots. The oldest snapshots are dropped to stay within this limit.");
+
     Pbool = secprop->Add_bool("show recorded filename", Property::Changeable::WhenIdle,false);
     Pbool->Set_help("If set, DOSBox-X will show message boxes with recorded filenames when making audio or video captures.");
 
@@ -1595,6 +1618,16 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool = secprop->Add_bool("skip encoding unchanged frames",Property::Changeable::WhenIdle,false);
     Pbool->Set_help("Unchanged frames will not be sent to the video codec as a possible performance and bandwidth optimization.");
 
+    Pint = secprop->Add_int("capture encoder queue",Property::Changeable::WhenIdle,3);
+    Pint->SetMinMax(0,16);
+    Pint->Set_help("Number of captured AVI+ZMBV video frames and screenshots that can wait for the background encoder thread.\n"
+                   "0 compresses and writes them on the emulation thread. Not used for the MPEGTS H.264+AAC format.");
+
+    Pstring = secprop->Add_string("capture queue full",Property::Changeable::WhenIdle,"block");
+    Pstring->Set_values(capturequeuefull);
+    Pstring->Set_help("What to do with a video frame when the encoder queue is full. 'block' waits for the encoder.\n"
+                      "'drop' writes the frame as unchanged, which keeps the video in sync but shows the previous frame again.");
+
     Pstring = secprop->Add_string("capture chroma format", Property::Changeable::OnlyAtStart,"auto");
     Pstring->Set_values(capturechromaformats);
     Pstring->Set_help("Chroma format to use when capturing to H.264. 'auto' picks the best quality option.\n"
@@ -2066,6 +2099,11 @@ void DOSBOX_SetupConfigSections(void) {
     Pint->SetMinMax(1,1024);
     Pint->Set_help("Number of screen lines to process in single xBRZ scaler taskset task, affects xBRZ performance, 16 is the default");
 
+    Pint = secprop->Add_int("xbrz threads",Property::Changeable::Always,0);
+    Pint->SetMinMax(0,64);
+    Pint->Set_help("Number of threads the xBRZ scaler spreads its slices over, 0 - one per host CPU core (default), 1 - scale on the rendering thread only.\n"
+                   "Not used on Windows builds with the Microsoft Parallel Patterns Library, which schedules the slices itself.");
+
     Pint = secprop->Add_int("xbrz fixed scale factor",Property::Changeable::OnlyAtStart, 0);
     Pint->SetMinMax(0,6);
     Pint->Set_help("To use fixed xBRZ scale factor (i.e. to attune performance), set it to 2-6, 0 - use automatic calculation (default)");
@@ -2722,6 +2760,11 @@ void DOSBOX_SetupConfigSections(void) {
 		    "Default auto, which will turn if off for VGA modes and turn it on for SVGA modes.");
     Pstring->SetBasic(true);
 
+    Pbool = secprop->Add_bool("render frame at once",Property::Changeable::Always,false);
+    Pbool->Set_help("If set, and the frame is rendered at vsync by 'scanline render on demand', SVGA modes drawn straight from\n"
+		    "linear video memory are converted and scaled on a separate thread while emulation carries on with the next frame.\n"
+		    "Palette and register changes in the middle of a frame then apply to the whole frame.");
+
     secprop=control->AddSection_prop("vsync",&Null_Init,true);//done
 
     Pstring = secprop->Add_string("vsyncmode",Property::Changeable::WhenIdle,"off");
@@ -2835,6 +2878,11 @@ void DOSBOX_SetupConfigSections(void) {
             "According to forum discussions, setting this to 1 can aid debugging, however doing so also causes\n"
             "problems with 32-bit protected mode DOS games and reduces the performance of the dynamic core.\n");
 
+    Pint = secprop->Add_int("dynamic core cache size",Property::Changeable::OnlyAtStart,8);
+    Pint->SetMinMax(2,64);
+    Pint->Set_help("Size in MB of the code cache of the dynamic_rec core (the default value is 8). Programs that run a lot of\n"
+            "different code, such as Windows 9x, spend less time translating code again with a larger cache.\n");
+
     Pstring = secprop->Add_string("cputype",Property::Changeable::Always,"auto");
     Pstring->Set_values(cputype_values);
     Pstring->Set_help("CPU Type used in emulation. \"auto\" emulates a 486 which tolerates Pentium instructions.\n"
@@ -3126,6 +3174,11 @@ void DOSBOX_SetupConfigSections(void) {
                     "Otherwise, the memory size will be the standard 4MB (2MB front buffer + 1x2MB texture unit)");
     Pbool->SetBasic(true);
 
+    Pint = secprop->Add_int("voodoo_threads",Property::Changeable::OnlyAtStart,0);
+    Pint->SetMinMax(0,64);
+    Pint->Set_help("Number of additional threads the software Voodoo rasterizer splits large triangles and fast fills across.\n"
+                   "0 (default) draws everything on the emulation thread. Not used while rendering through OpenGL.");
+
 	Pbool = secprop->Add_bool("glide",Property::Changeable::WhenIdle,false);
 	Pbool->Set_help("Enable Glide emulation (Glide API passthrough to the host).\n"
                     "Requires a Glide wrapper - glide2x.dll (Windows), libglide2x.so (Linux), or libglide2x.dylib (macOS).");
@@ -3172,6 +3225,10 @@ void DOSBOX_SetupConfigSections(void) {
     Pint->Set_help("How many milliseconds of data to keep on top of the blocksize.");
     Pint->SetBasic(true);
 
+    Pbool = secprop->Add_bool("mixer thread",Property::Changeable::OnlyAtStart,false);
+    Pbool->Set_help("Do the master volume, the audio output and the wave/video capture on a separate thread, fed through lock-free buffers.\n"
+                    "The sound output then never waits for the emulation, which may allow a smaller blocksize and prebuffer without stuttering.");
+
     secprop=control->AddSection_prop("midi",&Null_Init,true);//done
 
     Pstring = secprop->Add_string("mpu401",Property::Changeable::WhenIdle,"intelligent");
@@ -4270,6 +4327,31 @@ void DOSBOX_SetupConfigSections(void) {
                    "The disk I/O performance as in DOSBox SVN can be achieved by setting this to 0.");
     Pint->SetBasic(true);
 
+    Pstring = secprop->Add_string("hard drive image io",Property::Changeable::WhenIdle,"auto");
+    Pstring->Set_values(disk_image_io_settings);
+    Pstring->Set_help("How raw disk images are read and written. \"stdio\" works everywhere, \"pread\" reads the file directly and\n"
+                      "can read ahead on a separate thread, \"mmap\" maps the whole image into memory (64-bit hosts).\n"
+                      "\"auto\" uses pread where available. Applies to images mounted after the change.");
+
+    Pint = secprop->Add_int("hard drive image cache size",Property::Changeable::WhenIdle,8192);
+    Pint->SetMinMax(0,1048576);
+    Pint->Set_help("Size in KB of the block cache for each raw hard disk image, or 0 to read and write the image file directly.\n"
+                   "Not used with \"hard drive image io=mmap\". Applies to images mounted after the change.");
+
+    Pint = secprop->Add_int("hard drive image read ahead",Property::Changeable::WhenIdle,256);
+    Pint->SetMinMax(0,1024);
+    Pint->Set_help("How many KB of a raw hard disk image to read ahead of the guest once it reads the image sequentially, or 0 for none.");
+
+    Pint = secprop->Add_int("chd image read ahead",Property::Changeable::WhenIdle,8);
+    Pint->SetMinMax(0,256);
+    Pint->Set_help("How many hunks of a CHD CD image to decode ahead of the guest, or 0 to decode each hunk when it is read.\n"
+                   "A CD hunk holds 8 sectors. Applies to images mounted after the change.");
+
+    Pint = secprop->Add_int("chd image decoder threads",Property::Changeable::WhenIdle,2);
+    Pint->SetMinMax(0,16);
+    Pint->Set_help("Number of threads decoding CHD CD image hunks ahead of the guest, or 0 to decode them on the emulation thread.\n"
+                   "Applies to images mounted after the change.");
+
     Pstring = secprop->Add_string("special operation file prefix",Property::Changeable::OnlyAtStart,".DB");
     Pstring->Set_help("The file prefix used by DOSBox-X's special operations on mounted local/overlay drives. It is fixed to \"DB\" in mainline DOSBox.");
 
@@ -4831,6 +4913,13 @@ void DOSBOX_SetupConfigSections(void) {
                 "In this way, you can have DOSBox-X emulate one of the strange quirks of 1995-1997 era\n"
                 "laptop hardware");
 
+        Pbool = secprop->Add_bool("pci bus master",Property::Changeable::OnlyAtStart,false);
+        if (i == 0) Pbool->Set_help(
+                "If set, and the PCI bus is enabled, the primary and secondary IDE interfaces appear as the\n"
+                "bus master IDE function of an Intel PIIX3 on the PCI bus. Hard disks on them then support\n"
+                "READ/WRITE DMA, which guest drivers can use to move whole transfers to and from memory\n"
+                "instead of going through the data port a word at a time. Has no effect on other interfaces.");
+
         Pint = secprop->Add_int("cd-rom spinup time",Property::Changeable::WhenIdle,0/*use IDE or CD-ROM default*/);
         if (i == 0) Pint->Set_help("Emulated CD-ROM time in ms to spin up if CD is stationary.\n"
                 "Set to 0 to use controller or CD-ROM drive-specific default.");
@@ -697,6 +697,7 @@ static const char *def_menu_capture[] =
     "saveoptionmenu",
     "mapper_savestate",
     "mapper_loadstate",
+    "mapper_rewindstate",
     "saveslotmenu",
     "autosavecfg",
     "browsesavefile",
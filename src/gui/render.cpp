@@ -308,6 +308,35 @@ static void RENDER_FinishLineHandler(const void * s) {
 }
 
 
+/* The line the VGA emulation is about to draw is the same as the one drawn at this position the last
+ * time a frame was rendered. Unless the renderer needs the pixels anyway, account for it without
+ * converting it again: the start line handler takes NULL as an unchanged line, and the scaler finds
+ * nothing to do when handed back its own cached copy. Returns false if the line must be drawn. */
+bool RENDER_DrawLineUnchanged(void) {
+    if (RENDER_DrawLine == RENDER_StartLineHandler
+#if defined(C_SCALER_FULL_LINE)
+        || RENDER_DrawLine == RENDER_DrawLine_countdown_wait
+#endif
+        ) {
+        RENDER_DrawLine(NULL);
+        return true;
+    }
+    if (RENDER_DrawLine == render.scale.lineHandler || RENDER_DrawLine == RENDER_FinishLineHandler
+#if defined(C_SCALER_FULL_LINE)
+        || RENDER_DrawLine == RENDER_DrawLine_countdown
+#endif
+        ) {
+        RENDER_DrawLine(render.scale.cacheRead);
+        return true;
+    }
+    return false;
+}
+
+/* true if lines handed to RENDER_DrawLine() are kept in the scaler cache */
+bool RENDER_DrawLineCached(void) {
+    return render.updating && RENDER_DrawLine != RENDER_EmptyLineHandler;
+}
+
 static void RENDER_ClearCacheHandler(const void * src) {
     Bitu x, width;
     uint32_t *srcLine, *cacheLine;
@@ -368,6 +397,7 @@ bool RENDER_StartUpdate(void) {
 }
 
 static void RENDER_Halt( void ) {
+    VGA_RenderFrameWait();
     RENDER_DrawLine = RENDER_EmptyLineHandler;
     GFX_EndUpdate( 0 );
     render.updating=false;
@@ -472,6 +502,8 @@ std::string RENDER_GetScaler(void) {
 }
 
 void RENDER_Reset( void ) {
+    VGA_RenderFrameWait();
+
     Bitu width=render.src.width;
     Bitu height=render.src.height;
     bool dblw=render.src.dblw;
@@ -858,6 +890,7 @@ forcenormal:
 }
 
 void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
+    VGA_RenderFrameWait();
     if (function == GFX_CallBackStop) {
         RENDER_Halt( ); 
         return;
@@ -50,6 +50,21 @@
 
 #include <map>
 
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# include <chrono>
+# include <condition_variable>
+# include <deque>
+# include <mutex>
+# include <thread>
+/* With "mixer thread" the audio of the captures arrives on the mixer thread while the
+ * emulation thread starts and stops them and moves the audio into the video file */
+static std::mutex capture_audio_mutex;
+# define CAPTURE_AUDIO_LOCK std::lock_guard<std::mutex> capture_audio_guard(capture_audio_mutex)
+# define CAPTURE_THREADS
+#else
+# define CAPTURE_AUDIO_LOCK do { } while (0)
+#endif
+
 #if (C_AVCODEC)
 extern "C" {
 #include <libavutil/pixfmt.h>
@@ -69,6 +84,8 @@ extern "C" {
 
 bool video_debug_overlay = false;
 bool skip_encoding_unchanged_frames = false, show_recorded_filename = true;
+int capture_encoder_queue = 3;
+bool capture_queue_drop = false;
 std::string pathvid = "", pathwav = "", pathmtw = "", pathmid = "", pathopl = "", pathscr = "", pathprt = "", pathpcap = "";
 bool systemmessagebox(char const * aTitle, char const * aMessage, char const * aDialogType, char const * aIconType, int aDefaultButton);
 
@@ -341,7 +358,17 @@ extern std::string savefilename;
 extern bool showdbcs, use_save_file, noremark_save_state, force_load_state;
 extern unsigned int hostkeyalt, sendkeymap;
 extern const char* RunningProgram;
-Bitu CaptureState = 0;
+/* atomic because CAPTURE_AddWave() clears CAPTURE_WAVE on the mixer thread when the file
+ * cannot be written, while the emulation thread reads and changes the other bits */
+std::atomic<Bitu> CaptureState(0);
+
+void CAPTURE_SetState(Bitu bits) {
+	CaptureState |= bits;
+}
+
+void CAPTURE_ClearState(Bitu bits) {
+	CaptureState &= ~bits;
+}
 
 void OPL_SaveRawEvent(bool pressed), SetGameState_Run(int value), ResolvePath(std::string& in);
 
@@ -633,6 +660,314 @@ FILE * OpenCaptureFile(const char * type,const char * ext) {
 }
 
 #if (C_SSHOT)
+#ifdef PNG_pHYs_SUPPORTED
+static inline unsigned long math_gcd_png_uint_32(const png_uint_32 a,const png_uint_32 b) {
+        if (b) return math_gcd_png_uint_32(b,a%b);
+        return a;
+}
+#endif
+
+/* Background encoder for video frames and screenshots.
+ *
+ * CAPTURE_AddImage only copies the rows of a frame (doubled where needed) into a job, along
+ * with the palette and the audio that goes with the frame. The encoder thread then runs the
+ * ZMBV compression and writes the AVI chunks, or writes the PNG, in the order the jobs were
+ * queued. At most "capture encoder queue" frames or screenshots wait at a time. When that
+ * many are waiting, a video frame either waits for the encoder too or, with "capture queue
+ * full=drop", goes into the file as an unchanged frame so that the video keeps its timing.
+ * Screenshots always wait. Jobs for unchanged frames carry no pixels and never wait.
+ *
+ * The AVI writer, the codec and its buffer belong to the encoder while jobs are queued:
+ * CAPTURE_DrainEncoder has to be called before the emulation thread touches them. Without
+ * threads, or with a queue of 0, jobs run right away on the emulation thread. */
+struct capture_job {
+	enum type_t { VIDEO_FRAME, VIDEO_SAME, SCREENSHOT } type = VIDEO_FRAME;
+	int			codecFlags = 0;
+	zmbv_format_t	format = ZMBV_FORMAT_NONE;
+	Bitu		width = 0, height = 0, bpp = 0;
+	Bitu		rowlen = 0;			/* bytes in each row of pixels */
+	uint8_t		pal[256*4];
+	std::vector<uint8_t> pixels;	/* height rows of rowlen bytes */
+	std::vector<int16_t> audio;		/* stereo samples to write after the frame */
+	FILE*		fp = NULL;			/* SCREENSHOT */
+	std::string	path;				/* SCREENSHOT, for the log */
+};
+
+static struct {
+	std::vector<capture_job*> free_jobs;
+	bool			failed = false;		/* a frame could not be compressed */
+
+	struct {
+		uint64_t	frames = 0;			/* frames and screenshots handed to the encoder */
+		uint64_t	waited = 0;			/* ... that had to wait for a free slot */
+		uint64_t	dropped = 0;		/* frames written as unchanged because the queue was full */
+		uint64_t	wait_us = 0;
+		unsigned int	max_queued = 0;
+	} stats;
+
+#ifdef CAPTURE_THREADS
+	std::thread		worker;
+	std::mutex		lock;
+	std::condition_variable	wake;		/* a new job, or quit */
+	std::condition_variable	done;		/* a job is finished */
+	std::deque<capture_job*> queue;
+	unsigned int	queued = 0;			/* jobs with pixels, queued or being encoded */
+	unsigned int	busy = 0;			/* jobs queued or being encoded */
+	bool			quit = false;
+#endif
+} capture_encoder;
+
+static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, uint32_t flags, unsigned int streamindex);
+
+/* returns false, after logging it, if the screenshot could not be written */
+static bool CAPTURE_WritePNG(capture_job *job) {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_color palette[256];
+	bool ok;
+
+	/* First try to allocate the png structures */
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,NULL, NULL);
+	if (!png_ptr) {
+		fclose(job->fp);
+		LOG_MSG("Failed to write screenshot %s: out of memory",job->path.c_str());
+		return false;
+	}
+	info_ptr = png_create_info_struct(png_ptr);
+	if (!info_ptr) {
+		png_destroy_write_struct(&png_ptr,(png_infopp)NULL);
+		fclose(job->fp);
+		LOG_MSG("Failed to write screenshot %s: out of memory",job->path.c_str());
+		return false;
+	}
+
+	/* Finalize the initing of png library */
+	png_init_io(png_ptr, job->fp);
+	png_set_compression_level(png_ptr,Z_BEST_COMPRESSION);
+
+	/* set other zlib parameters */
+	png_set_compression_mem_level(png_ptr, 8);
+	png_set_compression_strategy(png_ptr,Z_DEFAULT_STRATEGY);
+	png_set_compression_window_bits(png_ptr, 15);
+	png_set_compression_method(png_ptr, 8);
+	png_set_compression_buffer_size(png_ptr, 8192);
+
+#ifdef PNG_pHYs_SUPPORTED
+	if (job->width >= 8 && job->height >= 8) {
+		png_uint_32 x=0,y=0,g;
+		x = (png_uint_32)(4 * job->height);
+		y = (png_uint_32)(3 * job->width);
+		g = math_gcd_png_uint_32(x,y);
+		png_set_pHYs(png_ptr, info_ptr, x/g, y/g, PNG_RESOLUTION_UNKNOWN);
+	}
+#endif
+
+	if (job->bpp==8) {
+		png_set_IHDR(png_ptr, info_ptr, (png_uint_32)job->width, (png_uint_32)job->height,
+			8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		for (Bitu i=0;i<256;i++) {
+			palette[i].red=job->pal[i*4+0];
+			palette[i].green=job->pal[i*4+1];
+			palette[i].blue=job->pal[i*4+2];
+		}
+		png_set_PLTE(png_ptr, info_ptr, palette,256);
+	} else {
+		png_set_bgr( png_ptr );
+		png_set_IHDR(png_ptr, info_ptr, (png_uint_32)job->width, (png_uint_32)job->height,
+			8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	}
+#ifdef PNG_TEXT_SUPPORTED
+	int fields = 1;
+	png_text text[1] = {};
+	const char* text_s = "DOSBox-X " VERSION;
+	size_t strl = strlen(text_s);
+	char* ptext_s = new char[strl + 1];
+	strcpy(ptext_s, text_s);
+	char software[9] = { 'S','o','f','t','w','a','r','e',0};
+	text[0].compression = PNG_TEXT_COMPRESSION_NONE;
+	text[0].key  = software;
+	text[0].text = ptext_s;
+	png_set_text(png_ptr, info_ptr, text, fields);
+#endif
+	png_write_info(png_ptr, info_ptr);
+#ifdef PNG_TEXT_SUPPORTED
+	delete [] ptext_s;
+#endif
+	for (Bitu i=0;i<job->height;i++)
+		png_write_row(png_ptr, (png_bytep)&job->pixels[i*job->rowlen]);
+	/* Finish writing */
+	png_write_end(png_ptr, 0);
+	/*Destroy PNG structs*/
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	/*close file*/
+	ok = !ferror(job->fp);
+	if (fclose(job->fp) != 0) ok = false;
+	if (!ok) LOG_MSG("Failed to write screenshot %s",job->path.c_str());
+	return ok;
+}
+
+/* returns false if the frame could not be compressed */
+static bool CAPTURE_RunJob(capture_job *job) {
+	bool ok = true;
+
+	switch (job->type) {
+	case capture_job::SCREENSHOT:
+		/* a screenshot that fails is logged, it does not stop the video */
+		CAPTURE_WritePNG(job);
+		return true;
+	case capture_job::VIDEO_FRAME:
+		if (!capture.video.codec->PrepareCompressFrame( job->codecFlags, job->format, (char *)job->pal, capture.video.buf, capture.video.bufSize)) {
+			ok = false;
+			break;
+		}
+		for (Bitu i=0;i<job->height;i++) {
+			void *rowPointer = &job->pixels[i*job->rowlen];
+			capture.video.codec->CompressLines( 1, &rowPointer );
+		}
+		{
+			int written = capture.video.codec->FinishCompressFrame();
+			if (written < 0) {
+				ok = false;
+				break;
+			}
+			CAPTURE_AddAviChunk( "00dc", (uint32_t)written, capture.video.buf, (uint32_t)(job->codecFlags & 1 ? 0x10 : 0x0), 0u);
+		}
+		break;
+	case capture_job::VIDEO_SAME:
+		/* write null non-keyframe */
+		CAPTURE_AddAviChunk( "00dc", (uint32_t)0, capture.video.buf, (uint32_t)(0x0), 0u);
+		break;
+	}
+
+	if (ok && !job->audio.empty())
+		CAPTURE_AddAviChunk( "01wb", (uint32_t)(job->audio.size() * 2u), job->audio.data(), /*keyframe*/0x10u, 1u);
+	return ok;
+}
+
+#ifdef CAPTURE_THREADS
+static void CAPTURE_EncoderThread(void) {
+	std::unique_lock<std::mutex> guard(capture_encoder.lock);
+	for (;;) {
+		capture_encoder.wake.wait(guard, [] { return capture_encoder.quit || !capture_encoder.queue.empty(); });
+		if (capture_encoder.queue.empty()) return;
+
+		capture_job *job = capture_encoder.queue.front();
+		capture_encoder.queue.pop_front();
+		const bool skip = capture_encoder.failed && job->type != capture_job::SCREENSHOT;
+		guard.unlock();
+
+		bool ok = true;
+		if (!skip) ok = CAPTURE_RunJob(job);
+
+		guard.lock();
+		if (!ok) capture_encoder.failed = true;
+		if (job->type != capture_job::VIDEO_SAME) capture_encoder.queued--;
+		capture_encoder.busy--;
+		capture_encoder.free_jobs.push_back(job);
+		capture_encoder.done.notify_all();
+	}
+}
+#endif
+
+/* a job for a frame or screenshot with pixels (or, if !pixels, for an unchanged frame), or
+ * NULL if the queue is full and the frame is to be dropped */
+static capture_job *CAPTURE_GetJob(bool pixels, bool may_drop) {
+	capture_job *job;
+#ifdef CAPTURE_THREADS
+	std::unique_lock<std::mutex> guard(capture_encoder.lock);
+	if (pixels && capture_encoder_queue > 0) {
+		capture_encoder.stats.frames++;
+		if (capture_encoder.queued >= (unsigned int)capture_encoder_queue) {
+			if (may_drop) {
+				capture_encoder.stats.dropped++;
+				return NULL;
+			}
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			capture_encoder.done.wait(guard, [] { return capture_encoder.queued < (unsigned int)capture_encoder_queue; });
+			capture_encoder.stats.waited++;
+			capture_encoder.stats.wait_us += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+#else
+	(void)pixels;
+	(void)may_drop;
+#endif
+	if (capture_encoder.free_jobs.empty()) {
+		job = new capture_job;
+	} else {
+		job = capture_encoder.free_jobs.back();
+		capture_encoder.free_jobs.pop_back();
+	}
+	return job;
+}
+
+/* give a job that has been run back to the pool */
+static void CAPTURE_FreeJob(capture_job *job) {
+#ifdef CAPTURE_THREADS
+	std::lock_guard<std::mutex> guard(capture_encoder.lock);
+#endif
+	capture_encoder.free_jobs.push_back(job);
+}
+
+/* true if queued jobs run on the encoder thread rather than right away */
+static bool CAPTURE_EncoderThreaded(void) {
+#ifdef CAPTURE_THREADS
+	return capture_encoder_queue > 0;
+#else
+	return false;
+#endif
+}
+
+/* hand the job to the encoder; returns false if it or an earlier frame could not be compressed */
+static bool CAPTURE_QueueJob(capture_job *job) {
+#ifdef CAPTURE_THREADS
+	if (capture_encoder_queue > 0) {
+		std::lock_guard<std::mutex> guard(capture_encoder.lock);
+		if (!capture_encoder.worker.joinable()) {
+			capture_encoder.quit = false;
+			capture_encoder.worker = std::thread(CAPTURE_EncoderThread);
+		}
+		if (job->type != capture_job::VIDEO_SAME) capture_encoder.queued++;
+		capture_encoder.busy++;
+		if (capture_encoder.queued > capture_encoder.stats.max_queued) capture_encoder.stats.max_queued = capture_encoder.queued;
+		capture_encoder.queue.push_back(job);
+		capture_encoder.wake.notify_one();
+		return !capture_encoder.failed;
+	}
+#endif
+	if (!CAPTURE_RunJob(job)) capture_encoder.failed = true;
+	CAPTURE_FreeJob(job);
+	return !capture_encoder.failed;
+}
+
+/* wait until everything queued is written; returns false if a frame could not be compressed */
+static bool CAPTURE_DrainEncoder(void) {
+#ifdef CAPTURE_THREADS
+	std::unique_lock<std::mutex> guard(capture_encoder.lock);
+	capture_encoder.done.wait(guard, [] { return capture_encoder.busy == 0; });
+#endif
+	const bool ok = !capture_encoder.failed;
+	capture_encoder.failed = false;
+	return ok;
+}
+
+static void CAPTURE_StopEncoder(void) {
+#ifdef CAPTURE_THREADS
+	{
+		std::lock_guard<std::mutex> guard(capture_encoder.lock);
+		capture_encoder.quit = true;
+	}
+	capture_encoder.wake.notify_all();
+	if (capture_encoder.worker.joinable()) capture_encoder.worker.join();
+#endif
+	for (size_t i = 0; i < capture_encoder.free_jobs.size(); i++)
+		delete capture_encoder.free_jobs[i];
+	capture_encoder.free_jobs.clear();
+	capture_encoder.failed = false;
+}
+
 static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, uint32_t flags, unsigned int streamindex) {
     (void)tag;//UNUSED
 	if (capture.video.writer != NULL) {
@@ -654,7 +989,7 @@ void CAPTURE_VideoEvent(bool pressed) {
 		return;
 	if (CaptureState & CAPTURE_VIDEO) {
 		/* Close the video */
-		CaptureState &= ~((unsigned int)CAPTURE_VIDEO);
+		CAPTURE_ClearState(CAPTURE_VIDEO);
 		LOG_MSG("Stopped capturing video.");	
 
 #if defined(USE_TTF)
@@ -662,10 +997,20 @@ void CAPTURE_VideoEvent(bool pressed) {
 			ttf_switch_on();
 #endif
 		if (capture.video.writer != NULL) {
-			if ( capture.video.audioused ) {
-				CAPTURE_AddAviChunk( "01wb", (uint32_t)(capture.video.audioused * 4), capture.video.audiobuf, 0x10, 1);
-				capture.video.audiowritten = capture.video.audioused*4;
-				capture.video.audioused = 0;
+			if (!CAPTURE_DrainEncoder())
+				LOG_MSG("Video capture: a frame could not be compressed");
+			if (capture_encoder.stats.frames != 0)
+				LOG_MSG("Video capture: %llu frames and screenshots encoded in the background, %llu waited for the encoder (%.1f ms in total), %llu dropped, up to %u queued",
+					(unsigned long long)capture_encoder.stats.frames, (unsigned long long)capture_encoder.stats.waited,
+					(double)capture_encoder.stats.wait_us / 1000.0, (unsigned long long)capture_encoder.stats.dropped, capture_encoder.stats.max_queued);
+			capture_encoder.stats = {};
+			{
+				CAPTURE_AUDIO_LOCK;
+				if ( capture.video.audioused ) {
+					CAPTURE_AddAviChunk( "01wb", (uint32_t)(capture.video.audioused * 4), capture.video.audiobuf, 0x10, 1);
+					capture.video.audiowritten = capture.video.audioused*4;
+					capture.video.audioused = 0;
+				}
 			}
 
 			avi_writer_end_data(capture.video.writer);
@@ -691,7 +1036,7 @@ void CAPTURE_VideoEvent(bool pressed) {
 			capture.video.codec = NULL;
 		}
 	} else {
-		CaptureState |= CAPTURE_VIDEO;
+		CAPTURE_SetState(CAPTURE_VIDEO);
 	}
 
 	pathvid = "";
@@ -794,17 +1139,9 @@ void CAPTURE_VideoStop() {
 #endif
 }
 
-#ifdef PNG_pHYs_SUPPORTED
-static inline unsigned long math_gcd_png_uint_32(const png_uint_32 a,const png_uint_32 b) {
-        if (b) return math_gcd_png_uint_32(b,a%b);
-        return a;
-}
-#endif
-
 void CAPTURE_AddImage(Bitu width, Bitu height, Bitu bpp, Bitu pitch, Bitu flags, float fps, uint8_t * data, uint8_t * pal) {
 #if (C_SSHOT)
 	Bitu i;
-	uint8_t doubleRow[SCALER_MAXWIDTH*4];
 	Bitu countWidth = width;
 
 	if (flags & CAPTURE_FLAG_DBLH)
@@ -818,156 +1155,104 @@ void CAPTURE_AddImage(Bitu width, Bitu height, Bitu bpp, Bitu pitch, Bitu flags,
 		return;
 	
 	if (CaptureState & CAPTURE_IMAGE) {
-		png_structp png_ptr;
-		png_infop info_ptr;
-		png_color palette[256];
+		capture_job *job;
 
-		CaptureState &= ~((unsigned int)CAPTURE_IMAGE);
+		CAPTURE_ClearState(CAPTURE_IMAGE);
 		/* Open the actual file */
 		FILE * fp=OpenCaptureFile("Screenshot",".png");
 		if (!fp) goto skip_shot;
-		/* First try to allocate the png structures */
-		png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,NULL, NULL);
-		if (!png_ptr) goto skip_shot;
-		info_ptr = png_create_info_struct(png_ptr);
-		if (!info_ptr) {
-			png_destroy_write_struct(&png_ptr,(png_infopp)NULL);
-			goto skip_shot;
-		}
-	
-		/* Finalize the initing of png library */
-		png_init_io(png_ptr, fp);
-		png_set_compression_level(png_ptr,Z_BEST_COMPRESSION);
-		
-		/* set other zlib parameters */
-		png_set_compression_mem_level(png_ptr, 8);
-		png_set_compression_strategy(png_ptr,Z_DEFAULT_STRATEGY);
-		png_set_compression_window_bits(png_ptr, 15);
-		png_set_compression_method(png_ptr, 8);
-		png_set_compression_buffer_size(png_ptr, 8192);
 
-#ifdef PNG_pHYs_SUPPORTED
-		if (width >= 8 && height >= 8) {
-			png_uint_32 x=0,y=0,g;
-			x = (png_uint_32)(4 * height);
-			y = (png_uint_32)(3 * width);
-			g = math_gcd_png_uint_32(x,y);
-			png_set_pHYs(png_ptr, info_ptr, x/g, y/g, PNG_RESOLUTION_UNKNOWN);
-		}
-#endif
+		/* the rows are converted here, the encoder compresses and writes them */
+		job = CAPTURE_GetJob(true, false);
+		job->type = capture_job::SCREENSHOT;
+		job->fp = fp;
+		job->path = pathscr;
+		job->width = width;
+		job->height = height;
+		job->bpp = bpp;
+		job->rowlen = (bpp == 8) ? width : width * 3;
+		job->pixels.resize(job->rowlen * height);
+		job->audio.clear();
+		if (bpp == 8) memcpy(job->pal, pal, sizeof(job->pal));
 
-		if (bpp==8) {
-			png_set_IHDR(png_ptr, info_ptr, (png_uint_32)width, (png_uint_32)height,
-				8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-				PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-			for (i=0;i<256;i++) {
-				palette[i].red=pal[i*4+0];
-				palette[i].green=pal[i*4+1];
-				palette[i].blue=pal[i*4+2];
-			}
-			png_set_PLTE(png_ptr, info_ptr, palette,256);
-		} else {
-			png_set_bgr( png_ptr );
-			png_set_IHDR(png_ptr, info_ptr, (png_uint_32)width, (png_uint_32)height,
-				8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-				PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-		}
-#ifdef PNG_TEXT_SUPPORTED
-		int fields = 1;
-		png_text text[1] = {};
-		const char* text_s = "DOSBox-X " VERSION;
-		size_t strl = strlen(text_s);
-		char* ptext_s = new char[strl + 1];
-		strcpy(ptext_s, text_s);
-		char software[9] = { 'S','o','f','t','w','a','r','e',0};
-		text[0].compression = PNG_TEXT_COMPRESSION_NONE;
-		text[0].key  = software;
-		text[0].text = ptext_s;
-		png_set_text(png_ptr, info_ptr, text, fields);
-#endif
-		png_write_info(png_ptr, info_ptr);
-#ifdef PNG_TEXT_SUPPORTED
-		delete [] ptext_s;
-#endif
 		for (i=0;i<height;i++) {
-			void *rowPointer;
+			uint8_t *row = &job->pixels[i*job->rowlen];
 			void *srcLine;
 			if (flags & CAPTURE_FLAG_DBLH)
 				srcLine=(data+(i >> 1)*pitch);
 			else
 				srcLine=(data+(i >> 0)*pitch);
-			rowPointer=srcLine;
 			switch (bpp) {
-			case 8:
-				if (flags & CAPTURE_FLAG_DBLW) {
-   					for (Bitu x=0;x<countWidth;x++)
-						doubleRow[x*2+0] =
-						doubleRow[x*2+1] = ((uint8_t *)srcLine)[x];
-					rowPointer = doubleRow;
-				}
-				break;
 			case 15:
 				if (flags & CAPTURE_FLAG_DBLW) {
 					for (Bitu x=0;x<countWidth;x++) {
 						Bitu pixel = ((uint16_t *)srcLine)[x];
-						doubleRow[x*6+0] = doubleRow[x*6+3] = ((pixel& 0x001f) * 0x21) >>  2;
-						doubleRow[x*6+1] = doubleRow[x*6+4] = (uint8_t)(((pixel& 0x03e0) * 0x21) >> 7);
-						doubleRow[x*6+2] = doubleRow[x*6+5] = ((pixel& 0x7c00) * 0x21) >>  12;
+						row[x*6+0] = row[x*6+3] = ((pixel& 0x001f) * 0x21) >>  2;
+						row[x*6+1] = row[x*6+4] = (uint8_t)(((pixel& 0x03e0) * 0x21) >> 7);
+						row[x*6+2] = row[x*6+5] = ((pixel& 0x7c00) * 0x21) >>  12;
 					}
 				} else {
 					for (Bitu x=0;x<countWidth;x++) {
 						Bitu pixel = ((uint16_t *)srcLine)[x];
-						doubleRow[x*3+0] = ((pixel& 0x001f) * 0x21) >>  2;
-						doubleRow[x*3+1] = (uint8_t)(((pixel& 0x03e0) * 0x21) >> 7);
-						doubleRow[x*3+2] = ((pixel& 0x7c00) * 0x21) >>  12;
+						row[x*3+0] = ((pixel& 0x001f) * 0x21) >>  2;
+						row[x*3+1] = (uint8_t)(((pixel& 0x03e0) * 0x21) >> 7);
+						row[x*3+2] = ((pixel& 0x7c00) * 0x21) >>  12;
 					}
 				}
-				rowPointer = doubleRow;
 				break;
 			case 16:
 				if (flags & CAPTURE_FLAG_DBLW) {
 					for (Bitu x=0;x<countWidth;x++) {
 						Bitu pixel = ((uint16_t *)srcLine)[x];
-						doubleRow[x*6+0] = doubleRow[x*6+3] = ((pixel& 0x001f) * 0x21) >> 2;
-						doubleRow[x*6+1] = doubleRow[x*6+4] = ((pixel& 0x07e0) * 0x41) >> 9;
-						doubleRow[x*6+2] = doubleRow[x*6+5] = ((pixel& 0xf800) * 0x21) >> 13;
+						row[x*6+0] = row[x*6+3] = ((pixel& 0x001f) * 0x21) >> 2;
+						row[x*6+1] = row[x*6+4] = ((pixel& 0x07e0) * 0x41) >> 9;
+						row[x*6+2] = row[x*6+5] = ((pixel& 0xf800) * 0x21) >> 13;
 					}
 				} else {
 					for (Bitu x=0;x<countWidth;x++) {
 						Bitu pixel = ((uint16_t *)srcLine)[x];
-						doubleRow[x*3+0] = ((pixel& 0x001f) * 0x21) >>  2;
-						doubleRow[x*3+1] = ((pixel& 0x07e0) * 0x41) >>  9;
-						doubleRow[x*3+2] = ((pixel& 0xf800) * 0x21) >>  13;
+						row[x*3+0] = ((pixel& 0x001f) * 0x21) >>  2;
+						row[x*3+1] = ((pixel& 0x07e0) * 0x41) >>  9;
+						row[x*3+2] = ((pixel& 0xf800) * 0x21) >>  13;
 					}
 				}
-				rowPointer = doubleRow;
 				break;
 			case 32:
 				if (flags & CAPTURE_FLAG_DBLW) {
 					for (Bitu x=0;x<countWidth;x++) {
-						doubleRow[x*6+0] = doubleRow[x*6+3] = ((uint8_t *)srcLine)[x*4+0];
-						doubleRow[x*6+1] = doubleRow[x*6+4] = ((uint8_t *)srcLine)[x*4+1];
-						doubleRow[x*6+2] = doubleRow[x*6+5] = ((uint8_t *)srcLine)[x*4+2];
+						row[x*6+0] = row[x*6+3] = ((uint8_t *)srcLine)[x*4+0];
+						row[x*6+1] = row[x*6+4] = ((uint8_t *)srcLine)[x*4+1];
+						row[x*6+2] = row[x*6+5] = ((uint8_t *)srcLine)[x*4+2];
 					}
 				} else {
 					for (Bitu x=0;x<countWidth;x++) {
-						doubleRow[x*3+0] = ((uint8_t *)srcLine)[x*4+0];
-						doubleRow[x*3+1] = ((uint8_t *)srcLine)[x*4+1];
-						doubleRow[x*3+2] = ((uint8_t *)srcLine)[x*4+2];
+						row[x*3+0] = ((uint8_t *)srcLine)[x*4+0];
+						row[x*3+1] = ((uint8_t *)srcLine)[x*4+1];
+						row[x*3+2] = ((uint8_t *)srcLine)[x*4+2];
 					}
 				}
-				rowPointer = doubleRow;
+				break;
+			default:
+				if (bpp == 8 && (flags & CAPTURE_FLAG_DBLW)) {
+   					for (Bitu x=0;x<countWidth;x++)
+						row[x*2+0] =
+						row[x*2+1] = ((uint8_t *)srcLine)[x];
+				} else {
+					memcpy(row, srcLine, job->rowlen);
+				}
 				break;
 			}
-			png_write_row(png_ptr, (png_bytep)rowPointer);
 		}
-		/* Finish writing */
-		png_write_end(png_ptr, 0);
-		/*Destroy PNG structs*/
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		/*close file*/
-		fclose(fp);
-		if (show_recorded_filename && pathscr.size()) systemmessagebox("Recording completed",("Saved screenshot to the file:\n\n"+pathscr).c_str(),"ok", "info", 1);
+		if (CAPTURE_EncoderThreaded()) {
+			/* written later on the encoder thread, which logs it if that fails */
+			CAPTURE_QueueJob(job);
+			if (show_recorded_filename && pathscr.size()) systemmessagebox("Saving screenshot",("Saving screenshot to the file:\n\n"+pathscr).c_str(),"ok", "info", 1);
+		}
+		else {
+			const bool saved = CAPTURE_WritePNG(job);
+			CAPTURE_FreeJob(job);
+			if (saved && show_recorded_filename && pathscr.size()) systemmessagebox("Recording completed",("Saved screenshot to the file:\n\n"+pathscr).c_str(),"ok", "info", 1);
+		}
 
 	}
 	pathscr = "";
@@ -1002,7 +1287,7 @@ skip_shot:
 #endif
 		}
 
-		CaptureState &= ~((unsigned int)CAPTURE_VIDEO);
+		CAPTURE_ClearState(CAPTURE_VIDEO);
 
 		switch (bpp) {
 		case 8:format = ZMBV_FORMAT_8BPP;break;
@@ -1045,8 +1330,11 @@ skip_shot:
 			capture.video.fps = fps;
 			capture.video.frames = 0;
 			capture.video.written = 0;
-			capture.video.audioused = 0;
-			capture.video.audiowritten = 0;
+			{
+				CAPTURE_AUDIO_LOCK;
+				capture.video.audioused = 0;
+				capture.video.audiowritten = 0;
+			}
 
 			riff_avih_AVIMAINHEADER *mheader = avi_writer_main_header(capture.video.writer);
 			if (mheader == NULL)
@@ -1173,8 +1461,11 @@ skip_shot:
 			capture.video.fps = fps;
 			capture.video.frames = 0;
 			capture.video.written = 0;
-			capture.video.audioused = 0;
-			capture.video.audiowritten = 0;
+			{
+				CAPTURE_AUDIO_LOCK;
+				capture.video.audioused = 0;
+				capture.video.audiowritten = 0;
+			}
 			ffmpeg_audio_sample_counter = 0;
 
 			if (!ffmpeg_init) {
@@ -1371,74 +1662,81 @@ skip_shot:
 
 		if (native_zmbv) {
 			int codecFlags;
+			capture_job *job;
 
 			if (capture.video.frames % 300 == 0)
 				codecFlags = 1;
 			else
 				codecFlags = 0;
 
-            if ((flags & CAPTURE_FLAG_NOCHANGE) && skip_encoding_unchanged_frames) {
+            bool same = (flags & CAPTURE_FLAG_NOCHANGE) && skip_encoding_unchanged_frames;
+            job = CAPTURE_GetJob(!same, capture_queue_drop);
+            if (job == NULL) {
+                /* the encoder is behind, keep the timing and show the last frame again */
+                same = true;
+                job = CAPTURE_GetJob(false, false);
+            }
+
+            if (same) {
                 /* advance unless at keyframe */
                 if (codecFlags == 0) capture.video.frames++;
 
                 /* write null non-keyframe */
-                CAPTURE_AddAviChunk( "00dc", (uint32_t)0, capture.video.buf, (uint32_t)(0x0), 0u);
+                job->type = capture_job::VIDEO_SAME;
             }
             else {
-                if (!capture.video.codec->PrepareCompressFrame( codecFlags, format, (char *)pal, capture.video.buf, capture.video.bufSize))
-                    goto skip_video;
+                job->type = capture_job::VIDEO_FRAME;
+                job->codecFlags = codecFlags;
+                job->format = format;
+                job->height = height;
+                job->rowlen = width * ((bpp + 7) / 8);
+                job->pixels.resize(job->rowlen * height);
+                if (pal != NULL) memcpy(job->pal, pal, sizeof(job->pal));
 
                 for (i=0;i<height;i++) {
-                    void * rowPointer;
+                    uint8_t *rowPointer = &job->pixels[i*job->rowlen];
+                    void *srcLine;
+                    if (flags & CAPTURE_FLAG_DBLH)
+                        srcLine=(data+(i >> 1)*pitch);
+                    else
+                        srcLine=(data+(i >> 0)*pitch);
                     if (flags & CAPTURE_FLAG_DBLW) {
-                        void *srcLine;
                         Bitu x;
                         Bitu countWidth = width >> 1;
-                        if (flags & CAPTURE_FLAG_DBLH)
-                            srcLine=(data+(i >> 1)*pitch);
-                        else
-                            srcLine=(data+(i >> 0)*pitch);
                         switch ( bpp) {
                             case 8:
                                 for (x=0;x<countWidth;x++)
-                                    ((uint8_t *)doubleRow)[x*2+0] =
-                                        ((uint8_t *)doubleRow)[x*2+1] = ((uint8_t *)srcLine)[x];
+                                    ((uint8_t *)rowPointer)[x*2+0] =
+                                        ((uint8_t *)rowPointer)[x*2+1] = ((uint8_t *)srcLine)[x];
                                 break;
                             case 15:
                             case 16:
                                 for (x=0;x<countWidth;x++)
-                                    ((uint16_t *)doubleRow)[x*2+0] =
-                                        ((uint16_t *)doubleRow)[x*2+1] = ((uint16_t *)srcLine)[x];
+                                    ((uint16_t *)rowPointer)[x*2+0] =
+                                        ((uint16_t *)rowPointer)[x*2+1] = ((uint16_t *)srcLine)[x];
                                 break;
                             case 32:
                                 for (x=0;x<countWidth;x++)
-                                    ((uint32_t *)doubleRow)[x*2+0] =
-                                        ((uint32_t *)doubleRow)[x*2+1] = ((uint32_t *)srcLine)[x];
+                                    ((uint32_t *)rowPointer)[x*2+0] =
+                                        ((uint32_t *)rowPointer)[x*2+1] = ((uint32_t *)srcLine)[x];
                                 break;
                         }
-                        rowPointer=doubleRow;
                     } else {
-                        if (flags & CAPTURE_FLAG_DBLH)
-                            rowPointer=(data+(i >> 1)*pitch);
-                        else
-                            rowPointer=(data+(i >> 0)*pitch);
+                        memcpy(rowPointer, srcLine, job->rowlen);
                     }
-                    capture.video.codec->CompressLines( 1, &rowPointer );
                 }
-
-                int written = capture.video.codec->FinishCompressFrame();
-                if (written < 0)
-                    goto skip_video;
-
-                CAPTURE_AddAviChunk( "00dc", (uint32_t)written, capture.video.buf, (uint32_t)(codecFlags & 1 ? 0x10 : 0x0), 0u);
                 capture.video.frames++;
             }
 
-			if ( capture.video.audioused ) {
-				CAPTURE_AddAviChunk( "01wb", (uint32_t)(capture.video.audioused * 4u), capture.video.audiobuf, /*keyframe*/0x10u, 1u);
+			{
+				CAPTURE_AUDIO_LOCK;
+				job->audio.assign(&capture.video.audiobuf[0][0], &capture.video.audiobuf[0][0] + capture.video.audioused * 2);
 				capture.video.audiowritten = capture.video.audioused*4;
 				capture.video.audioused = 0;
 			}
+
+			if (!CAPTURE_QueueJob(job))
+				goto skip_video;
 		}
 #if (C_AVCODEC)
 		else if (export_ffmpeg && ffmpeg_fmt_ctx != NULL) {
@@ -1552,6 +1850,7 @@ skip_shot:
 			av_packet_free(&pkt);
 			capture.video.frames++;
 
+			CAPTURE_AUDIO_LOCK;
 			if ( capture.video.audioused ) {
 				ffmpeg_take_audio((int16_t*)capture.video.audiobuf/*NTS: Ewwwwww.... what if the compiler pads the 2-dimensional array?*/,capture.video.audioused);
 				capture.video.audiowritten = capture.video.audioused*4;
@@ -1560,12 +1859,13 @@ skip_shot:
 		}
 #endif
 		else {
+			CAPTURE_AUDIO_LOCK;
 			capture.video.audiowritten = capture.video.audioused*4;
 			capture.video.audioused = 0;
 		}
 
 		/* Everything went okay, set flag again for next frame */
-		CaptureState |= CAPTURE_VIDEO;
+		CAPTURE_SetState(CAPTURE_VIDEO);
 
         mainMenu.get_item("mapper_video").check(!!(CaptureState & CAPTURE_VIDEO)).refresh_item(mainMenu);
     }
@@ -1576,6 +1876,7 @@ skip_shot:
 #endif
     return;
 skip_video:
+	CAPTURE_DrainEncoder();
 	capture.video.writer = avi_writer_destroy(capture.video.writer);
 # if (C_AVCODEC)
 	ffmpeg_flushout();
@@ -1594,7 +1895,7 @@ void CAPTURE_ScreenShotEvent(bool pressed) {
 	if (!pressed)
 		return;
 #if !defined(C_EMSCRIPTEN)
-	CaptureState |= CAPTURE_IMAGE;
+	CAPTURE_SetState(CAPTURE_IMAGE);
 #endif
 #if defined(USE_TTF)
     showdbcs = IS_EGAVGA_ARCH;
@@ -1606,7 +1907,7 @@ void CAPTURE_RawScreenShotEvent(bool pressed) {
 	if (!pressed)
 		return;
 #if !defined(C_EMSCRIPTEN)
-	CaptureState |= CAPTURE_RAWIMAGE;
+	CAPTURE_SetState(CAPTURE_RAWIMAGE);
 #endif
 }
 #endif
@@ -1615,6 +1916,7 @@ MixerChannel * MIXER_FirstChannel(void);
 
 void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const char *name) {
 #if !defined(C_EMSCRIPTEN)
+	CAPTURE_AUDIO_LOCK;
 	if (CaptureState & CAPTURE_MULTITRACK_WAVE) {
 		if (capture.multitrack_wave.writer == NULL) {
 			unsigned int streams = 0;
@@ -1785,14 +2087,14 @@ void Capture_WritePacket(bool /*send*/,const unsigned char *buf,size_t len) {
 	if (pcap_fp == NULL) {
 		std::string path = GetCaptureFilePath("PCAP Output",".pcap");
 		if (path == "") {
-			CaptureState &= ~((unsigned int)CAPTURE_NETWORK);
+			CAPTURE_ClearState(CAPTURE_NETWORK);
 			return;
 		}
 		pathpcap = path;
 
 		pcap_fp = fopen(pathpcap.c_str(),"wb");
 		if (pcap_fp == NULL) {
-			CaptureState &= ~((unsigned int)CAPTURE_NETWORK);
+			CAPTURE_ClearState(CAPTURE_NETWORK);
 			return;
 		}
 
@@ -1824,6 +2126,7 @@ void Capture_WritePacket(bool /*send*/,const unsigned char *buf,size_t len) {
 
 void CAPTURE_AddWave(uint32_t freq, uint32_t len, int16_t * data) {
 #if !defined(C_EMSCRIPTEN)
+	CAPTURE_AUDIO_LOCK;
 #if (C_SSHOT)
 	if (CaptureState & CAPTURE_VIDEO) {
 		Bitu left = WAVE_BUF - capture.video.audioused;
@@ -1912,18 +2215,21 @@ void CAPTURE_MTWaveEvent(bool pressed) {
 #if !defined(C_EMSCRIPTEN)
     if (CaptureState & CAPTURE_MULTITRACK_WAVE) {
         if (capture.multitrack_wave.writer != NULL) {
-            LOG_MSG("Stopped capturing multitrack wave output.");
-            capture.multitrack_wave.name_to_stream_index.clear();
-            avi_writer_end_data(capture.multitrack_wave.writer);
-            avi_writer_finish(capture.multitrack_wave.writer);
-            avi_writer_close_file(capture.multitrack_wave.writer);
-            capture.multitrack_wave.writer = avi_writer_destroy(capture.multitrack_wave.writer);
-            CaptureState &= ~((unsigned int)CAPTURE_MULTITRACK_WAVE);
+            {
+                CAPTURE_AUDIO_LOCK;
+                LOG_MSG("Stopped capturing multitrack wave output.");
+                capture.multitrack_wave.name_to_stream_index.clear();
+                avi_writer_end_data(capture.multitrack_wave.writer);
+                avi_writer_finish(capture.multitrack_wave.writer);
+                avi_writer_close_file(capture.multitrack_wave.writer);
+                capture.multitrack_wave.writer = avi_writer_destroy(capture.multitrack_wave.writer);
+                CaptureState &= ~((unsigned int)CAPTURE_MULTITRACK_WAVE);
+            }
             if (show_recorded_filename && pathmtw.size()) systemmessagebox("Recording completed",("Saved multi-track AVI output to the file:\n\n"+pathmtw).c_str(),"ok", "info", 1);
         }
     }
     else {
-        CaptureState |= CAPTURE_MULTITRACK_WAVE;
+        CAPTURE_SetState(CAPTURE_MULTITRACK_WAVE);
     }
     pathmtw = "";
 
@@ -1938,11 +2244,11 @@ void CAPTURE_NetworkEvent(bool pressed) {
 #if !defined(C_EMSCRIPTEN)
 	if (CaptureState & CAPTURE_NETWORK) {
 		pcap_writer_close();
-		CaptureState &= ~((unsigned int)CAPTURE_NETWORK);
+		CAPTURE_ClearState(CAPTURE_NETWORK);
 		if (show_recorded_filename && pathpcap.size()) systemmessagebox("Recording completed",("Saved PCAP output to the file:\n\n"+pathpcap).c_str(),"ok", "info", 1);
 	}
 	else {
-		CaptureState |= CAPTURE_NETWORK;
+		CAPTURE_SetState(CAPTURE_NETWORK);
 	}
 
 	mainMenu.get_item("mapper_capnetrf").check(!!(CaptureState & CAPTURE_NETWORK)).refresh_item(mainMenu);
@@ -1957,18 +2263,21 @@ void CAPTURE_WaveEvent(bool pressed) {
     if (CaptureState & CAPTURE_WAVE) {
         /* Check for previously opened wave file */
         if (capture.wave.writer != NULL) {
-            LOG_MSG("Stopped capturing wave output.");
-            /* Write last piece of audio in buffer */
-            riff_wav_writer_data_write(capture.wave.writer,capture.wave.buf,2*2*capture.wave.used);
-            capture.wave.length+=(uint32_t)(capture.wave.used*4);
-            riff_wav_writer_end_data(capture.wave.writer);
-            capture.wave.writer = riff_wav_writer_destroy(capture.wave.writer);
-            CaptureState &= ~((unsigned int)CAPTURE_WAVE);
+            {
+                CAPTURE_AUDIO_LOCK;
+                LOG_MSG("Stopped capturing wave output.");
+                /* Write last piece of audio in buffer */
+                riff_wav_writer_data_write(capture.wave.writer,capture.wave.buf,2*2*capture.wave.used);
+                capture.wave.length+=(uint32_t)(capture.wave.used*4);
+                riff_wav_writer_end_data(capture.wave.writer);
+                capture.wave.writer = riff_wav_writer_destroy(capture.wave.writer);
+                CaptureState &= ~((unsigned int)CAPTURE_WAVE);
+            }
             if (show_recorded_filename && pathwav.size()) systemmessagebox("Recording completed",("Saved WAV output to the file:\n\n"+pathwav).c_str(),"ok", "info", 1);
         }
     }
     else {
-        CaptureState |= CAPTURE_WAVE;
+        CAPTURE_SetState(CAPTURE_WAVE);
     }
     pathwav = "";
 
@@ -2051,12 +2360,13 @@ void CAPTURE_MidiEvent(bool pressed) {
 		fclose(capture.midi.handle);
 		if (show_recorded_filename && pathmid.size()) systemmessagebox("Recording completed",("Saved MIDI output to the file:\n\n"+pathmid).c_str(),"ok", "info", 1);
 		capture.midi.handle=0;
-		CaptureState &= ~((unsigned int)CAPTURE_MIDI);
+		CAPTURE_ClearState(CAPTURE_MIDI);
 		mainMenu.get_item("mapper_caprawmidi").check(false).refresh_item(mainMenu);
 		return;
 	} 
 	pathmid = "";
-	CaptureState ^= CAPTURE_MIDI;
+	if (CaptureState & CAPTURE_MIDI) CAPTURE_ClearState(CAPTURE_MIDI);
+	else CAPTURE_SetState(CAPTURE_MIDI);
 	if (CaptureState & CAPTURE_MIDI) {
 		LOG_MSG("Preparing for raw midi capture, will start with first data.");
 		capture.midi.used=0;
@@ -2074,6 +2384,7 @@ void CAPTURE_Destroy(Section *sec) {
 	// if capture is active, fake mapper event to "toggle" it off for each capture case.
 #if (C_SSHOT)
 	if (capture.video.writer != NULL) CAPTURE_VideoEvent(true);
+	CAPTURE_StopEncoder();
 #endif
     if (capture.multitrack_wave.writer) CAPTURE_MTWaveEvent(true);
 	if (capture.wave.writer) CAPTURE_WaveEvent(true);
@@ -2181,6 +2492,8 @@ void CAPTURE_Init() {
     else sendkeymap=0;
 
     skip_encoding_unchanged_frames = section->Get_bool("skip encoding unchanged frames");
+    capture_encoder_queue = section->Get_int("capture encoder queue");
+    capture_queue_drop = std::string(section->Get_string("capture queue full")) == "drop";
 
     std::string ffmpeg_pixfmt = section->Get_string("capture chroma format");
 
@@ -2218,7 +2531,7 @@ void CAPTURE_Init() {
 		export_ffmpeg = false;
 	}
 
-	CaptureState = 0; // make sure capture is off
+	CAPTURE_ClearState(~((Bitu)0)); // make sure capture is off
 
 #if !defined(C_EMSCRIPTEN)
 	// mapper shortcuts for capture
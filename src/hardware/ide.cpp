@@ -35,6 +35,7 @@
 #include "bios_disk.h"
 #include "../src/dos/cdrom.h"
 #include "bios.h"
+#include "pci_bus.h"
 
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
@@ -238,8 +239,12 @@ public:
     virtual void prepare_write(Bitu offset,Bitu size);
     virtual void io_completion();
     virtual bool increment_current_address(Bitu count=1);
+    virtual bool current_sector(uint32_t &sectorn);
+    virtual void dma_transfer();
 public:
     Bitu multiple_sector_max,multiple_sector_count;
+    uint8_t dma_mode;       /* transfer mode set by SET FEATURES 03h if multiword DMA (20h-22h), else 0 */
+    bool dma_pending;       /* READ/WRITE DMA is waiting for the host to start the bus master */
     Bitu heads,sects,cyls,headshr,progress_count;
     Bitu phys_heads,phys_sects,phys_cyls;
     unsigned char sector[512 * 128] = {};
@@ -322,6 +327,7 @@ public:
     bool enable_pio32;      /* enable 32-bit PIO (if disabled, attempts at 32-bit PIO are handled as if two 16-bit I/O) */
     bool ignore_pio32;      /* if 32-bit PIO enabled, but ignored, writes do nothing, reads return 0xFFFFFFFF */
     bool register_pnp;
+    bool busmaster;         /* channel of the PCI bus master IDE function (primary and secondary only) */
     unsigned short alt_io;
     unsigned short base_io;
     unsigned char interface_index;
@@ -333,6 +339,10 @@ public:
     bool interrupt_enable;      /* bit 1 of alt (0x3F6) */
     bool host_reset;        /* bit 2 of alt */
     bool irq_pending;
+    /* bus master registers for this channel */
+    uint8_t bm_command;         /* bit 0: start, bit 3: 1=transfer to memory */
+    uint8_t bm_status;          /* bit 0: active, bit 1: error, bit 2: interrupt, bits 5-6: drive DMA capable */
+    uint32_t bm_prd;            /* physical address of the PRD table */
     /* defaults for CD-ROM emulation */
     double spinup_time;
     double spindown_timeout;
@@ -342,6 +352,7 @@ public:
     void register_isapnp();
     void install_io_port();
     void check_device_irq();
+    void busmaster_start();
     ~IDEController();
 private:// Sorry, IDE devices and external code don't get to force IDE IRQs anymore
     void raise_irq();
@@ -355,6 +366,7 @@ static IDEController* idecontroller[MAX_IDE_CONTROLLERS]={NULL,NULL,NULL,NULL,NU
 
 static void IDE_DelayedCommand(Bitu pk/*which IDE device*/);
 static IDEController* GetIDEController(Bitu idx);
+bool has_pcibus_enable(void);
 
 static void IDE_ATAPI_SpinDown(Bitu pk/*which IDE device*/) {
 	IDEEventPack ep(pk);
@@ -1725,6 +1737,166 @@ bool IDEATADevice::increment_current_address(Bitu count) {
     return true;
 }
 
+/* the sector the task file registers point at, in LBA or C/H/S mode */
+bool IDEATADevice::current_sector(uint32_t &sectorn) {
+    if (drivehead_is_lba(drivehead)) {
+        sectorn = (((unsigned int)drivehead & 0xFu) << 24u) | (unsigned int)lba[0] |
+            ((unsigned int)lba[1] << 8u) |
+            ((unsigned int)lba[2] << 16u);
+    }
+    else {
+        if (lba[0] == 0) {
+            LOG_MSG("ATA sector 0 does not exist\n");
+            return false;
+        }
+        else if ((unsigned int)(drivehead & 0xFu) >= (unsigned int)heads ||
+            (unsigned int)lba[0] > (unsigned int)sects ||
+            (unsigned int)(lba[1] | ((unsigned int)lba[2] << 8u)) >= (unsigned int)cyls) {
+            LOG_MSG("C/H/S %u/%u/%u out of bounds %u/%u/%u\n",
+                (unsigned int)(lba[1] | ((unsigned int)lba[2] << 8u)),
+                (unsigned int)(drivehead&0xFu),
+                (unsigned int)lba[0],
+                (unsigned int)cyls,
+                (unsigned int)heads,
+                (unsigned int)sects);
+            return false;
+        }
+
+        sectorn = ((unsigned int)(drivehead & 0xFu) * sects) +
+            (((unsigned int)lba[1] | ((unsigned int)lba[2] << 8u)) * sects * heads) +
+            ((unsigned int)lba[0] - 1u);
+    }
+
+    return true;
+}
+
+/* bus master transfers are to and from physical memory, like ISA DMA. Anything outside
+ * of RAM reads as all ones and ignores writes */
+static void IDE_BusMaster_MemRead(PhysPt addr,uint8_t *data,Bitu len) {
+    const Bitu ram = MEM_TotalPages() * 4096u;
+
+    if (addr < ram && len <= (ram - addr)) {
+        memcpy(data,MemBase + addr,len);
+    }
+    else {
+        for (Bitu i=0;i < len;i++,addr++)
+            data[i] = (addr < ram) ? phys_readb(addr) : 0xFF;
+    }
+}
+
+static void IDE_BusMaster_MemWrite(PhysPt addr,const uint8_t *data,Bitu len) {
+    const Bitu ram = MEM_TotalPages() * 4096u;
+
+    if (addr < ram && len <= (ram - addr)) {
+        memcpy(MemBase + addr,data,len);
+    }
+    else {
+        for (Bitu i=0;i < len && addr < ram;i++,addr++)
+            phys_writeb(addr,data[i]);
+    }
+}
+
+/* READ/WRITE DMA, once the bus master has been started. The whole command is carried out at
+ * once: the sectors are read or written a sector buffer at a time, and scattered to or gathered
+ * from the regions of the PRD table. Each PRD entry is a dword physical address and a word byte
+ * count (0 = 64KB), with bit 15 of the last word set on the last entry */
+void IDEATADevice::dma_transfer() {
+    const bool to_memory = (command == 0xC8 || command == 0xC9);
+    imageDisk *disk = getBIOSdisk();
+    uint32_t sectorn = 0;
+    unsigned int sectcount;
+
+    if (disk == NULL || !current_sector(sectorn)) {
+        LOG_MSG("ATA DMA fail, bios disk N/A or bad address\n");
+        controller->bm_status = (controller->bm_status & ~0x01) | 0x02;
+        abort_error();
+        raise_irq();
+        return;
+    }
+
+    sectcount = count & 0xFF;
+    if (sectcount == 0) sectcount = 256;
+
+    PhysPt prd = controller->bm_prd;
+    PhysPt addr = 0;
+    Bitu left = 0;
+    bool last = false;
+    bool ok = true;
+
+    for (unsigned int done=0;ok && done < sectcount;) {
+        const unsigned int n = (unsigned int)MIN((Bitu)(sectcount - done),(Bitu)(sizeof(sector) / 512));
+        const Bitu total = (Bitu)n * 512u;
+
+        if (to_memory && disk->Read_AbsoluteSectors(sectorn + done, n, sector) != 0) {
+            LOG_MSG("ATA DMA read failed\n");
+            ok = false;
+            break;
+        }
+
+        for (Bitu pos=0;pos < total;) {
+            if (left == 0) {
+                if (last) {
+                    LOG_MSG("ATA DMA PRD table shorter than the transfer\n");
+                    ok = false;
+                    break;
+                }
+
+                uint8_t ent[8];
+                IDE_BusMaster_MemRead(prd,ent,8);
+                addr = host_readd(ent) & ~1u;
+                left = host_readw(ent+4);
+                if (left == 0) left = 0x10000;
+                last = (host_readw(ent+6) & 0x8000u) != 0;
+                prd += 8;
+            }
+
+            const Bitu chunk = MIN(left,total - pos);
+            if (to_memory)
+                IDE_BusMaster_MemWrite(addr,sector + pos,chunk);
+            else
+                IDE_BusMaster_MemRead(addr,sector + pos,chunk);
+
+            addr += (PhysPt)chunk;
+            left -= chunk;
+            pos += chunk;
+        }
+
+        if (ok && !to_memory && disk->Write_AbsoluteSectors(sectorn + done, n, sector) != 0) {
+            LOG_MSG("ATA DMA write failed\n");
+            ok = false;
+        }
+
+        done += n;
+    }
+
+    if (!ok) {
+        controller->bm_status = (controller->bm_status & ~0x01) | 0x02;
+        abort_error();
+        raise_irq();
+        return;
+    }
+
+    /* the registers end up pointing at the last sector transferred, as with PIO */
+    progress_count = sectcount;
+    if (sectcount > 1 && !increment_current_address(sectcount - 1)) {
+        LOG_MSG("DMA advance error\n");
+        controller->bm_status = (controller->bm_status & ~0x01) | 0x02;
+        abort_error();
+        raise_irq();
+        return;
+    }
+
+    /* a PRD table that covers exactly the transfer stops the bus master. If the table was
+     * longer, it stays active until the host stops it */
+    if (left == 0 && last) controller->bm_status &= ~0x01;
+
+    count = 0;
+    status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
+    state = IDE_DEV_READY;
+    allow_writing = true;
+    raise_irq();
+}
+
 void IDEATADevice::io_completion() {
     const unsigned int pk = IDEEventPack(controller->interface_index,slave?1u:0u).get();
 
@@ -2544,11 +2716,12 @@ void IDEATADevice::generate_identify_device() {
         host_writew(sector+(47*2),0x80|multiple_sector_max); /* <- READ/WRITE MULTIPLE MAX SECTORS */
 
     host_writew(sector+(48*2),0x0000);  /* :0  0=we do not support doubleword (32-bit) PIO */
-    host_writew(sector+(49*2),0x0A00);  /* :13 0=Standby timer values managed by device */
+    host_writew(sector+(49*2),controller->busmaster ? 0x0B00 : 0x0A00);
+                        /* :13 0=Standby timer values managed by device */
                         /* :11 1=IORDY supported */
                         /* :10 0=IORDY not disabled */
                         /* :9  1=LBA supported */
-                        /* :8  0=DMA not supported */
+                        /* :8  1=DMA supported if behind the PCI bus master */
     host_writew(sector+(50*2),0x4000);  /* FIXME: ??? */
     host_writew(sector+(51*2),0x00F0);  /* PIO data transfer cycle timing mode */
     host_writew(sector+(52*2),0x00F0);  /* DMA data transfer cycle timing mode */
@@ -2566,11 +2739,18 @@ void IDEATADevice::generate_identify_device() {
 
     host_writed(sector+(60*2),ptotal);  /* total user addressable sectors (LBA) */
     host_writew(sector+(62*2),0x0000);  /* FIXME: ??? */
-    host_writew(sector+(63*2),0x0000);  /* :10 0=Multiword DMA mode 2 not selected */
-                        /* TODO: Basically, we don't do DMA. Fill out this comment */
+    if (controller->busmaster) {
+        /* 10:8 multiword DMA mode selected, 2:0 multiword DMA modes 0-2 supported */
+        host_writew(sector+(63*2),0x0007 | ((dma_mode & 0x20) ? (0x0100 << (dma_mode & 7)) : 0));
+        host_writew(sector+(65*2),0x0078);  /* minimum multiword DMA cycle time (120ns) */
+        host_writew(sector+(66*2),0x0078);  /* recommended multiword DMA cycle time (120ns) */
+    }
+    else {
+        host_writew(sector+(63*2),0x0000);  /* no DMA modes without the bus master */
+        host_writew(sector+(65*2),0x0000);  /* FIXME: ??? */
+        host_writew(sector+(66*2),0x0000);  /* FIXME: ??? */
+    }
     host_writew(sector+(64*2),0x0003);  /* 7:0 PIO modes supported (FIXME ???) */
-    host_writew(sector+(65*2),0x0000);  /* FIXME: ??? */
-    host_writew(sector+(66*2),0x0000);  /* FIXME: ??? */
     host_writew(sector+(67*2),0x0078);  /* FIXME: ??? */
     host_writew(sector+(68*2),0x0078);  /* FIXME: ??? */
     host_writew(sector+(80*2),0x007E);  /* major version number. Here we say we support ATA-1 through ATA-8 */
@@ -2598,6 +2778,8 @@ IDEATADevice::IDEATADevice(IDEController *c,unsigned char disk_index,bool _slave
     type = IDE_TYPE_HDD;
     multiple_sector_max = sizeof(sector) / 512;
     multiple_sector_count = 1;
+    dma_mode = 0;
+    dma_pending = false;
     geo_translate = false;
     heads = 0;
     sects = 0;
@@ -2861,6 +3043,7 @@ void IDE_Hard_Disk_Attach(signed char index,bool slave,unsigned char bios_disk_i
     if (dev == NULL) return;
     dev->update_from_biosdisk();
     c->device[slave?1:0] = (IDEDevice*)dev;
+    if (c->busmaster) c->bm_status |= slave ? 0x40 : 0x20; /* drive DMA capable, as the BIOS would set it */
     LOG_MSG("IMGMOUNT: HDD image mounted to drive no. %d (IDE %s %s)", bios_disk_index, ideslot[index], master_slave[slave?1:0]);
 }
 
@@ -3654,14 +3837,11 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                 if ((512*ata->multiple_sector_count) > sizeof(ata->sector))
                     E_Exit("SECTOR OVERFLOW");
 
-                for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-                    /* it would be great if the disk object had a "read multiple sectors" member function */
-                    if (disk->Read_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-                        LOG_MSG("ATA read failed\n");
-                        ata->abort_error();
-                        dev->raise_irq();
-                        return;
-                    }
+                if (disk->Read_AbsoluteSectors(sectorn, (uint32_t)MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+                    LOG_MSG("ATA read failed\n");
+                    ata->abort_error();
+                    dev->raise_irq();
+                    return;
                 }
 
                 /* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
@@ -3720,14 +3900,11 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                         ((unsigned int)ata->lba[0] - 1);
                 }
 
-                for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-                    /* it would be great if the disk object had a "write multiple sectors" member function */
-                    if (disk->Write_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-                        LOG_MSG("Failed to write sector\n");
-                        ata->abort_error();
-                        dev->raise_irq();
-                        return;
-                    }
+                if (disk->Write_AbsoluteSectors(sectorn, (uint32_t)MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+                    LOG_MSG("Failed to write sector\n");
+                    ata->abort_error();
+                    dev->raise_irq();
+                    return;
                 }
 
                 for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
@@ -3759,6 +3936,20 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                 ata->prepare_write(0,512*MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount));
                 dev->raise_irq();
                 break;
+            case 0xC8:/* READ DMA */
+            case 0xC9:/* READ DMA (without retry) */
+            case 0xCA:/* WRITE DMA */
+            case 0xCB:/* WRITE DMA (without retry) */
+                /* the drive is ready for the data, but nothing moves until the host starts the bus
+                 * master. Writing the start bit comes back here through busmaster_start() */
+                if (!(ctrl->bm_command & 0x01)) {
+                    ata->dma_pending = true;
+                    return;
+                }
+
+                ata->dma_pending = false;
+                ata->dma_transfer();
+                break;
             case 0xEC:/*IDENTIFY DEVICE (CONTINUED) */
                 dev->state = IDE_DEV_DATA_READ;
                 dev->status = IDE_STATUS_DRQ|IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
@@ -3879,6 +4070,8 @@ IDEController *match_ide_controller(Bitu port) {
 void IDEDevice::raise_irq() {
     if (!irq_signal) {
         irq_signal = true;
+        /* the bus master latches the interrupt from the drive, whether or not nIEN masks it */
+        if (controller->busmaster) controller->bm_status |= 0x04;
         controller->check_device_irq();
     }
 }
@@ -4244,6 +4437,26 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRQ;
             prepare_write(0UL,512UL*MIN((unsigned long)multiple_sector_count,(unsigned long)(count == 0 ? 256 : count)));
             break;
+        case 0xC8: /* READ DMA */
+        case 0xC9: /* READ DMA (without retry) */
+        case 0xCA: /* WRITE DMA */
+        case 0xCB: /* WRITE DMA (without retry) */
+            if (!controller->busmaster) {
+                LOG_MSG("IDE/ATA DMA command %02X without bus master\n",cmd);
+                abort_error();
+                allow_writing = true;
+                raise_irq();
+                break;
+            }
+            /* the data moves through the bus master, not the data port, so DRQ is never
+             * raised for the host. The drive stays busy until the bus master is done */
+            progress_count = 0;
+            dma_pending = false;
+            state = IDE_DEV_BUSY;
+            status = IDE_STATUS_BUSY;
+            PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
+            PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 0.1)/*ms*/,pk);
+            break;
         case 0xC6: /* SET MULTIPLE MODE */
             /* only sector counts 1, 2, 4, 8, 16, 32, 64, and 128 are legal by standard.
              * NTS: There's a bug in VirtualBox that makes 0 legal too! */
@@ -4302,6 +4515,13 @@ void IDEATADevice::writecommand(uint8_t cmd) {
                 status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
                 state = IDE_DEV_READY;
             }
+            else if (feature == 0x03/*Set transfer mode*/ && controller->busmaster &&
+                ((count & 0xF0) == 0x00/*PIO*/ || ((count & 0xFF) >= 0x20 && (count & 0xFF) <= 0x22)/*multiword DMA 0-2*/)) {
+                /* PIO and DMA run at whatever speed the emulation does, only remember the mode for IDENTIFY DEVICE */
+                dma_mode = ((count & 0xF0) == 0x20) ? (uint8_t)count : 0;
+                status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
+                state = IDE_DEV_READY;
+            }
             else {
                 LOG_MSG("SET FEATURES %02xh SC=%02x SN=%02x CL=%02x CH=%02x",feature,count,lba[0],lba[1],lba[2]);
                 abort_error();
@@ -4351,6 +4571,10 @@ IDEController::IDEController(Section* configuration,unsigned char index):Module_
     irq_pending = false;
     interrupt_enable = true;
     interface_index = index;
+    busmaster = section->Get_bool("pci bus master") && has_pcibus_enable() && !IS_PC98_ARCH && index < 2;
+    bm_command = 0;
+    bm_status = 0;
+    bm_prd = 0;
     device[0] = NULL;
     device[1] = NULL;
     base_io = 0;
@@ -4483,6 +4707,24 @@ void IDEController::install_io_port(){
     }
 }
 
+void IDEController::busmaster_start() {
+    bm_status |= 0x01;
+
+    /* a READ/WRITE DMA issued before the bus master was started has been waiting for this */
+    for (unsigned int i=0;i < 2;i++) {
+        if (device[i] == NULL || device[i]->type != IDE_TYPE_HDD) continue;
+
+        IDEATADevice *ata = (IDEATADevice*)device[i];
+        if (ata->dma_pending && ata->state == IDE_DEV_BUSY && ata->command >= 0xC8 && ata->command <= 0xCB) {
+            const unsigned int pk = IDEEventPack(interface_index,i).get();
+
+            ata->dma_pending = false;
+            PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
+            PIC_AddEvent(IDE_DelayedCommand,0.00001/*ms*/,pk);
+        }
+    }
+}
+
 IDEController::~IDEController() {
     unsigned int i;
 
@@ -4494,6 +4736,85 @@ IDEController::~IDEController() {
     }
 }
 
+/* PCI bus master IDE registers (PIIX style): 8 ports per channel, primary then secondary.
+ * +0 command, +2 status, +4 PRD table address */
+static unsigned int ide_bm_base = 0;
+static IO_ReadHandleObject ide_bm_ReadHandler;
+static IO_WriteHandleObject ide_bm_WriteHandler;
+
+static uint8_t ide_bmio_readb(Bitu port) {
+    IDEController *ide = idecontroller[((port - ide_bm_base) >> 3u) & 1u];
+    if (ide == NULL || !ide->busmaster) return 0x00;
+
+    switch (port & 7) {
+        case 0: return ide->bm_command;
+        case 2: return ide->bm_status;
+        case 4: case 5: case 6: case 7:
+            return (uint8_t)(ide->bm_prd >> ((port & 3u) * 8u));
+        default: break;
+    }
+
+    return 0x00;
+}
+
+static void ide_bmio_writeb(Bitu port,uint8_t val) {
+    IDEController *ide = idecontroller[((port - ide_bm_base) >> 3u) & 1u];
+    if (ide == NULL || !ide->busmaster) return;
+
+    switch (port & 7) {
+        case 0: {
+            const uint8_t was = ide->bm_command;
+
+            /* the direction cannot change while the bus master is running */
+            if (was & 0x01) val = (val & 0x01) | (was & 0x08);
+            ide->bm_command = val & 0x09;
+
+            if ((val & 0x01) && !(was & 0x01))
+                ide->busmaster_start();
+            else if (!(val & 0x01))
+                ide->bm_status &= ~0x01; /* stopping aborts whatever is left */
+            } break;
+        case 2: /* bits 1-2 are cleared by writing 1, bits 5-6 are plain read/write */
+            ide->bm_status = (ide->bm_status & ~(0x60 | (val & 0x06))) | (val & 0x60);
+            break;
+        case 4: case 5: case 6: case 7: {
+            const unsigned int shf = (port & 3u) * 8u;
+            ide->bm_prd = ((ide->bm_prd & ~(0xFFu << shf)) | ((uint32_t)val << shf)) & ~3u;
+            } break;
+        default:
+            break;
+    }
+}
+
+static Bitu ide_bmio_r(Bitu port,Bitu iolen) {
+    Bitu ret = 0;
+
+    for (Bitu i=0;i < iolen;i++)
+        ret |= (Bitu)ide_bmio_readb(port + i) << (i * 8u);
+
+    return ret;
+}
+
+static void ide_bmio_w(Bitu port,Bitu val,Bitu iolen) {
+    for (Bitu i=0;i < iolen;i++)
+        ide_bmio_writeb(port + i,(uint8_t)(val >> (i * 8u)));
+}
+
+void IDE_BusMaster_SetBase(unsigned int base) {
+    base &= 0xFFF0u;
+    if (base == ide_bm_base) return;
+
+    ide_bm_ReadHandler.Uninstall();
+    ide_bm_WriteHandler.Uninstall();
+    ide_bm_base = base;
+
+    if (base != 0) {
+        LOG(LOG_MISC,LOG_DEBUG)("IDE bus master registers at %04xh",base);
+        ide_bm_ReadHandler.Install(base,ide_bmio_r,IO_MA,16);
+        ide_bm_WriteHandler.Install(base,ide_bmio_w,IO_MA,16);
+    }
+}
+
 static void IDE_PC98_Select(Bitu val) {
     val &= 1;
     pc98_ide_select = val;
@@ -4896,6 +5217,12 @@ void IDE_OnReset(Section *sec) {
 
     for (size_t i=0;i < MAX_IDE_CONTROLLERS;i++) ide_inits[i](control->GetSection(ide_names[i]));
 
+    /* the PCI bus master IDE function, if the primary or secondary interface asked for it */
+    if ((idecontroller[0] != NULL && idecontroller[0]->busmaster) || (idecontroller[1] != NULL && idecontroller[1]->busmaster))
+        PCI_AddIDE_Device();
+    else
+        PCI_RemoveIDE_Device();
+
     if (IS_PC98_ARCH) {//TODO: Only if any IDE interfaces are enabled
         for (size_t i=0;i < 8;i++) {
             PC98_WriteHandler[i].Uninstall();
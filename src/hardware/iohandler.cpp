@@ -31,6 +31,8 @@
 
 #include <math.h> /* floor */
 
+#include <algorithm>
+#include <chrono>
 #include <vector>
 
 extern bool pcibus_enable;
@@ -51,6 +53,141 @@ IO_ReadHandler * io_readhandlers[3][IO_MAX];
 
 static IO_callout_vector IO_callouts[IO_callouts_max];
 
+/* I/O access statistics, per direction, width and port. Allocated only while enabled,
+ * IO_ReadB() and friends test the pointer and otherwise dispatch as usual. */
+struct IO_PortStat {
+    uint64_t calls;
+    uint64_t ns;                    /* host time spent in the handler(s) */
+    uint64_t slow;                  /* accesses that went down the callout slow path */
+};
+
+static IO_PortStat *io_stats = NULL;
+
+static inline IO_PortStat &IO_Stat(bool write,unsigned int porti,Bitu port) {
+    return io_stats[((write ? 3u : 0u) + porti) * IO_MAX + port];
+}
+
+static inline uint64_t IO_StatNow(void) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Hot port dispatch.
+ *
+ * The slow path caches the handler of the one device that answered in io_readhandlers/io_writehandlers,
+ * but if more than one device answered (ISA devices fighting over a port, or an ISA device shadowed by
+ * a PCI device) it cannot, and every access scans the callout lists again. A program polling such a port
+ * pays for that every time. Once a port/width has taken the slow path IO_HOT_THRESHOLD times, the
+ * handlers the scan found are remembered here and the port is pointed at IO_ReadHot/IO_WriteHot, which
+ * call them in the same order without the scan. IO_InvalidateCachedHandler() drops the entry again.
+ *
+ * There are rarely more than a few such ports, so the table is small and searched linearly. */
+#define IO_HOT_MAX          16
+#define IO_HOT_HANDLERS     4
+#define IO_HOT_THRESHOLD    8
+
+enum {
+    IO_HOT_READ=0,                  /* the value read */
+    IO_HOT_READ_AND,                /* ANDed into the value read (ISA pullups vs. devices pulling lines down) */
+    IO_HOT_READ_DISCARD             /* called, the value is discarded (ISA device behind a PCI device that answered) */
+};
+
+struct IO_HotPort {
+    uint32_t key;                   /* port, width and direction, see IO_HotKey() */
+    unsigned int count;             /* handlers, more than IO_HOT_HANDLERS if they did not fit */
+    IO_ReadHandler *r[IO_HOT_HANDLERS];
+    unsigned char rmode[IO_HOT_HANDLERS];
+    IO_WriteHandler *w[IO_HOT_HANDLERS];
+
+    IO_HotPort() : key(0), count(0) { }
+    void add(IO_ReadHandler *f,unsigned char mode) {
+        if (count < IO_HOT_HANDLERS) { r[count] = f; rmode[count] = mode; }
+        count++;
+    }
+    void add(IO_WriteHandler *f) {
+        if (count < IO_HOT_HANDLERS) w[count] = f;
+        count++;
+    }
+};
+
+static IO_HotPort io_hot[IO_HOT_MAX];
+static unsigned int io_hot_count = 0;
+static bool io_hot_enable = true;
+static uint8_t io_slowhits[2][3][IO_MAX];
+
+static inline uint32_t IO_HotKey(bool write,unsigned int porti,Bitu port) {
+    return ((uint32_t)port << 3u) + (write ? 4u : 0u) + porti;
+}
+
+static inline IO_HotPort *IO_FindHot(uint32_t key) {
+    for (unsigned int i=0;i < io_hot_count;i++) {
+        if (io_hot[i].key == key) return &io_hot[i];
+    }
+    return NULL;
+}
+
+static Bitu IO_ReadSlowPath(Bitu port,Bitu iolen);
+void IO_WriteSlowPath(Bitu port,Bitu val,Bitu iolen);
+
+/* forget the hot ports in a range of ports, their handler slots go back to the slow path */
+static void IO_DropHot(Bitu port,Bitu range) {
+    unsigned int i=0;
+    while (i < io_hot_count) {
+        const uint32_t key = io_hot[i].key;
+        const Bitu p = key >> 3u;
+        if (p >= port && p < (port+range)) {
+            if (key & 4u) io_writehandlers[key & 3u][p] = IO_WriteSlowPath;
+            else io_readhandlers[key & 3u][p] = IO_ReadSlowPath;
+            io_hot[i] = io_hot[--io_hot_count];
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+static Bitu IO_ReadHot(Bitu port,Bitu iolen) {
+    const unsigned int porti = (iolen >= 4) ? 2 : (unsigned int)(iolen - 1);
+    const IO_HotPort *hot = IO_FindHot(IO_HotKey(false,porti,port));
+    Bitu ret = ~0ul;
+
+    assert(hot != NULL);
+    for (unsigned int i=0;i < hot->count;i++) {
+        switch (hot->rmode[i]) {
+            case IO_HOT_READ:           ret  = hot->r[i](port,iolen); break;
+            case IO_HOT_READ_AND:       ret &= hot->r[i](port,iolen); break;
+            default:                    hot->r[i](port,iolen); break;
+        }
+    }
+
+    return ret;
+}
+
+static void IO_WriteHot(Bitu port,Bitu val,Bitu iolen) {
+    const unsigned int porti = (iolen >= 4) ? 2 : (unsigned int)(iolen - 1);
+    const IO_HotPort *hot = IO_FindHot(IO_HotKey(true,porti,port));
+
+    assert(hot != NULL);
+    for (unsigned int i=0;i < hot->count;i++)
+        hot->w[i](port,val,iolen);
+}
+
+/* called by the slow path when more than one device answered: promote the port once it is hot enough */
+static bool IO_PromoteHot(const IO_HotPort &found) {
+    const unsigned int porti = found.key & 3u;
+    const bool write = (found.key & 4u) != 0;
+    const Bitu port = found.key >> 3u;
+    uint8_t &hits = io_slowhits[write ? 1 : 0][porti][port];
+
+    if (!io_hot_enable || found.count > IO_HOT_HANDLERS) return false;
+    if (hits < IO_HOT_THRESHOLD) hits++;
+    if (hits < IO_HOT_THRESHOLD || io_hot_count >= IO_HOT_MAX) return false;
+
+    io_hot[io_hot_count++] = found;
+    LOG(LOG_IO,LOG_DEBUG)("IO %s port %x iolen %u answered by %u devices, now dispatched directly",
+        write ? "write" : "read",(unsigned int)port,porti == 2 ? 4u : (porti + 1u),found.count);
+    return true;
+}
+
 #if C_DEBUG
 void DEBUG_EnableDebugger(void);
 #endif
@@ -100,7 +237,7 @@ void IO_WriteDefault(Bitu port,Bitu val,Bitu iolen) {
 	}
 }
 
-template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen) {
+template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen,IO_HotPort &found,bool discard=false) {
     int actual = iotype - IO_TYPE_MIN;
     IO_callout_vector &vec = IO_callouts[actual];
     unsigned int match = 0;
@@ -116,11 +253,14 @@ template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Read(Bitu &r
         t_f = obj.m_r_handler(obj,port,iolen);
         if (t_f != NULL) {
             if (match != 0) {
-                if (iotype == IO_TYPE_ISA)
+                if (iotype == IO_TYPE_ISA) {
                     ret &= t_f(port,iolen); /* ISA pullup resisters vs ISA devices pulling data lines down (two conflicting devices) */
+                    found.add(t_f,discard ? IO_HOT_READ_DISCARD : IO_HOT_READ_AND);
+                }
             }
             else {
                 ret = (/*assign and call*/f=t_f)(port,iolen);
+                found.add(t_f,discard ? IO_HOT_READ_DISCARD : IO_HOT_READ);
             }
 
             match++;
@@ -132,7 +272,7 @@ template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Read(Bitu &r
     return match;
 }
 
-template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen) {
+template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen,IO_HotPort &found) {
     int actual = iotype - IO_TYPE_MIN;
     IO_callout_vector &vec = IO_callouts[actual];
     unsigned int match = 0;
@@ -148,6 +288,7 @@ template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Write(IO_Wri
         t_f = obj.m_w_handler(obj,port,iolen);
         if (t_f != NULL) {
             t_f(port,val,iolen);
+            found.add(t_f);
             if (match == 0) f = t_f;
             match++;
         }
@@ -156,39 +297,40 @@ template <enum IO_Type_t iotype> static unsigned int IO_Gen_Callout_Write(IO_Wri
     return match;
 }
 
-static unsigned int IO_Motherboard_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen) {
-    return IO_Gen_Callout_Read<IO_TYPE_MB>(ret,f,port,iolen);
+static unsigned int IO_Motherboard_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen,IO_HotPort &found) {
+    return IO_Gen_Callout_Read<IO_TYPE_MB>(ret,f,port,iolen,found);
 }
 
-static unsigned int IO_PCI_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen) {
-    return IO_Gen_Callout_Read<IO_TYPE_PCI>(ret,f,port,iolen);
+static unsigned int IO_PCI_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen,IO_HotPort &found) {
+    return IO_Gen_Callout_Read<IO_TYPE_PCI>(ret,f,port,iolen,found);
 }
 
-static unsigned int IO_ISA_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen) {
-    return IO_Gen_Callout_Read<IO_TYPE_ISA>(ret,f,port,iolen);
+static unsigned int IO_ISA_Callout_Read(Bitu &ret,IO_ReadHandler* &f,Bitu port,Bitu iolen,IO_HotPort &found,bool discard=false) {
+    return IO_Gen_Callout_Read<IO_TYPE_ISA>(ret,f,port,iolen,found,discard);
 }
 
-static unsigned int IO_Motherboard_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen) {
-    return IO_Gen_Callout_Write<IO_TYPE_MB>(f,port,val,iolen);
+static unsigned int IO_Motherboard_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen,IO_HotPort &found) {
+    return IO_Gen_Callout_Write<IO_TYPE_MB>(f,port,val,iolen,found);
 }
 
-static unsigned int IO_PCI_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen) {
-    return IO_Gen_Callout_Write<IO_TYPE_PCI>(f,port,val,iolen);
+static unsigned int IO_PCI_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen,IO_HotPort &found) {
+    return IO_Gen_Callout_Write<IO_TYPE_PCI>(f,port,val,iolen,found);
 }
 
-static unsigned int IO_ISA_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen) {
-    return IO_Gen_Callout_Write<IO_TYPE_ISA>(f,port,val,iolen);
+static unsigned int IO_ISA_Callout_Write(IO_WriteHandler* &f,Bitu port,Bitu val,Bitu iolen,IO_HotPort &found) {
+    return IO_Gen_Callout_Write<IO_TYPE_ISA>(f,port,val,iolen,found);
 }
 
 static Bitu IO_ReadSlowPath(Bitu port,Bitu iolen) {
     IO_ReadHandler *f = iolen > 1 ? IO_ReadDefault : IO_ReadBlocked;
     unsigned int match = 0;
     unsigned int porti;
+    IO_HotPort found;
     Bitu ret = ~0ul;
 
     /* check motherboard devices */
     if ((port & 0xFF00) == 0x0000 || IS_PC98_ARCH) /* motherboard-level I/O */
-        match = IO_Motherboard_Callout_Read(/*&*/ret,/*&*/f,port,iolen);
+        match = IO_Motherboard_Callout_Read(/*&*/ret,/*&*/f,port,iolen,found);
 
     if (match == 0) {
         /* first PCI bus device, then ISA.
@@ -212,22 +354,22 @@ static Bitu IO_ReadSlowPath(Bitu port,Bitu iolen) {
          * I wish I had tools to watch I/O transactions on the ISA bus to verify this. --J.C. */
         if (pcibus_enable) {
             /* PCI and PCI/ISA bridge emulation */
-            match = IO_PCI_Callout_Read(/*&*/ret,/*&*/f,port,iolen);
+            match = IO_PCI_Callout_Read(/*&*/ret,/*&*/f,port,iolen,found);
 
             if (match == 0) {
                 /* PCI didn't take it, ask ISA bus */
-                match = IO_ISA_Callout_Read(/*&*/ret,/*&*/f,port,iolen);
+                match = IO_ISA_Callout_Read(/*&*/ret,/*&*/f,port,iolen,found);
             }
             else {
                 Bitu dummy;
 
                 /* PCI did match. Based on behavior noted above, probe ISA bus anyway and discard data. */
-                match += IO_ISA_Callout_Read(/*&*/dummy,/*&*/f,port,iolen);
+                match += IO_ISA_Callout_Read(/*&*/dummy,/*&*/f,port,iolen,found,/*discard*/true);
             }
         }
         else {
             /* Pure ISA emulation */
-            match = IO_ISA_Callout_Read(/*&*/ret,/*&*/f,port,iolen);
+            match = IO_ISA_Callout_Read(/*&*/ret,/*&*/f,port,iolen,found);
         }
     }
 
@@ -239,6 +381,13 @@ static Bitu IO_ReadSlowPath(Bitu port,Bitu iolen) {
     LOG(LOG_MISC,LOG_DEBUG)("IO read slow path port=%x iolen=%u: device matches=%u",(unsigned int)port,(unsigned int)iolen,(unsigned int)match);
     if (match == 0) ret = f(port,iolen); /* if nobody responded, then call the default */
     if (match <= 1) io_readhandlers[porti][port] = f;
+    if (GCC_UNLIKELY(io_stats != NULL)) IO_Stat(false,porti,port).slow++;
+
+    /* more than one device responded, remember who if this port is hot */
+    if (match > 1) {
+        found.key = IO_HotKey(false,porti,port);
+        if (IO_PromoteHot(found)) io_readhandlers[porti][port] = IO_ReadHot;
+    }
 
 	return ret;
 }
@@ -247,10 +396,11 @@ void IO_WriteSlowPath(Bitu port,Bitu val,Bitu iolen) {
     IO_WriteHandler *f = iolen > 1 ? IO_WriteDefault : IO_WriteBlocked;
     unsigned int match = 0;
     unsigned int porti;
+    IO_HotPort found;
 
     /* check motherboard devices */
     if ((port & 0xFF00) == 0x0000 || IS_PC98_ARCH) /* motherboard-level I/O */
-        match = IO_Motherboard_Callout_Write(/*&*/f,port,val,iolen);
+        match = IO_Motherboard_Callout_Write(/*&*/f,port,val,iolen,found);
 
     if (match == 0) {
         /* first PCI bus device, then ISA.
@@ -274,20 +424,20 @@ void IO_WriteSlowPath(Bitu port,Bitu val,Bitu iolen) {
          * I wish I had tools to watch I/O transactions on the ISA bus to verify this. --J.C. */
         if (pcibus_enable) {
             /* PCI and PCI/ISA bridge emulation */
-            match = IO_PCI_Callout_Write(/*&*/f,port,val,iolen);
+            match = IO_PCI_Callout_Write(/*&*/f,port,val,iolen,found);
 
             if (match == 0) {
                 /* PCI didn't take it, ask ISA bus */
-                match = IO_ISA_Callout_Write(/*&*/f,port,val,iolen);
+                match = IO_ISA_Callout_Write(/*&*/f,port,val,iolen,found);
             }
             else {
                 /* PCI did match. Based on behavior noted above, probe ISA bus anyway and discard data. */
-                match += IO_ISA_Callout_Write(/*&*/f,port,val,iolen);
+                match += IO_ISA_Callout_Write(/*&*/f,port,val,iolen,found);
             }
         }
         else {
             /* Pure ISA emulation */
-            match = IO_ISA_Callout_Write(/*&*/f,port,val,iolen);
+            match = IO_ISA_Callout_Write(/*&*/f,port,val,iolen,found);
         }
     }
 
@@ -299,6 +449,13 @@ void IO_WriteSlowPath(Bitu port,Bitu val,Bitu iolen) {
     LOG(LOG_MISC,LOG_DEBUG)("IO write slow path port=%x data=%x iolen=%u: device matches=%u",(unsigned int)port,(unsigned int)val,(unsigned int)iolen,(unsigned int)match);
     if (match == 0) f(port,val,iolen); /* if nobody responded, then call the default */
     if (match <= 1) io_writehandlers[porti][port] = f;
+    if (GCC_UNLIKELY(io_stats != NULL)) IO_Stat(true,porti,port).slow++;
+
+    /* more than one device responded, remember who if this port is hot */
+    if (match > 1) {
+        found.key = IO_HotKey(true,porti,port);
+        if (IO_PromoteHot(found)) io_writehandlers[porti][port] = IO_WriteHot;
+    }
 
 #if C_DEBUG && 0
     if (match == 0) DEBUG_EnableDebugger();
@@ -307,6 +464,7 @@ void IO_WriteSlowPath(Bitu port,Bitu val,Bitu iolen) {
 
 void IO_RegisterReadHandler(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range) {
     assert((port+range) <= IO_MAX);
+    IO_DropHot(port,range);
 	while (range--) {
 		if (mask&IO_MB) io_readhandlers[0][port]=handler;
 		if (mask&IO_MW) io_readhandlers[1][port]=handler;
@@ -317,6 +475,7 @@ void IO_RegisterReadHandler(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu ra
 
 void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu range) {
     assert((port+range) <= IO_MAX);
+    IO_DropHot(port,range);
 	while (range--) {
 		if (mask&IO_MB) io_writehandlers[0][port]=handler;
 		if (mask&IO_MW) io_writehandlers[1][port]=handler;
@@ -327,6 +486,7 @@ void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu
 
 void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range) {
     assert((port+range) <= IO_MAX);
+    IO_DropHot(port,range);
 	while (range--) {
 		if (mask&IO_MB) io_readhandlers[0][port]=IO_ReadSlowPath;
 		if (mask&IO_MW) io_readhandlers[1][port]=IO_ReadSlowPath;
@@ -337,6 +497,7 @@ void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range) {
 
 void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range) {
     assert((port+range) <= IO_MAX);
+    IO_DropHot(port,range);
 	while (range--) {
 		if (mask&IO_MB) io_writehandlers[0][port]=IO_WriteSlowPath;
 		if (mask&IO_MW) io_writehandlers[1][port]=IO_WriteSlowPath;
@@ -347,17 +508,91 @@ void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range) {
 
 void IO_InvalidateCachedHandler(Bitu port,Bitu range) {
     assert((port+range) <= IO_MAX);
+    IO_DropHot(port,range);
     for (Bitu mb=0;mb <= 2;mb++) {
         Bitu p = port;
         Bitu r = range;
         while (r--) {
             io_writehandlers[mb][p]=IO_WriteSlowPath;
             io_readhandlers[mb][p]=IO_ReadSlowPath;
+            io_slowhits[0][mb][p]=0;
+            io_slowhits[1][mb][p]=0;
             p++;
         }
     }
 }
 
+void IO_EnableHotDispatch(bool enable) {
+    io_hot_enable = enable;
+    if (!enable) {
+        /* send the hot ports back to the slow path */
+        while (io_hot_count != 0) {
+            const uint32_t key = io_hot[0].key;
+            IO_InvalidateCachedHandler(key >> 3u);
+        }
+    }
+}
+
+void IO_EnableStats(bool enable) {
+    if (enable && io_stats == NULL)
+        io_stats = new IO_PortStat[2u * 3u * IO_MAX](); /* ~9MB, only while profiling */
+    else if (!enable && io_stats != NULL) {
+        delete[] io_stats;
+        io_stats = NULL;
+    }
+}
+
+bool IO_StatsEnabled(void) {
+    return io_stats != NULL;
+}
+
+void IO_ResetStats(void) {
+    if (io_stats != NULL)
+        std::fill(io_stats,io_stats + (2u * 3u * IO_MAX),IO_PortStat());
+}
+
+void IO_GetStats(bool write,Bitu port,Bitu iolen,uint64_t &calls,uint64_t &ns,uint64_t &slow) {
+    const unsigned int porti = (iolen >= 4) ? 2 : (unsigned int)(iolen - 1);
+    calls = ns = slow = 0;
+    if (io_stats != NULL) {
+        const IO_PortStat &st = IO_Stat(write,porti,port);
+        calls = st.calls;
+        ns = st.ns;
+        slow = st.slow;
+    }
+}
+
+/* list the ports that took the most host time, busiest first */
+void IO_LogStats(unsigned int max) {
+    static const char * const width[3] = {" 8","16","32"};
+    std::vector<size_t> busy;
+
+    if (io_stats == NULL) {
+        LOG_MSG("I/O statistics are not enabled");
+        return;
+    }
+
+    for (size_t i=0;i < (2u * 3u * IO_MAX);i++) {
+        if (io_stats[i].calls != 0) busy.push_back(i);
+    }
+    std::sort(busy.begin(),busy.end(),[](size_t a,size_t b) { return io_stats[a].ns > io_stats[b].ns; });
+    if (busy.size() > max) busy.resize(max);
+
+    LOG_MSG("Dir Wd Port        Calls   Host ms   ns/call    Slow Dispatch");
+    for (size_t i=0;i < busy.size();i++) {
+        const IO_PortStat &st = io_stats[busy[i]];
+        const bool write = busy[i] >= (3u * IO_MAX);
+        const unsigned int porti = (unsigned int)((busy[i] / IO_MAX) % 3u);
+        const Bitu port = busy[i] % IO_MAX;
+        const bool hot = write ? (io_writehandlers[porti][port] == IO_WriteHot) : (io_readhandlers[porti][port] == IO_ReadHot);
+
+        LOG_MSG("%s %s %04x %12llu %9.3f %9.1f %7llu %s",
+            write ? "OUT" : "IN ",width[porti],(unsigned int)port,
+            (unsigned long long)st.calls,(double)st.ns / 1000000,(double)st.ns / st.calls,
+            (unsigned long long)st.slow,hot ? "hot" : "");
+    }
+}
+
 void IO_ReadHandleObject::Install(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range) {
 	if(!installed) {
 		installed=true;
@@ -491,6 +726,24 @@ void log_io(Bitu width, bool write, Bitu port, Bitu val) {
 #define log_io(W, X, Y, Z)
 #endif
 
+/* dispatch with I/O statistics enabled */
+static Bitu IO_ReadStats(unsigned int porti,Bitu port,Bitu iolen) {
+    const uint64_t start = IO_StatNow();
+    const Bitu ret = io_readhandlers[porti][port](port,iolen);
+    IO_PortStat &st = IO_Stat(false,porti,port);
+    st.ns += IO_StatNow() - start;
+    st.calls++;
+    return ret;
+}
+
+static void IO_WriteStats(unsigned int porti,Bitu port,Bitu val,Bitu iolen) {
+    const uint64_t start = IO_StatNow();
+    io_writehandlers[porti][port](port,val,iolen);
+    IO_PortStat &st = IO_Stat(true,porti,port);
+    st.ns += IO_StatNow() - start;
+    st.calls++;
+}
+
 
 void IO_WriteB(Bitu port,uint8_t val) {
 	log_io(0, true, port, val);
@@ -499,7 +752,8 @@ void IO_WriteB(Bitu port,uint8_t val) {
 	}
 	else {
 		IO_USEC_write_delay(0);
-		io_writehandlers[0][port](port,val,1);
+		if (GCC_UNLIKELY(io_stats != NULL)) IO_WriteStats(0,port,val,1);
+		else io_writehandlers[0][port](port,val,1);
 	}
 }
 
@@ -510,7 +764,8 @@ void IO_WriteW(Bitu port,uint16_t val) {
 	}
 	else {
 		IO_USEC_write_delay(1);
-		io_writehandlers[1][port](port,val,2);
+		if (GCC_UNLIKELY(io_stats != NULL)) IO_WriteStats(1,port,val,2);
+		else io_writehandlers[1][port](port,val,2);
 	}
 }
 
@@ -521,7 +776,8 @@ void IO_WriteD(Bitu port,uint32_t val) {
 	}
 	else {
 		IO_USEC_write_delay(2);
-		io_writehandlers[2][port](port,val,4);
+		if (GCC_UNLIKELY(io_stats != NULL)) IO_WriteStats(2,port,val,4);
+		else io_writehandlers[2][port](port,val,4);
 	}
 }
 
@@ -532,7 +788,8 @@ uint8_t IO_ReadB(Bitu port) {
 	}
 	else {
 		IO_USEC_read_delay(0);
-		retval = (uint8_t)io_readhandlers[0][port](port,1);
+		if (GCC_UNLIKELY(io_stats != NULL)) retval = (uint8_t)IO_ReadStats(0,port,1);
+		else retval = (uint8_t)io_readhandlers[0][port](port,1);
 	}
 	log_io(0, false, port, retval);
 	return retval;
@@ -545,7 +802,8 @@ uint16_t IO_ReadW(Bitu port) {
 	}
 	else {
 		IO_USEC_read_delay(1);
-		retval = (uint16_t)io_readhandlers[1][port](port,2);
+		if (GCC_UNLIKELY(io_stats != NULL)) retval = (uint16_t)IO_ReadStats(1,port,2);
+		else retval = (uint16_t)io_readhandlers[1][port](port,2);
 	}
 	log_io(1, false, port, retval);
 	return retval;
@@ -558,7 +816,8 @@ uint32_t IO_ReadD(Bitu port) {
 	}
 	else {
 		IO_USEC_read_delay(2);
-		retval = (uint32_t)io_readhandlers[2][port](port,4);
+		if (GCC_UNLIKELY(io_stats != NULL)) retval = (uint32_t)IO_ReadStats(2,port,4);
+		else retval = (uint32_t)io_readhandlers[2][port](port,4);
 	}
 	log_io(2, false, port, retval);
 	return retval;
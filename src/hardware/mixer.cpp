@@ -51,6 +51,7 @@
 #include "dosbox.h"
 #include "logging.h"
 #include "mixer.h"
+#include "mixer_kernels.h"
 #include "timer.h"
 #include "setup.h"
 #include "cross.h"
@@ -62,8 +63,17 @@
 #include "midi.h"
 #include "hydra.h"
 
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define MIXER_THREAD 1
+# include <atomic>
+# include <chrono>
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+# include "spsc_ring.h"
+#endif
+
 #define MIXER_SSIZE 4
-#define MIXER_VOLSHIFT 13
 
 static INLINE int16_t MIXER_CLIP(Bits SAMP) {
     if (SAMP < MAX_AUDIO) {
@@ -99,8 +109,153 @@ static struct {
     bool            prebuffer_wait;
     Bitu            prebuffer_samples;
     bool            mute;
+    bool            thread;
 } mixer;
 
+#if MIXER_THREAD
+/* "mixer thread": the emulation thread renders the channels and adds them up as before,
+ * then hands every finished millisecond to the mixer thread through mixer_in. The mixer
+ * thread does the captures, master volume and clipping and feeds the audio callback through
+ * mixer_out. Neither ring takes a lock, so the audio callback no longer waits for the
+ * emulation thread or the other way around, and file I/O of the captures stalls neither. */
+enum {
+    MIXER_PACKET_MIX=0,         /* the mix of one millisecond */
+    MIXER_PACKET_TRACK          /* one channel's output of one millisecond, for multitrack capture */
+};
+
+enum {
+    MIXER_PACKET_CAPTURE=1,     /* pass it on to the captures */
+    MIXER_PACKET_PLAY=2         /* pass it on to the audio callback */
+};
+
+/* everything the mixer thread needs to know is taken from the emulation thread's state
+ * when the packet is posted, so it never reads the mixer or capture settings itself */
+struct MixerPacket {
+    uint32_t        kind;
+    uint32_t        flags;
+    uint32_t        freq;
+    uint32_t        frames;     /* frames of audio, the last frames - used are silence */
+    uint32_t        used;       /* int32_t stereo frames following the header */
+    int32_t         recordscale[2];
+    int32_t         masterscale[2];
+    char            name[32];
+};
+
+static SPSCRing                 mixer_in;           /* emulation thread -> mixer thread, packets */
+static SPSCRing                 mixer_out;          /* mixer thread -> audio callback, int16_t stereo frames */
+static std::thread              mixer_thread;
+static std::atomic<bool>        mixer_thread_quit(false);
+static std::atomic<bool>        mixer_out_mute(false); /* mixer.mute, for the audio callback */
+static std::mutex               mixer_thread_mutex; /* only to sleep on mixer_thread_wake */
+static std::condition_variable  mixer_thread_wake;
+static unsigned long            mixer_in_dropped = 0;
+static unsigned long            mixer_out_dropped = 0;
+
+void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const char *name);
+
+/* emulation thread. If the mixer thread falls that far behind the packet is lost */
+static void MIXER_ThreadPost(uint32_t kind,const int32_t *frames,Bitu used,Bitu total,const char *name) {
+    MixerPacket p;
+
+    memset(&p,0,sizeof(p));
+    if (total > 2048) total = 2048;
+    if (used > total) used = total;
+    p.kind = kind;
+    p.freq = mixer.freq;
+    p.frames = (uint32_t)total;
+    p.used = (uint32_t)used;
+    p.recordscale[0] = (int32_t)(mixer.recordvol[0] * (1 << MIXER_VOLSHIFT));
+    p.recordscale[1] = (int32_t)(mixer.recordvol[1] * (1 << MIXER_VOLSHIFT));
+    p.masterscale[0] = (int32_t)(mixer.mastervol[0] * (1 << MIXER_VOLSHIFT));
+    p.masterscale[1] = (int32_t)(mixer.mastervol[1] * (1 << MIXER_VOLSHIFT));
+    if (kind == MIXER_PACKET_TRACK) {
+        if (CaptureState & CAPTURE_MULTITRACK_WAVE) p.flags |= MIXER_PACKET_CAPTURE;
+    }
+    else {
+        if (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)) p.flags |= MIXER_PACKET_CAPTURE;
+        if (!mixer.nosound && !mixer.mute) p.flags |= MIXER_PACKET_PLAY;
+    }
+    if (name != NULL) safe_strncpy(p.name,name,sizeof(p.name));
+    if (!mixer_in.write(&p,sizeof(p),frames,used*sizeof(int32_t)*2))
+        mixer_in_dropped++;
+}
+
+static void MIXER_ThreadNotify(void) {
+    /* taking the mutex orders this with the check the mixer thread makes before it sleeps */
+    { std::lock_guard<std::mutex> lock(mixer_thread_mutex); }
+    mixer_thread_wake.notify_one();
+}
+
+/* mixer thread: handle one packet, false if there was none */
+static bool MIXER_ThreadProcess(void) {
+    static int32_t frames[2048][2];
+    static int16_t convert[2048][2];
+    MixerPacket p;
+
+    if (mixer_in.readable() < sizeof(p)) return false;
+    mixer_in.read(&p,sizeof(p));
+    assert(p.used <= p.frames && p.frames <= 2048);
+    mixer_in.read(&frames[0][0],p.used*sizeof(int32_t)*2);
+
+    if (p.kind == MIXER_PACKET_TRACK) {
+        if (p.flags & MIXER_PACKET_CAPTURE) {
+            mixer_kernels->scale_clip(&convert[0][0],&frames[0][0],p.used,p.recordscale[0],p.recordscale[1]);
+            memset(&convert[p.used][0],0,(p.frames-p.used)*sizeof(int16_t)*2);
+            CAPTURE_MultiTrackAddWave(p.freq,p.frames,&convert[0][0],p.name);
+        }
+    }
+    else {
+        if (p.flags & MIXER_PACKET_CAPTURE) {
+            mixer_kernels->scale_clip(&convert[0][0],&frames[0][0],p.used,p.recordscale[0],p.recordscale[1]);
+            CAPTURE_AddWave(p.freq,p.used,&convert[0][0]);
+        }
+
+        if (p.flags & MIXER_PACKET_PLAY) {
+            mixer_kernels->scale_clip(&convert[0][0],&frames[0][0],p.used,p.masterscale[0],p.masterscale[1]);
+            if (!mixer_out.write(&convert[0][0],p.used*MIXER_SSIZE))
+                mixer_out_dropped++;
+        }
+    }
+
+    return true;
+}
+
+static void MIXER_ThreadRun(void) {
+    while (!mixer_thread_quit.load()) {
+        if (MIXER_ThreadProcess()) continue;
+
+        std::unique_lock<std::mutex> lock(mixer_thread_mutex);
+        mixer_thread_wake.wait_for(lock,std::chrono::milliseconds(10),[] {
+            return mixer_in.readable() != 0 || mixer_thread_quit.load();
+        });
+    }
+}
+
+static void MIXER_ThreadStop(void) {
+    if (!mixer_thread.joinable()) return;
+
+    mixer_thread_quit = true;
+    MIXER_ThreadNotify();
+    mixer_thread.join();
+
+    /* whatever is left still goes to the captures */
+    while (MIXER_ThreadProcess());
+
+    if (mixer_in_dropped != 0 || mixer_out_dropped != 0)
+        LOG(LOG_MISC,LOG_WARN)("Mixer thread: lost %lu ms of audio on the way in, %lu blocks on the way out",
+            mixer_in_dropped,mixer_out_dropped);
+}
+#endif
+
+/* the audio callback reads mixer.work unless the mixer thread is in between */
+static inline void MIXER_LockAudio(void) {
+    if (!mixer.thread) SDL_LockAudio();
+}
+
+static inline void MIXER_UnlockAudio(void) {
+    if (!mixer.thread) SDL_UnlockAudio();
+}
+
 uint32_t Mixer_MIXQ(void) {
     return  ((uint32_t)mixer.freq) |
             ((uint32_t)2u/*channels*/ << (uint32_t)20u) |
@@ -407,6 +562,13 @@ void MixerChannel::SetFreq(Bitu _freq,Bitu _den) {
 void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const char *name);
 
 void MixerChannel::EndFrame(Bitu samples) {
+#if MIXER_THREAD
+    if (mixer.thread) {
+        if (CaptureState & CAPTURE_MULTITRACK_WAVE)
+            MIXER_ThreadPost(MIXER_PACKET_TRACK,&msbuffer[0][0],std::min((Bitu)msbuffer_o,samples),samples,name);
+    }
+    else
+#endif
     if (CaptureState & CAPTURE_MULTITRACK_WAVE) {// TODO: should be a separate call!
         int16_t convert[1024][2];
         Bitu cnv = msbuffer_o;
@@ -422,10 +584,7 @@ void MixerChannel::EndFrame(Bitu samples) {
             int32_t volscale2 = (int32_t)(mixer.recordvol[1] * (1 << MIXER_VOLSHIFT));
 
             if (cnv > 1024) cnv = 1024;
-            for (Bitu i=0;i<cnv;i++) {
-                convert[i][0]=MIXER_CLIP(((int64_t)msbuffer[i][0] * (int64_t)volscale1) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-                convert[i][1]=MIXER_CLIP(((int64_t)msbuffer[i][1] * (int64_t)volscale2) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-            }
+            mixer_kernels->scale_clip(&convert[0][0],&msbuffer[0][0],cnv,volscale1,volscale2);
             CAPTURE_MultiTrackAddWave(mixer.freq,cnv,(int16_t*)convert,name);
         }
 
@@ -497,21 +656,10 @@ void MixerChannel::Mix(Bitu whole,Bitu frac) {
         }
     }
 
-    if (mixer.swapstereo) {
-        while (rend_n < whole && msbuffer_i < upto) {
-            *outptr++ += msbuffer[msbuffer_i][1];
-            *outptr++ += msbuffer[msbuffer_i][0];
-            msbuffer_i++;
-            rend_n++;
-        }
-    }
-    else {
-        while (rend_n < whole && msbuffer_i < upto) {
-            *outptr++ += msbuffer[msbuffer_i][0];
-            *outptr++ += msbuffer[msbuffer_i][1];
-            msbuffer_i++;
-            rend_n++;
-        }
+    if (rend_n < whole && msbuffer_i < upto) {
+        const Bitu n = std::min(whole - rend_n,upto - msbuffer_i);
+        mixer_kernels->accumulate(outptr,&msbuffer[msbuffer_i][0],n,mixer.swapstereo);
+        msbuffer_i += n;
     }
 
     rend_n = whole;
@@ -655,6 +803,53 @@ inline bool MixerChannel::runSampleInterpolation(const Bitu upto) {
     return true;
 }
 
+/* sample value as loadCurrentSample() reads it, native byte order */
+template<class Type,bool signeddata> static inline int32_t MIXER_SampleValue(const Type s) {
+    if (sizeof(Type) == 1)
+        return (int32_t)(int8_t)((uint8_t)s ^ (signeddata ? 0x00u : 0x80u)) * 256;
+    else if (sizeof(Type) == 2)
+        return (int16_t)((uint16_t)s ^ (signeddata ? 0x0000u : 0x8000u));
+    else
+        return (int32_t)((uint32_t)s ^ (signeddata ? 0x00000000UL : 0x80000000UL));
+}
+
+/* Source at the mixer rate, nothing to filter or limit on load, and in step with the mixer
+ * (what AddSamples leaves behind in that case): every sample loaded renders exactly one
+ * sample, the one loaded before it, so a whole block is just a conversion times volume. */
+template<class Type,bool stereo,bool signeddata>
+inline void MixerChannel::addSamplesAtMixerRate(Bitu &len, const Type* &data) {
+    const Bitu todo = std::min(len,(Bitu)2048 - msbuffer_o);
+    const unsigned int chans = stereo ? 2u : 1u;
+
+    msbuffer[msbuffer_o][0] = current[0] * volmul[0];
+    msbuffer[msbuffer_o][1] = current[1] * volmul[1];
+    if (sizeof(Type) == 1)
+        mixer_kernels->load8(&msbuffer[msbuffer_o+1][0],(const uint8_t*)data,todo-1,stereo,signeddata ? 0x00 : 0x80,volmul[0],volmul[1]);
+    else if (sizeof(Type) == 2)
+        mixer_kernels->load16(&msbuffer[msbuffer_o+1][0],(const uint16_t*)data,todo-1,stereo,signeddata ? 0x0000 : 0x8000,volmul[0],volmul[1]);
+    else
+        mixer_kernels->load32(&msbuffer[msbuffer_o+1][0],(const uint32_t*)data,todo-1,stereo,volmul[0],volmul[1]);
+
+    /* leave the state as loading the samples one at a time would */
+    if (todo >= 2) {
+        last[0] = MIXER_SampleValue<Type,signeddata>(data[(todo-2)*chans]);
+        last[1] = stereo ? MIXER_SampleValue<Type,signeddata>(data[(todo-2)*chans+1]) : last[0];
+    }
+    else {
+        last[0] = current[0];
+        last[1] = current[1];
+    }
+    current[0] = MIXER_SampleValue<Type,signeddata>(data[(todo-1)*chans]);
+    current[1] = stereo ? MIXER_SampleValue<Type,signeddata>(data[(todo-1)*chans+1]) : current[0];
+    delta[0] = current[0] - last[0];
+    delta[1] = current[1] - last[1];
+    freq_fslew = freq_nslew;
+
+    msbuffer_o += todo;
+    data += todo*chans;
+    len -= todo;
+}
+
 template<class Type,bool stereo,bool signeddata,bool nativeorder>
 inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
     last_sample_write = (Bits)mixer.samples_rendered_ms.w;
@@ -677,6 +872,12 @@ inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
         freq_f = freq_fslew = 0; /* interpolate now from what we just loaded */
     }
 
+    if (nativeorder && len != 0 && !lowpass_on_load && freq_n == freq_d && freq_f == freq_d && freq_fslew >= freq_d &&
+        (freq_nslew_want == 0 || freq_nslew_want >= freq_n)) {
+        addSamplesAtMixerRate<Type,stereo,signeddata>(len,data);
+        if (msbuffer_o >= 2048) return;
+    }
+
     if (lowpass_on_load) {
         for (;;) {
             if (freq_f >= freq_d) {
@@ -787,19 +988,16 @@ static void MIXER_MixData(Bitu fracs/*render up to*/) {
         chan=chan->next;
     }
 
-    if (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)) {
+    /* with the mixer thread the captures are done there, a millisecond at a time */
+    if ((CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)) && !mixer.thread) {
         int32_t volscale1 = (int32_t)(mixer.recordvol[0] * (1 << MIXER_VOLSHIFT));
         int32_t volscale2 = (int32_t)(mixer.recordvol[1] * (1 << MIXER_VOLSHIFT));
         int16_t convert[1024][2];
         Bitu added = whole - prev_rendered;
         if (added>1024) added=1024;
         Bitu readpos = mixer.work_in + prev_rendered;
-        for (Bitu i=0;i<added;i++) {
-            convert[i][0]=MIXER_CLIP(((int64_t)mixer.work[readpos][0] * (int64_t)volscale1) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-            convert[i][1]=MIXER_CLIP(((int64_t)mixer.work[readpos][1] * (int64_t)volscale2) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-            readpos++;
-        }
-        assert(readpos <= MIXER_BUFSIZE);
+        assert((readpos + added) <= MIXER_BUFSIZE);
+        mixer_kernels->scale_clip(&convert[0][0],&mixer.work[readpos][0],added,volscale1,volscale2);
         CAPTURE_AddWave( mixer.freq, added, (int16_t*)convert );
     }
 
@@ -838,11 +1036,11 @@ static void MIXER_MixData(Bitu fracs/*render up to*/) {
 }
 
 static void MIXER_FillUp(void) {
-    SDL_LockAudio();
+    MIXER_LockAudio();
     float index = PIC_TickIndex();
     if (index < 0) index = 0;
     MIXER_MixData((Bitu)((double)index * ((Bitu)mixer.samples_this_ms.w * mixer.samples_this_ms.fd)));
-    SDL_UnlockAudio();
+    MIXER_UnlockAudio();
 }
 
 void MixerChannel::FillUp(void) {
@@ -857,11 +1055,17 @@ void MIXER_MixSingle(Bitu /*val*/) {
 static void MIXER_Mix(void) {
     Bitu thr;
 
-    SDL_LockAudio();
+    MIXER_LockAudio();
 
     /* render */
     assert((mixer.work_in+mixer.samples_per_ms.w) <= MIXER_BUFSIZE);
     MIXER_MixData((Bitu)mixer.samples_this_ms.w * (Bitu)mixer.samples_this_ms.fd);
+#if MIXER_THREAD
+    if (mixer.thread) {
+        MIXER_ThreadPost(MIXER_PACKET_MIX,&mixer.work[mixer.work_in][0],mixer.samples_this_ms.w,mixer.samples_this_ms.w,NULL);
+        MIXER_ThreadNotify();
+    }
+#endif
     mixer.work_in += mixer.samples_this_ms.w;
 
     /* how many samples for the next ms? */
@@ -885,14 +1089,65 @@ static void MIXER_Mix(void) {
     memset(&mixer.work[mixer.work_in][0],0,sizeof(int32_t)*2*mixer.samples_this_ms.w);
     mixer.samples_rendered_ms.fn = 0;
     mixer.samples_rendered_ms.w = 0;
-    SDL_UnlockAudio();
+    MIXER_UnlockAudio();
     MIXER_FillUp();
 }
 
+#if MIXER_THREAD
+/* audio callback fed by the mixer thread, the same buffering and drop rules on mixer_out */
+static void MIXER_CallBackThreaded(int16_t *output,Bitu need) {
+    Bitu remains;
+
+    const bool mute = mixer_out_mute.load();
+
+    if (mute)
+        mixer_out.skip(mixer_out.readable());
+
+    if (mixer.prebuffer_wait) {
+        if ((mixer_out.readable() / MIXER_SSIZE) >= mixer.prebuffer_samples)
+            mixer.prebuffer_wait = false;
+    }
+
+    if (!mixer.prebuffer_wait && !mute) {
+        const Bitu n = mixer_out.read(output,need * MIXER_SSIZE) / MIXER_SSIZE;
+        output += n * 2;
+        need -= n;
+    }
+
+    if (need > 0)
+        mixer.prebuffer_wait = true;
+
+    while (need > 0) {
+        *output++ = 0;
+        *output++ = 0;
+        need--;
+    }
+
+    remains = mixer_out.readable() / MIXER_SSIZE;
+    if (remains >= (mixer.blocksize*2UL)) {
+        /* drop some samples to keep time */
+        Bitu drop;
+
+        if (remains >= (mixer.blocksize*3UL)) // hard drop
+            drop = remains - mixer.blocksize;
+        else // subtle drop
+            drop = ((remains - (mixer.blocksize*2)) / 50U) + 1;
+
+        mixer_out.skip(drop * MIXER_SSIZE);
+    }
+}
+#endif
+
 static void SDLCALL MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
     if (HYDRA_AudioCallback(stream, len)) return;
 
     (void)userdata;//UNUSED
+#if MIXER_THREAD
+    if (mixer.thread) {
+        MIXER_CallBackThreaded((int16_t*)stream,(Bitu)len/MIXER_SSIZE);
+        return;
+    }
+#endif
     int32_t volscale1 = (int32_t)(mixer.mastervol[0] * (1 << MIXER_VOLSHIFT));
     int32_t volscale2 = (int32_t)(mixer.mastervol[1] * (1 << MIXER_VOLSHIFT));
     Bitu need = (Bitu)len/MIXER_SSIZE;
@@ -916,17 +1171,17 @@ static void SDLCALL MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
     }
 
     if (!mixer.prebuffer_wait && !mixer.mute) {
-        int32_t *in = &mixer.work[mixer.work_out][0];
-        while (need > 0) {
-            if (mixer.work_out == mixer.work_in) break;
-            *output++ = MIXER_CLIP((((int64_t)(*in++)) * (int64_t)volscale1) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-            *output++ = MIXER_CLIP((((int64_t)(*in++)) * (int64_t)volscale2) >> (MIXER_VOLSHIFT + MIXER_VOLSHIFT));
-            mixer.work_out++;
-            if (mixer.work_out >= mixer.work_wrap) {
-                mixer.work_out = 0;
-                in = &mixer.work[mixer.work_out][0];
-            }
-            need--;
+        /* in runs up to work_in or the wraparound point, whichever comes first */
+        while (need > 0 && mixer.work_out != mixer.work_in) {
+            Bitu end = (mixer.work_out < mixer.work_in) ? std::min(mixer.work_in,mixer.work_wrap) : mixer.work_wrap;
+            if (end <= mixer.work_out) end = mixer.work_out + 1;
+            const Bitu n = std::min(need,end - mixer.work_out);
+
+            mixer_kernels->scale_clip(output,&mixer.work[mixer.work_out][0],n,volscale1,volscale2);
+            output += n * 2;
+            need -= n;
+            mixer.work_out += n;
+            if (mixer.work_out >= mixer.work_wrap) mixer.work_out = 0;
         }
     }
 
@@ -985,6 +1240,10 @@ std::string mixerinfo() {
 
 static void MIXER_Stop(Section* sec) {
     (void)sec;//UNUSED
+#if MIXER_THREAD
+    if (mixer.thread && !mixer.nosound) SDL_PauseAudio(1);
+    MIXER_ThreadStop();
+#endif
 }
 
 class MIXER : public Program {
@@ -1088,6 +1347,9 @@ MixerObject::~MixerObject(){
 
 void MENU_mute(bool enabled) {
     mixer.mute=enabled;
+#if MIXER_THREAD
+    mixer_out_mute = enabled;
+#endif
     mainMenu.get_item("mixer_mute").check(mixer.mute).refresh_item(mainMenu);
 }
 
@@ -1186,7 +1448,24 @@ void MIXER_Init() {
     mixer.swapstereo=section->Get_bool("swapstereo");
     mixer.sampleaccurate=section->Get_bool("sample accurate");
     mixer.mute=false;
+    mixer.thread=section->Get_bool("mixer thread");
     if (control->opt_silent) mixer.nosound = true;
+    MIXER_SelectKernels();
+#if !MIXER_THREAD
+    if (mixer.thread) {
+        LOG(LOG_MISC,LOG_WARN)("MIXER:mixer thread is not supported on this platform");
+        mixer.thread = false;
+    }
+#else
+    if (mixer.thread) {
+        /* MIXER_BUFSIZE frames either way, mixer_in with room for a few multitrack channels too */
+        mixer_in.resize(MIXER_BUFSIZE*sizeof(int32_t)*2*4);
+        mixer_out.resize(MIXER_BUFSIZE*MIXER_SSIZE);
+        mixer_thread_quit = false;
+        mixer_out_mute = false;
+        mixer_thread = std::thread(MIXER_ThreadRun);
+    }
+#endif
 
     /* Initialize the internal stuff */
     mixer.prebuffer_samples=0;
@@ -0,0 +1,447 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Block kernels of the mixer: plain C, SSE2, AVX2 and NEON versions.
+ *
+ * The SIMD versions must match the plain C versions bit for bit. The volume scaling is
+ * done in 64 bits like the C code, ((int64_t)sample * vol) >> 26 clipped to 16 bits, also
+ * for products that do not fit in 32 bits after the shift. The sample loops wrap around
+ * on overflow, which is what the int arithmetic of the scalar mixer does in practice. */
+
+#include "dosbox.h"
+#include "logging.h"
+#include "mixer.h"
+#include "mixer_kernels.h"
+
+#if defined(_M_AMD64) || defined(__amd64__) || defined(__e2k__)
+/* SSE2 is always available on x86_64 and Elbrus */
+# define MIXER_SSE2 1
+# define MIXER_TARGET_SSE2
+# define mixer_sse2_available (true)
+#elif defined(__SSE__) && !defined(EMSCRIPTEN)
+# define MIXER_SSE2 1
+# define MIXER_TARGET_SSE2 __attribute__((__target__("sse2")))
+extern bool sse2_available;
+# define mixer_sse2_available (sse2_available)
+#endif
+
+#if defined(__GNUC__) && defined(__SSE__) && (defined(__amd64__) || defined(__i386__)) && !defined(EMSCRIPTEN)
+# define MIXER_AVX2 1
+extern bool avx2_available;
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define MIXER_NEON 1
+#endif
+
+#if defined(MIXER_SSE2)
+# include <emmintrin.h>
+#endif
+#if defined(MIXER_AVX2)
+# include <immintrin.h>
+#endif
+#if defined(MIXER_NEON)
+# include <arm_neon.h>
+#endif
+
+#define MIXER_SCALESHIFT (MIXER_VOLSHIFT + MIXER_VOLSHIFT)
+/* the shifted product fits in int16 when the upper 32 bits of the product shifted by this are all sign */
+#define MIXER_CLIPSHIFT (MIXER_SCALESHIFT + 15 - 32)
+
+/*==================== plain C ====================*/
+
+/* multiply with wraparound, as the int arithmetic of the mixer does in practice */
+static inline int32_t MIXER_Mul(int32_t s,int32_t v) {
+    return (int32_t)((uint32_t)s * (uint32_t)v);
+}
+
+static inline int16_t MIXER_ScaleClip(int32_t s,int32_t v) {
+    const int64_t r = ((int64_t)s * (int64_t)v) >> (int64_t)MIXER_SCALESHIFT;
+    if (r > MAX_AUDIO) return MAX_AUDIO;
+    if (r < MIN_AUDIO) return MIN_AUDIO;
+    return (int16_t)r;
+}
+
+static void MIXER_Accumulate_C(int32_t *dst,const int32_t *src,size_t frames,bool swap) {
+    if (swap) {
+        for (size_t i=0;i < frames;i++,dst += 2,src += 2) {
+            dst[0] += src[1];
+            dst[1] += src[0];
+        }
+    }
+    else {
+        for (size_t i=0;i < frames*2u;i++)
+            dst[i] += src[i];
+    }
+}
+
+static void MIXER_ScaleClip_C(int16_t *dst,const int32_t *src,size_t frames,int32_t vol0,int32_t vol1) {
+    for (size_t i=0;i < frames;i++,dst += 2,src += 2) {
+        dst[0] = MIXER_ScaleClip(src[0],vol0);
+        dst[1] = MIXER_ScaleClip(src[1],vol1);
+    }
+}
+
+static void MIXER_Load8_C(int32_t *dst,const uint8_t *src,size_t frames,bool stereo,uint8_t xr,int32_t vol0,int32_t vol1) {
+    for (size_t i=0;i < frames;i++,dst += 2) {
+        const int32_t s0 = (int32_t)(int8_t)(*src++ ^ xr) * 256;
+        const int32_t s1 = stereo ? (int32_t)(int8_t)(*src++ ^ xr) * 256 : s0;
+        dst[0] = MIXER_Mul(s0,vol0);
+        dst[1] = MIXER_Mul(s1,vol1);
+    }
+}
+
+static void MIXER_Load16_C(int32_t *dst,const uint16_t *src,size_t frames,bool stereo,uint16_t xr,int32_t vol0,int32_t vol1) {
+    for (size_t i=0;i < frames;i++,dst += 2) {
+        const int32_t s0 = (int16_t)(*src++ ^ xr);
+        const int32_t s1 = stereo ? (int16_t)(*src++ ^ xr) : s0;
+        dst[0] = MIXER_Mul(s0,vol0);
+        dst[1] = MIXER_Mul(s1,vol1);
+    }
+}
+
+static void MIXER_Load32_C(int32_t *dst,const uint32_t *src,size_t frames,bool stereo,int32_t vol0,int32_t vol1) {
+    for (size_t i=0;i < frames;i++,dst += 2) {
+        const int32_t s0 = (int32_t)(*src++);
+        const int32_t s1 = stereo ? (int32_t)(*src++) : s0;
+        dst[0] = MIXER_Mul(s0,vol0);
+        dst[1] = MIXER_Mul(s1,vol1);
+    }
+}
+
+static const MixerKernels mixer_kernels_c = {
+    "C",
+    MIXER_Accumulate_C,
+    MIXER_ScaleClip_C,
+    MIXER_Load8_C,
+    MIXER_Load16_C,
+    MIXER_Load32_C
+};
+
+/*==================== SSE2 ====================*/
+
+#if defined(MIXER_SSE2)
+/* low 32 bits of a * b, SSE2 has no _mm_mullo_epi32 */
+MIXER_TARGET_SSE2 static inline __m128i MIXER_MulLo_SSE2(__m128i a,__m128i b) {
+    const __m128i even = _mm_mul_epu32(a,b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+}
+
+/* 8 samples as int16 to int32 times volume, 4 stereo frames or 8 mono ones */
+MIXER_TARGET_SSE2 static inline int32_t *MIXER_Store16_SSE2(int32_t *dst,__m128i w,bool stereo,__m128i vol) {
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w,w),16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w,w),16);
+    if (stereo) {
+        _mm_storeu_si128((__m128i*)dst + 0,MIXER_MulLo_SSE2(lo,vol));
+        _mm_storeu_si128((__m128i*)dst + 1,MIXER_MulLo_SSE2(hi,vol));
+        return dst + 8;
+    }
+    else {
+        _mm_storeu_si128((__m128i*)dst + 0,MIXER_MulLo_SSE2(_mm_unpacklo_epi32(lo,lo),vol));
+        _mm_storeu_si128((__m128i*)dst + 1,MIXER_MulLo_SSE2(_mm_unpackhi_epi32(lo,lo),vol));
+        _mm_storeu_si128((__m128i*)dst + 2,MIXER_MulLo_SSE2(_mm_unpacklo_epi32(hi,hi),vol));
+        _mm_storeu_si128((__m128i*)dst + 3,MIXER_MulLo_SSE2(_mm_unpackhi_epi32(hi,hi),vol));
+        return dst + 16;
+    }
+}
+
+MIXER_TARGET_SSE2 static void MIXER_Accumulate_SSE2(int32_t *dst,const int32_t *src,size_t frames,bool swap) {
+    size_t i = 0;
+    for (;(i+2u) <= frames;i += 2u,dst += 4,src += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        if (swap) s = _mm_shuffle_epi32(s,_MM_SHUFFLE(2,3,0,1));
+        _mm_storeu_si128((__m128i*)dst,_mm_add_epi32(_mm_loadu_si128((const __m128i*)dst),s));
+    }
+    MIXER_Accumulate_C(dst,src,frames-i,swap);
+}
+
+MIXER_TARGET_SSE2 static void MIXER_Load8_SSE2(int32_t *dst,const uint8_t *src,size_t frames,bool stereo,uint8_t xr,int32_t vol0,int32_t vol1) {
+    const __m128i vol = _mm_set_epi32(vol1,vol0,vol1,vol0);
+    const __m128i x = _mm_set1_epi8((char)xr);
+    const __m128i zero = _mm_setzero_si128();
+    const size_t step = stereo ? 8u : 16u; /* frames per 16 bytes */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 16) {
+        const __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)src),x);
+        dst = MIXER_Store16_SSE2(dst,_mm_unpacklo_epi8(zero,b),stereo,vol); /* byte << 8 */
+        dst = MIXER_Store16_SSE2(dst,_mm_unpackhi_epi8(zero,b),stereo,vol);
+    }
+    MIXER_Load8_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+MIXER_TARGET_SSE2 static void MIXER_Load16_SSE2(int32_t *dst,const uint16_t *src,size_t frames,bool stereo,uint16_t xr,int32_t vol0,int32_t vol1) {
+    const __m128i vol = _mm_set_epi32(vol1,vol0,vol1,vol0);
+    const __m128i x = _mm_set1_epi16((short)xr);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 samples */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8)
+        dst = MIXER_Store16_SSE2(dst,_mm_xor_si128(_mm_loadu_si128((const __m128i*)src),x),stereo,vol);
+    MIXER_Load16_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+MIXER_TARGET_SSE2 static void MIXER_Load32_SSE2(int32_t *dst,const uint32_t *src,size_t frames,bool stereo,int32_t vol0,int32_t vol1) {
+    const __m128i vol = _mm_set_epi32(vol1,vol0,vol1,vol0);
+    size_t i = 0;
+    if (stereo) {
+        for (;(i+2u) <= frames;i += 2u,src += 4,dst += 4)
+            _mm_storeu_si128((__m128i*)dst,MIXER_MulLo_SSE2(_mm_loadu_si128((const __m128i*)src),vol));
+    }
+    else {
+        for (;(i+4u) <= frames;i += 4u,src += 4,dst += 8) {
+            const __m128i s = _mm_loadu_si128((const __m128i*)src);
+            _mm_storeu_si128((__m128i*)dst + 0,MIXER_MulLo_SSE2(_mm_unpacklo_epi32(s,s),vol));
+            _mm_storeu_si128((__m128i*)dst + 1,MIXER_MulLo_SSE2(_mm_unpackhi_epi32(s,s),vol));
+        }
+    }
+    MIXER_Load32_C(dst,src,frames-i,stereo,vol0,vol1);
+}
+
+static const MixerKernels mixer_kernels_sse2 = {
+    "SSE2",
+    MIXER_Accumulate_SSE2,
+    MIXER_ScaleClip_C, /* SSE2 has no signed 32x32=64 multiply, emulating it is no faster than the scalar imul */
+    MIXER_Load8_SSE2,
+    MIXER_Load16_SSE2,
+    MIXER_Load32_SSE2
+};
+#endif
+
+/*==================== AVX2 ====================*/
+
+#if defined(MIXER_AVX2)
+/* (a * b) >> MIXER_SCALESHIFT in 64 bits. Where that does not fit in 16 bits, not even in 32,
+ * the result is the int32 limit of the same sign so that the saturating pack to int16 clips
+ * like the C code */
+__attribute__((__target__("avx2"))) static inline __m256i MIXER_Scale_AVX2(__m256i a,__m256i b) {
+    const __m256i even = _mm256_mul_epi32(a,b);
+    const __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a,32),_mm256_srli_epi64(b,32));
+    const __m256i r = _mm256_blend_epi32(_mm256_srli_epi64(even,MIXER_SCALESHIFT),_mm256_slli_epi64(_mm256_srli_epi64(odd,MIXER_SCALESHIFT),32),0xAA);
+    const __m256i hi = _mm256_blend_epi32(_mm256_srli_epi64(even,32),odd,0xAA);
+    const __m256i sign = _mm256_srai_epi32(hi,31);
+    const __m256i fits = _mm256_cmpeq_epi32(_mm256_srai_epi32(hi,MIXER_CLIPSHIFT),sign);
+    return _mm256_blendv_epi8(_mm256_xor_si256(sign,_mm256_set1_epi32(0x7FFFFFFF)),r,fits);
+}
+
+/* 8 samples as int32 times volume, 4 stereo frames or 8 mono ones */
+__attribute__((__target__("avx2"))) static inline int32_t *MIXER_Store32_AVX2(int32_t *dst,__m256i s,bool stereo,__m256i vol) {
+    if (stereo) {
+        _mm256_storeu_si256((__m256i*)dst,_mm256_mullo_epi32(s,vol));
+        return dst + 8;
+    }
+    else {
+        const __m256i dup_lo = _mm256_set_epi32(3,3,2,2,1,1,0,0);
+        const __m256i dup_hi = _mm256_set_epi32(7,7,6,6,5,5,4,4);
+        _mm256_storeu_si256((__m256i*)dst + 0,_mm256_mullo_epi32(_mm256_permutevar8x32_epi32(s,dup_lo),vol));
+        _mm256_storeu_si256((__m256i*)dst + 1,_mm256_mullo_epi32(_mm256_permutevar8x32_epi32(s,dup_hi),vol));
+        return dst + 16;
+    }
+}
+
+__attribute__((__target__("avx2"))) static void MIXER_Accumulate_AVX2(int32_t *dst,const int32_t *src,size_t frames,bool swap) {
+    size_t i = 0;
+    for (;(i+4u) <= frames;i += 4u,dst += 8,src += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        if (swap) s = _mm256_shuffle_epi32(s,_MM_SHUFFLE(2,3,0,1));
+        _mm256_storeu_si256((__m256i*)dst,_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)dst),s));
+    }
+    MIXER_Accumulate_C(dst,src,frames-i,swap);
+}
+
+__attribute__((__target__("avx2"))) static void MIXER_ScaleClip_AVX2(int16_t *dst,const int32_t *src,size_t frames,int32_t vol0,int32_t vol1) {
+    const __m256i vol = _mm256_set_epi32(vol1,vol0,vol1,vol0,vol1,vol0,vol1,vol0);
+    size_t i = 0;
+    for (;(i+8u) <= frames;i += 8u,dst += 16,src += 16) {
+        const __m256i a = MIXER_Scale_AVX2(_mm256_loadu_si256((const __m256i*)src + 0),vol);
+        const __m256i b = MIXER_Scale_AVX2(_mm256_loadu_si256((const __m256i*)src + 1),vol);
+        /* the pack works within 128-bit lanes, put the frames back in order */
+        _mm256_storeu_si256((__m256i*)dst,_mm256_permute4x64_epi64(_mm256_packs_epi32(a,b),_MM_SHUFFLE(3,1,2,0)));
+    }
+    MIXER_ScaleClip_C(dst,src,frames-i,vol0,vol1);
+}
+
+__attribute__((__target__("avx2"))) static void MIXER_Load8_AVX2(int32_t *dst,const uint8_t *src,size_t frames,bool stereo,uint8_t xr,int32_t vol0,int32_t vol1) {
+    const __m256i vol = _mm256_set_epi32(vol1,vol0,vol1,vol0,vol1,vol0,vol1,vol0);
+    const __m128i x = _mm_set1_epi8((char)xr);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 bytes */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8) {
+        const __m128i b = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)src),x);
+        dst = MIXER_Store32_AVX2(dst,_mm256_slli_epi32(_mm256_cvtepi8_epi32(b),8),stereo,vol);
+    }
+    MIXER_Load8_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+__attribute__((__target__("avx2"))) static void MIXER_Load16_AVX2(int32_t *dst,const uint16_t *src,size_t frames,bool stereo,uint16_t xr,int32_t vol0,int32_t vol1) {
+    const __m256i vol = _mm256_set_epi32(vol1,vol0,vol1,vol0,vol1,vol0,vol1,vol0);
+    const __m128i x = _mm_set1_epi16((short)xr);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 samples */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8) {
+        const __m128i w = _mm_xor_si128(_mm_loadu_si128((const __m128i*)src),x);
+        dst = MIXER_Store32_AVX2(dst,_mm256_cvtepi16_epi32(w),stereo,vol);
+    }
+    MIXER_Load16_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+__attribute__((__target__("avx2"))) static void MIXER_Load32_AVX2(int32_t *dst,const uint32_t *src,size_t frames,bool stereo,int32_t vol0,int32_t vol1) {
+    const __m256i vol = _mm256_set_epi32(vol1,vol0,vol1,vol0,vol1,vol0,vol1,vol0);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 samples */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8)
+        dst = MIXER_Store32_AVX2(dst,_mm256_loadu_si256((const __m256i*)src),stereo,vol);
+    MIXER_Load32_C(dst,src,frames-i,stereo,vol0,vol1);
+}
+
+static const MixerKernels mixer_kernels_avx2 = {
+    "AVX2",
+    MIXER_Accumulate_AVX2,
+    MIXER_ScaleClip_AVX2,
+    MIXER_Load8_AVX2,
+    MIXER_Load16_AVX2,
+    MIXER_Load32_AVX2
+};
+#endif
+
+/*==================== NEON ====================*/
+
+#if defined(MIXER_NEON)
+/* 8 samples as int16 to int32 times volume, 4 stereo frames or 8 mono ones */
+static inline int32_t *MIXER_Store16_NEON(int32_t *dst,int16x8_t w,bool stereo,int32x4_t vol) {
+    const int32x4_t lo = vmovl_s16(vget_low_s16(w));
+    const int32x4_t hi = vmovl_s16(vget_high_s16(w));
+    if (stereo) {
+        vst1q_s32(dst + 0,vmulq_s32(lo,vol));
+        vst1q_s32(dst + 4,vmulq_s32(hi,vol));
+        return dst + 8;
+    }
+    else {
+        const int32x4x2_t l = vzipq_s32(lo,lo);
+        const int32x4x2_t h = vzipq_s32(hi,hi);
+        vst1q_s32(dst + 0,vmulq_s32(l.val[0],vol));
+        vst1q_s32(dst + 4,vmulq_s32(l.val[1],vol));
+        vst1q_s32(dst + 8,vmulq_s32(h.val[0],vol));
+        vst1q_s32(dst + 12,vmulq_s32(h.val[1],vol));
+        return dst + 16;
+    }
+}
+
+static void MIXER_Accumulate_NEON(int32_t *dst,const int32_t *src,size_t frames,bool swap) {
+    size_t i = 0;
+    for (;(i+2u) <= frames;i += 2u,dst += 4,src += 4) {
+        int32x4_t s = vld1q_s32(src);
+        if (swap) s = vrev64q_s32(s);
+        vst1q_s32(dst,vaddq_s32(vld1q_s32(dst),s));
+    }
+    MIXER_Accumulate_C(dst,src,frames-i,swap);
+}
+
+static void MIXER_ScaleClip_NEON(int16_t *dst,const int32_t *src,size_t frames,int32_t vol0,int32_t vol1) {
+    const int32_t v[2] = {vol0,vol1};
+    const int32x2_t vol = vld1_s32(v);
+    size_t i = 0;
+    for (;(i+4u) <= frames;i += 4u,dst += 8,src += 8) {
+        const int32x4_t a = vld1q_s32(src + 0);
+        const int32x4_t b = vld1q_s32(src + 4);
+        const int32x4_t ra = vcombine_s32(vqshrn_n_s64(vmull_s32(vget_low_s32(a),vol),MIXER_SCALESHIFT),vqshrn_n_s64(vmull_s32(vget_high_s32(a),vol),MIXER_SCALESHIFT));
+        const int32x4_t rb = vcombine_s32(vqshrn_n_s64(vmull_s32(vget_low_s32(b),vol),MIXER_SCALESHIFT),vqshrn_n_s64(vmull_s32(vget_high_s32(b),vol),MIXER_SCALESHIFT));
+        vst1q_s16(dst,vcombine_s16(vqmovn_s32(ra),vqmovn_s32(rb)));
+    }
+    MIXER_ScaleClip_C(dst,src,frames-i,vol0,vol1);
+}
+
+static void MIXER_Load8_NEON(int32_t *dst,const uint8_t *src,size_t frames,bool stereo,uint8_t xr,int32_t vol0,int32_t vol1) {
+    const int32_t v[4] = {vol0,vol1,vol0,vol1};
+    const int32x4_t vol = vld1q_s32(v);
+    const uint8x8_t x = vdup_n_u8(xr);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 bytes */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8) {
+        const int8x8_t b = vreinterpret_s8_u8(veor_u8(vld1_u8(src),x));
+        dst = MIXER_Store16_NEON(dst,vshlq_n_s16(vmovl_s8(b),8),stereo,vol);
+    }
+    MIXER_Load8_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+static void MIXER_Load16_NEON(int32_t *dst,const uint16_t *src,size_t frames,bool stereo,uint16_t xr,int32_t vol0,int32_t vol1) {
+    const int32_t v[4] = {vol0,vol1,vol0,vol1};
+    const int32x4_t vol = vld1q_s32(v);
+    const uint16x8_t x = vdupq_n_u16(xr);
+    const size_t step = stereo ? 4u : 8u; /* frames per 8 samples */
+    size_t i = 0;
+    for (;(i+step) <= frames;i += step,src += 8)
+        dst = MIXER_Store16_NEON(dst,vreinterpretq_s16_u16(veorq_u16(vld1q_u16(src),x)),stereo,vol);
+    MIXER_Load16_C(dst,src,frames-i,stereo,xr,vol0,vol1);
+}
+
+static void MIXER_Load32_NEON(int32_t *dst,const uint32_t *src,size_t frames,bool stereo,int32_t vol0,int32_t vol1) {
+    const int32_t v[4] = {vol0,vol1,vol0,vol1};
+    const int32x4_t vol = vld1q_s32(v);
+    size_t i = 0;
+    if (stereo) {
+        for (;(i+2u) <= frames;i += 2u,src += 4,dst += 4)
+            vst1q_s32(dst,vmulq_s32(vreinterpretq_s32_u32(vld1q_u32(src)),vol));
+    }
+    else {
+        for (;(i+4u) <= frames;i += 4u,src += 4,dst += 8) {
+            const int32x4_t s = vreinterpretq_s32_u32(vld1q_u32(src));
+            const int32x4x2_t d = vzipq_s32(s,s);
+            vst1q_s32(dst + 0,vmulq_s32(d.val[0],vol));
+            vst1q_s32(dst + 4,vmulq_s32(d.val[1],vol));
+        }
+    }
+    MIXER_Load32_C(dst,src,frames-i,stereo,vol0,vol1);
+}
+
+static const MixerKernels mixer_kernels_neon = {
+    "NEON",
+    MIXER_Accumulate_NEON,
+    MIXER_ScaleClip_NEON,
+    MIXER_Load8_NEON,
+    MIXER_Load16_NEON,
+    MIXER_Load32_NEON
+};
+#endif
+
+const MixerKernels *mixer_kernels = &mixer_kernels_c;
+
+const MixerKernels *MIXER_GetKernels(unsigned int index) {
+    const MixerKernels *list[4];
+    unsigned int count = 0;
+
+    list[count++] = &mixer_kernels_c;
+#if defined(MIXER_SSE2)
+    if (mixer_sse2_available) list[count++] = &mixer_kernels_sse2;
+#endif
+#if defined(MIXER_AVX2)
+    if (avx2_available) list[count++] = &mixer_kernels_avx2;
+#endif
+#if defined(MIXER_NEON)
+    list[count++] = &mixer_kernels_neon;
+#endif
+
+    return index < count ? list[index] : NULL;
+}
+
+void MIXER_SelectKernels(void) {
+    const MixerKernels *k;
+
+    /* the list is in order of preference, take the last */
+    for (unsigned int i=0;(k=MIXER_GetKernels(i)) != NULL;i++)
+        mixer_kernels = k;
+
+    LOG(LOG_MISC,LOG_DEBUG)("Mixer: using %s sample kernels",mixer_kernels->name);
+}
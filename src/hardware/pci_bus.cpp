@@ -31,6 +31,7 @@
 #include "../ints/int10.h"
 #include "voodoo.h"
 #include "control.h"
+#include "ide.h"
 
 bool pcibus_enable = false;
 bool log_pci = false;
@@ -321,6 +322,76 @@ public:
 	}
 };
 
+class PCI_IDEDevice:public PCI_Device {
+private:
+	static const uint16_t vendor=0x8086;	// Intel
+	static const uint16_t device=0x7010;	// 82371SB PIIX3 IDE
+public:
+	PCI_IDEDevice():PCI_Device(vendor,device) {
+		// init (PIIX3 bus master IDE function)
+		config[0x08] = 0x00;	// revision
+		config[0x09] = 0x80;	// interface (bus master capable, both channels fixed in compatibility mode)
+		config[0x0a] = 0x01;	// subclass code (IDE controller)
+		config[0x0b] = 0x01;	// class code (mass storage controller)
+		config[0x0d] = 0x00;	// latency timer
+		config[0x0e] = 0x00;	// header type (other)
+
+		// reset
+		config[0x04] = 0x05;	// command register (I/O space enabled, bus master enabled)
+		config[0x05] = 0x00;
+		config[0x06] = 0x80;	// status register (fast back-to-back, medium DEVSEL timing)
+		config[0x07] = 0x02;
+
+		config[0x3c] = 0xff;	// no irq, the channels use IRQ 14 and 15 like ISA IDE
+
+		host_writew(config_writemask+0x04,0x0005);	/* allow changing I/O enable and bus master enable */
+
+		host_writed(config_writemask+0x20,0x0000FFF0);	/* BAR4: I/O resource, 16 ports for the bus master registers */
+		host_writed(config+0x20,0xFFA0 | 0x1);
+
+		/* IDETIM primary/secondary (40h-43h) and SIDETIM (44h). Bit 15 of IDETIM enables decode
+		 * of the channel, which drivers check before using it. The timings themselves mean nothing here */
+		host_writew(config+0x40,0x8000);
+		host_writew(config+0x42,0x8000);
+		host_writed(config_writemask+0x40,0xFFFFFFFF);
+		config_writemask[0x44] = 0xFF;
+	}
+
+	/* tell the IDE emulation where the bus master registers are, if anywhere */
+	void update_io(void) {
+		if (config[0x04] & 0x01)
+			IDE_BusMaster_SetBase(host_readd(config+0x20)&0xFFF0u);
+		else
+			IDE_BusMaster_SetBase(0);
+	}
+
+	virtual void config_write(uint8_t regnum,Bitu iolen,uint32_t value) {
+		if (iolen == 1) {
+			const unsigned char mask = config_writemask[regnum];
+			const unsigned char nmask = ~mask;
+
+			config[regnum] =
+				((unsigned char)value & mask) +
+				(config[regnum] & nmask);
+
+			switch (regnum) {
+				case 0x04:
+				case 0x20:
+				case 0x21:
+				case 0x22:
+				case 0x23:
+					update_io(); /* need to act on the new (masked off) value */
+					break;
+				default:
+					break;
+			}
+		}
+		else {
+			PCI_Device::config_write(regnum,iolen,value); /* which will break down I/O into 8-bit */
+		}
+	}
+};
+
 static bool initialized = false;
 
 static IO_WriteHandleObject PCI_WriteHandler[5];
@@ -408,6 +479,8 @@ Bits RegisterPCIDevice(PCI_Device* device, Bits bus=-1, Bits slot=-1) {
 	return slot;
 }
 
+static PCI_IDEDevice *IDE_PCI=NULL;
+
 static void Deinitialize(void) {
 	initialized=false;
 	pci_caddress=0;
@@ -433,6 +506,11 @@ static void Deinitialize(void) {
 			}
 		}
 	}
+
+	if (IDE_PCI != NULL) {
+		IDE_BusMaster_SetBase(0);
+		IDE_PCI = NULL;
+	}
 }
 
 static PCI_Device *S3_PCI=NULL;
@@ -490,6 +568,29 @@ void PCI_RemoveSST_Device(void) {
 	}
 }
 
+void PCI_AddIDE_Device(void) {
+	if (!pcibus_enable) return;
+
+	if (IDE_PCI == NULL) {
+		LOG(LOG_MISC,LOG_DEBUG)("Initializing PCI bus master IDE device");
+		if ((IDE_PCI=new PCI_IDEDevice()) == NULL)
+			return;
+
+		RegisterPCIDevice(IDE_PCI);
+	}
+
+	IDE_PCI->update_io();
+}
+
+void PCI_RemoveIDE_Device(void) {
+	if (IDE_PCI != NULL) {
+		IDE_BusMaster_SetBase(0);
+		UnregisterPCIDevice(IDE_PCI);
+		delete IDE_PCI;
+		IDE_PCI = NULL;
+	}
+}
+
 PhysPt PCI_GetPModeInterface(void) {
 	if (!pcibus_enable) return 0;
 	return GetPModeCallbackPointer();
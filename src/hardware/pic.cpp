@@ -17,6 +17,12 @@
  */
 
 #include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#if C_EVENT_PROFILE
+# include <chrono>
+#endif
 
 #include "dosbox.h"
 #include "inout.h"
@@ -24,6 +30,7 @@
 #include "callback.h"
 #include "logging.h"
 #include "pic.h"
+#include "pic_queue.h"
 #include "timer.h"
 #include "setup.h"
 #include "control.h"
@@ -32,8 +39,6 @@
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
 #endif
 
-#define PIC_QUEUESIZE 8192
-
 unsigned long PIC_irq_delay_ns = 0;
 
 bool never_mark_cascade_in_service = false;
@@ -217,18 +222,106 @@ void PIC_Controller::start_irq(uint8_t val){
     }
 }
 
-struct PICEntry {
-    pic_tickindex_t index;
-    Bitu value;
-    PIC_EventHandler pic_event;
-    PICEntry * next;
+static PIC_EventQueue pic_queue;
+
+#if C_EVENT_PROFILE
+/* Event profiler: call counts and host time per PIC event handler and timer tick handler.
+ * Reported in the log every PIC_PROFILE_INTERVAL emulated milliseconds, by the debugger
+ * command "PIC PROFILE", and written to PIC_PROFILE_FILE on exit. */
+#define PIC_PROFILE_SLOTS       512
+#define PIC_PROFILE_INTERVAL    10000
+#define PIC_PROFILE_FILE        "eventprofile.txt"
+
+struct PIC_ProfileSlot {
+    void*       handler;
+    const char* name;
+    bool        timer;
+    uint64_t    calls,ns;               // since the last periodic report
+    uint64_t    total_calls,total_ns;
 };
 
-static struct {
-    PICEntry entries[PIC_QUEUESIZE];
-    PICEntry * free_entry;
-    PICEntry * next_entry;
-} pic_queue;
+static PIC_ProfileSlot pic_profile[PIC_PROFILE_SLOTS];
+
+static PIC_ProfileSlot *PIC_Profile_Slot(void *handler,bool timer) {
+    unsigned int h = (unsigned int)((uintptr_t)handler >> 4u) & (PIC_PROFILE_SLOTS - 1u);
+    for (unsigned int i=0;i < PIC_PROFILE_SLOTS;i++,h=(h+1u) & (PIC_PROFILE_SLOTS - 1u)) {
+        PIC_ProfileSlot &slot = pic_profile[h];
+        if (slot.handler == handler && slot.timer == timer) return &slot;
+        if (slot.handler == NULL) {
+            slot.handler = handler;
+            slot.timer = timer;
+            return &slot;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t PIC_Profile_Now(void) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PIC_Profile_Name(void *handler,const char *name,bool timer) {
+    PIC_ProfileSlot *slot = PIC_Profile_Slot(handler,timer);
+    if (slot != NULL && slot->name == NULL) slot->name = name;
+}
+
+static void PIC_Profile_Record(void *handler,bool timer,uint64_t start) {
+    PIC_ProfileSlot *slot = PIC_Profile_Slot(handler,timer);
+    if (slot != NULL) {
+        const uint64_t ns = PIC_Profile_Now() - start;
+        slot->calls++;
+        slot->ns += ns;
+        slot->total_calls++;
+        slot->total_ns += ns;
+    }
+}
+
+static bool PIC_Profile_CompareInterval(const PIC_ProfileSlot *a,const PIC_ProfileSlot *b) {
+    return a->ns > b->ns;
+}
+
+static bool PIC_Profile_CompareTotal(const PIC_ProfileSlot *a,const PIC_ProfileSlot *b) {
+    return a->total_ns > b->total_ns;
+}
+
+/* write one line per handler, busiest first, either since the last periodic report or in total */
+static void PIC_Profile_Report(FILE *fp,bool totals) {
+    std::vector<PIC_ProfileSlot*> slots;
+    uint64_t all_ns = 0;
+    for (unsigned int i=0;i < PIC_PROFILE_SLOTS;i++) {
+        PIC_ProfileSlot &slot = pic_profile[i];
+        if (slot.handler == NULL || (totals ? slot.total_calls : slot.calls) == 0) continue;
+        slots.push_back(&slot);
+        all_ns += totals ? slot.total_ns : slot.ns;
+    }
+    std::sort(slots.begin(),slots.end(),totals ? PIC_Profile_CompareTotal : PIC_Profile_CompareInterval);
+
+    char line[256];
+    snprintf(line,sizeof(line),"Event profile (%s): %.3fms in handlers",totals ? "total" : "last interval",(double)all_ns / 1000000);
+    if (fp != NULL) fprintf(fp,"%s\n",line);
+    else LOG_MSG("%s",line);
+    for (size_t i=0;i < slots.size();i++) {
+        const PIC_ProfileSlot &slot = *slots[i];
+        const uint64_t calls = totals ? slot.total_calls : slot.calls;
+        const uint64_t ns = totals ? slot.total_ns : slot.ns;
+        snprintf(line,sizeof(line),"%-5s %-40s %12llu calls %12.3fms %10.1fns/call %5.1f%%",
+            slot.timer ? "TICK" : "EVENT",
+            slot.name != NULL ? slot.name : "?",
+            (unsigned long long)calls,
+            (double)ns / 1000000,
+            (double)ns / calls,
+            all_ns != 0 ? (double)ns * 100 / all_ns : 0.0);
+        if (fp != NULL) fprintf(fp,"%s\n",line);
+        else LOG_MSG("%s",line);
+    }
+}
+
+# define PIC_PROFILE_BEGIN()            const uint64_t profile_start = PIC_Profile_Now()
+# define PIC_PROFILE_END(handler,timer) PIC_Profile_Record((void*)((uintptr_t)(handler)),timer,profile_start)
+#else
+# define PIC_PROFILE_BEGIN()            do { } while (0)
+# define PIC_PROFILE_END(handler,timer) do { } while (0)
+#endif
 
 static void write_command(Bitu port,Bitu val,Bitu iolen) {
     (void)iolen;//UNUSED
@@ -594,30 +687,8 @@ void DEBUG_PICMask(int irq,bool mask) {
 }
 
 static void AddEntry(PICEntry * entry) {
-    PICEntry * find_entry=pic_queue.next_entry;
-    if (GCC_UNLIKELY(find_entry ==0)) {
-        entry->next=0;
-        pic_queue.next_entry=entry;
-    } else if (find_entry->index>entry->index) {
-        pic_queue.next_entry=entry;
-        entry->next=find_entry;
-    } else while (find_entry) {
-        if (find_entry->next) {
-            /* See if the next index comes later than this one */
-            if (find_entry->next->index > entry->index) {
-                entry->next=find_entry->next;
-                find_entry->next=entry;
-                break;
-            } else {
-                find_entry=find_entry->next;
-            }
-        } else {
-            entry->next=find_entry->next;
-            find_entry->next=entry;
-            break;
-        }
-    }
-    Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+    pic_queue.push(entry);
+    Bits cycles=PIC_MakeCycles(pic_queue.top()->index-PIC_TickIndex());
     if (cycles<CPU_Cycles) {
         CPU_CycleLeft+=CPU_Cycles;
         CPU_Cycles=0;
@@ -634,69 +705,26 @@ pic_tickindex_t PIC_GetCurrentEventTime(void) {
         return PIC_FullIndex();
 }
 
-void PIC_AddEvent(PIC_EventHandler handler,pic_tickindex_t delay,Bitu val) {
-    if (GCC_UNLIKELY(!pic_queue.free_entry)) {
+void (PIC_AddEvent)(PIC_EventHandler handler,pic_tickindex_t delay,Bitu val) {
+    PICEntry * entry=pic_queue.alloc();
+    if (GCC_UNLIKELY(!entry)) {
         LOG(LOG_PIC,LOG_ERROR)("Event queue full");
         return;
     }
-    PICEntry * entry=pic_queue.free_entry;
     if(InEventService) entry->index = delay + srv_lag;
     else entry->index = delay + PIC_TickIndex();
 
     entry->pic_event=handler;
     entry->value=val;
-    pic_queue.free_entry=pic_queue.free_entry->next;
     AddEntry(entry);
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-    PICEntry * entry=pic_queue.next_entry;
-    PICEntry * prev_entry;
-    prev_entry = 0;
-    while (entry) {
-        if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-            if (prev_entry) {
-                prev_entry->next=entry->next;
-                entry->next=pic_queue.free_entry;
-                pic_queue.free_entry=entry;
-                entry=prev_entry->next;
-                continue;
-            } else {
-                pic_queue.next_entry=entry->next;
-                entry->next=pic_queue.free_entry;
-                pic_queue.free_entry=entry;
-                entry=pic_queue.next_entry;
-                continue;
-            }
-        }
-        prev_entry=entry;
-        entry=entry->next;
-    }
+    pic_queue.remove(handler,val);
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-    PICEntry * entry=pic_queue.next_entry;
-    PICEntry * prev_entry;
-    prev_entry=0;
-    while (entry) {
-        if (GCC_UNLIKELY(entry->pic_event==handler)) {
-            if (prev_entry) {
-                prev_entry->next=entry->next;
-                entry->next=pic_queue.free_entry;
-                pic_queue.free_entry=entry;
-                entry=prev_entry->next;
-                continue;
-            } else {
-                pic_queue.next_entry=entry->next;
-                entry->next=pic_queue.free_entry;
-                pic_queue.free_entry=entry;
-                entry=pic_queue.next_entry;
-                continue;
-            }
-        }
-        prev_entry=entry;
-        entry=entry->next;
-    }
+    pic_queue.remove(handler);
 }
 
 extern ClockDomain clockdom_DOSBox_cycles;
@@ -736,25 +764,26 @@ bool PIC_RunQueue(void) {
         /* Check the queue for an entry */
         Bits index_nd=PIC_TickIndexND();
         InEventService = true;
-        while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-            PICEntry * entry=pic_queue.next_entry;
-            pic_queue.next_entry=entry->next;
+        while (pic_queue.top() && (pic_queue.top()->index*CPU_CycleMax<=index_nd)) {
+            PICEntry * entry=pic_queue.pop();
             srv_lag = entry->index;
 
-            if (entry->pic_event != NULL)
+            if (entry->pic_event != NULL) {
+                PIC_PROFILE_BEGIN();
                 (entry->pic_event)(entry->value); // call the event handler
+                PIC_PROFILE_END(entry->pic_event,false);
+            }
             else
                 LOG(LOG_MISC,LOG_WARN)("PIC: Event in queue with NULL handler"); // This can happen after save state / load state
 
             /* Put the entry in the free list */
-            entry->next=pic_queue.free_entry;
-            pic_queue.free_entry=entry;
+            pic_queue.release(entry);
         }
         InEventService = false;
 
         /* Check when to set the new cycle end */
-        if (pic_queue.next_entry) {
-            Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+        if (pic_queue.top()) {
+            Bits cycles=(Bits)(pic_queue.top()->index*CPU_CycleMax-index_nd);
             if (GCC_UNLIKELY(!cycles)) cycles=1;
             if (cycles<CPU_CycleLeft) {
                 CPU_Cycles=cycles;
@@ -813,7 +842,7 @@ void TIMER_DelTickHandler(TIMER_TickHandler handler) {
     }
 }
 
-void TIMER_AddTickHandler(TIMER_TickHandler handler) {
+void (TIMER_AddTickHandler)(TIMER_TickHandler handler) {
     TickerBlock * newticker=new TickerBlock;
     newticker->next=firstticker;
     newticker->handler=handler;
@@ -844,19 +873,26 @@ void TIMER_AddTick(void) {
         throw int(1);
 
     /* Go through the list of scheduled events and lower their index with 1000 */
-    PICEntry * entry=pic_queue.next_entry;
-    while (entry) {
-        entry->index -= 1.0;
-        entry=entry->next;
-    }
+    pic_queue.shift(1.0);
 
     /* Call our list of ticker handlers */
     TickerBlock * ticker=firstticker;
     while (ticker) {
         TickerBlock * nextticker=ticker->next;
-        ticker->handler();
+        TIMER_TickHandler handler=ticker->handler; /* the handler may remove itself */
+        PIC_PROFILE_BEGIN();
+        handler();
+        PIC_PROFILE_END(handler,true);
         ticker=nextticker;
     }
+
+#if C_EVENT_PROFILE
+    if ((PIC_Ticks % PIC_PROFILE_INTERVAL) == 0) {
+        PIC_Profile_Report(NULL,false);
+        for (unsigned int i=0;i < PIC_PROFILE_SLOTS;i++)
+            pic_profile[i].calls = pic_profile[i].ns = 0;
+    }
+#endif
 }
 
 static IO_WriteHandleObject PCXT_NMI_WriteHandler;
@@ -1014,6 +1050,14 @@ void PIC_Reset(Section *sec) {
 
 void PIC_Destroy(Section* sec) {
     (void)sec;//UNUSED
+#if C_EVENT_PROFILE
+    FILE *fp = fopen(PIC_PROFILE_FILE,"w");
+    if (fp != NULL) {
+        PIC_Profile_Report(fp,true);
+        fclose(fp);
+        LOG_MSG("Event profile written to %s",PIC_PROFILE_FILE);
+    }
+#endif
 }
 
 void Init_PIC() {
@@ -1022,15 +1066,11 @@ void Init_PIC() {
     LOG(LOG_MISC,LOG_DEBUG)("Init_PIC()");
 
     /* Initialize the pic queue */
-    for (i=0;i<PIC_QUEUESIZE-1;i++) {
-        pic_queue.entries[i].next=&pic_queue.entries[i+1];
-
+    pic_queue.clear();
+    for (i=0;i<PIC_QUEUESIZE;i++) {
         // savestate compatibility
         pic_queue.entries[i].pic_event = 0;
     }
-    pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-    pic_queue.free_entry=&pic_queue.entries[0];
-    pic_queue.next_entry=0;
 
     AddExitFunction(AddExitFunctionFuncPair(PIC_Destroy));
     AddVMEventFunction(VM_EVENT_RESET,AddVMEventFunctionFuncPair(PIC_Reset));
@@ -1072,6 +1112,12 @@ void DEBUG_LogPIC(void) {
     DEBUG_LogPIC_C(master);
     if (enable_slave_pic) DEBUG_LogPIC_C(slave);
 }
+
+#if C_EVENT_PROFILE
+void DEBUG_LogPICProfile(void) {
+    PIC_Profile_Report(NULL,true);
+}
+#endif
 #endif
 
 // PIC_EventHandlers
@@ -1238,19 +1284,23 @@ private:
 				uint16_t ticker_handler_idx;
 
 
-				for( int lcv=0; lcv<PIC_QUEUESIZE; lcv++ ) {
-					Bitu pic_addr;
+				// - the queue is stored as the sorted linked list it used to be
+				std::vector<PICEntry *> queued;
+				for( unsigned int lcv=0; lcv<pic_queue.size(); lcv++ )
+					queued.push_back( pic_queue.at(lcv) );
+				std::sort( queued.begin(), queued.end(), PIC_EventQueue::before );
 
-					pic_addr = (Bitu) pic_queue.entries[lcv].next;
+				for( int lcv=0; lcv<PIC_QUEUESIZE; lcv++ )
 					pic_next_ptr[lcv] = 0xffff;
-
-					for( int lcv2=0; lcv2<PIC_QUEUESIZE; lcv2++ ) {
-						if( pic_addr == (Bitu) &pic_queue.entries[lcv2] ) {
-							pic_next_ptr[lcv] = lcv2;
-							break;
-						}
-					}
+				for( PICEntry *entry = pic_queue.first_free(); entry != NULL; entry = entry->next ) {
+					if( entry->next != NULL )
+						pic_next_ptr[entry - pic_queue.entries] = (uint16_t) (entry->next - pic_queue.entries);
 				}
+				for( size_t lcv=1; lcv<queued.size(); lcv++ )
+					pic_next_ptr[queued[lcv-1] - pic_queue.entries] = (uint16_t) (queued[lcv] - pic_queue.entries);
+
+				pic_free_idx = pic_queue.first_free() != NULL ? (uint16_t) (pic_queue.first_free() - pic_queue.entries) : 0xffff;
+				pic_next_idx = !queued.empty() ? (uint16_t) (queued[0] - pic_queue.entries) : 0xffff;
 
 
 				ticker_size = 0;
@@ -1276,8 +1326,6 @@ private:
         stream.write(reinterpret_cast<const char*>(&pics), sizeof(pics) );
 
 
-				pic_free_idx = 0xffff;
-				pic_next_idx = 0xffff;
 				for( int lcv=0; lcv<PIC_QUEUESIZE; lcv++ ) {
 					uint16_t event_idx;
 
@@ -1291,10 +1339,6 @@ private:
 
 					// - reloc ptr
 					stream.write(reinterpret_cast<const char*>(&pic_next_ptr[lcv]), sizeof(pic_next_ptr[lcv]) );
-
-
-					if( &pic_queue.entries[lcv] == pic_queue.free_entry ) pic_free_idx = lcv;
-					if( &pic_queue.entries[lcv] == pic_queue.next_entry ) pic_next_idx = lcv;
 				}
 
 				// - reloc ptrs
@@ -1334,6 +1378,7 @@ private:
     virtual void setBytes(std::istream& stream)
     {
 				uint16_t free_idx, next_idx;
+				uint16_t pic_next_ptr[PIC_QUEUESIZE];
 				uint16_t ticker_size;
 
 
@@ -1350,7 +1395,7 @@ private:
 
 
 				for( int lcv=0; lcv<PIC_QUEUESIZE; lcv++ ) {
-					uint16_t event_idx, next_idx;
+					uint16_t event_idx;
 
 					// - data
 					stream.read(reinterpret_cast<char*>(&pic_queue.entries[lcv].index), sizeof(pic_queue.entries[lcv].index) );
@@ -1363,24 +1408,14 @@ private:
 
 
 					// - reloc ptr
-					stream.read(reinterpret_cast<char*>(&next_idx), sizeof(next_idx) );
-
-					pic_queue.entries[lcv].next = NULL;
-					if( next_idx != 0xffff )
-						pic_queue.entries[lcv].next = &pic_queue.entries[next_idx];
+					stream.read(reinterpret_cast<char*>(&pic_next_ptr[lcv]), sizeof(pic_next_ptr[lcv]) );
 				}
 
-				// - reloc ptrs
+				// - reloc ptrs (the free list is rebuilt from whatever is not queued)
         stream.read(reinterpret_cast<char*>(&free_idx), sizeof(free_idx) );
         stream.read(reinterpret_cast<char*>(&next_idx), sizeof(next_idx) );
 
-				pic_queue.free_entry = NULL;
-				if( free_idx != 0xffff )
-					pic_queue.free_entry = &pic_queue.entries[free_idx];
-
-				pic_queue.next_entry = NULL;
-				if( next_idx != 0xffff )
-					pic_queue.next_entry = &pic_queue.entries[next_idx];
+				pic_queue.restore( pic_next_ptr, next_idx );
 
 
 				// - data
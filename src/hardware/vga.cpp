@@ -189,6 +189,7 @@ bool                                ignore_sequencer_blanking = false;
 bool                                memio_complexity_optimization = true;
 bool                                vga_render_on_demand = false; // Render at vsync or specific changes to hardware instead of every scanline
 signed char                         vga_render_on_demand_user = -1;
+bool                                vga_render_frame_at_once = false; // Hand whole frames to a render thread, see VGA_RenderFrameWait
 
 bool                                pc98_crt_mode = false;      // see port 6Ah command 40h/41h.
                                                                 // this boolean is the INVERSE of the bit.
@@ -238,6 +239,7 @@ SDL_Rect &VGA_CaptureRectFromGuest(void) {
 }
 
 VGA_Type vga;
+VGA_Dirty vga_dirty;
 SVGA_Driver svga;
 int enableCGASnow;
 int vesa_modelist_cap = 0;
@@ -1021,6 +1023,8 @@ void VGA_Reset(Section*) {
             vga_render_on_demand_user = -1;
     }
 
+    vga_render_frame_at_once = section->Get_bool("render frame at once");
+
     if (memio_complexity_optimization)
         LOG_MSG("Memory I/O complexity optimization enabled aka option 'memory io optimization 1'. If the game or demo is unable to draw to the screen properly, set the option to false.");
 
@@ -1581,6 +1585,9 @@ void VGA_OnEnterPC98_phase2(Section *sec) {
 void VGA_Destroy(Section*) {
     void PC98_FM_Destroy(Section *sec);
     PC98_FM_Destroy(NULL);
+
+    void VGA_StopRenderThread(void);
+    VGA_StopRenderThread();
 }
 
 extern uint8_t                     pc98_pal_analog[256*3]; /* G R B    0x0..0xF */
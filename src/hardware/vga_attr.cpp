@@ -225,6 +225,7 @@ void write_p3c0(Bitu /*port*/,Bitu val,Bitu iolen) {
 		return;
 	} else {
 		if (vga_render_on_demand && !attr(disabled)/*screen not disabled*/) VGA_RenderOnDemandUpTo();
+		VGA_MarkStateChanged();
 		vga.internal.attrindex=false;
 		switch (attr(index)) {
 			/* Palette */
@@ -110,6 +110,10 @@ static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
     const uint8_t green = dacexpand(vga.dac.rgb[src].green&dacmask,dacshl,dacshr);
     const uint8_t blue = dacexpand(vga.dac.rgb[src].blue&dacmask,dacshl,dacshr);
 
+    /* the render thread may still be drawing a frame with the old palette */
+    VGA_RenderFrameWait();
+    VGA_MarkStateChanged();
+
     /* FIXME: CGA composite mode calls RENDER_SetPal itself, which conflicts with this code */
     if (vga.mode == M_CGA16)
         return;
@@ -54,6 +54,14 @@
 #include "../libs/zmbv/zmbv.h"
 #endif
 
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#define VGA_RENDER_THREAD
+#endif
+#include <vector>
+
 /* do not issue CPU-side I/O here -- this code emulates functions that the GDC itself carries out, not on the CPU */
 #include "cpu_io_is_forbidden.h"
 
@@ -70,6 +78,9 @@ bool enable_supermegazeux_256colortext = false;
 
 extern bool vga_render_on_demand;
 extern signed char vga_render_on_demand_user;
+extern bool vga_render_frame_at_once;
+extern bool enable_page_flip_debugging_marker;
+extern bool enable_vretrace_poll_debugging_marker;
 
 /* S3 streams processor state.
  * Registers are only loaded into hardware on vertical sync anyway. */
@@ -3376,6 +3387,89 @@ void VGA_DAC_DeferredUpdateColorPalette();
 void VGA_DebugAddEvent(debugline_event &ev);
 void VGA_DrawDebugLine(uint8_t *line,unsigned int w);
 
+/* what each scanline was drawn from the last time it went into the scaler cache */
+struct VGA_DirtyLine {
+    uint32_t    frame = 0;          /* vga_dirty.frame when drawn, 0 if the cache does not hold it */
+    uint32_t    state = 0;
+    Bitu        address = 0;
+    Bitu        address_line = 0;
+};
+
+static std::vector<VGA_DirtyLine> vga_dirty_lines;
+
+/* how many bytes of video memory from the start address the line handler reads, 0 if it depends on more than that */
+static Bitu VGA_DirtyLineSpan(void) {
+    if (vga_enable_hretrace_effects) return 0;
+    if (VGA_DrawLine == VGA_Draw_Xlat32_VGA_CRTC_bmode_Line) return ((vga.draw.line_length >> 4u) + 1u) * (4u << vga.config.addr_shift);
+    if (VGA_DrawLine == VGA_Draw_Xlat32_Linear_Line) return vga.draw.width + 4u;
+    if (VGA_DrawLine == VGA_Draw_Linear_Line) return vga.draw.line_length;
+    return 0;
+}
+
+/* true if the scanline about to be drawn can be compared against its record. Anything that draws over
+ * the line, or needs the converted pixels, rules it out. */
+static inline bool VGA_DirtyLineUsable(void) {
+    if (!vga_dirty.exact || !IS_VGA_ARCH) return false;
+    if (vga.draw.render_max != 1 || mcga_double_scan || vga.draw.linear_base != vga.mem.linear) return false;
+    if (video_debug_overlay || vga_page_flip_occurred || vga_3da_polled) return false;
+    if (VGA_IsCaptureEnabled() || ((CaptureState & CAPTURE_RAWIMAGE) && rawshot.capturing)) return false;
+    return true;
+}
+
+/* true if neither the video memory this scanline shows nor anything else that goes into it changed since it was drawn */
+static bool VGA_DirtyLineUnchanged(const VGA_DirtyLine &dl) {
+    if (dl.frame == 0 || dl.state != vga_dirty.state) return false;
+    if (dl.address != vga.draw.address || dl.address_line != vga.draw.address_line) return false;
+
+    const Bitu span = VGA_DirtyLineSpan();
+    if (span == 0) return false;
+
+    const Bitu pmask = vga.draw.linear_mask >> VGA_DIRTY_PAGE_SHIFT;
+    const Bitu first = (vga.draw.address & vga.draw.linear_mask) >> VGA_DIRTY_PAGE_SHIFT;
+    const Bitu last = ((vga.draw.address & vga.draw.linear_mask) + span - 1u) >> VGA_DIRTY_PAGE_SHIFT;
+    for (Bitu p=first;p <= last;p++) {
+        if (vga_dirty.page_frame[p & pmask] >= dl.frame)
+            return false;
+    }
+
+    return true;
+}
+
+/* step to the next scanline of the frame, counting it as done if it was drawn */
+static inline void VGA_NextScanline(const bool rendered) {
+    vga.draw.address_line++;
+    if (vga.draw.address_line>=vga.draw.address_line_total) {
+        vga.draw.address_line=0;
+        vga.draw.address+=vga.draw.address_add;
+    }
+
+    if (rendered) {
+        vga.draw.lines_done++;
+        if (vga.draw.split_line==vga.draw.lines_done && machine != MCH_PC98) VGA_ProcessSplit();
+    }
+}
+
+/* registers the hardware latches again at the end of each scanline */
+static inline void VGA_ScanlineLatches(void) {
+    /* some VGA cards (ATI chipsets especially) do not double-buffer the
+     * horizontal panning register. some DOS demos take advantage of that
+     * to make the picture "waver".
+     *
+     * We stop doing this though if the attribute controller is setup to set hpel=0 at splitscreen.
+     *
+     * EGA allows per scanline hpel according to DOSBox SVN source code. */
+    if ((IS_VGA_ARCH && vga_enable_hpel_effects) || (IS_EGA_ARCH && egavga_per_scanline_hpel)) {
+        /* Attribute Mode Controller: If bit 5 (Pixel Panning Mode) is set, then upon line compare the bottom portion is displayed as if Pixel Shift Count and Byte Panning are set to 0.
+         * This ensures some demos like Future Crew "Yo" display correctly instead of the bottom non-scroller half jittering because the top half is scrolling. */
+        if (vga.draw.has_split && (vga.attr.mode_control&0x20))
+            vga.draw.panning = 0;
+        else
+            vga.draw.panning = vga.config.pel_panning;
+    }
+
+    if (IS_EGAVGA_ARCH && !vga_double_buffered_line_compare) VGA_Update_SplitLineCompare();
+}
+
 static void VGA_DrawSingleLine(Bitu /*blah*/) {
     unsigned int lines = 0;
     bool skiprender;
@@ -3413,7 +3507,10 @@ again:
         }
 
         VGA_DAC_DeferredUpdateColorPalette();
+        VGA_DirtyLine *dirty = vga.draw.lines_done < vga_dirty_lines.size() ? &vga_dirty_lines[vga.draw.lines_done] : NULL;
+        const bool dirty_usable = dirty != NULL && VGA_DirtyLineUsable();
         if (GCC_UNLIKELY(vga.attr.disabled)) {
+            if (dirty != NULL && RENDER_DrawLineCached()) dirty->frame = 0;
             switch(machine) {
                 case MCH_PCJR:
                     // Displays the border color when screen is disabled
@@ -3480,6 +3577,8 @@ again:
                 vga_3da_polled = false;
             }
             RENDER_DrawLine(TempLine);
+        } else if (dirty_usable && VGA_DirtyLineUnchanged(*dirty) && RENDER_DrawLineUnchanged()) {
+            /* the scaler cache already holds this line */
         } else {
             if ((CaptureState & CAPTURE_RAWIMAGE) && VGA_DrawRawLine && rawshot.capturing) {
                 if (rawshot.render_y < rawshot.image_height && rawshot.image != NULL) {
@@ -3541,19 +3640,23 @@ again:
                 VGA_ProcessScanline(data);
 
             RENDER_DrawLine(data);
-        }
-    }
 
-    vga.draw.address_line++;
-    if (vga.draw.address_line>=vga.draw.address_line_total) {
-        vga.draw.address_line=0;
-        vga.draw.address+=vga.draw.address_add;
+            /* the scaler cache now holds this line. If the renderer is not drawing, it still holds the line as recorded */
+            if (dirty != NULL && RENDER_DrawLineCached()) {
+                if (dirty_usable) {
+                    dirty->frame = vga_dirty.frame;
+                    dirty->state = vga_dirty.state;
+                    dirty->address = vga.draw.address;
+                    dirty->address_line = vga.draw.address_line;
+                }
+                else {
+                    dirty->frame = 0;
+                }
+            }
+        }
     }
 
-    if (!skiprender) {
-        vga.draw.lines_done++;
-        if (vga.draw.split_line==vga.draw.lines_done && machine != MCH_PC98) VGA_ProcessSplit();
-    }
+    VGA_NextScanline(!skiprender);
 
     if (mcga_double_scan) {
         if (vga.draw.lines_done < vga.draw.lines_total) {
@@ -3581,23 +3684,7 @@ again:
         pc98_text_draw.next_line();
     }
 
-    /* some VGA cards (ATI chipsets especially) do not double-buffer the
-     * horizontal panning register. some DOS demos take advantage of that
-     * to make the picture "waver".
-     *
-     * We stop doing this though if the attribute controller is setup to set hpel=0 at splitscreen.
-     *
-     * EGA allows per scanline hpel according to DOSBox SVN source code. */
-    if ((IS_VGA_ARCH && vga_enable_hpel_effects) || (IS_EGA_ARCH && egavga_per_scanline_hpel)) {
-        /* Attribute Mode Controller: If bit 5 (Pixel Panning Mode) is set, then upon line compare the bottom portion is displayed as if Pixel Shift Count and Byte Panning are set to 0.
-         * This ensures some demos like Future Crew "Yo" display correctly instead of the bottom non-scroller half jittering because the top half is scrolling. */
-        if (vga.draw.has_split && (vga.attr.mode_control&0x20))
-            vga.draw.panning = 0;
-        else
-            vga.draw.panning = vga.config.pel_panning;
-    }
-
-    if (IS_EGAVGA_ARCH && !vga_double_buffered_line_compare) VGA_Update_SplitLineCompare();
+    VGA_ScanlineLatches();
 }
 
 static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
@@ -3707,6 +3794,198 @@ void VGA_SetBlinking(Bitu enabled) {
 
 extern bool                        GDC_vsync_interrupt;
 
+/* "render frame at once": the render on demand mode draws the whole frame at vertical retrace anyway.
+ * For the SVGA modes drawn straight from linear video memory, the frame is instead handed to a render
+ * thread that converts and scales it from a copy of the visible part of video memory while emulation
+ * carries on with the next frame. RENDER_StartUpdate() is put off from the vertical timer until the
+ * frame is handed over, so that the render thread has time to finish the frame before it.
+ *
+ * Until VGA_RenderFrameWait() returns, the render thread owns the scaler and the output surface and
+ * reads the line handler state (width, linear mask, palette). Anything that changes those must call
+ * VGA_RenderFrameWait() first. Palette or register changes in the middle of such a frame apply to the
+ * whole frame, which is why only modes without per scanline effects are eligible. */
+static struct vga_render_thread_t {
+    bool                    frame = false;          /* this frame goes to the render thread, RENDER_StartUpdate() not called yet */
+    bool                    busy = false;           /* the render thread has a frame (emulation thread only) */
+    uint8_t*                saved_base = NULL;      /* vga.draw.linear_base while the copy stands in for it */
+    std::vector<uint8_t>    vram;                   /* copy of video memory the frame is drawn from */
+    std::vector<Bitu>       lines;                  /* address, address_line pairs of each line of the frame */
+    VGA_Line_Handler        drawline = NULL;        /* VGA_DrawLine at the time the frame was handed over */
+#ifdef VGA_RENDER_THREAD
+    std::thread             worker;
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool                    job = false;
+    bool                    quit = false;
+#endif
+} vga_render_thread;
+
+static bool VGA_RenderThreadUsable(void) {
+#ifdef VGA_RENDER_THREAD
+    if (!vga_render_frame_at_once || !vga_render_on_demand) return false;
+    if (!IS_VGA_ARCH || vga.draw.mode != DRAWLINE || vga.draw.render_max != 1) return false;
+    if (mcga_double_scan || vga.attr.disabled) return false;
+    if (video_debug_overlay || enable_page_flip_debugging_marker || enable_vretrace_poll_debugging_marker) return false;
+    if (VGA_IsCaptureEnabled() || ((CaptureState & CAPTURE_RAWIMAGE) && rawshot.capturing)) return false;
+#if defined(USE_TTF)
+    if (ttf.inUse) return false;
+#endif
+    if (VGA_DrawLine == VGA_Draw_Linear_Line || VGA_DrawLine == VGA_Draw_Linear_Line_24_to_32) return true;
+    if (VGA_DrawLine == VGA_Draw_Xlat32_Linear_Line) return !vga_enable_hretrace_effects; /* hretrace effects change per scanline */
+    /* Not VGA_Draw_VGA_Planar_Xlat32_Line: besides video memory it reads the pel panning, doublescan,
+     * CRTC address shift and MEM13 interleave state, which the port handlers and VGA_PanningLatch()
+     * rewrite without waiting for the render thread. Waiting there instead would stall the scrolling
+     * games and demos that rewrite them every frame, which gains nothing over drawing it here.
+     *
+     * Not the text handlers either (VGA_TEXT_Xlat32_Draw_Line here, VGA_TEXT_Draw_Line is CGA only):
+     * they also read the font from plane 2, the cursor count the vertical timer steps and, for DBCS,
+     * edit the jtbs/dbox lists the mouse code reads. A text line is cheap to draw, so there is little
+     * to gain from the thread anyway. */
+#endif
+    return false;
+}
+
+#ifdef VGA_RENDER_THREAD
+static void VGA_RenderThreadRun(void) {
+    std::unique_lock<std::mutex> guard(vga_render_thread.lock);
+
+    for (;;) {
+        vga_render_thread.wake.wait(guard, [] { return vga_render_thread.quit || vga_render_thread.job; });
+        if (!vga_render_thread.job) break;
+
+        guard.unlock();
+        const std::vector<Bitu> &lines = vga_render_thread.lines;
+        for (size_t i=0;i+1 < lines.size();i += 2)
+            RENDER_DrawLine(vga_render_thread.drawline(lines[i],lines[i+1]));
+        guard.lock();
+
+        vga_render_thread.job = false;
+        vga_render_thread.done.notify_all();
+    }
+}
+#endif
+
+/* wait for the render thread to finish the frame it was handed, and end it */
+void VGA_RenderFrameWait(void) {
+    if (!vga_render_thread.busy) return;
+
+#ifdef VGA_RENDER_THREAD
+    {
+        std::unique_lock<std::mutex> guard(vga_render_thread.lock);
+        vga_render_thread.done.wait(guard, [] { return !vga_render_thread.job; });
+    }
+#endif
+
+    vga_render_thread.busy = false;
+    vga.draw.linear_base = vga_render_thread.saved_base;
+    RENDER_EndUpdate(false);
+}
+
+void VGA_StopRenderThread(void) {
+    vga_render_thread.frame = false;
+#ifdef VGA_RENDER_THREAD
+    if (vga_render_thread.worker.joinable()) {
+        {
+            std::unique_lock<std::mutex> guard(vga_render_thread.lock);
+            vga_render_thread.done.wait(guard, [] { return !vga_render_thread.job; });
+            vga_render_thread.quit = true;
+        }
+        vga_render_thread.wake.notify_all();
+        vga_render_thread.worker.join();
+        vga_render_thread.quit = false;
+    }
+#endif
+    if (vga_render_thread.busy) {
+        vga_render_thread.busy = false;
+        vga.draw.linear_base = vga_render_thread.saved_base;
+    }
+    vga_render_thread.vram.clear();
+    vga_render_thread.vram.shrink_to_fit();
+}
+
+/* the vertical timer may rewrite the linear mask while the render thread still draws the frame before */
+static inline void VGA_SetDrawLinearMask(Bitu mask) {
+    if (vga.draw.linear_mask != mask) {
+        VGA_RenderFrameWait();
+        vga.draw.linear_mask = mask;
+    }
+}
+
+/* hand the rest of this frame to the render thread, or draw it here if that is no longer possible */
+static void VGA_RenderThreadFrame(void) {
+    vga_render_thread.frame = false;
+    VGA_RenderFrameWait();
+
+    if (vga.draw.lines_done >= vga.draw.lines_total) return;
+
+    VGA_DAC_DeferredUpdateColorPalette();
+    if (!RENDER_StartUpdate()) {
+        /* skipped frame, the same as the vertical timer returning early */
+        vga.draw.lines_done = vga.draw.lines_total;
+        return;
+    }
+
+    const bool split = vga.draw.split_line > vga.draw.lines_done && vga.draw.split_line <= vga.draw.lines_total;
+    if (split || vga_page_flip_occurred || vga_3da_polled || !VGA_RenderThreadUsable()) {
+        int patience = 4096;
+
+        while (vga.draw.lines_done < vga.draw.lines_total && patience-- > 0)
+            VGA_DrawSingleLine(0);
+
+        return;
+    }
+
+    /* the render thread does not keep the scanline records */
+    VGA_MarkStateChanged();
+
+    /* the same bookkeeping VGA_DrawSingleLine() does, without drawing */
+    std::vector<Bitu> &lines = vga_render_thread.lines;
+    lines.clear();
+    while (vga.draw.lines_done < vga.draw.lines_total) {
+        vga.draw.hsync_events++;
+        lines.push_back(vga.draw.address);
+        lines.push_back(vga.draw.address_line);
+        VGA_NextScanline(true);
+        VGA_ScanlineLatches();
+    }
+    vga_mode_frames_since_time_base++;
+
+    /* copy the part of video memory the frame shows, wrapping around like the line handlers do.
+     * the copy is as large as video memory plus slack, so the line handlers need no changes. */
+    const Bitu size = vga.draw.linear_mask + 1u;
+    const Bitu first = lines[0];
+    const Bitu span = std::min(size, (Bitu)(lines[lines.size() - 2u] - first) + vga.draw.line_length + 4u);
+    if (vga_render_thread.vram.size() < size + vga.draw.line_length + 32u)
+        vga_render_thread.vram.resize(size + vga.draw.line_length + 32u, 0);
+
+    uint8_t *copy = vga_render_thread.vram.data();
+    const Bitu start = first & vga.draw.linear_mask;
+    if (start + span <= size) {
+        memcpy(copy + start, vga.draw.linear_base + start, span);
+    }
+    else {
+        memcpy(copy + start, vga.draw.linear_base + start, size - start);
+        memcpy(copy, vga.draw.linear_base, span - (size - start));
+    }
+
+    vga_render_thread.saved_base = vga.draw.linear_base;
+    vga.draw.linear_base = copy;
+    vga_render_thread.drawline = VGA_DrawLine;
+    vga_render_thread.busy = true;
+
+#ifdef VGA_RENDER_THREAD
+    if (!vga_render_thread.worker.joinable())
+        vga_render_thread.worker = std::thread(VGA_RenderThreadRun);
+
+    {
+        std::unique_lock<std::mutex> guard(vga_render_thread.lock);
+        vga_render_thread.job = true;
+    }
+    vga_render_thread.wake.notify_one();
+#endif
+}
+
 void VGA_RenderOnDemandUpTo(void) {
     /* dt calculation is designed to match PIC_AddEvent() calls for the same scanline by scanline rendering without the on demand rendering mode */
     const pic_tickindex_t dt = PIC_FullIndex() - vga.draw.delay.framestart;
@@ -3715,6 +3994,12 @@ void VGA_RenderOnDemandUpTo(void) {
 
 //assert(vga_render_on_demand);
 
+    /* frames for the render thread are drawn all at once */
+    if (vga_render_thread.frame) {
+        VGA_RenderFrameWait();
+        return;
+    }
+
     if (scanline < 0) scanline = 0;
     while (vga.draw.lines_done < vga.draw.lines_total && vga.draw.hsync_events < (unsigned int)scanline && patience-- > 0)
         VGA_DrawSingleLine(0);
@@ -3725,6 +4010,11 @@ void VGA_RenderOnDemandComplete(void) {
 
 //assert(vga_render_on_demand);
 
+    if (vga_render_thread.frame) {
+        VGA_RenderThreadFrame();
+        return;
+    }
+
     while (vga.draw.lines_done < vga.draw.lines_total && patience-- > 0)
         VGA_DrawSingleLine(0);
 }
@@ -5598,6 +5888,14 @@ pic_tickindex_t VGA_PITSync_delay(void) {
 static void VGA_VerticalTimer(Bitu /*val*/) {
 	double current_time = PIC_GetCurrentEventTime();
 
+	/* writes from here on are newer than any scanline drawn so far */
+	if (GCC_UNLIKELY(++vga_dirty.frame == 0)) {
+		if (vga_dirty.page_frame != NULL)
+			memset(vga_dirty.page_frame,0,((vga.mem.memsize >> VGA_DIRTY_PAGE_SHIFT) + 1u) * sizeof(uint32_t));
+		vga_dirty.frame = 1;
+		VGA_MarkStateChanged();
+	}
+
 	dbg_event_maxscan = false;
 	dbg_event_scanstep = false;
 	dbg_event_hretrace = false;
@@ -5635,13 +5933,13 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			}
 			else {
 				LOG(LOG_VGAMISC,LOG_ERROR)("Raw capture not supported in the current video mode");
-				CaptureState &= ~CAPTURE_RAWIMAGE;
+				CAPTURE_ClearState(CAPTURE_RAWIMAGE);
 			}
 		}
 		else {
 			if (rawshot.render_y >= vga.draw.height) {
 				WriteRawImage();
-				CaptureState &= ~CAPTURE_RAWIMAGE;
+				CAPTURE_ClearState(CAPTURE_RAWIMAGE);
 				LOG(LOG_VGAMISC,LOG_NORMAL)("Raw capture saved");
 				rawshot.capturing = false;
 			}
@@ -5837,8 +6135,22 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			pc98_gdc[i].cursor_advance();
 	}
 
+	// report saved states that finished writing in the background, and take the rewind
+	// snapshots, whether or not this frame is rendered: the rewind interval is in
+	// emulated frames
+	SaveState::instance().pollSave();
+	SaveState::instance().rewindCapture();
+
 	//Check if we can actually render, else skip the rest
-	if (vga.draw.vga_override || !RENDER_StartUpdate()) return;
+	if (vga.draw.vga_override) return;
+	if (VGA_RenderThreadUsable()) {
+		/* RENDER_StartUpdate() when the frame is handed to the render thread */
+		vga_render_thread.frame = true;
+	}
+	else {
+		VGA_RenderFrameWait();
+		if (!RENDER_StartUpdate()) return;
+	}
 
 	if (svgaCard == SVGA_S3Trio) {
 		if (s3Card >= S3_ViRGE || s3Card == S3_Trio64V) {
@@ -5895,13 +6207,13 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			break;
 		case M_VGA:
 			/* TODO: Various SVGA chipsets have a bit to enable/disable 256KB wrapping */
-			vga.draw.linear_mask = 0x3ffffu;
+			VGA_SetDrawLinearMask(0x3ffffu);
 			if (svgaCard == SVGA_TsengET3K || svgaCard == SVGA_TsengET4K) {
 				if (vga.config.addr_shift == 1) /* NTS: Remember the ET4K steps by 4 pixels, one per byteplane, treats BYTE and DWORD modes the same */
 					vga.draw.address *= 2u;
 			}
 			else if (machine == MCH_MCGA) {
-				vga.draw.linear_mask = 0xffffu;
+				VGA_SetDrawLinearMask(0xffffu);
 				vga.draw.address *= 2u;
 				break;// don't fall through
 			}
@@ -5915,7 +6227,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 				if (vga.attr.mode_control & 1) {
 					if (vga.gfx.mode & 0x40) {
 						if (!(vga.attr.mode_control & 0x40)) {
-							vga.draw.linear_mask = vga.mem.memmask; // SVGA text mode
+							VGA_SetDrawLinearMask(vga.mem.memmask); // SVGA text mode
 						}
 					}
 				}
@@ -5936,7 +6248,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			vga.draw.address *= vga.draw.byte_panning_shift;
 			break;
 		case M_PC98:
-			vga.draw.linear_mask = 0xfff; // 1 page
+			VGA_SetDrawLinearMask(0xfff); // 1 page
 			vga.draw.byte_panning_shift = 2;
 			vga.draw.address += vga.draw.bytes_skip;
 			vga.draw.cursor.address = vga.config.cursor_start;
@@ -5947,15 +6259,15 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			// fall-through
 		case M_TANDY_TEXT:
 		case M_HERC_TEXT:
-			if (machine==MCH_HERC && hercCard == HERC_InColor) vga.draw.linear_mask = 0x3fff; // 1 page x 4 bitplanes
-			else if (machine==MCH_HERC || machine==MCH_MDA) vga.draw.linear_mask = 0xfff; // 1 page
+			if (machine==MCH_HERC && hercCard == HERC_InColor) VGA_SetDrawLinearMask(0x3fff); // 1 page x 4 bitplanes
+			else if (machine==MCH_HERC || machine==MCH_MDA) VGA_SetDrawLinearMask(0xfff); // 1 page
 			else if (IS_EGAVGA_ARCH || machine == MCH_MCGA) {
 				if (vga.config.compatible_chain4 || svgaCard == SVGA_None)
-					vga.draw.linear_mask = vga.mem.memmask & 0x3ffff;
+					VGA_SetDrawLinearMask(vga.mem.memmask & 0x3ffff);
 				else
-					vga.draw.linear_mask = vga.mem.memmask; // SVGA text mode
+					VGA_SetDrawLinearMask(vga.mem.memmask); // SVGA text mode
 			}
-			else vga.draw.linear_mask = 0x3fff; // CGA, Tandy 4 pages
+			else VGA_SetDrawLinearMask(0x3fff); // CGA, Tandy 4 pages
 			if (IS_EGAVGA_ARCH) {
 				vga.draw.cursor.address=vga.config.cursor_start<<vga.config.addr_shift;
 				vga.draw.address <<= vga.config.addr_shift;
@@ -5974,7 +6286,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 					|| !vga.draw.blinking) ? true:false;
 			break;
 		case M_HERC_GFX:
-			if (machine==MCH_HERC && hercCard == HERC_InColor) vga.draw.linear_mask = 0x1ffff; // 32KB x 4 bitplanes
+			if (machine==MCH_HERC && hercCard == HERC_InColor) VGA_SetDrawLinearMask(0x1ffff); // 32KB x 4 bitplanes
 			// fall through
 		case M_CGA4:
 		case M_CGA2:
@@ -6030,7 +6342,8 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	// NTS: To be moved
 	if (autosave_second>0&&enable_autosave) {
 		uint32_t ticksNew=GetTicks();
-		if (ticksNew-ticksPrev>(unsigned int)autosave_second*1000) {
+		/* do not stack up auto-saves behind one that is still being written out */
+		if (ticksNew-ticksPrev>(unsigned int)autosave_second*1000 && !SaveState::instance().isSaving()) {
 			auto_save_state=true;
 			int index=0;
 			for (int i=1; i<10&&i<=autosave_count; i++) if (autosave_name[i].size()&&!strcasecmp(RunningProgram, autosave_name[i].c_str())) index=i;
@@ -6380,6 +6693,8 @@ bool IsDebuggerActive(void);
 void VGA_DebugRedraw(void) {
 #if C_DEBUG
 	if (IsDebuggerActive()) {
+		VGA_RenderFrameWait();
+		vga_render_thread.frame = false;
 		RENDER_EndUpdate(true);
 		vga.draw.lines_done = vga.draw.lines_total;
 		PIC_RemoveEvents(VGA_Other_VertInterrupt);
@@ -6521,6 +6836,8 @@ void VGA_CheckScanLength(void) {
 void VGA_ActivateHardwareCursor(void) {
 	bool hwcursor_active=false;
 
+	VGA_MarkStateChanged();
+
 	if (svga.hardware_cursor_active) {
 		if (svga.hardware_cursor_active()) hwcursor_active=true;
 	}
@@ -6602,6 +6919,9 @@ void ChooseRenderOnDemand(void) {
 }
 
 void VGA_SetupDrawing(Bitu /*val*/) {
+	VGA_RenderFrameWait();
+	vga_render_thread.frame = false;
+
 	if (vga.mode==M_ERROR) {
 		PIC_RemoveEvents(VGA_VerticalTimer);
 		PIC_RemoveEvents(VGA_PanningLatch);
@@ -7472,6 +7792,10 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 
 	vga.draw.lines_total=height;
 	vga.draw.line_length = width * ((bpp + 1) / 8);
+
+	vga_dirty_lines.assign(height, VGA_DirtyLine());
+	VGA_MarkStateChanged();
+
 	vga.draw.oscclock = oscclock;
 	vga.draw.clock = clock;
 
@@ -7622,6 +7946,8 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 }
 
 void VGA_KillDrawing(void) {
+	VGA_RenderFrameWait();
+	vga_render_thread.frame = false;
 	PIC_RemoveEvents(VGA_DrawSingleLine);
 	PIC_RemoveEvents(VGA_DrawEGASingleLine);
 }
@@ -7757,6 +8083,8 @@ void POD_Save_VGA_Draw( std::ostream& stream )
 	uint8_t font_tables_idx[2];
 	uint8_t drawline_idx;
 
+	VGA_RenderFrameWait();
+
 
 	if(0) {}
 	else if( vga.draw.linear_base == vga.mem.linear ) linear_base_idx = 0;
@@ -7834,6 +8162,9 @@ void POD_Load_VGA_Draw( std::istream& stream )
 	uint8_t font_tables_idx[2];
 	uint8_t drawline_idx;
 
+	VGA_RenderFrameWait();
+	vga_render_thread.frame = false;
+
 	//**********************************************
 	//**********************************************
 
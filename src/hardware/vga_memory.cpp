@@ -358,6 +358,7 @@ template <const bool chained> static inline void VGA_Generic_Write_Handler(PhysP
     vga.draw.font[planeaddr] = pixels.b[2];
 
     ((uint32_t*)vga.mem.linear)[planeaddr]=pixels.d;
+    VGA_MarkDirty((Bitu)planeaddr << 2u);
 }
 
 // Fast version especially for 256-color mode.
@@ -395,19 +396,27 @@ public:
 	}
 	void writeb(PhysPt addr, uint8_t val ) {
 		VGAMEM_USEC_write_delay();
-		vga.mem.linear[lin2mem(addr)] = val;
+		const PhysPt memaddr = lin2mem(addr);
+		vga.mem.linear[memaddr] = val;
+		VGA_MarkDirty(memaddr);
 	}
 	void writew(PhysPt addr,uint16_t val) {
 		VGAMEM_USEC_write_delay();
-		if ((addr & 1) == 0)
-			*((uint16_t*)(&vga.mem.linear[lin2mem(addr)])) = val;
+		if ((addr & 1) == 0) {
+			const PhysPt memaddr = lin2mem(addr);
+			*((uint16_t*)(&vga.mem.linear[memaddr])) = val;
+			VGA_MarkDirty(memaddr);
+		}
 		else
 			PageHandler::writew(addr,val);
 	}
 	void writed(PhysPt addr,uint32_t val) {
 		VGAMEM_USEC_write_delay();
-		if ((addr & 3) == 0)
-			*((uint32_t*)(&vga.mem.linear[lin2mem(addr)])) = val;
+		if ((addr & 3) == 0) {
+			const PhysPt memaddr = lin2mem(addr);
+			*((uint32_t*)(&vga.mem.linear[memaddr])) = val;
+			VGA_MarkDirty(memaddr);
+		}
 		else
 			PageHandler::writed(addr,val);
 	}
@@ -634,10 +643,12 @@ public:
 	void writeHandler(PhysPt start, uint8_t val) {
 		start &= 0xFFFFu;
 		((uint32_t*)vga.mem.linear)[start] = (((uint32_t*)vga.mem.linear)[start] & vga.config.full_not_map_mask) + (ExpandTable[val] & vga.config.full_map_mask);
+		VGA_MarkDirty((Bitu)start << 2u);
 	}
 	void writeHandlerFull(PhysPt start, uint8_t val) {
 		start &= 0xFFFFu;
 		((uint32_t*)vga.mem.linear)[start] = ExpandTable[val];
+		VGA_MarkDirty((Bitu)start << 2u);
 	}
 public:
 	VGA_UnchainedVGA_Fast_Handler() : VGA_UnchainedVGA_Handler() {}
@@ -2608,6 +2619,19 @@ void MEM_ResetPageHandler_Unmapped(Bitu phys_page, Bitu pages);
 void MEM_ResetPageHandler_RAM(Bitu phys_page, Bitu pages);
 
 extern void DISP2_SetPageHandler(void);
+static bool vga_dirty_handlers_stamp = false; /* the A0000-BFFFF handler stamps dirty pages */
+
+/* dirty tracking can only be trusted while nothing maps video memory straight into the CPU's address space */
+static void VGA_UpdateDirtyTracking(void) {
+	const bool exact = vga_dirty_handlers_stamp && vga.lfb.handler == NULL;
+
+	/* writes may have gone around the handlers until now */
+	if (exact && !vga_dirty.exact)
+		VGA_MarkStateChanged();
+
+	vga_dirty.exact = exact;
+}
+
 void VGA_SetupHandlers(void) {
 	/* This code inherited from DOSBox SVN confuses bank size with bank granularity.
 	 * This code is enforcing bank granularity. Bank size concerns how much memory is
@@ -2617,7 +2641,7 @@ void VGA_SetupHandlers(void) {
 	vga.svga.bank_read_full = vga.svga.bank_read*vga.svga.bank_size;
 	vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
 	bool runeten = false;
-	PageHandler *newHandler;
+	PageHandler *newHandler = NULL;
 	switch (machine) {
 	case MCH_CGA:
 		MEM_ResetPageHandler_Unmapped( VGA_PAGE_B0, 8 );            // B0000-B7FFF is unmapped
@@ -2913,6 +2937,11 @@ void VGA_SetupHandlers(void) {
 		(non_cga_ignore_oddeven && !(vga.mode == M_TEXT || vga.mode == M_CGA2 || vga.mode == M_CGA4));
 
 range_done:
+	vga_dirty_handlers_stamp = IS_EGAVGA_ARCH &&
+		(newHandler == &vgaph.cvga || newHandler == &vgaph.cvga_slow || newHandler == &vgaph.cvga_et4000_slow ||
+		 newHandler == &vgaph.uvga || newHandler == &vgaph.uvga_fast);
+	VGA_UpdateDirtyTracking();
+
 #if C_DEBUG
 	if (control->opt_display2) DISP2_SetPageHandler();
 #endif
@@ -2963,6 +2992,8 @@ void VGA_StartUpdateLFB(void) {
 		vga.lfb.handler = &vgaph.lfb;
 		MEM_SetLFB((unsigned int)vga.s3.la_window << 4u,(unsigned int)vga.mem.memsize/4096u, vga.lfb.handler, &vgaph.mmio);
 	}
+
+	VGA_UpdateDirtyTracking();
 }
 
 static bool VGA_Memory_ShutDown_init = false;
@@ -2987,6 +3018,10 @@ static void VGA_Memory_ShutDown(Section * /*sec*/) {
 		vga.mem.linear_orgptr = NULL;
 		vga.mem.linear = NULL;
 	}
+	if (vga_dirty.page_frame != NULL) {
+		delete[] vga_dirty.page_frame;
+		vga_dirty.page_frame = NULL;
+	}
 }
 
 void VGA_SetupMemory() {
@@ -2994,12 +3029,18 @@ void VGA_SetupMemory() {
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
 
     if (vga.mem.linear == NULL) {
+        VGA_RenderFrameWait();
         VGA_Memory_ShutDown(NULL);
 
         vga.mem.linear_orgptr = new uint8_t[vga.mem.memsize+32u];
         memset(vga.mem.linear_orgptr,0,vga.mem.memsize+32u);
         vga.mem.linear=(uint8_t*)(((uintptr_t)vga.mem.linear_orgptr + 16ull-1ull) & ~(16ull-1ull));
 
+        /* one more page for writes that run into the slack at the end */
+        vga_dirty.page_frame = new uint32_t[(vga.mem.memsize >> VGA_DIRTY_PAGE_SHIFT) + 1u]();
+        vga_dirty.exact = false;
+        VGA_MarkStateChanged();
+
         /* HACK. try to avoid stale pointers */
 	    vga.draw.linear_base = vga.mem.linear;
         vga.tandy.draw_base = vga.mem.linear;
@@ -3088,6 +3129,7 @@ void POD_Load_VGA_Memory( std::istream& stream )
 
 	// - pure data
 	READ_POD_SIZE( vga.mem.linear, sizeof(uint8_t) * vga.mem.memsize);
+	VGA_MarkStateChanged();
 
 	//***************************************************
 	//***************************************************
@@ -358,18 +358,22 @@ void XGA_DrawPoint(Bitu x, Bitu y, Bitu c) {
 		case M_LIN8:
 			if (GCC_UNLIKELY(memaddr >= vga.mem.memsize)) break;
 			vga.mem.linear[memaddr] = (uint8_t)c;
+			VGA_MarkDirty(memaddr);
 			break;
 		case M_LIN15:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.mem.memsize)) break;
 			((uint16_t*)(vga.mem.linear))[memaddr] = (uint16_t)(c&0x7fff);
+			VGA_MarkDirty(memaddr*2);
 			break;
 		case M_LIN16:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.mem.memsize)) break;
 			((uint16_t*)(vga.mem.linear))[memaddr] = (uint16_t)(c&0xffff);
+			VGA_MarkDirty(memaddr*2);
 			break;
 		case M_LIN32:
 			if (GCC_UNLIKELY(memaddr*4 >= vga.mem.memsize)) break;
 			((uint32_t*)(vga.mem.linear))[memaddr] = (uint32_t)c;
+			VGA_MarkDirty(memaddr*4);
 			break;
 		default:
 			break;
@@ -1571,11 +1575,14 @@ void XGA_DrawVirgePixel(XGAStatus::XGA_VirgeState::reggroup &rset,unsigned int x
 			memaddr = (uint32_t)((y * rset.dst_stride) + x) + rset.dst_base;
 			if (GCC_UNLIKELY(memaddr >= vga.mem.memsize)) break;
 			vga.mem.linear[memaddr] = (uint8_t)c;
+			VGA_MarkDirty(memaddr);
 			break;
 		case 1: // 16 bits/pixel
 			memaddr = (uint32_t)((y * rset.dst_stride) + (x*2)) + rset.dst_base;
 			if (GCC_UNLIKELY(memaddr >= vga.mem.memsize)) break;
 			*((uint16_t*)(vga.mem.linear+memaddr)) = (uint16_t)(c&0xffff);
+			VGA_MarkDirty(memaddr);
+			VGA_MarkDirty(memaddr+1);
 			break;
 		case 2: // 24/32 bits/pixel
 			memaddr = (uint32_t)((y * rset.dst_stride) + (x*xga.virge.truecolor_bypp)) + rset.dst_base;
@@ -1588,6 +1595,8 @@ void XGA_DrawVirgePixel(XGAStatus::XGA_VirgeState::reggroup &rset,unsigned int x
 				vga.mem.linear[memaddr+1] = (uint8_t)(c >> 8u);
 				vga.mem.linear[memaddr+2] = (uint8_t)(c >> 16u);
 			}
+			VGA_MarkDirty(memaddr);
+			VGA_MarkDirty(memaddr+3);
 			break;
 		default:
 			break;
@@ -115,12 +115,14 @@ public:
 		else
 			max_voodoomem = false;
 
+        int raster_threads = section->Get_int("voodoo_threads");
+
         bool needs_pci_device = false;
 
         switch (emulation_type) {
             case 1:
             case 2:
-                Voodoo_Initialize(emulation_type, card_type, max_voodoomem);
+                Voodoo_Initialize(emulation_type, card_type, max_voodoomem, raster_threads);
                 needs_pci_device = true;
                 break;
             default:
@@ -783,6 +783,7 @@ struct _voodoo_state
 	tmu_shared_state	tmushare;				/* TMU shared state */
 
 	stats_block	*		thread_stats;			/* per-thread statistics */
+	int					thread_count;			/* entries in thread_stats, emulation thread + workers */
 
 	int					next_rasterizer;		/* next rasterizer index */
 	raster_info			rasterizer[MAX_RASTERIZERS];	/* array of rasterizers */
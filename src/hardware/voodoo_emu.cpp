@@ -74,6 +74,15 @@ iterated W    = 18.32 [48 bits]
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <vector>
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define VOODOO_THREADS 1
+# include <atomic>
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+#endif
 
 #include "dosbox.h"
 #include "cross.h"
@@ -126,7 +135,7 @@ static raster_info *add_rasterizer(voodoo_state *v, const raster_info *cinfo);
 static raster_info *find_rasterizer(voodoo_state *v, int texcount);
 
 /* generic rasterizers */
-static void raster_fastfill(void *dest, INT32 scanline, const poly_extent *extent, const void *extradata);
+static void raster_fastfill(void *dest, INT32 scanline, const poly_extent *extent, const void *extradata, int threadid);
 
 
 /***************************************************************************
@@ -134,11 +143,11 @@ static void raster_fastfill(void *dest, INT32 scanline, const poly_extent *exten
 ***************************************************************************/
 
 void raster_generic(UINT32 TMUS, UINT32 TEXMODE0, UINT32 TEXMODE1, void *destbase,
-					INT32 y, const poly_extent *extent,	const void *extradata)
+					INT32 y, const poly_extent *extent,	const void *extradata, int threadid)
 {
 	const poly_extra_data *extra = (const poly_extra_data *)extradata;
 	voodoo_state *v = extra->state;
-	stats_block *stats = &v->thread_stats[0];
+	stats_block *stats = &v->thread_stats[threadid];
 	DECLARE_DITHER_POINTERS;
 	INT32 startx = extent->startx;
 	INT32 stopx = extent->stopx;
@@ -520,16 +529,16 @@ void raster_generic(UINT32 TMUS, UINT32 TEXMODE0, UINT32 TEXMODE1, void *destbas
     RASTERIZER MANAGEMENT
 ***************************************************************************/
 
-void raster_generic_0tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata) {
-	raster_generic(0, 0, 0, destbase, y, extent, extradata);
+void raster_generic_0tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata, int threadid) {
+	raster_generic(0, 0, 0, destbase, y, extent, extradata, threadid);
 }
 
-void raster_generic_1tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata) {
-	raster_generic(1, v->tmu[0].reg[textureMode].u, 0, destbase, y, extent, extradata);
+void raster_generic_1tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata, int threadid) {
+	raster_generic(1, v->tmu[0].reg[textureMode].u, 0, destbase, y, extent, extradata, threadid);
 }
 
-void raster_generic_2tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata) {
-	raster_generic(2, v->tmu[0].reg[textureMode].u, v->tmu[1].reg[textureMode].u, destbase, y, extent, extradata);
+void raster_generic_2tmu(void *destbase, INT32 y, const poly_extent *extent, const void *extradata, int threadid) {
+	raster_generic(2, v->tmu[0].reg[textureMode].u, v->tmu[1].reg[textureMode].u, destbase, y, extent, extradata, threadid);
 }
 
 
@@ -1127,11 +1136,145 @@ INLINE INT32 round_coordinate(float value)
 	return result + (value - (float)result > 0.5f);
 }
 
+
+/*************************************
+ *
+ *  Rasterizer threads
+ *
+ *************************************/
+
+/* Scanlines of a triangle are independent of each other (each one has its own row in the
+   color and depth buffers), so a large triangle is split into bands of scanlines that the
+   worker threads and the emulation thread pick up in turn. Each thread counts its own
+   statistics in v->thread_stats[threadid], the emulation thread being 0. The emulation
+   thread waits for the whole triangle, so the registers and buffers never change under
+   the workers. */
+
+#define RASTER_BAND_SCANLINES	8		/* scanlines handed out at a time */
+#define RASTER_MIN_PIXELS		2048	/* smaller triangles are not worth waking the workers */
+
+static std::vector<poly_extent> raster_extents;	/* extents of the triangle being drawn */
+
+#if VOODOO_THREADS
+static struct {
+	std::vector<std::thread> workers;
+	std::mutex			lock;
+	std::condition_variable	wake;				/* a new job, or quit */
+	std::condition_variable	done;				/* the last worker is through */
+	UINT32				job;					/* counts up for every job */
+	int					busy;					/* workers still on the current job */
+	bool				quit;
+
+	/* the current job */
+	void *				dest;
+	poly_draw_scanline_func callback;
+	const poly_extra_data *extra;
+	INT32				startscanline;
+	INT32				numscanlines;
+	std::atomic<INT32>	nextband;
+} raster_pool;
+
+static void raster_run_bands(int threadid)
+{
+	const INT32 bands = (raster_pool.numscanlines + RASTER_BAND_SCANLINES - 1) / RASTER_BAND_SCANLINES;
+	INT32 band;
+
+	while ((band = raster_pool.nextband.fetch_add(1)) < bands)
+	{
+		INT32 first = band * RASTER_BAND_SCANLINES;
+		INT32 last = MIN(first + RASTER_BAND_SCANLINES, raster_pool.numscanlines);
+
+		for (INT32 i = first; i < last; i++)
+			(raster_pool.callback)(raster_pool.dest, raster_pool.startscanline + i, &raster_extents[i], raster_pool.extra, threadid);
+	}
+}
+
+static void raster_worker(int threadid)
+{
+	UINT32 seen = 0;
+
+	std::unique_lock<std::mutex> guard(raster_pool.lock);
+	for (;;)
+	{
+		raster_pool.wake.wait(guard, [&seen] { return raster_pool.quit || raster_pool.job != seen; });
+		if (raster_pool.quit)
+			return;
+		seen = raster_pool.job;
+
+		guard.unlock();
+		raster_run_bands(threadid);
+		guard.lock();
+
+		if (--raster_pool.busy == 0)
+			raster_pool.done.notify_one();
+	}
+}
+
+static void raster_threads_start(int count)
+{
+	raster_pool.job = 0;
+	raster_pool.busy = 0;
+	raster_pool.quit = false;
+	for (int i = 0; i < count; i++)
+		raster_pool.workers.push_back(std::thread(raster_worker, i + 1));
+}
+
+static void raster_threads_stop(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(raster_pool.lock);
+		raster_pool.quit = true;
+	}
+	raster_pool.wake.notify_all();
+	for (size_t i = 0; i < raster_pool.workers.size(); i++)
+		raster_pool.workers[i].join();
+	raster_pool.workers.clear();
+}
+#endif
+
+/* draw raster_extents[0..numscanlines-1], on the worker threads too if it pays off */
+static void raster_scanlines(void *dest, poly_draw_scanline_func callback, INT32 startscanline, INT32 numscanlines, const poly_extra_data *extra, INT32 pixels)
+{
+	voodoo_state *vs = extra->state;
+
+	/* rotating stipple changes with every pixel drawn, so it needs the pixels in order */
+	bool ordered = FBZMODE_ENABLE_STIPPLE(vs->reg[fbzMode].u) && FBZMODE_STIPPLE_PATTERN(vs->reg[fbzMode].u) == 0;
+
+#if VOODOO_THREADS
+	if (!raster_pool.workers.empty() && !ordered && pixels >= RASTER_MIN_PIXELS && numscanlines > RASTER_BAND_SCANLINES)
+	{
+		std::unique_lock<std::mutex> guard(raster_pool.lock);
+		raster_pool.dest = dest;
+		raster_pool.callback = callback;
+		raster_pool.extra = extra;
+		raster_pool.startscanline = startscanline;
+		raster_pool.numscanlines = numscanlines;
+		raster_pool.nextband = 0;
+		raster_pool.busy = (int)raster_pool.workers.size();
+		raster_pool.job++;
+		guard.unlock();
+		raster_pool.wake.notify_all();
+
+		raster_run_bands(0);
+
+		guard.lock();
+		raster_pool.done.wait(guard, [] { return raster_pool.busy == 0; });
+		return;
+	}
+#endif
+	(void)ordered;
+	(void)pixels;
+
+	for (INT32 i = 0; i < numscanlines; i++)
+		(callback)(dest, startscanline + i, &raster_extents[i], extra, 0);
+}
+
 void poly_render_triangle(void *dest, poly_draw_scanline_func callback, const poly_vertex *v1, const poly_vertex *v2, const poly_vertex *v3, poly_extra_data *extra)
 {
 	float dxdy_v1v2, dxdy_v1v3, dxdy_v2v3;
 	const poly_vertex *tv;
-	INT32 curscan, scaninc=1;
+	INT32 curscan;
+	INT32 pixels = 0;
 
 	INT32 v1yclip, v3yclip;
     INT32 v1y, v3y;
@@ -1173,87 +1316,67 @@ void poly_render_triangle(void *dest, poly_draw_scanline_func callback, const po
 	dxdy_v1v3 = (v3->y == v1->y) ? 0.0f : (v3->x - v1->x) / (v3->y - v1->y);
 	dxdy_v2v3 = (v3->y == v2->y) ? 0.0f : (v3->x - v2->x) / (v3->y - v2->y);
 
-	poly_extent *extent = new poly_extent;
-	int extnum=0;
-	for (curscan = v1yclip; curscan < v3yclip; curscan += scaninc)
+	if (raster_extents.size() < (size_t)(v3yclip - v1yclip))
+		raster_extents.resize((size_t)(v3yclip - v1yclip));
+
+	for (curscan = v1yclip; curscan < v3yclip; curscan++)
 	{
-		{
-			float fully = (float)(curscan + extnum) + 0.5f;
-			float startx = v1->x + (fully - v1->y) * dxdy_v1v3;
-			float stopx;
-			INT32 istartx, istopx;
-
-			/* compute the ending X based on which part of the triangle we're in */
-			if (fully < v2->y)
-				stopx = v1->x + (fully - v1->y) * dxdy_v1v2;
-			else
-				stopx = v2->x + (fully - v2->y) * dxdy_v2v3;
-
-			/* clamp to full pixels */
-			istartx = round_coordinate(startx);
-			istopx = round_coordinate(stopx);
-
-			/* force start < stop */
-			if (istartx > istopx)
-			{
-				INT32 temp = istartx;
-				istartx = istopx;
-				istopx = temp;
-			}
+		poly_extent *extent = &raster_extents[curscan - v1yclip];
+		float fully = (float)curscan + 0.5f;
+		float startx = v1->x + (fully - v1->y) * dxdy_v1v3;
+		float stopx;
+		INT32 istartx, istopx;
+
+		/* compute the ending X based on which part of the triangle we're in */
+		if (fully < v2->y)
+			stopx = v1->x + (fully - v1->y) * dxdy_v1v2;
+		else
+			stopx = v2->x + (fully - v2->y) * dxdy_v2v3;
 
-			/* set the extent and update the total pixel count */
-			if (istartx >= istopx)
-				istartx = istopx = 0;
+		/* clamp to full pixels */
+		istartx = round_coordinate(startx);
+		istopx = round_coordinate(stopx);
 
-			extent->startx = istartx;
-			extent->stopx = istopx;
-			(callback)(dest,curscan,extent,extra);
+		/* force start < stop */
+		if (istartx > istopx)
+		{
+			INT32 temp = istartx;
+			istartx = istopx;
+			istopx = temp;
 		}
+
+		/* set the extent and update the total pixel count */
+		if (istartx >= istopx)
+			istartx = istopx = 0;
+
+		extent->startx = istartx;
+		extent->stopx = istopx;
+		pixels += istopx - istartx;
 	}
 
-	delete extent;
+	raster_scanlines(dest, callback, v1yclip, v3yclip - v1yclip, extra, pixels);
 }
 
 
 
 void poly_render_triangle_custom(void *dest, int startscanline, int numscanlines, const poly_extent *extents, poly_extra_data *extra)
 {
-	INT32 curscan, scaninc;
-	INT32 v1yclip, v3yclip;
+	INT32 pixels = 0;
 
-	v1yclip = startscanline;
-	v3yclip = startscanline + numscanlines;
-
-	if (v3yclip - v1yclip <= 0)
+	if (numscanlines <= 0)
 		return;
 
-	for (curscan = v1yclip; curscan < v3yclip; curscan += scaninc)
-	{
-		tri_work_unit *unit = new tri_work_unit;
-		int extnum=0;
-
-		/* determine how much to advance to hit the next bucket */
-		scaninc = 1;
+	if (raster_extents.size() < (size_t)numscanlines)
+		raster_extents.resize((size_t)numscanlines);
 
-		{
-			const poly_extent *extent = &extents[(curscan + extnum) - startscanline];
-			INT32 istartx = extent->startx, istopx = extent->stopx;
-
-			/* force start < stop */
-			if (istartx > istopx)
-			{
-				INT32 temp = istartx;
-				istartx = istopx;
-				istopx = temp;
-			}
-
-			/* set the extent and update the total pixel count */
-			unit->extent[extnum].startx = (INT16)istartx;
-			unit->extent[extnum].stopx = (INT16)istopx;
-			raster_fastfill(dest,curscan,extent,extra);
-		}
-		delete unit;
+	for (int i = 0; i < numscanlines; i++)
+	{
+		raster_extents[i] = extents[i];
+		if (extents[i].stopx > extents[i].startx)
+			pixels += extents[i].stopx - extents[i].startx;
 	}
+
+	raster_scanlines(dest, raster_fastfill, startscanline, numscanlines, extra, pixels);
 }
 
 
@@ -1277,9 +1400,12 @@ static void accumulate_statistics(voodoo_state *v, const stats_block *stats)
 static void update_statistics(voodoo_state *v, bool accumulate)
 {
 	/* accumulate/reset statistics from all units */
-	if (accumulate)
-		accumulate_statistics(v, &v->thread_stats[0]);
-	memset(&v->thread_stats[0], 0, sizeof(v->thread_stats[0]));
+	for (int i = 0; i < v->thread_count; i++)
+	{
+		if (accumulate)
+			accumulate_statistics(v, &v->thread_stats[i]);
+		memset(&v->thread_stats[i], 0, sizeof(v->thread_stats[i]));
+	}
 
 	/* accumulate/reset statistics from the LFB */
 	if (accumulate)
@@ -2905,7 +3031,7 @@ UINT32 voodoo_r(UINT32 offset) {
     device start callback
 -------------------------------------------------*/
 
-void voodoo_init(int type) {
+void voodoo_init(int type, int threads) {
 	v->active = false;
 
 	v->type = VOODOO_1;
@@ -2941,14 +3067,24 @@ void voodoo_init(int type) {
 	for (UINT32 rct=0; rct<MAX_RASTERIZERS; rct++)
 		v->rasterizer[rct] = raster_info();
 
-	v->thread_stats = new stats_block[1];
-	v->thread_stats[0].pixels_in = 0;
-	v->thread_stats[0].pixels_out = 0;
-	v->thread_stats[0].chroma_fail = 0;
-	v->thread_stats[0].zfunc_fail = 0;
-	v->thread_stats[0].afunc_fail = 0;
-	v->thread_stats[0].clip_fail = 0;
-	v->thread_stats[0].stipple_count = 0;
+#if !VOODOO_THREADS
+	if (threads > 0) {
+		LOG_MSG("VOODOO: rasterizer threads are not supported on this platform");
+		threads = 0;
+	}
+#endif
+
+	/* one statistics block for the emulation thread and one per worker */
+	v->thread_count = 1 + threads;
+	v->thread_stats = new stats_block[v->thread_count];
+	memset(v->thread_stats, 0, sizeof(stats_block) * v->thread_count);
+
+#if VOODOO_THREADS
+	if (threads > 0) {
+		raster_threads_start(threads);
+		LOG_MSG("VOODOO: rasterizing on %d additional threads", threads);
+	}
+#endif
 
 	v->alt_regmap = false;
 	v->regnames = voodoo_reg_name;
@@ -3088,7 +3224,11 @@ void voodoo_shutdown() {
 			free(v->tmu[1].ram);
 			v->tmu[1].ram = NULL;
 		}
+#if VOODOO_THREADS
+		raster_threads_stop();
+#endif
 		delete[] v->thread_stats;
+		v->thread_stats = NULL;
 		v->active=false;
 	}
 }
@@ -3675,11 +3815,11 @@ static raster_info *find_rasterizer(voodoo_state *v, int texcount)
     implementation of the 'fastfill' command
 -------------------------------------------------*/
 
-static void raster_fastfill(void *destbase, INT32 y, const poly_extent *extent, const void *extradata)
+static void raster_fastfill(void *destbase, INT32 y, const poly_extent *extent, const void *extradata, int threadid)
 {
 	const poly_extra_data *extra = (const poly_extra_data *)extradata;
 	voodoo_state *v = extra->state;
-	stats_block *stats = &v->thread_stats[0];
+	stats_block *stats = &v->thread_stats[threadid];
 	INT32 startx = extent->startx;
 	INT32 stopx = extent->stopx;
 	int scry, x;
@@ -33,7 +33,7 @@ extern voodoo_state *v;
 void voodoo_w(UINT32 offset, UINT32 data, UINT32 mask);
 UINT32 voodoo_r(UINT32 offset);
 
-void voodoo_init(int type);
+void voodoo_init(int type, int threads);
 void voodoo_shutdown();
 void voodoo_leave(void);
 
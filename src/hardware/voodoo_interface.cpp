@@ -262,7 +262,7 @@ void Voodoo_Output_Enable(bool enabled) {
 	}
 }
 
-void Voodoo_Initialize(Bits emulation_type, Bits card_type, bool max_voodoomem) {
+void Voodoo_Initialize(Bits emulation_type, Bits card_type, bool max_voodoomem, int raster_threads) {
 	if ((emulation_type <= 0) || (emulation_type > 2)) return;
 
 	int board = VOODOO_1;
@@ -290,7 +290,7 @@ void Voodoo_Initialize(Bits emulation_type, Bits card_type, bool max_voodoomem)
 
 	vdraw.vfreq = 1000.0f/60.0f;
 
-	voodoo_init(board);
+	voodoo_init(board, raster_threads);
 }
 
 void Voodoo_Shut_Down() {
@@ -23,6 +23,7 @@
 #include "callback.h"
 #include "bios.h"
 #include "bios_disk.h"
+#include "bios_disk_io.h"
 #include "timer.h"
 #include "regs.h"
 #include "mem.h"
@@ -1333,30 +1334,47 @@ uint8_t imageDisk::Read_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,v
 uint8_t imageDisk::Read_AbsoluteSector(uint32_t sectnum, void * data) {
 	if (ffdd) return ffdd->ReadSector(sectnum, data);
 
-    uint64_t bytenum,res;
-    int got;
+    return Read_Image(sectnum, 1, data);
+}
+
+uint8_t imageDisk::Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data) {
+    for (uint32_t i=0;i < count;i++) {
+        const uint8_t res = Read_AbsoluteSector(sectnum + i, (uint8_t*)data + ((size_t)i * sector_size));
+        if (res != 0x00) return res;
+    }
+    return 0x00;
+}
+
+uint8_t imageDiskRaw::Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data) {
+    return Read_Image(sectnum, count, data);
+}
+
+bool imageDisk::Open_IO(void) {
+    if (io != NULL) return true;
+    if (diskimg == NULL) return false;
+
+    /* only hard disks are big enough to be worth caching */
+    const size_t cache_kb = hardDrive ? (size_t)disk_image_cache_kb : 0;
+    io = new imageDiskIO(diskimg, image_base, image_length, disk_image_io_backend,
+        cache_kb * 1024u, (size_t)disk_image_readahead_kb * 1024u);
+    return true;
+}
+
+uint8_t imageDisk::Read_Image(uint32_t sectnum, uint32_t count, void * data) {
+    uint64_t bytenum, len;
 
     bytenum = (uint64_t)sectnum * (uint64_t)sector_size;
-    if ((bytenum + sector_size) > this->image_length) {
+    len = (uint64_t)count * (uint64_t)sector_size;
+    if ((bytenum + len) > this->image_length) {
         LOG_MSG("Attempt to read invalid sector in Read_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
         return 0x05;
     }
-    bytenum += image_base;
 
     //LOG_MSG("Reading sectors %ld at bytenum %I64d", sectnum, bytenum);
 
-    fseeko64(diskimg,(fseek_ofs_t)bytenum,SEEK_SET);
-    res = (uint64_t)ftello64(diskimg);
-    if (res != bytenum) {
-        LOG_MSG("fseek() failed in Read_AbsoluteSector for sector %lu. Want=%llu Got=%llu\n",
-            (unsigned long)sectnum,(unsigned long long)bytenum,(unsigned long long)res);
-        return 0x05;
-    }
-
-    got = (int)fread(data, 1, sector_size, diskimg);
-    if ((unsigned int)got != sector_size) {
-        LOG_MSG("fread() failed in Read_AbsoluteSector for sector %lu. Want=%u got=%d\n",
-            (unsigned long)sectnum,sector_size,(unsigned int)got);
+    if (!Open_IO() || !io->read(bytenum, data, (size_t)len)) {
+        LOG_MSG("Read failed in Read_AbsoluteSector for sector %lu (%lu sectors).\n",
+            (unsigned long)sectnum,(unsigned long)count);
         return 0x05;
     }
 
@@ -1380,25 +1398,35 @@ uint8_t imageDisk::Write_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,
 uint8_t imageDisk::Write_AbsoluteSector(uint32_t sectnum, const void *data) {
 	if (ffdd) return ffdd->WriteSector(sectnum, data);
 
-    uint64_t bytenum;
+    return Write_Image(sectnum, 1, data);
+}
+
+uint8_t imageDisk::Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data) {
+    for (uint32_t i=0;i < count;i++) {
+        const uint8_t res = Write_AbsoluteSector(sectnum + i, (const uint8_t*)data + ((size_t)i * sector_size));
+        if (res != 0x00) return res;
+    }
+    return 0x00;
+}
+
+uint8_t imageDiskRaw::Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data) {
+    return Write_Image(sectnum, count, data);
+}
+
+uint8_t imageDisk::Write_Image(uint32_t sectnum, uint32_t count, const void * data) {
+    uint64_t bytenum, len;
 
     bytenum = (uint64_t)sectnum * sector_size;
-    if ((bytenum + sector_size) > this->image_length) {
+    len = (uint64_t)count * sector_size;
+    if ((bytenum + len) > this->image_length) {
         LOG_MSG("Attempt to read invalid sector in Write_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
         return 0x05;
     }
-    bytenum += image_base;
 
     //LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
 
-    fseeko64(diskimg,(fseek_ofs_t)bytenum,SEEK_SET);
-    if ((uint64_t)ftello64(diskimg) != bytenum)
-        LOG_MSG("WARNING: fseek() failed in Write_AbsoluteSector for sector %lu\n",(unsigned long)sectnum);
-
-    size_t ret=fwrite(data, sector_size, 1, diskimg);
-
-    return ((ret>0)?0x00:0x05);
-
+    if (!Open_IO()) return 0x05;
+    return io->write(bytenum, data, (size_t)len) ? 0x00 : 0x05;
 }
 
 void imageDisk::Set_Reserved_Cylinders(Bitu resCyl) {
@@ -1671,6 +1699,7 @@ imageDisk::imageDisk(class DOS_Drive *useDrive, unsigned int letter, uint32_t fr
 
 imageDisk::~imageDisk()
 {
+    delete io;
     if(diskimg != NULL) {
         fclose(diskimg);
         diskimg=NULL;
@@ -0,0 +1,457 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "dosbox.h"
+#include "logging.h"
+#include "dos_inc.h" /* fseeko64, ftello64 */
+#include "bios_disk_io.h"
+
+#if defined(DISK_IO_POSIX)
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# if defined(LINUX)
+#  include <sys/uio.h>
+# endif
+#endif
+
+/* the most blocks read from the file in one go */
+#define DISK_IO_MAX_RUN 32
+
+imageDiskIO::backend_t disk_image_io_backend = imageDiskIO::BACKEND_AUTO;
+int disk_image_cache_kb = 8192;
+int disk_image_readahead_kb = 256;
+
+#if defined(DISK_IO_THREADS)
+# define DISK_IO_LOCK() std::unique_lock<std::mutex> guard(lock)
+#else
+# define DISK_IO_LOCK()
+#endif
+
+imageDiskIO::imageDiskIO(FILE *f,uint64_t base,uint64_t length,backend_t want,size_t cache_bytes,size_t readahead_bytes) : f(f), base(base), length(length) {
+#if defined(DISK_IO_POSIX)
+    if (want != BACKEND_STDIO) {
+        /* nothing may be left in the stdio buffer once the descriptor is used directly */
+        fflush(f);
+        fd = fileno(f);
+        if (fd >= 0) backend = BACKEND_PREAD;
+    }
+
+    if (backend == BACKEND_PREAD && want == BACKEND_MMAP) {
+        struct stat st;
+
+        /* the whole file must fit the address space, which rules out big images on 32-bit hosts */
+        if (fstat(fd,&st) == 0 && (uint64_t)st.st_size >= (base + length) &&
+            (uint64_t)st.st_size == (uint64_t)((size_t)st.st_size)) {
+            map_writable = (fcntl(fd,F_GETFL) & O_ACCMODE) == O_RDWR;
+
+            void *p = mmap(NULL,(size_t)st.st_size,PROT_READ|(map_writable ? PROT_WRITE : 0),MAP_SHARED,fd,0);
+            if (p != MAP_FAILED) {
+                map = (uint8_t*)p;
+                map_size = (size_t)st.st_size;
+                backend = BACKEND_MMAP;
+            }
+        }
+
+        if (backend != BACKEND_MMAP)
+            LOG_MSG("Disk image: unable to map the image file, using pread instead");
+    }
+#else
+    (void)want;
+#endif
+
+    /* a mapping is cached by the host already */
+    if (backend != BACKEND_MMAP) {
+        const size_t count = cache_bytes / block_size;
+
+        if (count >= 2) {
+            slots.resize(count);
+            slot_mem.resize(count * block_size);
+            for (size_t i=0;i < count;i++) slots[i].data = &slot_mem[i * block_size];
+            index.reserve(count);
+        }
+    }
+
+    readahead_blocks = (unsigned int)((readahead_bytes + block_size - 1u) / block_size);
+    if (backend != BACKEND_MMAP) {
+        /* leave room in the cache for what the guest is actually reading */
+        if (readahead_blocks > slots.size() / 2u) readahead_blocks = (unsigned int)(slots.size() / 2u);
+        if (readahead_blocks > (DISK_IO_MAX_RUN / 2)) readahead_blocks = DISK_IO_MAX_RUN / 2;
+    }
+
+#if defined(DISK_IO_THREADS)
+    if (backend == BACKEND_PREAD && !slots.empty() && readahead_blocks != 0)
+        worker = std::thread(&imageDiskIO::worker_run,this);
+#endif
+}
+
+imageDiskIO::~imageDiskIO() {
+#if defined(DISK_IO_THREADS)
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_one();
+        loaded.notify_all();
+        worker.join();
+    }
+#endif
+#if defined(DISK_IO_POSIX)
+    if (map != NULL) munmap(map,map_size);
+#endif
+}
+
+size_t imageDiskIO::block_length(uint64_t block) const {
+    const uint64_t ofs = block * block_size;
+    return (length - ofs) < block_size ? (size_t)(length - ofs) : block_size;
+}
+
+bool imageDiskIO::raw_read(uint64_t pos,const piece_t *pieces,unsigned int count) {
+#if defined(DISK_IO_POSIX)
+    if (backend != BACKEND_STDIO) {
+        unsigned int i = 0;
+        size_t done = 0; /* of pieces[i] */
+# if defined(LINUX)
+        /* one system call for the whole run, then finish off whatever came back short */
+        struct iovec iov[DISK_IO_MAX_RUN];
+        size_t total = 0;
+        assert(count <= DISK_IO_MAX_RUN);
+        for (unsigned int j=0;j < count;j++) {
+            iov[j].iov_base = pieces[j].buf;
+            iov[j].iov_len = pieces[j].len;
+            total += pieces[j].len;
+        }
+        ssize_t got = preadv(fd,iov,(int)count,(off_t)pos);
+        if (got < 0) return false;
+        pos += (uint64_t)got;
+        if ((size_t)got == total) return true;
+        while (got > 0 && (size_t)got >= pieces[i].len) got -= (ssize_t)pieces[i++].len;
+        done = (size_t)got;
+# endif
+        for (;i < count;i++,done=0) {
+            while (done < pieces[i].len) {
+                const ssize_t r = pread(fd,(uint8_t*)pieces[i].buf + done,pieces[i].len - done,(off_t)pos);
+                if (r <= 0) return false;
+                done += (size_t)r;
+                pos += (uint64_t)r;
+            }
+        }
+        return true;
+    }
+#endif
+
+    fseeko64(f,(fseek_ofs_t)pos,SEEK_SET);
+    if ((uint64_t)ftello64(f) != pos) return false;
+    for (unsigned int i=0;i < count;i++) {
+        if (fread(pieces[i].buf,1,pieces[i].len,f) != pieces[i].len) return false;
+    }
+    return true;
+}
+
+bool imageDiskIO::raw_write(uint64_t pos,const void *data,size_t len) {
+#if defined(DISK_IO_POSIX)
+    if (backend != BACKEND_STDIO) {
+        size_t done = 0;
+        while (done < len) {
+            const ssize_t r = pwrite(fd,(const uint8_t*)data + done,len - done,(off_t)(pos + done));
+            if (r <= 0) return false;
+            done += (size_t)r;
+        }
+        return true;
+    }
+#endif
+
+    fseeko64(f,(fseek_ofs_t)pos,SEEK_SET);
+    if ((uint64_t)ftello64(f) != pos) return false;
+    return fwrite(data,len,1,f) == 1;
+}
+
+/* take a slot for block: a free one, or the least recently used block that is not being read in.
+ * The slot is indexed and SLOT_LOADING on return. -1 if every slot is being read in */
+int imageDiskIO::claim_slot(uint64_t block) {
+    int s = -1;
+
+    for (size_t i=0;i < slots.size();i++) {
+        if (slots[i].state == SLOT_EMPTY) {
+            s = (int)i;
+            break;
+        }
+        if (slots[i].state == SLOT_VALID && (s < 0 || slots[i].lru < slots[(size_t)s].lru))
+            s = (int)i;
+    }
+
+    if (s >= 0) {
+        slot_t &sl = slots[(size_t)s];
+        if (sl.state == SLOT_VALID) index.erase(sl.block);
+        sl.block = block;
+        sl.lru = ++tick;
+        sl.state = SLOT_LOADING;
+        index[block] = s;
+    }
+
+    return s;
+}
+
+void imageDiskIO::release_slot(int s) {
+    slot_t &sl = slots[(size_t)s];
+    index.erase(sl.block);
+    sl.state = SLOT_EMPTY;
+}
+
+bool imageDiskIO::read(uint64_t ofs,void *data,size_t len) {
+    if (len == 0) return true;
+
+    if (map != NULL) {
+        memcpy(data,map + base + ofs,len);
+#if defined(DISK_IO_POSIX) && defined(MADV_WILLNEED)
+        /* the mapping equivalent of read-ahead, asked for again once half of it has been read */
+        const uint64_t ahead = (uint64_t)readahead_blocks * block_size;
+        if (ofs == last_end && ahead != 0 && (base + ofs + len + (ahead / 2u)) > map_advised) {
+            const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+            uint64_t from = base + ofs + len;
+            if (from < map_advised) from = map_advised;
+            from = (from / page) * page;
+            uint64_t to = base + ofs + len + ahead;
+            if (to > base + length) to = base + length;
+            if (to > from) madvise(map + from,(size_t)(to - from),MADV_WILLNEED);
+            map_advised = to;
+        }
+#endif
+        last_end = ofs + len;
+        return true;
+    }
+
+    if (slots.empty()) {
+        const piece_t piece = { data, len };
+        return raw_read(base + ofs,&piece,1);
+    }
+
+    return read_cached(ofs,(uint8_t*)data,len);
+}
+
+bool imageDiskIO::read_cached(uint64_t ofs,uint8_t *data,size_t len) {
+    const uint64_t blocks = (length + block_size - 1u) / block_size;
+    const uint64_t first = ofs / block_size;
+    const uint64_t last = (ofs + len - 1u) / block_size;
+    const bool sequential = (ofs == last_end);
+    uint64_t own_end = first; /* blocks before this were read in by this call */
+    uint64_t b = first;
+    bool async = false;
+
+#if defined(DISK_IO_THREADS)
+    async = worker.joinable();
+#endif
+
+    DISK_IO_LOCK();
+    last_end = ofs + len;
+
+    while (b <= last) {
+        std::unordered_map<uint64_t,int>::const_iterator i = index.find(b);
+
+        if (i != index.end()) {
+            slot_t &sl = slots[(size_t)i->second];
+#if defined(DISK_IO_THREADS)
+            if (sl.state == SLOT_LOADING) {
+                /* the read-ahead thread is on it */
+                loaded.wait(guard);
+                continue;
+            }
+#endif
+            const uint64_t bofs = b * block_size;
+            const uint64_t from = (ofs > bofs) ? ofs : bofs;
+            const uint64_t to = ((ofs + len) < (bofs + block_size)) ? (ofs + len) : (bofs + block_size);
+            memcpy(data + (from - ofs),sl.data + (from - bofs),(size_t)(to - from));
+            sl.lru = ++tick;
+            if (b >= own_end) stats.hits++;
+            b++;
+            continue;
+        }
+
+        /* read in the run of blocks that are not cached, and when reading along
+         * without a read-ahead thread, the blocks after the request as well */
+        uint64_t limit = last + 1u;
+        if (sequential && !async) limit += readahead_blocks;
+        if (limit > blocks) limit = blocks;
+        if (limit > b + DISK_IO_MAX_RUN) limit = b + DISK_IO_MAX_RUN;
+
+        piece_t pieces[DISK_IO_MAX_RUN];
+        int claimed[DISK_IO_MAX_RUN];
+        unsigned int count = 0;
+
+        for (uint64_t e=b;e < limit;e++) {
+            if (e != b && index.find(e) != index.end()) break;
+            const int s = claim_slot(e);
+            if (s < 0) break;
+            claimed[count] = s;
+            pieces[count].buf = slots[(size_t)s].data;
+            pieces[count].len = block_length(e);
+            count++;
+        }
+
+        if (count == 0) {
+            /* every slot is busy being read in, go around the cache for this block */
+            const uint64_t bofs = b * block_size;
+            const uint64_t from = (ofs > bofs) ? ofs : bofs;
+            const uint64_t to = ((ofs + len) < (bofs + block_size)) ? (ofs + len) : (bofs + block_size);
+            const piece_t piece = { data + (from - ofs), (size_t)(to - from) };
+            if (!raw_read(base + from,&piece,1)) return false;
+            stats.misses++;
+            b++;
+            continue;
+        }
+
+        for (unsigned int c=0;c < count;c++) {
+            if ((b + c) <= last) stats.misses++;
+            else stats.readahead++;
+        }
+
+#if defined(DISK_IO_THREADS)
+        guard.unlock();
+#endif
+        const bool ok = raw_read(base + (b * block_size),pieces,count);
+#if defined(DISK_IO_THREADS)
+        guard.lock();
+#endif
+
+        for (unsigned int c=0;c < count;c++) {
+            if (ok) slots[(size_t)claimed[c]].state = SLOT_VALID;
+            else release_slot(claimed[c]);
+        }
+#if defined(DISK_IO_THREADS)
+        loaded.notify_all();
+#endif
+        if (!ok) return false;
+
+        own_end = b + count;
+    }
+
+    if (sequential && async && (last + 1u) < blocks)
+        start_readahead(last + 1u);
+
+    return true;
+}
+
+bool imageDiskIO::write(uint64_t ofs,const void *data,size_t len) {
+    if (len == 0) return true;
+
+    if (map != NULL && map_writable) {
+        memcpy(map + base + ofs,data,len);
+        return true;
+    }
+
+    if (!raw_write(base + ofs,data,len)) return false;
+    if (slots.empty()) return true;
+
+    /* bring what is cached up to date. a block still being read in may have been read before
+     * the write went through, so wait for it and patch it afterwards */
+    const uint64_t first = ofs / block_size;
+    const uint64_t last = (ofs + len - 1u) / block_size;
+    uint64_t b = first;
+
+    DISK_IO_LOCK();
+    while (b <= last) {
+        std::unordered_map<uint64_t,int>::const_iterator i = index.find(b);
+
+        if (i != index.end()) {
+            slot_t &sl = slots[(size_t)i->second];
+#if defined(DISK_IO_THREADS)
+            if (sl.state == SLOT_LOADING) {
+                loaded.wait(guard);
+                continue;
+            }
+#endif
+            const uint64_t bofs = b * block_size;
+            const uint64_t from = (ofs > bofs) ? ofs : bofs;
+            const uint64_t to = ((ofs + len) < (bofs + block_size)) ? (ofs + len) : (bofs + block_size);
+            memcpy(sl.data + (from - bofs),(const uint8_t*)data + (from - ofs),(size_t)(to - from));
+        }
+
+        b++;
+    }
+
+    return true;
+}
+
+#if defined(DISK_IO_THREADS)
+/* queue the blocks from block on for the read-ahead thread. lock must be held */
+void imageDiskIO::start_readahead(uint64_t block) {
+    const uint64_t blocks = (length + block_size - 1u) / block_size;
+
+    /* whatever was queued before is of no interest anymore */
+    queue.clear();
+    for (unsigned int i=0;i < readahead_blocks && (block + i) < blocks;i++) {
+        if (index.find(block + i) == index.end())
+            queue.push_back(block + i);
+    }
+
+    if (!queue.empty()) wake.notify_one();
+}
+
+void imageDiskIO::worker_run(void) {
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        wake.wait(guard,[this] { return quit || !queue.empty(); });
+        if (quit) break;
+
+        /* take the queued blocks that follow each other in one read */
+        const uint64_t b = queue.front();
+        piece_t pieces[DISK_IO_MAX_RUN];
+        int claimed[DISK_IO_MAX_RUN];
+        unsigned int count = 0;
+
+        while (!queue.empty() && queue.front() == (b + count) && count < DISK_IO_MAX_RUN) {
+            if (index.find(b + count) != index.end()) {
+                /* read in since it was queued */
+                queue.pop_front();
+                break;
+            }
+            const int s = claim_slot(b + count);
+            if (s < 0) break; /* every slot is being read in, the rest stays queued */
+            queue.pop_front();
+            claimed[count] = s;
+            pieces[count].buf = slots[(size_t)s].data;
+            pieces[count].len = block_length(b + count);
+            count++;
+        }
+        if (count == 0) {
+            /* wait for a slot to be read in before trying again */
+            if (!queue.empty() && queue.front() == b) loaded.wait(guard);
+            continue;
+        }
+
+        guard.unlock();
+        const bool ok = raw_read(base + (b * block_size),pieces,count);
+        guard.lock();
+
+        for (unsigned int c=0;c < count;c++) {
+            if (ok) slots[(size_t)claimed[c]].state = SLOT_VALID;
+            else release_slot(claimed[c]);
+        }
+        if (ok) stats.readahead += count;
+        loaded.notify_all();
+    }
+}
+#else
+void imageDiskIO::start_readahead(uint64_t block) {
+    (void)block;
+}
+#endif
@@ -17,6 +17,7 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
 
+#include <algorithm>
 #include <assert.h>
 #include <stdlib.h>
 #include <time.h>
@@ -46,9 +47,12 @@
 * - code does not prevent loading if parent does not match correct datestamp
 * - for differencing disks, parent paths are converted to ASCII; unicode characters will cancel loading
 * - differencing disks only support absolute paths on Windows platforms
+* - the BAT is kept in memory, along with the sector bitmaps of the last few blocks used
 *
 */
 
+static const unsigned int vhd_bitmap_cache_blocks = 32;
+
 imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool readOnly, imageDisk** disk) {
 	return Open(fileName, readOnly, disk, 0);
 }
@@ -131,7 +135,7 @@ imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool rea
         vhd->cylinders = sizes[3];
         vhd->heads = sizes[2];
         vhd->sectors = sizes[1];
-        vhd->fixedDisk = new imageDisk(file, fileName, vhd->cylinders, vhd->heads, vhd->sectors, 512, true);
+        vhd->fixedDisk = new imageDiskRaw(file, fileName, vhd->cylinders, vhd->heads, vhd->sectors, 512, true);
         *disk = vhd;
 		return !readOnly && roflag ? UNSUPPORTED_WRITE : OPEN_SUCCESS;
 	}
@@ -205,8 +209,13 @@ imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool rea
 	vhd->blockMapSectors = blockMapSectors;
 	vhd->blockMapSize = blockMapSectors * 512;
 	vhd->sectorsPerBlock = sectorsPerBlock;
-	vhd->currentBlockDirtyMap = (uint8_t*)malloc(vhd->blockMapSize);
-	if (vhd->currentBlockDirtyMap == 0) { delete vhd; return INVALID_DATA; }
+	//read the whole BAT, it is small and only changes when we allocate a block
+	vhd->blockTable.resize(dynHeader.maxTableEntries);
+	if (fseeko64(file, (off_t)dynHeader.tableOffset, SEEK_SET)) { delete vhd; return INVALID_DATA; }
+	if (fread(vhd->blockTable.data(), sizeof(uint32_t), dynHeader.maxTableEntries, file) != dynHeader.maxTableEntries) { delete vhd; return INVALID_DATA; }
+	for (auto &entry : vhd->blockTable) entry = SDL_SwapBE32(entry);
+	vhd->bitmapCache.resize(vhd_bitmap_cache_blocks);
+	for (auto &entry : vhd->bitmapCache) entry.map.resize(vhd->blockMapSize);
 
 	//try loading the first block
 	if (!vhd->loadBlock(0)) { 
@@ -324,27 +333,50 @@ imageDiskVHD::ErrorCodes imageDiskVHD::TryOpenParent(const char* childFileName,
 
 uint8_t imageDiskVHD::Read_AbsoluteSector(uint32_t sectnum, void * data) {
     if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Read_AbsoluteSector(sectnum, data);
-	uint32_t blockNumber = sectnum / sectorsPerBlock;
-	uint32_t sectorOffset = sectnum % sectorsPerBlock;
-	if (!loadBlock(blockNumber)) return 0x05; //can't load block
-	if (currentBlockAllocated) {
-		uint32_t byteNum = sectorOffset / 8;
-		uint32_t bitNum = sectorOffset % 8;
-		bool hasData = currentBlockDirtyMap[byteNum] & (1 << (7 - bitNum));
-		if (hasData) {
-			if (fseeko64(diskimg, (off_t)(((uint64_t)currentBlockSectorOffset + blockMapSectors + sectorOffset) * 512ull), SEEK_SET)) return 0x05; //can't seek
-			if (fread(data, sizeof(uint8_t), 512, diskimg) != 512) return 0x05; //can't read
-			return 0;
+	return Read_AbsoluteSectors(sectnum, 1, data);
+}
+
+//sectors are read in runs: all the sectors present in a block with one read, and all the sectors
+//missing from it with one request to the parent, which does the same with its own blocks
+uint8_t imageDiskVHD::Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void * data) {
+    if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Read_AbsoluteSectors(sectnum, count, data);
+	uint8_t* out = (uint8_t*)data;
+	while (count > 0) {
+		uint32_t blockNumber = sectnum / sectorsPerBlock;
+		uint32_t sectorOffset = sectnum % sectorsPerBlock;
+		uint32_t inBlock = std::min(count, sectorsPerBlock - sectorOffset);
+		if (!loadBlock(blockNumber)) return 0x05; //can't load block
+		if (!currentBlockAllocated) {
+			if (readUnallocated(sectnum, inBlock, out)) return 0x05;
 		}
+		else {
+			uint32_t i = 0;
+			while (i < inBlock) {
+				bool hasData = currentBlockDirtyMap[(sectorOffset + i) / 8] & (1 << (7 - ((sectorOffset + i) % 8)));
+				uint32_t run = 1;
+				while (i + run < inBlock && hasData == ((currentBlockDirtyMap[(sectorOffset + i + run) / 8] & (1 << (7 - ((sectorOffset + i + run) % 8)))) != 0)) run++;
+				if (hasData) {
+					if (fseeko64(diskimg, (off_t)(((uint64_t)currentBlockSectorOffset + blockMapSectors + sectorOffset + i) * 512ull), SEEK_SET)) return 0x05; //can't seek
+					if (fread(out + i * 512ull, 512, run, diskimg) != run) return 0x05; //can't read
+				}
+				else if (readUnallocated(sectnum + i, run, out + i * 512ull)) {
+					return 0x05;
+				}
+				i += run;
+			}
+		}
+		sectnum += inBlock;
+		count -= inBlock;
+		out += inBlock * 512ull;
 	}
-    //NOTE: should come first?
-	if (parentDisk) {
-		return parentDisk->Read_AbsoluteSector(sectnum, data);
-	}
-	else {
-		memset(data, 0, 512);
-		return 0;
-	}
+	return 0;
+}
+
+//sectors that are not in this image come from the parent, or are zero
+uint8_t imageDiskVHD::readUnallocated(uint32_t sectnum, uint32_t count, uint8_t* data) {
+	if (parentDisk) return parentDisk->Read_AbsoluteSectors(sectnum, count, data);
+	memset(data, 0, count * 512ull);
+	return 0;
 }
 
 bool imageDiskVHD::is_zeroed_sector(const void* data) {
@@ -356,7 +388,8 @@ bool imageDiskVHD::is_zeroed_sector(const void* data) {
 }
 
 bool imageDiskVHD::is_block_allocated(uint32_t blockNumber) {
-    if(currentBlockAllocated) return true;
+    if(vhdType == VHD_TYPE_FIXED) return true;
+    if(blockNumber < blockTable.size() && blockTable[blockNumber] != 0xFFFFFFFFul) return true;
     if(parentDisk && ((imageDiskVHD*) parentDisk)->is_block_allocated(blockNumber)) return true;
     return false;
 }
@@ -392,6 +425,8 @@ uint8_t imageDiskVHD::Write_AbsoluteSector(uint32_t sectnum, const void * data)
 		uint32_t newBlockSectorNumber = (uint32_t)((footerPosition + 511ul) / 512ul);
 		footerPosition = newFooterPosition;
 		//clear the dirty flags for the new footer position
+		bool cached;
+		currentBlockDirtyMap = claimBitmap(blockNumber, cached)->map.data();
 		for (uint32_t i = 0; i < blockMapSize; i++) currentBlockDirtyMap[i] = 0;
 		//write the dirty map
 		if (fseeko64(diskimg, (off_t)(newBlockSectorNumber * 512ull), SEEK_SET)) return 0x05;
@@ -401,7 +436,8 @@ uint8_t imageDiskVHD::Write_AbsoluteSector(uint32_t sectnum, const void * data)
 		//update the BAT
 		if (fseeko64(diskimg, (off_t)(dynamicHeader.tableOffset + (blockNumber * 4ull)), SEEK_SET)) return 0x05;
 		uint32_t newBlockSectorNumberBE = SDL_SwapBE32(newBlockSectorNumber);
-		if (fwrite(&newBlockSectorNumberBE, sizeof(uint8_t), 4, diskimg) != 4) return false;
+		if (fwrite(&newBlockSectorNumberBE, sizeof(uint8_t), 4, diskimg) != 4) return 0x05;
+		blockTable[blockNumber] = newBlockSectorNumber;
 		currentBlockAllocated = true;
 		currentBlockSectorOffset = newBlockSectorNumber;
 		//flush the data to disk after allocating a block
@@ -424,6 +460,15 @@ uint8_t imageDiskVHD::Write_AbsoluteSector(uint32_t sectnum, const void * data)
 	return 0;
 }
 
+uint8_t imageDiskVHD::Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void * data) {
+    if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Write_AbsoluteSectors(sectnum, count, data);
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t res = Write_AbsoluteSector(sectnum + i, (const uint8_t*)data + i * 512ull);
+		if (res) return res;
+	}
+	return 0;
+}
+
 imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(void) const {
 	return footer.diskType;
 }
@@ -440,31 +485,49 @@ imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(const char* fileName) {
 
 bool imageDiskVHD::loadBlock(const uint32_t blockNumber) {
 	if (currentBlock == blockNumber) return true;
-	if (blockNumber >= dynamicHeader.maxTableEntries) return false;
-	if (fseeko64(diskimg, (off_t)(dynamicHeader.tableOffset + (blockNumber * 4ull)), SEEK_SET)) return false;
-	uint32_t blockSectorOffset;
-	if (fread(&blockSectorOffset, sizeof(uint8_t), 4, diskimg) != 4) return false;
-	blockSectorOffset = SDL_SwapBE32(blockSectorOffset);
+	if (blockNumber >= blockTable.size()) return false;
+	uint32_t blockSectorOffset = blockTable[blockNumber];
 	if (blockSectorOffset == 0xFFFFFFFFul) {
 		currentBlock = blockNumber;
 		currentBlockAllocated = false;
 	}
 	else {
-		if (fseeko64(diskimg, (off_t)(blockSectorOffset * (uint64_t)512), SEEK_SET)) return false;
 		currentBlock = 0xFFFFFFFFul;
+		bool cached;
+		BlockBitmap* bitmap = claimBitmap(blockNumber, cached);
+		if (!cached) {
+			if (fseeko64(diskimg, (off_t)(blockSectorOffset * (uint64_t)512), SEEK_SET) ||
+				fread(bitmap->map.data(), sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) {
+				bitmap->block = 0xFFFFFFFFul;
+				return false;
+			}
+		}
 		currentBlockAllocated = true;
 		currentBlockSectorOffset = blockSectorOffset;
-		if (fread(currentBlockDirtyMap, sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return false;
+		currentBlockDirtyMap = bitmap->map.data();
 		currentBlock = blockNumber;
 	}
 	return true;
 }
 
-imageDiskVHD::~imageDiskVHD() {
-	if (currentBlockDirtyMap) {
-		free(currentBlockDirtyMap);
-		currentBlockDirtyMap = 0;
+//find the cached bitmap of a block, or give the block the least recently used entry
+imageDiskVHD::BlockBitmap* imageDiskVHD::claimBitmap(const uint32_t blockNumber, bool& cached) {
+	BlockBitmap* victim = &bitmapCache[0];
+	for (auto &entry : bitmapCache) {
+		if (entry.block == blockNumber) {
+			entry.lru = ++bitmapTick;
+			cached = true;
+			return &entry;
+		}
+		if (entry.lru < victim->lru) victim = &entry;
 	}
+	victim->block = blockNumber;
+	victim->lru = ++bitmapTick;
+	cached = false;
+	return victim;
+}
+
+imageDiskVHD::~imageDiskVHD() {
 	if (parentDisk) {
 		parentDisk->Release();
 		parentDisk = 0;
@@ -762,7 +825,7 @@ uint32_t imageDiskVHD::CreateDifferencing(const char* filename, const char* base
         table_size -= 512;
     }
     //write Parent Locator sectors
-    wchar_t* w_basename = (wchar_t*)malloc(platsize);
+    uint16_t* w_basename = (uint16_t*)malloc(platsize); //UTF-16, not wchar_t which is 32 bits outside Windows
     memset(w_basename, 0, platsize);
     for(uint32_t i = 0; i < l_basename; i++)
         //dirty hack to quickly convert ASCII -> UTF-16 *LE* and fix slashes
@@ -827,11 +890,8 @@ uint32_t imageDiskVHD::GetInfo(VHDInfo* info) {
     if(vhdType != VHD_TYPE_FIXED) {
         info->blockSize = dynamicHeader.blockSize;
         info->totalBlocks = dynamicHeader.maxTableEntries;
-        fseeko64(diskimg, dynamicHeader.tableOffset, SEEK_SET);
-        for(int i = 0; i < info->totalBlocks; i++) {
-            uint32_t n;
-            if(fread(&n, 1, 4, diskimg) != 4) return ERROR_OPENING;
-            if(n != 0xFFFFFFFF) info->allocatedBlocks++;
+        for(uint32_t i = 0; i < info->totalBlocks; i++) {
+            if(blockTable[i] != 0xFFFFFFFF) info->allocatedBlocks++;
         }
     }
     else {
@@ -876,11 +936,8 @@ bool imageDiskVHD::MergeSnapshot(uint32_t* totalSectorsMerged, uint32_t* totalBl
     *totalSectorsMerged = 0;
     *totalBlocksUpdated = 0;
     for(uint32_t block = 0; block < dynamicHeader.maxTableEntries; block++) {
-        uint32_t n;
-        fseeko64(diskimg, dynamicHeader.tableOffset+block*4, SEEK_SET);
-        if(fread(&n, 1, 4, diskimg) != 4) { return false; }
-        if(n == 0xFFFFFFFF) continue;
-        loadBlock(block);
+        if(blockTable[block] == 0xFFFFFFFF) continue;
+        if(!loadBlock(block)) return false;
         bool blockUpdated = false;
         //scan bitmap
         for(uint32_t sector = 0; sector < sectorsPerBlock; sector++) {
@@ -19,6 +19,10 @@
 
 #include "qcow2_disk.h"
 
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
 #endif
@@ -30,6 +34,12 @@ using namespace std;
 	const uint32_t QCow2Image::magic = 0x514649FB;
 
 
+//Memory given to the L2 table, refcount block and inflated cluster caches. Each holds at least a few clusters whatever the cluster size.
+	static const uint64_t l2_cache_bytes = 1024 * 1024;
+	static const uint64_t refcount_cache_bytes = 256 * 1024;
+	static const uint64_t compressed_cache_bytes = 512 * 1024;
+
+
 //Public function to read a QCow2 header.
 	QCow2Image::QCow2Header QCow2Image::read_header(FILE* qcow2File){
 		QCow2Header header;
@@ -56,7 +66,7 @@ using namespace std;
 
 
 //Public Constructor.
-	QCow2Image::QCow2Image(QCow2Image::QCow2Header& qcow2Header, FILE *qcow2File, const char* imageName, uint32_t sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL)
+	QCow2Image::QCow2Image(QCow2Image::QCow2Header& qcow2Header, FILE *qcow2File, const char* imageName, uint32_t sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL), tables_loaded(false), buffered_cluster_offset(0), last_sector(~0ull)
 	{
 		cluster_mask = mask64(header.cluster_bits);
 		cluster_size = cluster_mask + 1;
@@ -66,6 +76,14 @@ using namespace std;
 		l1_bits = header.cluster_bits + l2_bits;
 		refcount_bits = header.cluster_bits - 1;
 		refcount_mask = mask64(refcount_bits);
+		compressed_sectors_shift = 62 - (header.cluster_bits - 8);
+		compressed_offset_mask = mask64(compressed_sectors_shift);
+		l2_cache.entries.resize((size_t)std::max<uint64_t>(4, l2_cache_bytes / cluster_size));
+		refcount_cache.entries.resize((size_t)std::max<uint64_t>(2, refcount_cache_bytes / cluster_size));
+		compressed_cache.entries.resize((size_t)std::max<uint64_t>(2, compressed_cache_bytes / cluster_size));
+		if (0 != load_tables()){
+			LOG(LOG_IO, LOG_ERROR) ("Failed to read the QCow2 L1 or refcount table of %s\n", imageName);
+		}
 		if (header.backing_file_offset != 0 && header.backing_file_size != 0){
 			char* backing_file_name = new char[header.backing_file_size + 1];
 			backing_file_name[header.backing_file_size] = 0;
@@ -108,6 +126,18 @@ using namespace std;
 
 //Public Destructor.
 	QCow2Image::~QCow2Image(){
+		if (0 != flush()){
+			LOG_MSG("QCow2: failed to write back metadata cache");
+		}
+		const uint64_t l2_lookups = stats.l2_hits + stats.l2_misses;
+		const uint64_t refcount_lookups = stats.refcount_hits + stats.refcount_misses;
+		if (l2_lookups != 0){
+			LOG_MSG("QCow2: L2 cache %.1f%% hits of %llu, refcount cache %.1f%% hits of %llu, %llu sectors from %llu clusters read ahead, %llu metadata writes, %llu compressed clusters inflated for %llu reads",
+				100.0 * (double)stats.l2_hits / (double)l2_lookups, (unsigned long long)l2_lookups,
+				refcount_lookups ? 100.0 * (double)stats.refcount_hits / (double)refcount_lookups : 0.0, (unsigned long long)refcount_lookups,
+				(unsigned long long)stats.cluster_hits, (unsigned long long)stats.cluster_reads, (unsigned long long)stats.writebacks,
+				(unsigned long long)stats.compressed_reads, (unsigned long long)(stats.compressed_reads + stats.compressed_hits));
+		}
 		if (backing_image != NULL){
 			fclose(backing_image->file);
 			delete backing_image;
@@ -128,19 +158,90 @@ using namespace std;
 		if (0 == l2_table_offset){
 			return read_unallocated_sector(sectnum, data);
 		}
-		uint64_t data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+		uint64_t l2_entry;
+		if (0 != read_l2_table(l2_table_offset, address, l2_entry)){
 			return 0x05;
 		}
-		if (0 == data_cluster_offset){
-			return read_unallocated_sector(sectnum, data);
+		switch (cluster_type(l2_entry)){
+			case CLUSTER_NORMAL:
+				return read_allocated_sector(sectnum, l2_entry & standard_offset_mask, data);
+			case CLUSTER_ZERO:
+				std::fill(data, data + sector_size, 0);
+				return 0;
+			case CLUSTER_COMPRESSED: {
+				const uint8_t* cluster;
+				if (0 != read_compressed_cluster(l2_entry, cluster)){
+					return 0x05;
+				}
+				memcpy(data, cluster + (address & cluster_mask), sector_size);
+				return 0;
+			}
+			default:
+				return read_unallocated_sector(sectnum, data);
 		}
-		return read_allocated_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+	}
+
+
+//Public function to read consecutive sectors. Sectors that are together in one data cluster are read with one call.
+	uint8_t QCow2Image::read_sectors(uint32_t sectnum, uint32_t count, uint8_t* data){
+		while (count > 0){
+			const uint64_t address = (uint64_t)sectnum * sector_size;
+			const uint64_t in_cluster = (cluster_size - (address & cluster_mask)) / sector_size;
+			if (count == 1 || in_cluster < 2 || address >= header.size){
+				if (0 != read_sector(sectnum, data)){
+					return 0x05;
+				}
+				sectnum++; count--; data += sector_size;
+				continue;
+			}
+			uint64_t l2_table_offset;
+			uint64_t l2_entry = 0;
+			if (0 != read_l1_table(address, l2_table_offset)){
+				return 0x05;
+			}
+			if (0 != l2_table_offset && 0 != read_l2_table(l2_table_offset, address, l2_entry)){
+				return 0x05;
+			}
+			const uint64_t data_cluster_offset = l2_entry & standard_offset_mask;
+			const uint32_t n = (uint32_t)std::min<uint64_t>(count, in_cluster);
+			if (CLUSTER_NORMAL != cluster_type(l2_entry) || data_cluster_offset == buffered_cluster_offset){
+				for (uint32_t i = 0; i < n; i++){
+					if (0 != read_sector(sectnum + i, data + (uint64_t)i * sector_size)){
+						return 0x05;
+					}
+				}
+			} else {
+				if (0 != read_allocated_data(data_cluster_offset + (address & cluster_mask), data, (uint64_t)n * sector_size)){
+					return 0x05;
+				}
+				last_sector = sectnum + n - 1;
+			}
+			sectnum += n; count -= n; data += (uint64_t)n * sector_size;
+		}
+		return 0;
 	}
 
 
 //Public function to a write a sector.
 	uint8_t QCow2Image::write_sector(uint32_t sectnum, const uint8_t* data){
+		return write_sectors(sectnum, 1, data);
+	}
+
+
+//Public function to write consecutive sectors. Metadata changed along the way is written back once at the end.
+	uint8_t QCow2Image::write_sectors(uint32_t sectnum, uint32_t count, const uint8_t* data){
+		for (uint32_t i = 0; i < count; i++){
+			if (0 != write_one_sector(sectnum + i, data + (uint64_t)i * sector_size)){
+				flush();
+				return 0x05;
+			}
+		}
+		return flush();
+	}
+
+
+//Write a sector, allocating an L2 table and data cluster for it if needed.
+	uint8_t QCow2Image::write_one_sector(uint32_t sectnum, const uint8_t* data){
 		const uint64_t address = (uint64_t)sectnum * sector_size;
 		if (address >= header.size){
 			return 0x05;
@@ -149,7 +250,12 @@ using namespace std;
 		if (0 != read_l1_table(address, l2_table_offset)){
 			return 0x05;
 		}
+		//Zeros written where there is nothing yet already read back as zeros, so nothing needs to be allocated.
+		const bool zero_data = is_zero(data, sector_size);
 		if (0 == l2_table_offset){
+			if (zero_data && backing_image == NULL){
+				return 0;
+			}
 			if (0 != pad_file(l2_table_offset)){
 				return 0x05;
 			}
@@ -162,25 +268,48 @@ using namespace std;
 				delete[] cluster_buffer;
 				return 0x05;
 			}
+			if (NULL == cache_get(l2_cache, l2_table_offset, true)){
+				delete[] cluster_buffer;
+				return 0x05;
+			}
 			if (0 != update_reference_count(l2_table_offset, cluster_buffer)){
 				delete[] cluster_buffer;
 				return 0x05;
 			}
 			delete[] cluster_buffer;
 		}
-		uint64_t data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+		uint64_t l2_entry;
+		if (0 != read_l2_table(l2_table_offset, address, l2_entry)){
 			return 0x05;
 		}
-		if (data_cluster_offset == 0){
-			if (0 != pad_file(data_cluster_offset)){
+		const ClusterType type = cluster_type(l2_entry);
+		if (type != CLUSTER_NORMAL){
+			if (zero_data && (type == CLUSTER_ZERO || (type == CLUSTER_UNALLOCATED && backing_image == NULL))){
+				return 0;
+			}
+			//A zero cluster keeps its preallocated cluster if it has one, anything else gets a new one. The
+			//compressed data stays where it is, possibly shared with other compressed clusters.
+			uint64_t data_cluster_offset = (type == CLUSTER_ZERO) ? (l2_entry & standard_offset_mask) : 0;
+			const bool allocate = (0 == data_cluster_offset);
+			uint8_t* cluster_buffer = new uint8_t[cluster_size];
+			if (type == CLUSTER_COMPRESSED){
+				const uint8_t* cluster;
+				if (0 != read_compressed_cluster(l2_entry, cluster)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
+				memcpy(cluster_buffer, cluster, cluster_size);
+			} else if (type == CLUSTER_ZERO){
+				std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
+			} else if (0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
+				delete[] cluster_buffer;
 				return 0x05;
 			}
-			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+			if (allocate && 0 != pad_file(data_cluster_offset)){
+				delete[] cluster_buffer;
 				return 0x05;
 			}
-			uint8_t* cluster_buffer = new uint8_t[cluster_size];
-			if ( 0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
+			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
 				delete[] cluster_buffer;
 				return 0x05;
 			}
@@ -192,21 +321,37 @@ using namespace std;
 				delete[] cluster_buffer;
 				return 0x05;
 			}
-			if (0 != update_reference_count(data_cluster_offset, cluster_buffer)){
+			if (allocate && 0 != update_reference_count(data_cluster_offset, cluster_buffer)){
 				delete[] cluster_buffer;
 				return 0x05;
 			}
 			delete[] cluster_buffer;
 			return 0;
 		}
+		const uint64_t data_cluster_offset = l2_entry & standard_offset_mask;
+		if (data_cluster_offset == buffered_cluster_offset){
+			memcpy(&data_cluster[address & cluster_mask], data, sector_size);
+		}
 		return write_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
 	}
 
 
+//Write back everything that changed in the L2 table and refcount block caches.
+	uint8_t QCow2Image::flush(){
+		uint8_t result = cache_flush(l2_cache);
+		if (0 != cache_flush(refcount_cache)){
+			result = 0x05;
+		}
+		return result;
+	}
+
+
 //Private constants.
 	const uint64_t QCow2Image::copy_flag = 0x8000000000000000;
-	const uint64_t QCow2Image::empty_mask = 0xFFFFFFFFFFFFFFFF;
+	const uint64_t QCow2Image::compressed_flag = 0x4000000000000000;
+	const uint64_t QCow2Image::zero_flag = 0x0000000000000001;
 	const uint64_t QCow2Image::table_entry_mask = 0x00FFFFFFFFFFFFFF;
+	const uint64_t QCow2Image::standard_offset_mask = 0x00FFFFFFFFFFFE00;
 
 
 //Helper functions for endianness. QCOW format is big endian so we need different functions than those defined in mem.h.
@@ -280,6 +425,209 @@ using namespace std;
 	}
 
 
+//Read one sector of an allocated data cluster. Sequential reads take the whole cluster at once and the
+//sectors after it come from memory.
+	uint8_t QCow2Image::read_allocated_sector(uint32_t sectnum, uint64_t file_offset, uint8_t* data){
+		const uint64_t offset_in_cluster = ((uint64_t)sectnum * sector_size) & cluster_mask;
+		const bool sequential = (sectnum == last_sector + 1);
+		last_sector = sectnum;
+		if (file_offset != buffered_cluster_offset && sequential && offset_in_cluster + sector_size < cluster_size){
+			data_cluster.resize((size_t)cluster_size);
+			buffered_cluster_offset = 0;
+			if (0 == read_allocated_data(file_offset, data_cluster.data(), cluster_size)){
+				buffered_cluster_offset = file_offset;
+				stats.cluster_reads++;
+			} else {
+				clearerr(file); /* a short last cluster, read just the sector */
+			}
+		}
+		if (file_offset == buffered_cluster_offset){
+			memcpy(data, &data_cluster[offset_in_cluster], sector_size);
+			stats.cluster_hits++;
+			return 0;
+		}
+		return read_allocated_data(file_offset + offset_in_cluster, data, sector_size);
+	}
+
+
+//Read the L1 table and refcount table into memory. Both are small and change only when tables are allocated.
+	uint8_t QCow2Image::load_tables(){
+		tables_loaded = false;
+		if (header.cluster_bits < 9 || header.cluster_bits > 21){
+			return 0x05;
+		}
+		std::vector<uint64_t> l1(header.l1_size);
+		if (!l1.empty() && 0 != read_allocated_data(header.l1_table_offset, (uint8_t*)l1.data(), l1.size() * sizeof(uint64_t))){
+			return 0x05;
+		}
+		std::vector<uint64_t> refcounts((size_t)((uint64_t)header.refcount_table_clusters * cluster_size / sizeof(uint64_t)));
+		if (!refcounts.empty() && 0 != read_allocated_data(header.refcount_table_offset, (uint8_t*)refcounts.data(), refcounts.size() * sizeof(uint64_t))){
+			return 0x05;
+		}
+		for (auto &entry : l1) entry = host_read64(entry);
+		for (auto &entry : refcounts) entry = host_read64(entry);
+		l1_table.swap(l1);
+		refcount_table.swap(refcounts);
+		tables_loaded = true;
+		return 0;
+	}
+
+
+//Classify a cluster by its L2 table entry.
+	QCow2Image::ClusterType QCow2Image::cluster_type(uint64_t l2_entry) const{
+		if (0 != (l2_entry & compressed_flag)){
+			return CLUSTER_COMPRESSED;
+		}
+		if (header.version >= 3 && 0 != (l2_entry & zero_flag)){
+			return CLUSTER_ZERO;
+		}
+		if (0 == (l2_entry & standard_offset_mask)){
+			return CLUSTER_UNALLOCATED;
+		}
+		return CLUSTER_NORMAL;
+	}
+
+
+//Get the contents of a compressed cluster, inflating it unless it is one of the last few used. The entry gives the
+//file offset of the deflated data and how many 512 byte sectors after the first it runs into.
+	uint8_t QCow2Image::read_compressed_cluster(uint64_t l2_entry, const uint8_t*& cluster){
+		const uint64_t file_offset = l2_entry & compressed_offset_mask;
+		const uint64_t extra_sectors = (l2_entry & ~(copy_flag | compressed_flag)) >> compressed_sectors_shift;
+		const uint64_t compressed_size = (extra_sectors + 1) * 512 - (file_offset & 511);
+		//Checked first: an unused cache slot has offset 0 and no data.
+		if (0 == file_offset || compressed_size > 2 * cluster_size){
+			return 0x05;
+		}
+		TableCacheEntry* victim;
+		TableCacheEntry* found = cache_lookup(compressed_cache, file_offset, victim);
+		if (NULL != found){
+			stats.compressed_hits++;
+			cluster = found->data.data();
+			return 0;
+		}
+		//The last compressed cluster in the file may end before the sector count says it does.
+		compressed_buffer.resize((size_t)compressed_size);
+		if (0 != fseeko64(file, (off_t)file_offset, SEEK_SET)){
+			return 0x05;
+		}
+		const size_t got = fread(compressed_buffer.data(), 1, (size_t)compressed_size, file);
+		if (got < compressed_size){
+			clearerr(file);
+		}
+		victim->offset = 0;
+		victim->data.resize((size_t)cluster_size);
+		z_stream stream;
+		memset(&stream, 0, sizeof stream);
+		if (Z_OK != inflateInit2(&stream, -12)){
+			return 0x05;
+		}
+		stream.next_in = compressed_buffer.data();
+		stream.avail_in = (uInt)got;
+		stream.next_out = victim->data.data();
+		stream.avail_out = (uInt)cluster_size;
+		const int result = inflate(&stream, Z_FINISH);
+		const bool complete = (0 == stream.avail_out) && (Z_STREAM_END == result || Z_BUF_ERROR == result || Z_OK == result);
+		inflateEnd(&stream);
+		if (!complete){
+			LOG_MSG("QCow2: failed to inflate compressed cluster at %llu", (unsigned long long)file_offset);
+			return 0x05;
+		}
+		stats.compressed_reads++;
+		victim->offset = file_offset;
+		victim->lru = ++compressed_cache.tick;
+		cluster = victim->data.data();
+		return 0;
+	}
+
+
+//Find a cluster in a cache. If it isn't there, victim is the least recently used entry.
+	QCow2Image::TableCacheEntry* QCow2Image::cache_lookup(TableCache& cache, uint64_t table_offset, TableCacheEntry*& victim){
+		victim = &cache.entries[0];
+		for (auto &entry : cache.entries){
+			if (entry.offset == table_offset){
+				entry.lru = ++cache.tick;
+				return &entry;
+			}
+			if (entry.lru < victim->lru){
+				victim = &entry;
+			}
+		}
+		return NULL;
+	}
+
+
+//Find a table in a cache, reading it from the file if it isn't there. A new table is taken as all zeros.
+	QCow2Image::TableCacheEntry* QCow2Image::cache_get(TableCache& cache, uint64_t table_offset, bool is_new){
+		const bool l2 = (&cache == &l2_cache);
+		TableCacheEntry* victim;
+		TableCacheEntry* found = cache_lookup(cache, table_offset, victim);
+		if (NULL != found){
+			if (l2) stats.l2_hits++; else stats.refcount_hits++;
+			if (is_new){
+				std::fill(found->data.begin(), found->data.end(), 0);
+			}
+			return found;
+		}
+		if (l2) stats.l2_misses++; else stats.refcount_misses++;
+		if (0 != cache_write_back(*victim)){
+			return NULL;
+		}
+		victim->offset = 0;
+		victim->data.resize((size_t)cluster_size);
+		if (is_new){
+			std::fill(victim->data.begin(), victim->data.end(), 0);
+		} else if (0 != read_allocated_data(table_offset, victim->data.data(), cluster_size)){
+			return NULL;
+		}
+		victim->offset = table_offset;
+		victim->lru = ++cache.tick;
+		return victim;
+	}
+
+
+//Write the changed part of a cached table back to the file.
+	uint8_t QCow2Image::cache_write_back(TableCacheEntry& entry){
+		if (entry.offset == 0 || entry.dirty_hi <= entry.dirty_lo){
+			return 0;
+		}
+		if (0 != write_data(entry.offset + entry.dirty_lo, &entry.data[entry.dirty_lo], entry.dirty_hi - entry.dirty_lo)){
+			return 0x05;
+		}
+		stats.writebacks++;
+		entry.dirty_lo = entry.dirty_hi = 0;
+		return 0;
+	}
+
+
+	uint8_t QCow2Image::cache_flush(TableCache& cache){
+		if (!cache.dirty){
+			return 0;
+		}
+		uint8_t result = 0;
+		for (auto &entry : cache.entries){
+			if (0 != cache_write_back(entry)){
+				result = 0x05;
+			}
+		}
+		cache.dirty = (result != 0);
+		return result;
+	}
+
+
+//Change bytes of a cached table, to be written back later.
+	void QCow2Image::cache_set_entry(TableCache& cache, TableCacheEntry& entry, uint64_t byte_offset, const uint8_t* value, uint64_t size){
+		memcpy(&entry.data[byte_offset], value, size);
+		cache.dirty = true;
+		if (entry.dirty_hi <= entry.dirty_lo){
+			entry.dirty_lo = byte_offset;
+			entry.dirty_hi = byte_offset + size;
+		} else {
+			entry.dirty_lo = std::min(entry.dirty_lo, byte_offset);
+			entry.dirty_hi = std::max(entry.dirty_hi, byte_offset + size);
+		}
+	}
+
+
 //Read an entire cluster that may or may not be allocated in the image file.
 	uint8_t QCow2Image::read_cluster(uint64_t data_cluster_number, uint8_t* data)
 	{
@@ -294,46 +642,61 @@ using namespace std;
 		if (0 == l2_table_offset){
 			return read_unallocated_cluster(data_cluster_number, data);
 		}
-		uint64_t data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+		uint64_t l2_entry;
+		if (0 != read_l2_table(l2_table_offset, address, l2_entry)){
 			return 0x05;
 		}
-		if (0 == data_cluster_offset){
-			return read_unallocated_cluster(data_cluster_number, data);
+		switch (cluster_type(l2_entry)){
+			case CLUSTER_NORMAL:
+				return read_allocated_data(l2_entry & standard_offset_mask, data, cluster_size);
+			case CLUSTER_ZERO:
+				std::fill(data, data + cluster_size, 0);
+				return 0;
+			case CLUSTER_COMPRESSED: {
+				const uint8_t* cluster;
+				if (0 != read_compressed_cluster(l2_entry, cluster)){
+					return 0x05;
+				}
+				memcpy(data, cluster, cluster_size);
+				return 0;
+			}
+			default:
+				return read_unallocated_cluster(data_cluster_number, data);
 		}
-		return read_allocated_data(data_cluster_offset, data, cluster_size);
 	}
 
 
 //Read the L1 table to get the offset of the L2 table for a given address.
 	inline uint8_t QCow2Image::read_l1_table(uint64_t address, uint64_t& l2_table_offset){
-		const uint64_t l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return read_table(l1_entry_offset, table_entry_mask, l2_table_offset);
+		const uint64_t l1_index = address >> l1_bits;
+		if (!tables_loaded || l1_index >= l1_table.size()){
+			return 0x05;
+		}
+		l2_table_offset = l1_table[(size_t)l1_index] & table_entry_mask;
+		return 0;
 	}
 
 
-//Read an L2 table to get the offset of the data cluster for a given address.
-	inline uint8_t QCow2Image::read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& data_cluster_offset){
-		const uint64_t l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return read_table(l2_entry_offset, table_entry_mask, data_cluster_offset);
+//Read an L2 table to get the entry describing the data cluster for a given address.
+	inline uint8_t QCow2Image::read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& l2_entry){
+		TableCacheEntry* l2_table = cache_get(l2_cache, l2_table_offset, false);
+		if (NULL == l2_table){
+			return 0x05;
+		}
+		uint64_t buffer;
+		memcpy(&buffer, &l2_table->data[((address >> header.cluster_bits) & l2_mask) << 3], sizeof buffer);
+		l2_entry = host_read64(buffer);
+		return 0;
 	}
 
 
 //Read the refcount table to get the offset of the refcount cluster for a given address.
 	inline uint8_t QCow2Image::read_refcount_table(uint64_t data_cluster_offset, uint64_t& refcount_cluster_offset){
-		const uint64_t refcount_entry_offset = header.refcount_table_offset + (((data_cluster_offset/cluster_size) >> refcount_bits) << 3);
-		return read_table(refcount_entry_offset, empty_mask, refcount_cluster_offset);
-	}
-
-
-//Read a table entry at the given offset.
-	inline uint8_t QCow2Image::read_table(uint64_t entry_offset, uint64_t entry_mask, uint64_t& entry_value){
-        (void)entry_mask;//UNUSED
-		uint64_t buffer;
-		if (0 != read_allocated_data(entry_offset, (uint8_t*)&buffer, sizeof buffer)){
+		const uint64_t refcount_index = (data_cluster_offset/cluster_size) >> refcount_bits;
+		if (!tables_loaded || refcount_index >= refcount_table.size()){
 			return 0x05;
 		}
-		entry_value = host_read64(buffer) & table_entry_mask;
+		refcount_cluster_offset = refcount_table[(size_t)refcount_index] & table_entry_mask;
 		return 0;
 	}
 
@@ -373,6 +736,9 @@ using namespace std;
 			if (0 != write_data(refcount_cluster_offset, cluster_buffer, cluster_size)){
 			return 0x05;
 			}
+			if (NULL == cache_get(refcount_cache, refcount_cluster_offset, true)){
+				return 0x05;
+			}
 			if (0 != write_refcount(refcount_cluster_offset, refcount_cluster_offset, 0x1)){
 				return 0x05;
 			}
@@ -384,6 +750,17 @@ using namespace std;
 	}
 
 
+//Check whether a buffer holds nothing but zeros.
+	bool QCow2Image::is_zero(const uint8_t* data, uint64_t data_size){
+		for (uint64_t i = 0; i < data_size; i++){
+			if (0 != data[i]){
+				return false;
+			}
+		}
+		return true;
+	}
+
+
 //Write data of arbitrary length to the image file.
 	uint8_t QCow2Image::write_data(uint64_t file_offset, const uint8_t* data, uint64_t data_size){
 		if (0 != fseeko64(file, (off_t)file_offset, SEEK_SET)){
@@ -398,30 +775,49 @@ using namespace std;
 
 //Write an L2 table offset into the L1 table.
 	inline uint8_t QCow2Image::write_l1_table_entry(uint64_t address, uint64_t l2_table_offset){
-		const uint64_t l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return write_table_entry(l1_entry_offset, l2_table_offset | copy_flag);
+		const uint64_t l1_index = address >> l1_bits;
+		const uint64_t l1_entry_offset = header.l1_table_offset + (l1_index << 3);
+		if (l1_index >= l1_table.size() || 0 != write_table_entry(l1_entry_offset, l2_table_offset | copy_flag)){
+			return 0x05;
+		}
+		l1_table[(size_t)l1_index] = l2_table_offset | copy_flag;
+		return 0;
 	}
 
 
 //Write a data cluster offset into an L2 table.
 	inline uint8_t QCow2Image::write_l2_table_entry(uint64_t l2_table_offset, uint64_t address, uint64_t data_cluster_offset){
-		const uint64_t l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return write_table_entry(l2_entry_offset, data_cluster_offset | copy_flag);
+		TableCacheEntry* l2_table = cache_get(l2_cache, l2_table_offset, false);
+		if (NULL == l2_table){
+			return 0x05;
+		}
+		uint64_t buffer = host_read64(data_cluster_offset | copy_flag);
+		cache_set_entry(l2_cache, *l2_table, ((address >> header.cluster_bits) & l2_mask) << 3, (const uint8_t*)&buffer, sizeof buffer);
+		return 0;
 	}
 
 
 //Write a refcount.
 	inline uint8_t QCow2Image::write_refcount(uint64_t cluster_offset, uint64_t refcount_cluster_offset, uint16_t refcount){
-		const uint64_t refcount_offset = refcount_cluster_offset + (((cluster_offset/cluster_size) & refcount_mask) << 1);
+		TableCacheEntry* refcount_block = cache_get(refcount_cache, refcount_cluster_offset, false);
+		if (NULL == refcount_block){
+			return 0x05;
+		}
 		uint16_t buffer = host_read16(refcount);
-		return write_data(refcount_offset, (uint8_t*)&buffer, sizeof buffer);
+		cache_set_entry(refcount_cache, *refcount_block, ((cluster_offset/cluster_size) & refcount_mask) << 1, (const uint8_t*)&buffer, sizeof buffer);
+		return 0;
 	}
 
 
 //Write a refcount table entry.
 	inline uint8_t QCow2Image::write_refcount_table_entry(uint64_t cluster_offset, uint64_t refcount_cluster_offset){
-		const uint64_t refcount_entry_offset = header.refcount_table_offset + (((cluster_offset/cluster_size) >> refcount_bits) << 3);
-		return write_table_entry(refcount_entry_offset, refcount_cluster_offset);
+		const uint64_t refcount_index = (cluster_offset/cluster_size) >> refcount_bits;
+		const uint64_t refcount_entry_offset = header.refcount_table_offset + (refcount_index << 3);
+		if (refcount_index >= refcount_table.size() || 0 != write_table_entry(refcount_entry_offset, refcount_cluster_offset)){
+			return 0x05;
+		}
+		refcount_table[(size_t)refcount_index] = refcount_cluster_offset;
+		return 0;
 	}
 
 
@@ -452,3 +848,15 @@ using namespace std;
 	uint8_t QCow2Disk::Write_AbsoluteSector(uint32_t sectnum,const void* data){
 		return qcowImage.write_sector(sectnum, (const uint8_t*)data);
 	}
+
+
+//Public function to read consecutive sectors.
+	uint8_t QCow2Disk::Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void* data){
+		return qcowImage.read_sectors(sectnum, count, (uint8_t*)data);
+	}
+
+
+//Public function to write consecutive sectors.
+	uint8_t QCow2Disk::Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void* data){
+		return qcowImage.write_sectors(sectnum, count, (const uint8_t*)data);
+	}
@@ -30,6 +30,30 @@
 
 #include "zmbv.h"
 
+#if defined(_M_AMD64) || defined(__amd64__) || defined(__e2k__)
+/* SSE2 is always available on x86_64 and Elbrus */
+# define ZMBV_SSE2 1
+# define ZMBV_TARGET_SSE2
+# define zmbv_sse2_available (true)
+#elif defined(__SSE__) && !defined(EMSCRIPTEN)
+# define ZMBV_SSE2 1
+# define ZMBV_TARGET_SSE2 __attribute__((__target__("sse2")))
+extern bool sse2_available;
+# define zmbv_sse2_available (sse2_available)
+#endif
+
+#if defined(__GNUC__) && defined(__SSE__) && (defined(__amd64__) || defined(__i386__)) && !defined(EMSCRIPTEN)
+# define ZMBV_AVX2 1
+extern bool avx2_available;
+#endif
+
+#if defined(ZMBV_SSE2)
+# include <emmintrin.h>
+#endif
+#if defined(ZMBV_AVX2)
+# include <immintrin.h>
+#endif
+
 #define DBZV_VERSION_HIGH 0
 #define DBZV_VERSION_LOW 1
 
@@ -152,6 +176,195 @@ void VideoCodec::CreateVectorTable(void) {
 	}
 }
 
+/*==================== block kernels ====================*/
+
+/* The compare kernels count in bytes of differing pixels, so that the SIMD versions can add
+ * up the byte mask of a compare. Every pixel that differs has all its bytes in the count. */
+
+template<class P>
+static inline bool ZMBV_Differs(P a,P b) {
+	return ((a ^ b) & (P)0x00ffffffu) != 0;
+}
+
+static inline int ZMBV_Bits16(unsigned int m) {
+	m = m - ((m >> 1) & 0x5555u);
+	m = (m & 0x3333u) + ((m >> 2) & 0x3333u);
+	m = (m + (m >> 4)) & 0x0f0fu;
+	return (int)((m + (m >> 8)) & 0x1fu);
+}
+
+template<class P>
+static inline int ZMBV_CompareRow_C(const unsigned char *pold,const unsigned char *pnew,int x,int bytes) {
+	int ret=0;
+	for (;x<bytes;x+=(int)sizeof(P)) {
+		if (ZMBV_Differs<P>(*(const P*)(pold+x),*(const P*)(pnew+x)))
+			ret+=(int)sizeof(P);
+	}
+	return ret;
+}
+
+template<class P>
+static int ZMBV_Compare_C(const unsigned char *pold,const unsigned char *pnew,int pitch,int dx,int dy,int limit) {
+	const int bytes=dx*(int)sizeof(P);
+	limit*=(int)sizeof(P);
+	int ret=0;
+	for (int y=0;y<dy && ret<limit;y++) {
+		ret+=ZMBV_CompareRow_C<P>(pold,pnew,0,bytes);
+		pold+=pitch;
+		pnew+=pitch;
+	}
+	return ret/(int)sizeof(P);
+}
+
+static void ZMBV_XorBlock_C(unsigned char *dst,int dpitch,const unsigned char *a,int apitch,const unsigned char *b,int bpitch,int bytes,int rows) {
+	for (int y=0;y<rows;y++) {
+		for (int x=0;x<bytes;x++)
+			dst[x]=a[x]^b[x];
+		dst+=dpitch;
+		a+=apitch;
+		b+=bpitch;
+	}
+}
+
+static const ZMBVKernels zmbv_kernels_c = {
+	"C",
+	ZMBV_Compare_C<uint8_t>,
+	ZMBV_Compare_C<uint16_t>,
+	ZMBV_Compare_C<uint32_t>,
+	ZMBV_XorBlock_C
+};
+
+#if defined(ZMBV_SSE2)
+/* byte mask of the pixels that are the same, ignoring the top byte of 32 bit pixels */
+ZMBV_TARGET_SSE2 static inline __m128i ZMBV_Same_SSE2(__m128i a,__m128i b,uint8_t) {
+	return _mm_cmpeq_epi8(a,b);
+}
+
+ZMBV_TARGET_SSE2 static inline __m128i ZMBV_Same_SSE2(__m128i a,__m128i b,uint16_t) {
+	return _mm_cmpeq_epi16(a,b);
+}
+
+ZMBV_TARGET_SSE2 static inline __m128i ZMBV_Same_SSE2(__m128i a,__m128i b,uint32_t) {
+	const __m128i top=_mm_set1_epi32((int)0xff000000u);
+	return _mm_cmpeq_epi32(_mm_or_si128(a,top),_mm_or_si128(b,top));
+}
+
+template<class P>
+ZMBV_TARGET_SSE2 static int ZMBV_Compare_SSE2(const unsigned char *pold,const unsigned char *pnew,int pitch,int dx,int dy,int limit) {
+	const int bytes=dx*(int)sizeof(P);
+	limit*=(int)sizeof(P);
+	int ret=0;
+	for (int y=0;y<dy && ret<limit;y++) {
+		int x=0;
+		for (;(x+16)<=bytes;x+=16) {
+			const __m128i same=ZMBV_Same_SSE2(_mm_loadu_si128((const __m128i*)(pold+x)),_mm_loadu_si128((const __m128i*)(pnew+x)),(P)0);
+			ret+=16-ZMBV_Bits16((unsigned int)_mm_movemask_epi8(same));
+		}
+		ret+=ZMBV_CompareRow_C<P>(pold,pnew,x,bytes);
+		pold+=pitch;
+		pnew+=pitch;
+	}
+	return ret/(int)sizeof(P);
+}
+
+ZMBV_TARGET_SSE2 static void ZMBV_XorBlock_SSE2(unsigned char *dst,int dpitch,const unsigned char *a,int apitch,const unsigned char *b,int bpitch,int bytes,int rows) {
+	for (int y=0;y<rows;y++) {
+		int x=0;
+		for (;(x+16)<=bytes;x+=16)
+			_mm_storeu_si128((__m128i*)(dst+x),_mm_xor_si128(_mm_loadu_si128((const __m128i*)(a+x)),_mm_loadu_si128((const __m128i*)(b+x))));
+		for (;x<bytes;x++)
+			dst[x]=a[x]^b[x];
+		dst+=dpitch;
+		a+=apitch;
+		b+=bpitch;
+	}
+}
+
+static const ZMBVKernels zmbv_kernels_sse2 = {
+	"SSE2",
+	ZMBV_Compare_SSE2<uint8_t>,
+	ZMBV_Compare_SSE2<uint16_t>,
+	ZMBV_Compare_SSE2<uint32_t>,
+	ZMBV_XorBlock_SSE2
+};
+#endif
+
+#if defined(ZMBV_AVX2)
+__attribute__((__target__("avx2"))) static inline __m256i ZMBV_Same_AVX2(__m256i a,__m256i b,uint8_t) {
+	return _mm256_cmpeq_epi8(a,b);
+}
+
+__attribute__((__target__("avx2"))) static inline __m256i ZMBV_Same_AVX2(__m256i a,__m256i b,uint16_t) {
+	return _mm256_cmpeq_epi16(a,b);
+}
+
+__attribute__((__target__("avx2"))) static inline __m256i ZMBV_Same_AVX2(__m256i a,__m256i b,uint32_t) {
+	const __m256i top=_mm256_set1_epi32((int)0xff000000u);
+	return _mm256_cmpeq_epi32(_mm256_or_si256(a,top),_mm256_or_si256(b,top));
+}
+
+/* 16 pixel rows of 8 bit pixels are too short for AVX2, they are left to SSE2 */
+template<class P>
+__attribute__((__target__("avx2"))) static int ZMBV_Compare_AVX2(const unsigned char *pold,const unsigned char *pnew,int pitch,int dx,int dy,int limit) {
+	const int bytes=dx*(int)sizeof(P);
+	limit*=(int)sizeof(P);
+	int ret=0;
+	for (int y=0;y<dy && ret<limit;y++) {
+		int x=0;
+		for (;(x+32)<=bytes;x+=32) {
+			const unsigned int same=(unsigned int)_mm256_movemask_epi8(ZMBV_Same_AVX2(_mm256_loadu_si256((const __m256i*)(pold+x)),_mm256_loadu_si256((const __m256i*)(pnew+x)),(P)0));
+			ret+=32-ZMBV_Bits16(same & 0xffffu)-ZMBV_Bits16(same >> 16u);
+		}
+		for (;(x+16)<=bytes;x+=16) {
+			const __m128i same=ZMBV_Same_SSE2(_mm_loadu_si128((const __m128i*)(pold+x)),_mm_loadu_si128((const __m128i*)(pnew+x)),(P)0);
+			ret+=16-ZMBV_Bits16((unsigned int)_mm_movemask_epi8(same));
+		}
+		ret+=ZMBV_CompareRow_C<P>(pold,pnew,x,bytes);
+		pold+=pitch;
+		pnew+=pitch;
+	}
+	return ret/(int)sizeof(P);
+}
+
+__attribute__((__target__("avx2"))) static void ZMBV_XorBlock_AVX2(unsigned char *dst,int dpitch,const unsigned char *a,int apitch,const unsigned char *b,int bpitch,int bytes,int rows) {
+	for (int y=0;y<rows;y++) {
+		int x=0;
+		for (;(x+32)<=bytes;x+=32)
+			_mm256_storeu_si256((__m256i*)(dst+x),_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a+x)),_mm256_loadu_si256((const __m256i*)(b+x))));
+		for (;(x+16)<=bytes;x+=16)
+			_mm_storeu_si128((__m128i*)(dst+x),_mm_xor_si128(_mm_loadu_si128((const __m128i*)(a+x)),_mm_loadu_si128((const __m128i*)(b+x))));
+		for (;x<bytes;x++)
+			dst[x]=a[x]^b[x];
+		dst+=dpitch;
+		a+=apitch;
+		b+=bpitch;
+	}
+}
+
+static const ZMBVKernels zmbv_kernels_avx2 = {
+	"AVX2",
+	ZMBV_Compare_SSE2<uint8_t>,
+	ZMBV_Compare_AVX2<uint16_t>,
+	ZMBV_Compare_AVX2<uint32_t>,
+	ZMBV_XorBlock_AVX2
+};
+#endif
+
+const ZMBVKernels *ZMBV_GetKernels(unsigned int index) {
+	const ZMBVKernels *list[3];
+	unsigned int count = 0;
+
+	list[count++] = &zmbv_kernels_c;
+#if defined(ZMBV_SSE2)
+	if (zmbv_sse2_available) list[count++] = &zmbv_kernels_sse2;
+#endif
+#if defined(ZMBV_AVX2)
+	if (avx2_available) list[count++] = &zmbv_kernels_avx2;
+#endif
+
+	return index < count ? list[index] : NULL;
+}
+
 template<class P>
 INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 	int ret=0;
@@ -162,6 +375,8 @@ INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 			int test=0-(int)((pold[x]-pnew[x])&0x00ffffffu);
 			ret-=(test>>31);
 		}
+		/* the motion search only wants to know if less than 4 differ */
+		if (ret>=4) break;
 		pold+=pitch*4;
 		pnew+=pitch*4;
 	}
@@ -169,33 +384,23 @@ INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 }
 
 template<class P>
-INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block) {
-	int ret=0;
-	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
-	P * pnew=((P*)newframe)+block->start;;	
-	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			int test=0-(int)((pold[x]-pnew[x])&0x00ffffffu);
-			ret-=(test>>31);
-		}
-		pold+=pitch;
-		pnew+=pitch;
+INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block,int limit) {
+	const unsigned char * pold=(const unsigned char *)(((P*)oldframe)+block->start+(vy*pitch)+vx);
+	const unsigned char * pnew=(const unsigned char *)(((P*)newframe)+block->start);
+	switch (sizeof(P)) {
+	case 1: return kernels->compare8(pold,pnew,pitch,block->dx,block->dy,limit);
+	case 2: return kernels->compare16(pold,pnew,pitch*2,block->dx,block->dy,limit);
+	default: return kernels->compare32(pold,pnew,pitch*4,block->dx,block->dy,limit);
 	}
-	return ret;
 }
 
 template<class P>
 INLINE void VideoCodec::AddXorBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
-	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			*((P*)&work[workUsed])=pnew[x] ^ pold[x];
-			workUsed+=(int)sizeof(P);
-		}
-		pold+=pitch;
-		pnew+=pitch;
-	}
+	const int bytes=block->dx*(int)sizeof(P);
+	kernels->xor_block(&work[workUsed],bytes,(unsigned char *)pnew,pitch*(int)sizeof(P),(unsigned char *)pold,pitch*(int)sizeof(P),bytes,block->dy);
+	workUsed+=bytes*block->dy;
 }
 
 template<class P>
@@ -211,7 +416,7 @@ void VideoCodec::AddXorFrame(void) {
 		FrameBlock * block=&blocks[b];
 		int bestvx = 0;
 		int bestvy = 0;
-		int bestchange=CompareBlock<P>(0,0, block);
+		int bestchange=CompareBlock<P>(0,0, block, block->dx*block->dy);
 		int possibles=64;
 		for (int v=0;v<VectorCount && possibles;v++) {
 			if (bestchange<4) break;
@@ -220,7 +425,8 @@ void VideoCodec::AddXorFrame(void) {
 			if (PossibleBlock<P>(vx, vy, block) < 4) {
 				possibles--;
 //				if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
-				int testchange=CompareBlock<P>(vx,vy, block);
+				/* a count that gets to bestchange can stop, it would not be taken anyway */
+				int testchange=CompareBlock<P>(vx,vy, block, bestchange);
 				if (testchange<bestchange) {
 					bestchange=testchange;
 					bestvx = vx;
@@ -376,14 +582,9 @@ template<class P>
 INLINE void VideoCodec::UnXorBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
-	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			pnew[x]=pold[x]^*((P*)&work[workPos]);
-			workPos+=(int)sizeof(P);
-		}
-		pold+=pitch;
-		pnew+=pitch;
-	}
+	const int bytes=block->dx*(int)sizeof(P);
+	kernels->xor_block((unsigned char *)pnew,pitch*(int)sizeof(P),(unsigned char *)pold,pitch*(int)sizeof(P),&work[workPos],bytes,bytes,block->dy);
+	workPos+=bytes*block->dy;
 }
 
 template<class P>
@@ -391,9 +592,7 @@ INLINE void VideoCodec::CopyBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
 	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			pnew[x]=pold[x];
-		}
+		memcpy(pnew,pold,(size_t)block->dx*sizeof(P));
 		pold+=pitch;
 		pnew+=pitch;
 	}
@@ -553,6 +752,9 @@ void VideoCodec::FreeBuffers(void) {
 
 VideoCodec::VideoCodec() {
 	CreateVectorTable();
+	/* the list is in order of preference, take the last */
+	for (unsigned int i=0;ZMBV_GetKernels(i) != NULL;i++)
+		kernels = ZMBV_GetKernels(i);
 	blocks = 0;
 	buf1 = 0;
 	buf2 = 0;
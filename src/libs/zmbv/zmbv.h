@@ -40,6 +40,25 @@ typedef enum {
 	ZMBV_FORMAT_32BPP	= 0x08
 } zmbv_format_t;
 
+/* The block loops of the motion search and of the XOR frame data: plain C, SSE2 and AVX2
+ * versions that give exactly the same result. Pitches are in bytes. */
+struct ZMBVKernels {
+	const char *name;
+
+	/* number of pixels of a dx by dy block that differ, ignoring the top byte of 32 bit
+	 * pixels. May stop counting and return early once the count reaches limit */
+	int (*compare8)(const unsigned char *pold, const unsigned char *pnew, int pitch, int dx, int dy, int limit);
+	int (*compare16)(const unsigned char *pold, const unsigned char *pnew, int pitch, int dx, int dy, int limit);
+	int (*compare32)(const unsigned char *pold, const unsigned char *pnew, int pitch, int dx, int dy, int limit);
+
+	/* dst = a ^ b for rows of bytes */
+	void (*xor_block)(unsigned char *dst, int dpitch, const unsigned char *a, int apitch,
+		const unsigned char *b, int bpitch, int bytes, int rows);
+};
+
+/* all versions built in and usable on this CPU, plain C first. NULL past the end */
+const ZMBVKernels *ZMBV_GetKernels(unsigned int index);
+
 void Msg(const char fmt[], ...);
 class VideoCodec {
 private:
@@ -86,6 +105,8 @@ private:
 
 	z_stream zstream;
 
+	const ZMBVKernels *kernels;
+
 	// methods
 	void FreeBuffers(void);
 	void CreateVectorTable(void);
@@ -98,7 +119,7 @@ private:
 	template<class P>
 		INLINE int PossibleBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
-		INLINE int CompareBlock(int vx,int vy,FrameBlock * block);
+		INLINE int CompareBlock(int vx,int vy,FrameBlock * block,int limit);
 	template<class P>
 		INLINE void AddXorBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
@@ -117,4 +138,7 @@ public:
 	int FinishCompressFrame( void );
 	bool DecompressFrame(void * framedata, int size);
 	void Output_UpsideDown_24(void * output);
+
+	/* the block kernels to use, the best the CPU supports unless set otherwise */
+	void SetKernels(const ZMBVKernels *k) { kernels = k; }
 };
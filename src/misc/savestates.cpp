@@ -5,6 +5,9 @@
 #include <string>
 #include <cstring>
 #include <fstream>
+#include <vector>
+#include <deque>
+#include <algorithm>
 #include "SDL.h"
 #include "menu.h"
 #include "shell.h"
@@ -25,6 +28,15 @@
 # include <utime.h>
 #endif
 
+/* compression and write-out of saved states can run on a background thread */
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define SAVESTATE_THREADS 1
+# include <thread>
+# include <atomic>
+#else
+# define SAVESTATE_THREADS 0
+#endif
+
 #define MAXU32 0xffffffff
 #include "zip.h"
 #include "unzip.h"
@@ -166,10 +178,6 @@ void SaveGameState(bool pressed) {
     {
         LOG_MSG("Saving state to slot: %d", (int)currentSlot + 1);
         SaveState::instance().save(currentSlot);
-        if (page!=GetGameState()/SaveState::SLOT_COUNT)
-            SetGameState((int)currentSlot);
-        else
-            refresh_slots();
     }
     catch (const SaveState::Error& err)
     {
@@ -286,6 +294,26 @@ std::string GetPlatform(bool save) {
 	return std::string(platform);
 }
 
+void RewindState(bool pressed) {
+    if (!pressed) return;
+
+    try
+    {
+        if (!SaveState::instance().rewind()) {
+            LOG_MSG("No rewind snapshot to go back to");
+            return;
+        }
+        LOG_MSG("[%s]: Rewound.", getTime().c_str());
+#if defined(USE_TTF)
+        if (ttf.inUse) resetFontSize();
+#endif
+    }
+    catch (const SaveState::Error& err)
+    {
+        notifyError(err);
+    }
+}
+
 size_t GetGameState_Run(void) { return GetGameState(); }
 void SetGameState_Run(int value) { SetGameState(value); }
 void SaveGameState_Run(void) { SaveGameState(true); }
@@ -312,6 +340,8 @@ void AddSaveStateMapper() {
         item->set_text("Select previous slot");
 	MAPPER_AddHandler(NextSaveSlot, MK_period, MMODHOST,"nextslot","Next save slot", &item);
         item->set_text("Select next slot");
+	MAPPER_AddHandler(RewindState, MK_z, MMODHOST,"rewindstate","Rewind state", &item);
+        item->set_text("Rewind");
 }
 
 #ifndef WIN32
@@ -355,6 +385,21 @@ void SaveState::registerComponent(const std::string& uniqueName, Component& comp
 }
 
 namespace Util {
+//same output format as compress(), written into a buffer supplied by the caller so that
+//repeated snapshots can reuse its allocation
+void compress(const char *input, size_t length, std::string& output) { //throw (SaveState::Error)
+	const uLong bufferSize = ::compressBound((uLong)length);
+	output.resize(bufferSize);
+
+	uLongf actualSize = bufferSize;
+	if (::compress2(reinterpret_cast<Bytef*>(&output[0]), &actualSize,
+					reinterpret_cast<const Bytef*>(input), (uLong)length, Z_BEST_SPEED) != Z_OK)
+		throw SaveState::Error("Compression failed!");
+
+	output.resize(actualSize);
+	output.append(reinterpret_cast<const char*>(&length), sizeof(length)); //save size of uncompressed data
+}
+
 std::string compress(const std::string& input) { //throw (SaveState::Error)
 	if (input.empty())
 		return input;
@@ -379,6 +424,90 @@ std::string compress(const std::string& input) { //throw (SaveState::Error)
 	return std::string(&output[0], output.size()); //strip reserved space
 }
 
+//same output format as compress(), but large inputs are split into chunks that are deflated
+//independently on several threads and joined into one zlib stream (the way pigz does it), so
+//decompress() and older DOSBox-X versions can read the result unchanged
+std::string compress(const std::string& input, unsigned int threads) { //throw (SaveState::Error)
+	const size_t chunkSize = 1024 * 1024;
+	if (threads < 2 || input.size() < chunkSize * 2)
+		return compress(input);
+
+	const size_t chunks = (input.size() + chunkSize - 1) / chunkSize;
+	std::vector<std::string> deflated(chunks);
+	std::vector<uLong> checksums(chunks);
+	bool failed = false;
+
+	auto deflateChunk = [&](size_t c) -> bool {
+		const size_t offset = c * chunkSize, length = std::min(chunkSize, input.size() - offset);
+		const bool last = (c + 1) == chunks;
+		const Bytef *src = reinterpret_cast<const Bytef*>(input.data()) + offset;
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		if (::deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return false;
+
+		std::string& out = deflated[c];
+		out.resize(::deflateBound(&zs, (uLong)length) + 16); //room for the sync flush marker
+		zs.next_in   = const_cast<Bytef*>(src);
+		zs.avail_in  = (uInt)length;
+		zs.next_out  = reinterpret_cast<Bytef*>(&out[0]);
+		zs.avail_out = (uInt)out.size();
+
+		//every chunk but the last ends on a byte-aligned empty stored block without the final bit
+		const int ret = ::deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+		const bool ok = (last ? ret == Z_STREAM_END : ret == Z_OK) && zs.avail_in == 0;
+		out.resize(zs.total_out);
+		::deflateEnd(&zs);
+
+		checksums[c] = ::adler32(::adler32(0L, Z_NULL, 0), src, (uInt)length);
+		return ok;
+	};
+
+#if SAVESTATE_THREADS
+	std::atomic<size_t> nextChunk(0);
+	std::atomic<bool> workerFailed(false);
+	auto worker = [&]() {
+		for (size_t c; (c = nextChunk++) < chunks;)
+			if (!deflateChunk(c)) workerFailed = true;
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned int t = 1; t < threads && t < chunks; t++)
+		pool.push_back(std::thread(worker));
+	worker();
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+	failed = workerFailed;
+#else
+	for (size_t c = 0; c < chunks; c++)
+		if (!deflateChunk(c)) failed = true;
+#endif
+	if (failed)
+		throw SaveState::Error("Compression failed!");
+
+	std::string output;
+	size_t total = 2 + 4 + sizeof(size_t);
+	for (size_t c = 0; c < chunks; c++) total += deflated[c].size();
+	output.reserve(total);
+
+	output += (char)0x78; //zlib header: deflate, 32K window, fastest level
+	output += (char)0x01;
+	uLong checksum = checksums[0];
+	for (size_t c = 0; c < chunks; c++) {
+		output += deflated[c];
+		std::string().swap(deflated[c]);
+		if (c > 0) checksum = ::adler32_combine(checksum, checksums[c], (z_off_t)std::min(chunkSize, input.size() - c * chunkSize));
+	}
+	for (int shift = 24; shift >= 0; shift -= 8)
+		output += (char)((checksum >> shift) & 0xFF);
+
+	const size_t uncompressedSize = input.size(); //save size of uncompressed data
+	output.append(reinterpret_cast<const char*>(&uncompressedSize), sizeof(uncompressedSize));
+
+	return output;
+}
+
 std::string decompress(const std::string& input) { //throw (SaveState::Error)
 	if (input.empty())
 		return input;
@@ -1110,10 +1239,376 @@ int my_minizip(char ** savefile, char ** savefile2, char* savename=NULL) {
 int flagged_backup(char *zip);
 int flagged_restore(char* zip);
 
+namespace
+{
+struct SavePart
+{
+    SavePart(const std::string& n, const std::string& d, bool c) : name(n), data(d), compress(c) {}
+    std::string name;
+    std::string data;
+    bool compress; //component data, subject to "compresssaveparts"
+};
+
+struct SaveJob
+{
+    std::string file;
+    size_t slot = 0;
+    bool compress = true;
+    bool keyframe = false; //full save the following delta saves refer to
+    bool delta = false;    //store only the pages changed since the keyframe
+    bool failed = false;
+    std::string error;
+    std::vector<SavePart> parts;
+};
+
+//delta saved states: components are split into pages, and a delta save only stores the pages
+//whose fingerprint differs from the last keyframe, which the "Delta_Base" part points to
+const size_t DELTA_PAGE = 4096;
+const size_t DELTA_MIN_PAGES = 16; //smaller components are always stored in full
+
+struct DeltaBase
+{
+    std::string file; //keyframe save file
+    std::string id;   //its "Delta_Id", to notice when it has been overwritten
+    int saves = 0;    //delta saves written since the keyframe
+    std::map<std::string, std::vector<uint64_t> > pages; //page fingerprints of the keyframe components
+} deltaBase; //only touched by whoever runs the pending save job
+
+uint64_t pageFingerprint(const char *data, size_t length) {
+    const Bytef *p = reinterpret_cast<const Bytef*>(data);
+    return ((uint64_t)::crc32(0L, p, (uInt)length) << 32) | (uint64_t)::adler32(1L, p, (uInt)length);
+}
+
+void fingerprintPages(const std::string& data, std::vector<uint64_t>& pages) {
+    pages.resize((data.size() + DELTA_PAGE - 1) / DELTA_PAGE);
+    for (size_t pg = 0; pg < pages.size(); pg++)
+        pages[pg] = pageFingerprint(data.data() + pg * DELTA_PAGE, std::min(DELTA_PAGE, data.size() - pg * DELTA_PAGE));
+}
+
+//delta format: uint64_t size, uint32_t page count, then (uint32_t page number, page data) per changed page
+bool encodeDelta(const std::string& data, const std::vector<uint64_t>& base, std::string& out) {
+    if (base.size() != (data.size() + DELTA_PAGE - 1) / DELTA_PAGE) return false;
+
+    std::vector<uint32_t> changed;
+    for (size_t pg = 0; pg < base.size(); pg++)
+        if (pageFingerprint(data.data() + pg * DELTA_PAGE, std::min(DELTA_PAGE, data.size() - pg * DELTA_PAGE)) != base[pg])
+            changed.push_back((uint32_t)pg);
+    if (changed.size() * 2 > base.size()) return false; //not worth it, store in full
+
+    const uint64_t size = data.size();
+    const uint32_t count = (uint32_t)changed.size();
+    out.clear();
+    out.reserve(sizeof(size) + sizeof(count) + changed.size() * (sizeof(uint32_t) + DELTA_PAGE));
+    out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (size_t c = 0; c < changed.size(); c++) {
+        const size_t offset = changed[c] * DELTA_PAGE;
+        out.append(reinterpret_cast<const char*>(&changed[c]), sizeof(uint32_t));
+        out.append(data, offset, std::min(DELTA_PAGE, data.size() - offset));
+    }
+    return true;
+}
+
+//rebuild a component from the keyframe copy and a delta, in place
+bool applyDelta(std::string& base, const std::string& delta) {
+    uint64_t size;
+    uint32_t count;
+    if (delta.size() < sizeof(size) + sizeof(count)) return false;
+    memcpy(&size, delta.data(), sizeof(size));
+    memcpy(&count, delta.data() + sizeof(size), sizeof(count));
+    if (size != base.size()) return false;
+
+    size_t pos = sizeof(size) + sizeof(count);
+    for (uint32_t c = 0; c < count; c++) {
+        uint32_t pg;
+        if (pos + sizeof(pg) > delta.size()) return false;
+        memcpy(&pg, delta.data() + pos, sizeof(pg));
+        pos += sizeof(pg);
+        const size_t offset = (size_t)pg * DELTA_PAGE;
+        if (offset >= base.size()) return false;
+        const size_t length = std::min(DELTA_PAGE, base.size() - offset);
+        if (pos + length > delta.size()) return false;
+        base.replace(offset, length, delta, pos, length);
+        pos += length;
+    }
+    return pos == delta.size();
+}
+
+//fingerprint a keyframe, or replace its components with deltas against the keyframe
+void encodeSaveJob(SaveJob& job) {
+    if (job.keyframe) {
+        for (size_t p = 0; p < job.parts.size(); p++) {
+            const SavePart& part = job.parts[p];
+            if (part.compress && part.data.size() >= DELTA_MIN_PAGES * DELTA_PAGE)
+                fingerprintPages(part.data, deltaBase.pages[part.name]);
+        }
+    }
+    else if (job.delta) {
+        std::string info = deltaBase.file + "\n" + deltaBase.id + "\n", encoded;
+        for (size_t p = 0; p < job.parts.size(); p++) {
+            SavePart& part = job.parts[p];
+            std::map<std::string, std::vector<uint64_t> >::const_iterator base = deltaBase.pages.find(part.name);
+            if (!part.compress || base == deltaBase.pages.end() || !encodeDelta(part.data, base->second, encoded)) continue;
+            part.data.swap(encoded);
+            info += part.name + "\n";
+        }
+        job.parts.push_back(SavePart("Delta_Base", info, false));
+    }
+}
+
+//read one part of a saved state into memory
+bool readSavePart(const std::string& zip, const char *name, std::string& out) {
+#ifdef USEWIN32IOAPI
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64A(&ffunc);
+    unzFile uf = unzOpen2_64(zip.c_str(),&ffunc);
+#else
+    unzFile uf = unzOpen64(zip.c_str());
+#endif
+    if (uf == NULL) return false;
+    bool ok = unzLocateFile(uf, name, CASESENSITIVITY) == UNZ_OK && unzOpenCurrentFile(uf) == UNZ_OK;
+    if (ok) {
+        char buf[16384];
+        int n;
+        out.clear();
+        while ((n = unzReadCurrentFile(uf, buf, sizeof(buf))) > 0) out.append(buf, (size_t)n);
+        if (n < 0) ok = false;
+        if (unzCloseCurrentFile(uf) != UNZ_OK) ok = false;
+    }
+    unzClose(uf);
+    return ok;
+}
+
+SaveJob *pendingSave = NULL; //owned by the emulation thread, handed back by finishSave()
+#if SAVESTATE_THREADS
+std::thread saveThread;
+std::atomic<bool> saveThreadDone(false);
+
+struct SaveThreadJoin
+{
+    ~SaveThreadJoin() { if (saveThread.joinable()) saveThread.join(); }
+} saveThreadJoin; //do not let exit() tear down a half written slot
+#endif
+
+//write all parts into a fresh zip archive in one pass, straight from memory
+bool writeSaveZip(const SaveJob& job) {
+    zipFile zf;
+#        ifdef USEWIN32IOAPI
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64A(&ffunc);
+    zf = zipOpen2_64(job.file.c_str(), APPEND_STATUS_CREATE, NULL, &ffunc);
+#        else
+    zf = zipOpen64(job.file.c_str(), APPEND_STATUS_CREATE);
+#        endif
+    if (zf == NULL) return false;
+
+    const time_t current = time(NULL);
+    const tm *timeinfo = localtime(&current);
+    zip_fileinfo zi;
+    memset(&zi, 0, sizeof(zi));
+    zi.tmz_date.tm_sec  = (uInt)timeinfo->tm_sec;
+    zi.tmz_date.tm_min  = (uInt)timeinfo->tm_min;
+    zi.tmz_date.tm_hour = (uInt)timeinfo->tm_hour;
+    zi.tmz_date.tm_mday = (uInt)timeinfo->tm_mday;
+    zi.tmz_date.tm_mon  = (uInt)timeinfo->tm_mon;
+    zi.tmz_date.tm_year = (uInt)timeinfo->tm_year;
+
+    int err = ZIP_OK;
+    for (size_t p = 0; p < job.parts.size() && err == ZIP_OK; p++) {
+        const SavePart& part = job.parts[p];
+        //parts that already went through Util::compress would only burn time in a second deflate pass
+        const bool store = job.compress && part.compress;
+        err = zipOpenNewFileInZip3_64(zf, part.name.c_str(), &zi,
+                                      NULL, 0, NULL, 0, NULL /* comment*/,
+                                      store ? 0 : Z_DEFLATED, store ? 0 : 9, 0,
+                                      -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                                      NULL, 0, part.data.size() >= 0xffffffff ? 1 : 0);
+        if (err != ZIP_OK) break;
+        for (size_t ofs = 0; ofs < part.data.size() && err == ZIP_OK;) {
+            const unsigned int len = (unsigned int)std::min(part.data.size() - ofs, (size_t)0x40000000);
+            err = zipWriteInFileInZip(zf, part.data.data() + ofs, len);
+            ofs += len;
+        }
+        if (err == ZIP_OK) err = zipCloseFileInZip(zf);
+    }
+    if (zipClose(zf, NULL) != ZIP_OK) err = ZIP_ERRNO;
+    return err == ZIP_OK;
+}
+
+//compress and write out a snapshot, safe to run off the emulation thread
+void runSaveJob(SaveJob& job) {
+    unsigned int threads = 1;
+#if SAVESTATE_THREADS
+    threads = std::max(1u, std::thread::hardware_concurrency());
+#endif
+    try {
+        encodeSaveJob(job);
+        if (job.compress) {
+            for (size_t p = 0; p < job.parts.size(); p++)
+                if (job.parts[p].compress) (Util::compress(job.parts[p].data, threads)).swap(job.parts[p].data);
+        }
+        if (!writeSaveZip(job)) {
+            job.failed = true;
+            job.error = "Save failed! - " + job.file;
+        }
+    }
+    catch (const SaveState::Error& err) {
+        job.failed = true;
+        job.error = "Save failed! " + err;
+    }
+    catch (const std::bad_alloc&) {
+        job.failed = true;
+        job.error = "Save failed! Out of Memory!";
+    }
+    if (job.failed) remove(job.file.c_str());
+}
+
+//report a finished job on the emulation thread, takes ownership
+void reportSaveJob(SaveJob *job) {
+    if (job->failed) {
+        LOG_MSG("%s", job->error.c_str());
+        notifyError("Failed to save the current state.");
+        if (job->keyframe) deltaBase = DeltaBase(); //next save has to be a keyframe again
+    } else
+        LOG_MSG("[%s]: Saved. (Slot %d)", getTime().c_str(), (int)job->slot+1);
+    const size_t slot = job->slot;
+    delete job;
+
+    if (slot == currentSlot && page!=GetGameState()/SaveState::SLOT_COUNT)
+        SetGameState((int)currentSlot);
+    else
+        refresh_slots();
+}
+}
+
+namespace
+{
+//std::ostream target appending to a string that keeps its capacity between snapshots
+class RewindStreamBuf : public std::streambuf
+{
+public:
+    RewindStreamBuf(std::string& s) : str(s) {}
+
+protected:
+    virtual std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        str.append(s, (size_t)n);
+        return n;
+    }
+
+    virtual int_type overflow(int_type c)
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) str += traits_type::to_char_type(c);
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::string& str;
+};
+
+struct RewindSnapshot
+{
+    std::string data;            //compressed component states, one after another
+    std::vector<size_t> lengths; //uncompressed size of each component
+};
+
+std::deque<RewindSnapshot> rewindRing; //oldest first
+RewindSnapshot rewindSpare;            //buffers of the last snapshot given back, reused by the next one
+std::string rewindRaw;                 //uncompressed scratch buffer
+size_t rewindBytes = 0, rewindBudget = 0;
+int rewindFrames = 0, rewindCount = 0;
+
+void rewindRecycle(RewindSnapshot& snap) {
+    rewindBytes -= snap.data.capacity();
+    std::swap(rewindSpare, snap);
+}
+}
+
+void SaveState::setRewind(int frames, int memorymb) {
+	rewindFrames = frames > 0 && memorymb > 0 ? frames : 0;
+	rewindBudget = (size_t)std::max(memorymb, 0) * 1024 * 1024;
+	rewindCount = 0;
+	rewindRing.clear();
+	rewindSpare = RewindSnapshot();
+	std::string().swap(rewindRaw);
+	rewindBytes = 0;
+}
+
+void SaveState::rewindCapture() {
+	if (rewindFrames == 0 || ++rewindCount < rewindFrames) return;
+	rewindCount = 0;
+
+	RewindSnapshot snap;
+	std::swap(snap, rewindSpare);
+	snap.lengths.clear();
+	rewindRaw.clear();
+	try {
+		RewindStreamBuf buf(rewindRaw);
+		std::ostream ss(&buf);
+		for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
+			const size_t before = rewindRaw.size();
+			i->second.comp.getBytes(ss);
+			snap.lengths.push_back(rewindRaw.size() - before);
+		}
+
+		//once the budget is used up the oldest snapshot makes room, and its buffers are reused
+		if (snap.data.capacity() == 0 && !rewindRing.empty() && rewindBytes + rewindRing.back().data.size() > rewindBudget) {
+			snap.data.swap(rewindRing.front().data);
+			rewindBytes -= snap.data.capacity();
+			rewindRing.pop_front();
+		}
+		Util::compress(rewindRaw.data(), rewindRaw.size(), snap.data);
+	}
+	catch (const SaveState::Error& err) {
+		LOG_MSG("Rewind snapshot failed! %s", err.c_str());
+		return;
+	}
+	catch (const std::bad_alloc&) {
+		LOG_MSG("Rewind snapshot failed! Out of Memory!");
+		return;
+	}
+
+	rewindBytes += snap.data.capacity();
+	while (!rewindRing.empty() && rewindBytes > rewindBudget) {
+		rewindBytes -= rewindRing.front().data.capacity();
+		rewindRing.pop_front();
+	}
+	if (rewindBytes > rewindBudget) { //a single snapshot does not even fit
+		rewindRecycle(snap);
+		return;
+	}
+	rewindRing.push_back(RewindSnapshot());
+	std::swap(rewindRing.back(), snap);
+}
+
+bool SaveState::rewind() { //throw (Error)
+	if (rewindRing.empty()) return false;
+
+	RewindSnapshot& snap = rewindRing.back();
+	(Util::decompress(snap.data)).swap(rewindRaw);
+	if (snap.lengths.size() != components.size())
+		throw Error("Rewind snapshot does not match the emulator components!");
+
+	size_t offset = 0, c = 0;
+	for (CompEntry::iterator i = components.begin(); i != components.end(); ++i, ++c) {
+		if (offset + snap.lengths[c] > rewindRaw.size())
+			throw Error("Rewind snapshot is corrupt!");
+		clearline=true;
+		std::stringstream mystream(rewindRaw.substr(offset, snap.lengths[c]));
+		i->second.comp.setBytes(mystream);
+		offset += snap.lengths[c];
+	}
+
+	rewindRecycle(snap);
+	rewindRing.pop_back();
+	rewindCount = 0;
+	return true;
+}
+
 void SaveState::save(size_t slot) { //throw (Error)
 	if (slot >= SLOT_COUNT*MAX_PAGE)  return;
+	finishSave();
 	SDL_PauseAudio(0);
-	bool save_err=false;
 	if((MEM_TotalPages()*4096/1024/1024)>1024) {
 		LOG_MSG("Stopped. 1 GB is the maximum memory size for saving/loading states.");
 		notifyError("Unsupported memory size for saving states.", false);
@@ -1150,12 +1645,6 @@ void SaveState::save(size_t slot) { //throw (Error)
         save_remark = new_remark;
     }
 #endif
-	bool create_version=false;
-	bool create_title=false;
-	bool create_memorysize=false;
-	bool create_machinetype=false;
-	bool create_timestamp=false;
-	bool create_saveremark=false;
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {
@@ -1174,136 +1663,97 @@ void SaveState::save(size_t slot) { //throw (Error)
 		path+=CROSS_FILESPLIT;
 	}
 
-	std::string temp, save2;
 	std::stringstream slotname;
 	slotname << slot+1;
-	temp=path;
-	std::string save=use_save_file&&savefilename.size()?savefilename:temp+slotname.str()+".sav";
-	remove(save.c_str());
-	std::ofstream file (save.c_str());
-	file << "";
-	file.close();
+	SaveJob *job = new SaveJob;
+	job->file = use_save_file&&savefilename.size()?savefilename:path+slotname.str()+".sav";
+	job->slot = slot;
+	job->compress = compresssaveparts;
+
+	//only the snapshot of the component states has to happen on the emulation thread,
+	//compression and the zip write-out can run while the guest keeps going
 	try {
 		for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
 			std::ostringstream ss;
 			i->second.comp.getBytes(ss);
-			i->second.rawBytes[slot].set(ss.str());
-			
 			//LOG_MSG("Component is %s",i->first.c_str());
-
-			if(!create_version) {
-				std::string tempname = temp+"DOSBox-X_Version";
-				std::ofstream emulatorversion (tempname.c_str(), std::ofstream::binary);
-				emulatorversion << "DOSBox-X " << VERSION << " (" << SDL_STRING << ")" << std::endl << GetPlatform(true) << std::endl << UPDATED_STR;
-				if (!compresssaveparts) emulatorversion << std::endl << "No compression";
-				create_version=true;
-				emulatorversion.close();
-			}
-
-			if(!create_title) {
-				std::string tempname = temp+"Program_Name";
-				std::ofstream programname (tempname.c_str(), std::ofstream::binary);
-				programname << RunningProgram;
-				create_title=true;
-				programname.close();
-			}
-
-			if(!create_memorysize) {
-				std::string tempname = temp+"Memory_Size";
-				std::ofstream memorysize (tempname.c_str(), std::ofstream::binary);
-				memorysize << MEM_TotalPages();
-				create_memorysize=true;
-				memorysize.close();
-			}
-
-			if(!create_machinetype) {
-				std::string tempname = temp+"Machine_Type";
-				std::ofstream machinetype (tempname.c_str(), std::ofstream::binary);
-				machinetype << getType();
-				create_machinetype=true;
-				machinetype.close();
-			}
-
-			if(!create_timestamp) {
-				std::string tempname = temp+"Time_Stamp";
-				std::ofstream timestamp (tempname.c_str(), std::ofstream::binary);
-				timestamp << getTime(true);
-				create_timestamp=true;
-				timestamp.close();
-			}
-
-			if(!create_saveremark) {
-				std::string tempname = temp+"Save_Remark";
-				std::ofstream saveremark (tempname.c_str(), std::ofstream::binary);
-				saveremark << std::string(save_remark);
-				create_saveremark=true;
-				saveremark.close();
-			}
-
-			std::string realtemp;
-			realtemp = temp + i->first;
-			std::ofstream outfile (realtemp.c_str(), std::ofstream::binary);
-			outfile << (compresssaveparts?Util::compress(ss.str()):ss.str());
-			//compress all other saved states except position "slot"
-			//const std::vector<RawBytes>& rb = i->second.rawBytes;
-			//std::for_each(rb.begin(), rb.begin() + slot, std::mem_fun_ref(&RawBytes::compress));
-			//std::for_each(rb.begin() + slot + 1, rb.end(), std::mem_fun_ref(&RawBytes::compress));
-			outfile.close();
-			ss.clear();
-			if(outfile.fail()) {
-				LOG_MSG("Save failed! - %s", realtemp.c_str());
-				save_err=true;
-				remove(save.c_str());
-				goto delete_all;
-			}
+			job->parts.push_back(SavePart(i->first, ss.str(), true));
 		}
+
+		std::ostringstream emulatorversion;
+		emulatorversion << "DOSBox-X " << VERSION << " (" << SDL_STRING << ")" << std::endl << GetPlatform(true) << std::endl << UPDATED_STR;
+		if (!compresssaveparts) emulatorversion << std::endl << "No compression";
+		job->parts.push_back(SavePart("DOSBox-X_Version", emulatorversion.str(), false));
+		job->parts.push_back(SavePart("Program_Name", RunningProgram, false));
+		job->parts.push_back(SavePart("Memory_Size", std::to_string(MEM_TotalPages()), false));
+		job->parts.push_back(SavePart("Machine_Type", getType(), false));
+		job->parts.push_back(SavePart("Time_Stamp", getTime(true), false));
+		job->parts.push_back(SavePart("Save_Remark", save_remark, false));
 	}
 	catch (const std::bad_alloc&) {
-		LOG_MSG("Save failed! Out of Memory!");
-		save_err=true;
-		remove(save.c_str());
-		goto delete_all;
+		job->parts.clear();
+		job->failed = true;
+		job->error = "Save failed! Out of Memory!";
+		remove(job->file.c_str());
+		reportSaveJob(job);
+		return;
 	}
 
-	for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
-		save2=temp+i->first;
-		my_minizip((char **)save.c_str(), (char **)save2.c_str());
+	//delta saves go against the last keyframe as long as its file is still around
+	int deltasavestate = static_cast<Section_prop *>(control->GetSection("dosbox"))->Get_int("deltasavestate");
+	if (deltasavestate > 0) {
+		std::ifstream check_base(deltaBase.file.c_str());
+		if (!deltaBase.id.empty() && deltaBase.saves + 1 < deltasavestate && job->file != deltaBase.file && !check_base.fail()) {
+			job->delta = true;
+			deltaBase.saves++;
+		} else {
+			char id[40];
+			sprintf(id, "%lx-%x", (unsigned long)time(NULL), (unsigned int)SDL_GetTicks());
+			deltaBase = DeltaBase();
+			deltaBase.file = job->file;
+			deltaBase.id = id;
+			job->keyframe = true;
+			job->parts.push_back(SavePart("Delta_Id", id, false));
+		}
+	} else
+		deltaBase = DeltaBase();
+
+	if (!dos_kernel_disabled) flagged_backup((char *)job->file.c_str());
+
+#if SAVESTATE_THREADS
+	bool asyncsavestate = static_cast<Section_prop *>(control->GetSection("dosbox"))->Get_bool("asyncsavestate");
+	if (asyncsavestate) {
+		pendingSave = job;
+		saveThreadDone = false;
+		saveThread = std::thread([job]() {
+			runSaveJob(*job);
+			saveThreadDone = true;
+		});
+		return;
 	}
-	save2=temp+"DOSBox-X_Version";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-	save2=temp+"Program_Name";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-	save2=temp+"Memory_Size";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-	save2=temp+"Machine_Type";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-	save2=temp+"Time_Stamp";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-	save2=temp+"Save_Remark";
-	my_minizip((char **)save.c_str(), (char **)save2.c_str());
-    if (!dos_kernel_disabled) flagged_backup((char *)save.c_str());
+#endif
+	runSaveJob(*job);
+	reportSaveJob(job);
+}
 
-delete_all:
-	for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
-		save2=temp+i->first;
-		remove(save2.c_str());
-	}
-	save2=temp+"DOSBox-X_Version";
-	remove(save2.c_str());
-	save2=temp+"Program_Name";
-	remove(save2.c_str());
-	save2=temp+"Memory_Size";
-	remove(save2.c_str());
-	save2=temp+"Machine_Type";
-	remove(save2.c_str());
-	save2=temp+"Time_Stamp";
-	remove(save2.c_str());
-	save2=temp+"Save_Remark";
-	remove(save2.c_str());
-	if (save_err)
-		notifyError("Failed to save the current state.");
-	else
-		LOG_MSG("[%s]: Saved. (Slot %d)", getTime().c_str(), (int)slot+1);
+bool SaveState::isSaving() const {
+	return pendingSave != NULL;
+}
+
+void SaveState::finishSave() const {
+	if (pendingSave == NULL) return;
+#if SAVESTATE_THREADS
+	saveThread.join();
+#endif
+	SaveJob *job = pendingSave;
+	pendingSave = NULL;
+	reportSaveJob(job);
+}
+
+void SaveState::pollSave() const {
+#if SAVESTATE_THREADS
+	if (pendingSave != NULL && saveThreadDone) finishSave();
+#endif
 }
 
 void savestatecorrupt(const char* part) {
@@ -1323,6 +1773,7 @@ bool loadstateconfirm(int ind) {
 
 void SaveState::load(size_t slot) const { //throw (Error)
 //	if (isEmpty(slot)) return;
+	finishSave();
 	bool load_err=false;
 	if((MEM_TotalPages()*4096/1024/1024)>1024) {
 		LOG_MSG("Stopped. 1 GB is the maximum memory size for saving/loading states.");
@@ -1365,6 +1816,27 @@ void SaveState::load(size_t slot) const { //throw (Error)
 		load_err=true;
 		return;
 	}
+	check_slot.close();
+
+	//a delta save only carries the pages that changed since its keyframe
+	std::string delta_info, delta_file;
+	std::vector<std::string> delta_parts;
+	bool base_decompressparts=true;
+	if (readSavePart(save, "Delta_Base", delta_info)) {
+		std::istringstream info(delta_info);
+		std::string delta_id, base_id, base_version, name;
+		std::getline(info, delta_file);
+		std::getline(info, delta_id);
+		while (std::getline(info, name))
+			if (!name.empty()) delta_parts.push_back(name);
+		if (!readSavePart(delta_file, "Delta_Id", base_id) || base_id != delta_id) {
+			LOG_MSG("Keyframe of delta saved state is missing or was overwritten - %s", delta_file.c_str());
+			notifyError("The saved state this delta saved state is based on is missing or has been overwritten.", false);
+			return;
+		}
+		if (readSavePart(delta_file, "DOSBox-X_Version", base_version) && base_version.find("\nNo compression") != std::string::npos)
+			base_decompressparts = false;
+	}
 
 	for (CompEntry::const_iterator i = components.begin(); i != components.end(); ++i) {
 		std::filebuf * fb;
@@ -1533,8 +2005,24 @@ void SaveState::load(size_t slot) const { //throw (Error)
 		clearline=true;
 		fb->open(realtemp.c_str(),std::ios::in | std::ios::binary);
 		std::string str((std::istreambuf_iterator<char>(ss)), std::istreambuf_iterator<char>());
+		std::string bytes = decompressparts?Util::decompress(str):str;
+		if (std::find(delta_parts.begin(), delta_parts.end(), i->first) != delta_parts.end()) {
+			std::string base;
+			if (!readSavePart(delta_file, i->first.c_str(), base)) {
+				savestatecorrupt(i->first.c_str());
+				load_err=true;
+				goto delete_all;
+			}
+			if (base_decompressparts) base = Util::decompress(base);
+			if (!applyDelta(base, bytes)) {
+				savestatecorrupt(i->first.c_str());
+				load_err=true;
+				goto delete_all;
+			}
+			bytes.swap(base);
+		}
 		std::stringstream mystream;
-		mystream << (decompressparts?Util::decompress(str):str);
+		mystream << bytes;
 		i->second.comp.setBytes(mystream);
 		if (mystream.rdbuf()->in_avail() != 0 || mystream.eof()) { //basic consistency check
 			savestatecorrupt(i->first.c_str());
@@ -1568,6 +2056,7 @@ delete_all:
 
 bool SaveState::isEmpty(size_t slot) const {
 	if (slot >= SLOT_COUNT*MAX_PAGE) return true;
+	if (pendingSave != NULL && pendingSave->slot == slot) return false; //still being written
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {
@@ -1596,6 +2085,7 @@ bool SaveState::isEmpty(size_t slot) const {
 
 void SaveState::removeState(size_t slot) const {
 	if (slot >= SLOT_COUNT*MAX_PAGE) return;
+	finishSave();
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {
@@ -1638,6 +2128,7 @@ void SaveState::removeState(size_t slot) const {
 
 std::string SaveState::getName(size_t slot, bool nl) const {
 	if (slot >= SLOT_COUNT*MAX_PAGE) return "["+std::string(MSG_Get("EMPTY_SLOT"))+"]";
+	finishSave();
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {
@@ -10,8 +10,143 @@
 
 #include <output/output_tools_xbrz.h>
 
+#include <functional>
+#include <utility>
+#include <vector>
+
+#ifdef XBRZ_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
 using namespace std;
 
+#if C_XBRZ || C_SURFACE_POSTRENDER_ASPECT
+
+/* Without PPL, slices of rows are spread over a pool of worker threads. The rendering thread
+ * takes slices too and returns when all of them are done, so the buffers never change under
+ * the workers. Slices write disjoint rows of the target, xBRZ only reads around them. */
+
+static int xbrz_threads_wanted = 0;
+
+void xBRZ_SetThreads(int count)
+{
+    xbrz_threads_wanted = count;
+}
+
+#if !defined(XBRZ_PPL)
+typedef std::vector<std::pair<int, int> > xbrz_slices_t;
+
+#ifdef XBRZ_THREADS
+static class xBRZ_Pool {
+public:
+    ~xBRZ_Pool() { stop(); }
+
+    void start(int count) {
+        job = 0;
+        busy = 0;
+        quit = false;
+        for (int i = 0; i < count; i++)
+            workers.push_back(std::thread(&xBRZ_Pool::worker, this));
+    }
+
+    void stop(void) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    void run(const xbrz_slices_t& s, const std::function<void(int, int)>& f) {
+        std::unique_lock<std::mutex> guard(lock);
+        slices = &s;
+        func = &f;
+        next = 0;
+        busy = (int)workers.size();
+        job++;
+        guard.unlock();
+        wake.notify_all();
+
+        run_slices();
+
+        guard.lock();
+        done.wait(guard, [this] { return busy == 0; });
+    }
+
+    std::vector<std::thread>                workers;
+private:
+    void run_slices(void) {
+        size_t i;
+        while ((i = next.fetch_add(1)) < slices->size())
+            (*func)((*slices)[i].first, (*slices)[i].second);
+    }
+
+    void worker(void) {
+        uint32_t seen = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            wake.wait(guard, [this, &seen] { return quit || job != seen; });
+            if (quit) return;
+            seen = job;
+
+            guard.unlock();
+            run_slices();
+            guard.lock();
+
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    std::mutex                              lock;
+    std::condition_variable                 wake;       // a new job, or quit
+    std::condition_variable                 done;       // the last worker is through
+    uint32_t                                job = 0;    // counts up for every job
+    int                                     busy = 0;   // workers still on the current job
+    bool                                    quit = false;
+
+    // the current job
+    const xbrz_slices_t*                    slices = nullptr;
+    const std::function<void(int, int)>*    func = nullptr;
+    std::atomic<size_t>                     next{0};
+} xbrz_pool;
+#endif
+
+// run f(first, last) for every slice, on the pool when there is more than one
+static void xBRZ_RunSlices(const xbrz_slices_t& slices, const std::function<void(int, int)>& f)
+{
+#ifdef XBRZ_THREADS
+    int threads = xbrz_threads_wanted;
+    if (threads <= 0) threads = max(1, (int)std::thread::hardware_concurrency());
+    if (xbrz_pool.workers.size() != (size_t)(threads - 1)) {
+        xbrz_pool.stop();
+        xbrz_pool.start(threads - 1);
+    }
+    if (slices.size() > 1 && !xbrz_pool.workers.empty()) {
+        xbrz_pool.run(slices, f);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < slices.size(); i++)
+        f(slices[i].first, slices[i].second);
+}
+
+// cut rows first..last-1 into slices of granularity rows
+static void xBRZ_AddSlices(xbrz_slices_t& slices, int first, int last, int granularity)
+{
+    if (granularity < 1) granularity = last - first;
+    for (int i = first; i < last; i += granularity)
+        slices.push_back(std::make_pair(i, min(i + granularity, last)));
+}
+#endif /*!XBRZ_PPL*/
+
+#endif /*C_XBRZ || C_SURFACE_POSTRENDER_ASPECT*/
+
 #if C_XBRZ
 
 struct SDL_xBRZ sdl_xbrz;
@@ -37,6 +172,7 @@ void xBRZ_Initialize()
 void xBRZ_Change_Options(Section_prop* section)
 {
     sdl_xbrz.task_granularity = section->Get_int("xbrz slice");
+    xBRZ_SetThreads(section->Get_int("xbrz threads"));
     sdl_xbrz.fixed_scale_factor = section->Get_int("xbrz fixed scale factor");
     sdl_xbrz.max_scale_factor = section->Get_int("xbrz max scale factor");
     if ((sdl_xbrz.max_scale_factor < 2) || (sdl_xbrz.max_scale_factor > xbrz::SCALE_FACTOR_MAX))
@@ -118,8 +254,7 @@ void xBRZ_Render(const uint32_t* renderBuf, uint32_t* xbrzBuf, const uint16_t *c
         tg.wait();
     }
 #else
-    /* non-PPL for non-Windows.
-    * combine the code above, cleanly, if possible. */
+    xbrz_slices_t slices;
     if (changedLines)
     {
         int yLast = 0;
@@ -136,15 +271,19 @@ void xBRZ_Render(const uint32_t* renderBuf, uint32_t* xbrzBuf, const uint16_t *c
 
                 int yFirst = max(yLast, sliceFirst - 2); // we need to update two adjacent lines as well since they are analyzed by xBRZ!
                 yLast = min(srcHeight, sliceLast + 2);  // (and make sure to not overlap with last slice!)
-                xbrz::scale((size_t)scalingFactor, renderBuf, xbrzBuf, srcWidth, srcHeight, xbrz::ColorFormat::RGB, xbrz::ScalerCfg(), yFirst, yLast);
+                xBRZ_AddSlices(slices, yFirst, yLast, sdl_xbrz.task_granularity);
             }
             index++;
         }
     }
     else // process complete input image
     {
-        xbrz::scale((size_t)scalingFactor, renderBuf, xbrzBuf, srcWidth, srcHeight, xbrz::ColorFormat::RGB, xbrz::ScalerCfg(), 0, srcHeight);
+        xBRZ_AddSlices(slices, 0, srcHeight, sdl_xbrz.task_granularity);
     }
+
+    xBRZ_RunSlices(slices, [=](int first, int last) {
+        xbrz::scale((size_t)scalingFactor, renderBuf, xbrzBuf, srcWidth, srcHeight, xbrz::ColorFormat::RGB, xbrz::ScalerCfg(), first, last);
+    });
 #endif /*XBRZ_PPL*/
 }
 
@@ -156,8 +295,6 @@ void xBRZ_PostScale(const uint32_t* src, const int srcWidth, const int srcHeight
                     uint32_t* tgt, const int tgtWidth, const int tgtHeight, const int tgtPitch, 
                     const bool bilinear, const int task_granularity)
 {
-    (void)task_granularity;
-
 # if defined(XBRZ_PPL)
     if (bilinear) {
         concurrency::task_group tg;
@@ -180,10 +317,17 @@ void xBRZ_PostScale(const uint32_t* src, const int srcWidth, const int srcHeight
         tg.wait();
     }
 #else
+    xbrz_slices_t slices;
+    xBRZ_AddSlices(slices, 0, tgtHeight, task_granularity);
+
     if (bilinear)
-        xbrz::bilinearScale(&src[0], srcWidth, srcHeight, srcPitch, &tgt[0], tgtWidth, tgtHeight, tgtPitch, 0, tgtHeight, [](uint32_t pix) { return pix; });
+        xBRZ_RunSlices(slices, [=](int first, int last) {
+            xbrz::bilinearScale(&src[0], srcWidth, srcHeight, srcPitch, &tgt[0], tgtWidth, tgtHeight, tgtPitch, first, last, [](uint32_t pix) { return pix; });
+        });
     else
-        xbrz::nearestNeighborScale(&src[0], srcWidth, srcHeight, srcPitch, &tgt[0], tgtWidth, tgtHeight, tgtPitch, 0, tgtHeight, [](uint32_t pix) { return pix; });
+        xBRZ_RunSlices(slices, [=](int first, int last) {
+            xbrz::nearestNeighborScale(&src[0], srcWidth, srcHeight, srcPitch, &tgt[0], tgtWidth, tgtHeight, tgtPitch, first, last, [](uint32_t pix) { return pix; });
+        });
 #endif
 }
 
@@ -11,8 +11,13 @@
 #if defined(WIN32) && !defined(__MINGW32__) && !defined(HX_DOS)
 #define XBRZ_PPL 1
 #include <ppl.h>
+#elif !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#define XBRZ_THREADS 1
 #endif
 
+// number of threads xBRZ_Render and xBRZ_PostScale spread slices over, 0 for one per host core
+void xBRZ_SetThreads(int count);
+
 #endif /*C_XBRZ || C_SURFACE_POSTRENDER_ASPECT*/
 
 #if C_XBRZ
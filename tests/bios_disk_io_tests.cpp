@@ -0,0 +1,176 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "bios_disk.h"
+#include "bios_disk_io.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 16 heads, 63 sectors, 8 cylinders of 512 bytes: a little over 4MB, so that
+// reading it through evicts from the largest cache tested
+const uint32_t dio_heads = 16, dio_sects = 63, dio_cyls = 8;
+const uint32_t dio_total = dio_heads * dio_sects * dio_cyls;
+
+struct DiskIOSetting {
+	const char *name;
+	imageDiskIO::backend_t backend;
+	int cache_kb, readahead_kb;
+};
+
+const DiskIOSetting dio_settings[] = {
+	{ "stdio",            imageDiskIO::BACKEND_STDIO, 0,    0   },
+	{ "stdio+cache",      imageDiskIO::BACKEND_STDIO, 1024, 256 },
+#if defined(DISK_IO_POSIX)
+	{ "pread",            imageDiskIO::BACKEND_PREAD, 0,    0   },
+	{ "pread+cache",      imageDiskIO::BACKEND_PREAD, 1024, 0   },
+	{ "pread+read ahead", imageDiskIO::BACKEND_PREAD, 1024, 256 },
+	{ "mmap",             imageDiskIO::BACKEND_MMAP,  0,    256 },
+#endif
+};
+
+// every sector starts with its number, and the rest depends on it too
+void DIO_FillSector(uint8_t *p, uint32_t sect, uint32_t gen)
+{
+	for (unsigned int i = 0; i < 512; i++) p[i] = (uint8_t)((sect * 7u) + (i * 13u) + gen);
+	memcpy(p, &sect, sizeof(sect));
+}
+
+// a temporary image of cyls cylinders opened the way IMGMOUNT opens one, with the
+// cache settings taken the way they are taken from [dos]
+imageDisk *DIO_Open(const DiskIOSetting &s, uint32_t cyls = dio_cyls)
+{
+	FILE *f = tmpfile();
+	if (f == NULL) return NULL;
+
+	std::vector<uint8_t> buf(512 * dio_sects);
+	for (uint32_t t = 0; t < dio_heads * cyls; t++) {
+		for (uint32_t i = 0; i < dio_sects; i++) DIO_FillSector(&buf[i * 512], t * dio_sects + i, 0);
+		if (fwrite(buf.data(), buf.size(), 1, f) != 1) {
+			fclose(f);
+			return NULL;
+		}
+	}
+	fflush(f);
+
+	const imageDiskIO::backend_t old_backend = disk_image_io_backend;
+	const int old_cache = disk_image_cache_kb, old_readahead = disk_image_readahead_kb;
+	disk_image_io_backend = s.backend;
+	disk_image_cache_kb = s.cache_kb;
+	disk_image_readahead_kb = s.readahead_kb;
+
+	imageDisk *disk = new imageDiskRaw(f, "test.img", cyls, dio_heads, dio_sects, 512, true);
+	disk->Addref();
+
+	// the backend comes up with the first access
+	uint8_t sector[512];
+	EXPECT_EQ(0, disk->Read_AbsoluteSector(0, sector));
+
+	disk_image_io_backend = old_backend;
+	disk_image_cache_kb = old_cache;
+	disk_image_readahead_kb = old_readahead;
+	return disk;
+}
+
+TEST(DiskImageIO, ReadWrite)
+{
+	for (const auto &s : dio_settings) {
+		SCOPED_TRACE(s.name);
+		imageDisk *disk = DIO_Open(s);
+		ASSERT_NE((imageDisk *)NULL, disk);
+
+		std::vector<uint8_t> buf(512 * 256), want(512 * 256);
+
+		// sequential, in the sizes READ MULTIPLE and INT 13h use
+		for (uint32_t sect = 0; sect + 256 <= dio_total; sect += 256) {
+			const uint32_t count = (sect & 512) ? 1 : 16;
+			for (uint32_t i = 0; i < 256; i += count) {
+				ASSERT_EQ(0, disk->Read_AbsoluteSectors(sect + i, count, &buf[i * 512]));
+			}
+			for (uint32_t i = 0; i < 256; i++) DIO_FillSector(&want[i * 512], sect + i, 0);
+			ASSERT_EQ(0, memcmp(want.data(), buf.data(), buf.size())) << "sector " << sect;
+		}
+
+		// writes across block boundaries must show up in what is cached and in the file
+		uint32_t wsect = (64 * 1024 / 512) - 3;
+		for (uint32_t i = 0; i < 8; i++) DIO_FillSector(&want[i * 512], wsect + i, 1);
+		ASSERT_EQ(0, disk->Write_AbsoluteSectors(wsect, 8, want.data()));
+		ASSERT_EQ(0, disk->Write_AbsoluteSector(dio_total - 1, &want[7 * 512]));
+		ASSERT_EQ(0, disk->Read_AbsoluteSectors(wsect - 1, 10, buf.data()));
+		DIO_FillSector(&want[8 * 512], wsect - 1, 0);
+		EXPECT_EQ(0, memcmp(&want[8 * 512], &buf[0], 512));
+		EXPECT_EQ(0, memcmp(&want[0], &buf[512], 8 * 512));
+		DIO_FillSector(&want[8 * 512], wsect + 8, 0);
+		EXPECT_EQ(0, memcmp(&want[8 * 512], &buf[9 * 512], 512));
+		ASSERT_EQ(0, disk->Read_AbsoluteSector(dio_total - 1, buf.data()));
+		EXPECT_EQ(0, memcmp(&want[7 * 512], &buf[0], 512));
+
+		uint8_t filebuf[512];
+		fflush(disk->diskimg);
+		ASSERT_EQ(0, fseek(disk->diskimg, (long)(wsect + 2) * 512, SEEK_SET));
+		ASSERT_EQ(1u, fread(filebuf, sizeof(filebuf), 1, disk->diskimg));
+		EXPECT_EQ(0, memcmp(&want[2 * 512], filebuf, 512));
+
+		// nothing past the end
+		EXPECT_NE(0, disk->Read_AbsoluteSectors(dio_total - 1, 2, buf.data()));
+		EXPECT_NE(0, disk->Read_AbsoluteSector(dio_total, buf.data()));
+		EXPECT_NE(0, disk->Write_AbsoluteSectors(dio_total - 1, 2, buf.data()));
+
+		disk->Release();
+	}
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests: a guest reading a 32MB image
+// front to back, one sector at a time as INT 13h does and 16 sectors at a time as
+// READ MULTIPLE does
+TEST(DiskImageIO, DISABLED_SequentialThroughput)
+{
+	const uint32_t cyls = 65, total = dio_heads * dio_sects * cyls;
+	const double mb = (double)total * 512 / (1024 * 1024);
+	std::vector<uint8_t> buf(512 * 16);
+
+	for (const auto &s : dio_settings) {
+		imageDisk *disk = DIO_Open(s, cyls);
+		ASSERT_NE((imageDisk *)NULL, disk);
+
+		double mbs[2];
+		for (int pass = 0; pass < 2; pass++) {
+			const uint32_t count = pass ? 16 : 1;
+			uint32_t check = 0;
+
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t sect = 0; sect + count <= total; sect += count) {
+				ASSERT_EQ(0, disk->Read_AbsoluteSectors(sect, count, buf.data()));
+				check += buf[0];
+			}
+			mbs[pass] = mb / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			EXPECT_NE(~0u, check);
+		}
+
+		printf("Disk image, %-16s: %8.1f MB/s by sector, %8.1f MB/s by 16 sectors (%.0f MB)\n",
+		       s.name, mbs[0], mbs[1], mb);
+		disk->Release();
+	}
+}
+
+} // namespace
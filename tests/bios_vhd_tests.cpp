@@ -0,0 +1,108 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "bios_disk.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// 16MB, eight 2MB blocks of 4096 sectors
+const uint64_t vhd_size = 16ull * 1024 * 1024;
+const uint32_t vhd_total = (uint32_t)(vhd_size / 512);
+const char *vhd_base = "vhd_test_base.vhd";
+const char *vhd_child = "vhd_test_child.vhd";
+
+struct VHDWrite {
+	uint32_t sect, count;
+};
+
+void VHD_FillSector(uint8_t *p, uint32_t sect, uint32_t gen)
+{
+	for (unsigned int i = 0; i < 512; i++) p[i] = (uint8_t)((sect * 5u) + (i * 7u) + gen + 1u);
+	memcpy(p, &sect, sizeof(sect));
+}
+
+// writes a run of sectors to the image, and to what the image should read back as
+void VHD_Write(imageDisk *disk, std::vector<uint8_t> &model, const VHDWrite &w, uint32_t gen)
+{
+	std::vector<uint8_t> buf(w.count * 512);
+	for (uint32_t i = 0; i < w.count; i++) {
+		if (gen == 0xFF) memset(&buf[i * 512], 0, 512);
+		else VHD_FillSector(&buf[i * 512], w.sect + i, gen);
+	}
+	ASSERT_EQ(0, disk->Write_AbsoluteSectors(w.sect, w.count, buf.data()));
+	memcpy(&model[(size_t)w.sect * 512], buf.data(), buf.size());
+}
+
+// the whole disk, in reads of odd sizes that start and end all over the blocks
+void VHD_Check(imageDisk *disk, const std::vector<uint8_t> &model)
+{
+	std::vector<uint8_t> buf(512 * 97);
+	for (uint32_t sect = 0; sect < vhd_total;) {
+		const uint32_t count = std::min<uint32_t>(vhd_total - sect, 1 + (sect % 97));
+		ASSERT_EQ(0, disk->Read_AbsoluteSectors(sect, count, buf.data()));
+		ASSERT_EQ(0, memcmp(&model[(size_t)sect * 512], buf.data(), count * 512)) << "sectors " << sect << "+" << count;
+		sect += count;
+	}
+	for (uint32_t sect = 4090; sect < 4110; sect++) {
+		ASSERT_EQ(0, disk->Read_AbsoluteSector(sect, buf.data()));
+		ASSERT_EQ(0, memcmp(&model[(size_t)sect * 512], buf.data(), 512)) << "sector " << sect;
+	}
+	EXPECT_NE(0, disk->Read_AbsoluteSectors(vhd_total - 1, 2, buf.data()));
+}
+
+TEST(VHDImage, DifferencingReads)
+{
+	std::vector<uint8_t> model((size_t)vhd_size, 0);
+	imageDisk *disk = NULL;
+
+	ASSERT_EQ(0u, imageDiskVHD::CreateDynamic(vhd_base, vhd_size));
+	ASSERT_EQ(imageDiskVHD::OPEN_SUCCESS, imageDiskVHD::Open(vhd_base, false, &disk));
+	const VHDWrite base_writes[] = { { 0, 10 }, { 4090, 16 }, { 9000, 1 }, { 20000, 4 }, { 20010, 3 } };
+	for (const auto &w : base_writes) VHD_Write(disk, model, w, 0);
+	VHD_Check(disk, model);
+	delete disk;
+
+	ASSERT_EQ(0u, imageDiskVHD::CreateDifferencing(vhd_child, vhd_base));
+	disk = NULL;
+	ASSERT_EQ(imageDiskVHD::OPEN_SUCCESS, imageDiskVHD::Open(vhd_child, false, &disk));
+	ASSERT_EQ(imageDiskVHD::VHD_TYPE_DIFFERENCING, ((imageDiskVHD *)disk)->GetVHDType());
+	VHD_Check(disk, model);
+
+	// sectors of the child among and beside those of the parent, and zeros over the parent's data
+	const VHDWrite child_writes[] = { { 5, 3 }, { 4100, 1 }, { 12000, 2 }, { 20002, 10 }, { 30000, 1 } };
+	for (const auto &w : child_writes) VHD_Write(disk, model, w, 1);
+	VHD_Write(disk, model, VHDWrite{ 9000, 1 }, 0xFF);
+	VHD_Write(disk, model, VHDWrite{ 1, 2 }, 0xFF);
+	VHD_Check(disk, model);
+	delete disk;
+
+	disk = NULL;
+	ASSERT_EQ(imageDiskVHD::OPEN_SUCCESS, imageDiskVHD::Open(vhd_child, true, &disk));
+	VHD_Check(disk, model);
+	delete disk;
+
+	remove(vhd_child);
+	remove(vhd_base);
+}
+
+} // namespace
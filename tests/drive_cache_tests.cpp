@@ -0,0 +1,208 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "dos_system.h"
+#include "../src/dos/drives.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <vector>
+#if defined(WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const std::string dc_split(1, CROSS_FILESPLIT);
+const std::string dc_base = std::string("dircache_test") + dc_split;
+
+void DC_MakeDir(const std::string &path)
+{
+#if defined(WIN32)
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0775);
+#endif
+}
+
+void DC_Touch(const std::string &path)
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	ASSERT_NE((FILE *)NULL, f) << path;
+	fclose(f);
+}
+
+std::string DC_LongName(unsigned int i)
+{
+	char name[64];
+	sprintf(name, "Long File Name %03u.txt", i);
+	return name;
+}
+
+// a directory full of names that all shorten to LONGFI~N.TXT, and one below it
+TEST(DriveCache, ShortNames)
+{
+	const unsigned int count = 400;
+	const std::string sub = dc_base + "Sub Directory Long";
+
+	DC_MakeDir(dc_base);
+	DC_MakeDir(sub);
+	for (unsigned int i = 0; i < count; i++) DC_Touch(dc_base + DC_LongName(i));
+	DC_Touch(dc_base + "readme.txt");
+	DC_Touch(sub + dc_split + "inner file.txt");
+
+	std::vector<std::string> options;
+	localDrive *drv = new localDrive(dc_base.c_str(), 512, 32, 32765, 16000, 0xF8, options);
+	DOS_Drive_Cache *cache = new DOS_Drive_Cache(dc_base.c_str(), drv);
+
+	std::set<std::string> shortnames;
+	char shortname[CROSS_LEN];
+	for (unsigned int i = 0; i < count; i++) {
+		const std::string name = DC_LongName(i);
+		ASSERT_TRUE(cache->GetShortName((dc_base + name).c_str(), shortname)) << name;
+		EXPECT_EQ(0, strncmp(shortname, "LONG", 4)) << shortname;
+		EXPECT_TRUE(shortnames.insert(shortname).second) << shortname << " is used twice";
+		EXPECT_EQ(dc_base + name, cache->GetExpandName((dc_base + shortname).c_str()));
+	}
+	EXPECT_FALSE(cache->GetShortName((dc_base + "readme.txt").c_str(), shortname));
+	EXPECT_EQ(dc_base + "readme.txt", cache->GetExpandName((dc_base + "README.TXT").c_str()));
+	EXPECT_EQ(sub + dc_split + "inner file.txt", cache->GetExpandName((dc_base + "SUBDIR~1" + dc_split + "INNERF~1.TXT").c_str()));
+
+	// long names in any case, as DOS programs asking for LFNs may spell them
+	const bool old_lfn = uselfn;
+	uselfn = true;
+	EXPECT_EQ(dc_base + DC_LongName(7), cache->GetExpandName((dc_base + "long file name 007.TXT").c_str()));
+	uselfn = false;
+	EXPECT_EQ(dc_base + "long file name 007.TXT", cache->GetExpandName((dc_base + "long file name 007.TXT").c_str()));
+	uselfn = old_lfn;
+
+	// a file that turns up later gets a name of its own
+	DC_Touch(dc_base + DC_LongName(count));
+	cache->AddEntry((dc_base + DC_LongName(count)).c_str(), true);
+	ASSERT_TRUE(cache->GetShortName((dc_base + DC_LongName(count)).c_str(), shortname));
+	EXPECT_TRUE(shortnames.insert(shortname).second) << shortname << " is used twice";
+	EXPECT_EQ(dc_base + DC_LongName(count), cache->GetExpandName((dc_base + shortname).c_str()));
+
+	// the listing: directories first, then files, each in short name order
+	uint16_t id;
+	char *result, *lresult;
+	unsigned int files = 0, dirs = 0;
+	std::string last;
+	bool last_dir = true;
+	ASSERT_TRUE(cache->FindFirst((char *)dc_base.c_str(), id));
+	while (cache->FindNext(id, result, lresult)) {
+		const bool is_dir = !strcmp(result, ".") || !strcmp(result, "..") || !strcmp(result, "SUBDIR~1");
+		if (is_dir) {
+			EXPECT_TRUE(last_dir) << result;
+			dirs++;
+		} else {
+			if (!last_dir) {
+				EXPECT_LT(last, std::string(result));
+			}
+			files++;
+		}
+		last = result;
+		last_dir = is_dir;
+	}
+	EXPECT_EQ(count + 2, files);
+	EXPECT_EQ(3u, dirs);
+
+	delete cache;
+	delete drv;
+	for (unsigned int i = 0; i <= count; i++) remove((dc_base + DC_LongName(i)).c_str());
+	remove((dc_base + "readme.txt").c_str());
+	remove((sub + dc_split + "inner file.txt").c_str());
+	rmdir(sub.c_str());
+	rmdir(dc_base.c_str());
+}
+
+#if defined(LINUX)
+unsigned int DC_Count(DOS_Drive_Cache *cache)
+{
+	uint16_t id;
+	char *result, *lresult;
+	unsigned int count = 0;
+	EXPECT_TRUE(cache->FindFirst((char *)dc_base.c_str(), id));
+	while (cache->FindNext(id, result, lresult)) count++;
+	return count;
+}
+
+// files made, removed and renamed behind the cache's back
+TEST(DriveCache, HostChanges)
+{
+	const std::string newdir = dc_base + "New Directory";
+
+	DC_MakeDir(dc_base);
+	for (unsigned int i = 0; i < 20; i++) DC_Touch(dc_base + DC_LongName(i));
+
+	std::vector<std::string> options;
+	localDrive *drv = new localDrive(dc_base.c_str(), 512, 32, 32765, 16000, 0xF8, options);
+	DOS_Drive_Cache *cache = new DOS_Drive_Cache();
+	cache->WatchHost(true);
+	cache->SetBaseDir(dc_base.c_str(), drv);
+	const unsigned int entries = DC_Count(cache);
+	char shortname[CROSS_LEN];
+
+	DC_Touch(dc_base + "New Long File.txt");
+	DC_MakeDir(newdir);
+	DC_Touch(newdir + dc_split + "inside.txt");
+	EXPECT_FALSE(cache->GetShortName((dc_base + "New Long File.txt").c_str(), shortname));
+	cache->CheckHostChanges();
+	ASSERT_TRUE(cache->GetShortName((dc_base + "New Long File.txt").c_str(), shortname));
+	EXPECT_STREQ("NEWLON~1.TXT", shortname);
+	EXPECT_EQ(newdir + dc_split + "inside.txt", cache->GetExpandName((dc_base + "NEWDIR~1" + dc_split + "INSIDE.TXT").c_str()));
+	EXPECT_EQ(entries + 2, DC_Count(cache));
+
+	// the drive looks for changes itself
+	EXPECT_TRUE(drv->FileExists("NEWLON~1.TXT"));
+	DC_Touch(dc_base + "Another Long File.txt");
+	EXPECT_TRUE(drv->FileExists("ANOTHE~1.TXT"));
+
+	// what the cache was told about already is not added twice
+	DC_Touch(dc_base + "Added Long File.txt");
+	cache->AddEntry((dc_base + "Added Long File.txt").c_str(), true);
+	cache->CheckHostChanges();
+	EXPECT_EQ(entries + 4, DC_Count(cache));
+
+	remove((dc_base + DC_LongName(3)).c_str());
+	rename((dc_base + DC_LongName(4)).c_str(), (dc_base + "Renamed Long File.txt").c_str());
+	cache->CheckHostChanges();
+	EXPECT_FALSE(cache->GetShortName((dc_base + DC_LongName(3)).c_str(), shortname));
+	EXPECT_FALSE(cache->GetShortName((dc_base + DC_LongName(4)).c_str(), shortname));
+	EXPECT_TRUE(cache->GetShortName((dc_base + "Renamed Long File.txt").c_str(), shortname));
+	EXPECT_EQ(entries + 3, DC_Count(cache));
+
+	delete cache;
+	delete drv;
+	for (unsigned int i = 0; i < 20; i++) remove((dc_base + DC_LongName(i)).c_str());
+	remove((dc_base + "New Long File.txt").c_str());
+	remove((dc_base + "Another Long File.txt").c_str());
+	remove((dc_base + "Added Long File.txt").c_str());
+	remove((dc_base + "Renamed Long File.txt").c_str());
+	remove((newdir + dc_split + "inside.txt").c_str());
+	rmdir(newdir.c_str());
+	rmdir(dc_base.c_str());
+}
+#endif
+
+} // namespace
@@ -0,0 +1,215 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "bios_disk.h"
+#include "../src/dos/drives.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+uint8_t FAT_TestByte(uint32_t pos)
+{
+	return (uint8_t)((pos * 7u) + (pos >> 9));
+}
+
+// reads the FAT16 copies straight from the disk, checks they are the same and
+// returns how many clusters they have allocated
+uint32_t FAT_DiskAllocated(fatDrive *drv)
+{
+	uint32_t bytes_sector, sectors_cluster, total_clusters, free_clusters;
+	EXPECT_TRUE(drv->AllocationInfo32(&bytes_sector, &sectors_cluster, &total_clusters, &free_clusters));
+
+	const FAT_BootSector::bpb_union_t &bpb = drv->GetBPB();
+	std::vector<uint8_t> fat[2];
+	uint8_t sector[512];
+
+	for (unsigned int fc = 0; fc < 2; fc++) {
+		for (uint32_t i = 0; i < bpb.v.BPB_FATSz16; i++) {
+			const uint32_t sect = drv->partSectOff + bpb.v.BPB_RsvdSecCnt + (fc * bpb.v.BPB_FATSz16) + i;
+			EXPECT_EQ(0, drv->loadedDisk->Read_AbsoluteSector(sect, sector));
+			fat[fc].insert(fat[fc].end(), sector, sector + sizeof(sector));
+		}
+	}
+	EXPECT_TRUE(fat[0] == fat[1]) << "FAT copies differ";
+
+	uint32_t allocated = 0;
+	for (uint32_t c = 2; c < total_clusters + 2; c++) {
+		if (fat[0][c * 2] != 0 || fat[0][c * 2 + 1] != 0) allocated++;
+	}
+	return allocated;
+}
+
+void FAT_CheckRead(DOS_File *f, uint32_t pos, uint16_t len, uint32_t filelen)
+{
+	std::vector<uint8_t> buf(len);
+	uint32_t seekto = pos;
+	uint16_t got = len;
+
+	ASSERT_TRUE(f->Seek(&seekto, DOS_SEEK_SET));
+	ASSERT_TRUE(f->Read(buf.data(), &got));
+	ASSERT_EQ((uint16_t)std::min<uint32_t>(len, filelen > pos ? filelen - pos : 0), got) << "at " << pos;
+	for (uint16_t i = 0; i < got; i++) ASSERT_EQ(FAT_TestByte(pos + i), buf[i]) << "at " << (pos + i);
+}
+
+TEST(FATDrive, AllocationAndSeeks)
+{
+	imageDiskMemory *dsk = new imageDiskMemory(16384);
+	ASSERT_TRUE(dsk->active);
+	ASSERT_EQ(0, dsk->Format());
+
+	std::vector<std::string> options;
+	dsk->Addref();
+	fatDrive *drv = new fatDrive(dsk, options);
+	dsk->Release();
+	ASSERT_TRUE(drv->created_successfully);
+
+	uint32_t bytes_sector, sectors_cluster, total_clusters, free_clusters, free_start;
+	ASSERT_TRUE(drv->AllocationInfo32(&bytes_sector, &sectors_cluster, &total_clusters, &free_start));
+	ASSERT_GE(total_clusters, 4085u); // FAT16
+	const uint32_t cluster_size = bytes_sector * sectors_cluster;
+	const uint32_t used_start = FAT_DiskAllocated(drv);
+
+	// a file written in pieces that do not line up with sectors or clusters
+	const uint32_t filelen = 300000;
+	DOS_File *f = NULL;
+	ASSERT_TRUE(drv->FileCreate(&f, "TEST.DAT", DOS_ATTR_ARCHIVE));
+	std::vector<uint8_t> buf(4000);
+	for (uint32_t pos = 0; pos < filelen;) {
+		uint16_t len = (uint16_t)std::min<uint32_t>((uint32_t)buf.size(), filelen - pos);
+		for (uint16_t i = 0; i < len; i++) buf[i] = FAT_TestByte(pos + i);
+		ASSERT_TRUE(f->Write(buf.data(), &len));
+		ASSERT_NE(0, len);
+		pos += len;
+	}
+
+	const uint32_t file_clusters = (filelen + cluster_size - 1) / cluster_size;
+	ASSERT_TRUE(drv->AllocationInfo32(&bytes_sector, &sectors_cluster, &total_clusters, &free_clusters));
+	EXPECT_EQ(free_start - file_clusters, free_clusters);
+
+	// back and forth through the file, across cluster boundaries and past the end
+	const uint32_t reads[] = { 299990, 0, cluster_size - 7, 150000, 2 * cluster_size, 1, 299999, 300000, 123456 };
+	for (const uint32_t pos : reads) FAT_CheckRead(f, pos, 600, filelen);
+
+	f->Close();
+	delete f;
+	EXPECT_EQ(used_start + file_clusters, FAT_DiskAllocated(drv));
+
+	// cut the file short, then grow it again past a hole
+	ASSERT_TRUE(drv->FileOpen(&f, "TEST.DAT", OPEN_READWRITE));
+	uint32_t seekto = 50000;
+	uint16_t len = 0;
+	ASSERT_TRUE(f->Seek(&seekto, DOS_SEEK_SET));
+	ASSERT_TRUE(f->Write(buf.data(), &len));
+	FAT_CheckRead(f, 49000, 2000, 50000);
+	FAT_CheckRead(f, 10000, 600, 50000);
+
+	seekto = 90000;
+	len = 100;
+	for (uint16_t i = 0; i < len; i++) buf[i] = FAT_TestByte(seekto + i);
+	ASSERT_TRUE(f->Seek(&seekto, DOS_SEEK_SET));
+	ASSERT_TRUE(f->Write(buf.data(), &len));
+	FAT_CheckRead(f, 90000, 100, 90100);
+	FAT_CheckRead(f, 40000, 600, 90100);
+	f->Close();
+	delete f;
+	EXPECT_EQ(used_start + (90100 + cluster_size - 1) / cluster_size, FAT_DiskAllocated(drv));
+
+	ASSERT_TRUE(drv->FileUnlink("TEST.DAT"));
+	EXPECT_EQ(used_start, FAT_DiskAllocated(drv));
+	ASSERT_TRUE(drv->AllocationInfo32(&bytes_sector, &sectors_cluster, &total_clusters, &free_clusters));
+	EXPECT_EQ(free_start, free_clusters);
+
+	delete drv;
+}
+
+// two files written a few clusters at a time take turns on the disk, so that
+// large reads and writes of either one run into the other all the time
+TEST(FATDrive, FragmentedRuns)
+{
+	imageDiskMemory *dsk = new imageDiskMemory(16384);
+	ASSERT_TRUE(dsk->active);
+	ASSERT_EQ(0, dsk->Format());
+
+	std::vector<std::string> options;
+	dsk->Addref();
+	fatDrive *drv = new fatDrive(dsk, options);
+	dsk->Release();
+	ASSERT_TRUE(drv->created_successfully);
+
+	const uint32_t cluster_size = drv->getClusterSize();
+	const uint32_t filelen = 200000;
+	const char *names[2] = { "A.DAT", "B.DAT" };
+	std::vector<uint8_t> model[2];
+	DOS_File *f[2] = { NULL, NULL };
+
+	for (unsigned int n = 0; n < 2; n++) {
+		ASSERT_TRUE(drv->FileCreate(&f[n], names[n], DOS_ATTR_ARCHIVE));
+		model[n].resize(filelen);
+		for (uint32_t i = 0; i < filelen; i++) model[n][i] = (uint8_t)(FAT_TestByte(i) + n);
+	}
+	for (uint32_t pos = 0, turn = 0; pos < filelen; turn++) {
+		const uint32_t len = std::min<uint32_t>(cluster_size * (1 + (turn % 3)), filelen - pos);
+		for (unsigned int n = 0; n < 2; n++) {
+			uint16_t wlen = (uint16_t)len;
+			ASSERT_TRUE(f[n]->Write(&model[n][pos], &wlen));
+			ASSERT_EQ(len, wlen);
+		}
+		pos += len;
+	}
+
+	// overwrite and read back in pieces of up to 64KB, aligned and not
+	std::vector<uint8_t> buf(65535);
+	const uint32_t ops[][2] = { { 1000, 65000 }, { 512, 65024 }, { 70000, 40000 }, { 150000, 65535 }, { 3, 509 } };
+	for (const auto &op : ops) {
+		uint32_t seekto = op[0];
+		uint16_t len = (uint16_t)op[1];
+		const uint32_t end = std::max<uint32_t>(filelen, op[0] + op[1]);
+		if (model[0].size() < end) model[0].resize(end);
+		for (uint32_t i = 0; i < op[1]; i++) model[0][op[0] + i] = (uint8_t)(op[0] + i * 3);
+		ASSERT_TRUE(f[0]->Seek(&seekto, DOS_SEEK_SET));
+		ASSERT_TRUE(f[0]->Write(&model[0][op[0]], &len));
+		ASSERT_EQ(op[1], len);
+	}
+
+	for (unsigned int n = 0; n < 2; n++) {
+		const uint32_t len_n = (uint32_t)model[n].size();
+		for (const uint32_t step : { 65535u, 32768u, 4097u }) {
+			uint32_t seekto = 0;
+			ASSERT_TRUE(f[n]->Seek(&seekto, DOS_SEEK_SET));
+			for (uint32_t pos = 0; pos < len_n;) {
+				uint16_t len = (uint16_t)step;
+				ASSERT_TRUE(f[n]->Read(buf.data(), &len));
+				ASSERT_EQ(std::min<uint32_t>(step, len_n - pos), len);
+				ASSERT_EQ(0, memcmp(&model[n][pos], buf.data(), len)) << names[n] << " at " << pos << " by " << step;
+				pos += len;
+			}
+		}
+		f[n]->Close();
+		delete f[n];
+	}
+
+	ASSERT_TRUE(drv->FileUnlink("A.DAT"));
+	ASSERT_TRUE(drv->FileUnlink("B.DAT"));
+	delete drv;
+}
+
+} // namespace
@@ -0,0 +1,125 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "inout.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// two ISA devices decoding the same (otherwise unused) ports
+const Bitu conflict_port = 0xDE10;
+
+unsigned int reads_a, reads_b, writes_a, writes_b;
+Bitu written_a, written_b;
+
+Bitu IOTest_ReadA(Bitu /*port*/, Bitu /*iolen*/) { reads_a++; return 0xF7; }
+Bitu IOTest_ReadB(Bitu /*port*/, Bitu /*iolen*/) { reads_b++; return 0x7F; }
+void IOTest_WriteA(Bitu /*port*/, Bitu val, Bitu /*iolen*/) { writes_a++; written_a = val; }
+void IOTest_WriteB(Bitu /*port*/, Bitu val, Bitu /*iolen*/) { writes_b++; written_b = val; }
+
+IO_ReadHandler *IOTest_CalloutReadA(IO_CalloutObject & /*co*/, Bitu /*port*/, Bitu iolen) { return iolen == 1 ? IOTest_ReadA : NULL; }
+IO_ReadHandler *IOTest_CalloutReadB(IO_CalloutObject & /*co*/, Bitu /*port*/, Bitu iolen) { return iolen == 1 ? IOTest_ReadB : NULL; }
+IO_WriteHandler *IOTest_CalloutWriteA(IO_CalloutObject & /*co*/, Bitu /*port*/, Bitu iolen) { return iolen == 1 ? IOTest_WriteA : NULL; }
+IO_WriteHandler *IOTest_CalloutWriteB(IO_CalloutObject & /*co*/, Bitu /*port*/, Bitu iolen) { return iolen == 1 ? IOTest_WriteB : NULL; }
+
+class IOHandlerTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		reads_a = reads_b = writes_a = writes_b = 0;
+		written_a = written_b = 0;
+		dev_a = install(IOTest_CalloutReadA, IOTest_CalloutWriteA);
+		dev_b = install(IOTest_CalloutReadB, IOTest_CalloutWriteB);
+	}
+
+	void TearDown() override
+	{
+		if (dev_a != IO_Callout_t_none) IO_FreeCallout(dev_a);
+		if (dev_b != IO_Callout_t_none) IO_FreeCallout(dev_b);
+		IO_EnableHotDispatch(true);
+		IO_EnableStats(false);
+	}
+
+	IO_Callout_t install(IO_ReadCalloutHandler *r, IO_WriteCalloutHandler *w)
+	{
+		IO_Callout_t c = IO_AllocateCallout(IO_TYPE_ISA);
+		EXPECT_NE(IO_Callout_t_none, c);
+		IO_CalloutObject *obj = IO_GetCallout(c);
+		EXPECT_NE((IO_CalloutObject *)NULL, obj);
+		if (obj != NULL) {
+			obj->Install(conflict_port, IOMASK_Combine(IOMASK_FULL, IOMASK_Range(16)), r, w);
+			IO_PutCallout(obj);
+		}
+		return c;
+	}
+
+	IO_Callout_t dev_a = IO_Callout_t_none;
+	IO_Callout_t dev_b = IO_Callout_t_none;
+};
+
+TEST_F(IOHandlerTest, ConflictingDevices)
+{
+	// both devices answer every access, whether or not the port has been promoted
+	for (unsigned int i = 1; i <= 32; i++) {
+		EXPECT_EQ(0x77, IO_ReadB(conflict_port));
+		IO_WriteB(conflict_port, (uint8_t)i);
+		EXPECT_EQ(i, reads_a);
+		EXPECT_EQ(i, reads_b);
+		EXPECT_EQ(i, writes_a);
+		EXPECT_EQ(i, writes_b);
+		EXPECT_EQ(i, written_a);
+		EXPECT_EQ(i, written_b);
+	}
+
+	// uninstalling one device must take the port off the direct dispatch
+	IO_FreeCallout(dev_b);
+	dev_b = IO_Callout_t_none;
+	EXPECT_EQ(0xF7, IO_ReadB(conflict_port));
+	IO_WriteB(conflict_port, 0x55);
+	EXPECT_EQ(32u, reads_b);
+	EXPECT_EQ(32u, writes_b);
+	EXPECT_EQ(0x55u, written_a);
+}
+
+TEST_F(IOHandlerTest, Statistics)
+{
+	uint64_t calls, ns, slow;
+
+	IO_EnableStats(true);
+	for (unsigned int i = 0; i < 100; i++)
+		IO_ReadB(conflict_port);
+	IO_WriteB(conflict_port, 1);
+
+	IO_GetStats(false, conflict_port, 1, calls, ns, slow);
+	EXPECT_EQ(100u, calls);
+	EXPECT_GE(slow, 1u);
+	EXPECT_LT(slow, 100u); // promoted after a few slow path scans
+	IO_GetStats(true, conflict_port, 1, calls, ns, slow);
+	EXPECT_EQ(1u, calls);
+	IO_GetStats(false, conflict_port, 2, calls, ns, slow);
+	EXPECT_EQ(0u, calls);
+
+	IO_ResetStats();
+	IO_GetStats(false, conflict_port, 1, calls, ns, slow);
+	EXPECT_EQ(0u, calls);
+
+	IO_EnableStats(false);
+	EXPECT_FALSE(IO_StatsEnabled());
+}
+
+} // namespace
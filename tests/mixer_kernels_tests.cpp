@@ -0,0 +1,155 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "mixer_kernels.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const size_t mk_frames = 1000 + 13; // odd, so that every version runs its tail too
+
+uint32_t mk_seed = 1;
+
+uint32_t MK_Random(void)
+{
+	mk_seed = mk_seed * 1103515245u + 12345u;
+	return (mk_seed >> 16) | (mk_seed << 16);
+}
+
+// random values with a fair share of the extremes, which is where the clipping
+// and wraparound of the different versions could part ways
+int32_t MK_Sample(void)
+{
+	switch (MK_Random() & 7) {
+	case 0: return INT32_MAX;
+	case 1: return INT32_MIN;
+	case 2: return (int32_t)(MK_Random() & 0xFFFF) - 0x8000;
+	default: return (int32_t)MK_Random();
+	}
+}
+
+const int32_t mk_volumes[][2] = {
+	{ 1 << MIXER_VOLSHIFT, 1 << MIXER_VOLSHIFT },
+	{ 0, 3 << MIXER_VOLSHIFT },
+	{ 12345, -777 },
+	{ INT32_MAX, INT32_MIN },
+	{ -1, 1 },
+};
+
+TEST(MixerKernels, MatchPlainC)
+{
+	const MixerKernels *ref = MIXER_GetKernels(0);
+	ASSERT_NE((const MixerKernels *)NULL, ref);
+
+	std::vector<int32_t> src(mk_frames * 2), ref_out(mk_frames * 2), out(mk_frames * 2);
+	std::vector<int16_t> ref_out16(mk_frames * 2), out16(mk_frames * 2);
+	std::vector<uint8_t> src8(mk_frames * 2);
+	std::vector<uint16_t> src16(mk_frames * 2);
+	std::vector<uint32_t> src32(mk_frames * 2);
+
+	for (size_t i = 0; i < mk_frames * 2; i++) {
+		src[i] = MK_Sample();
+		src8[i] = (uint8_t)MK_Random();
+		src16[i] = (uint16_t)MK_Random();
+		src32[i] = (uint32_t)MK_Sample();
+	}
+
+	const MixerKernels *k;
+	for (unsigned int ki = 1; (k = MIXER_GetKernels(ki)) != NULL; ki++) {
+		SCOPED_TRACE(k->name);
+
+		for (size_t frames = 0; frames <= mk_frames; frames += (frames < 40 ? 1 : 97)) {
+			for (int swap = 0; swap < 2; swap++) {
+				for (size_t i = 0; i < mk_frames * 2; i++) ref_out[i] = out[i] = MK_Sample();
+				ref->accumulate(ref_out.data(), src.data(), frames, swap != 0);
+				k->accumulate(out.data(), src.data(), frames, swap != 0);
+				ASSERT_EQ(0, memcmp(ref_out.data(), out.data(), out.size() * sizeof(int32_t))) << "accumulate, " << frames << " frames";
+			}
+
+			for (const auto &vol : mk_volumes) {
+				ref_out16.assign(ref_out16.size(), 0x5555);
+				out16.assign(out16.size(), 0x5555);
+				ref->scale_clip(ref_out16.data(), src.data(), frames, vol[0], vol[1]);
+				k->scale_clip(out16.data(), src.data(), frames, vol[0], vol[1]);
+				ASSERT_EQ(0, memcmp(ref_out16.data(), out16.data(), out16.size() * sizeof(int16_t))) << "scale_clip, " << frames << " frames";
+
+				for (int stereo = 0; stereo < 2; stereo++) {
+					for (int xr = 0; xr < 2; xr++) {
+						ref_out.assign(ref_out.size(), 0x55555555);
+						out.assign(out.size(), 0x55555555);
+						ref->load8(ref_out.data(), src8.data(), frames, stereo != 0, xr ? 0x80 : 0x00, vol[0], vol[1]);
+						k->load8(out.data(), src8.data(), frames, stereo != 0, xr ? 0x80 : 0x00, vol[0], vol[1]);
+						ASSERT_EQ(0, memcmp(ref_out.data(), out.data(), out.size() * sizeof(int32_t))) << "load8, " << frames << " frames";
+
+						ref->load16(ref_out.data(), src16.data(), frames, stereo != 0, xr ? 0x8000 : 0x0000, vol[0], vol[1]);
+						k->load16(out.data(), src16.data(), frames, stereo != 0, xr ? 0x8000 : 0x0000, vol[0], vol[1]);
+						ASSERT_EQ(0, memcmp(ref_out.data(), out.data(), out.size() * sizeof(int32_t))) << "load16, " << frames << " frames";
+					}
+
+					ref->load32(ref_out.data(), src32.data(), frames, stereo != 0, vol[0], vol[1]);
+					k->load32(out.data(), src32.data(), frames, stereo != 0, vol[0], vol[1]);
+					ASSERT_EQ(0, memcmp(ref_out.data(), out.data(), out.size() * sizeof(int32_t))) << "load32, " << frames << " frames";
+				}
+			}
+		}
+	}
+}
+
+// Microbenchmark, run with --gtest_also_run_disabled_tests: the block sizes the mixer
+// works with, 1ms of 48kHz audio for the channels and a typical audio callback for the
+// output
+TEST(MixerKernels, DISABLED_Throughput)
+{
+	const size_t frames = 1024;
+	const unsigned int rounds = 20000;
+
+	std::vector<int32_t> src(frames * 2), dst(frames * 2);
+	std::vector<int16_t> dst16(frames * 2);
+	std::vector<uint16_t> src16(frames * 2);
+	for (size_t i = 0; i < frames * 2; i++) {
+		src[i] = (int32_t)(MK_Random() & 0xFFFF) - 0x8000;
+		src16[i] = (uint16_t)MK_Random();
+	}
+
+	const MixerKernels *k;
+	for (unsigned int ki = 0; (k = MIXER_GetKernels(ki)) != NULL; ki++) {
+		double ns[3];
+
+		for (int op = 0; op < 3; op++) {
+			const auto start = std::chrono::steady_clock::now();
+			for (unsigned int r = 0; r < rounds; r++) {
+				if (op == 0) k->load16(dst.data(), src16.data(), frames, true, 0, 4096, 8192);
+				else if (op == 1) k->accumulate(dst.data(), src.data(), frames, false);
+				else k->scale_clip(dst16.data(), dst.data(), frames, 8192, 8192);
+			}
+			ns[op] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / rounds;
+		}
+
+		// keep the results alive
+		EXPECT_NE(0x7FFF7FFF, dst[0] ^ dst16[1]);
+		printf("Mixer kernels, %-5s: %7.1f ns load16, %7.1f ns accumulate, %7.1f ns scale_clip per %u frames\n",
+		       k->name, ns[0], ns[1], ns[2], (unsigned int)frames);
+	}
+}
+
+} // namespace
@@ -0,0 +1,165 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pic_queue.h"
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+void PICQueueTest_EventA(Bitu val) { (void)val; }
+void PICQueueTest_EventB(Bitu val) { (void)val; }
+void PICQueueTest_EventC(Bitu val) { (void)val; }
+
+PICEntry *add_event(PIC_EventQueue &queue, PIC_EventHandler handler, pic_tickindex_t index, Bitu val)
+{
+	PICEntry *entry = queue.alloc();
+	if (entry != NULL) {
+		entry->index = index;
+		entry->pic_event = handler;
+		entry->value = val;
+		queue.push(entry);
+	}
+	return entry;
+}
+
+// pop everything, returning the values in the order they would be dispatched
+std::vector<Bitu> drain(PIC_EventQueue &queue)
+{
+	std::vector<Bitu> order;
+	while (queue.top() != NULL) {
+		PICEntry *entry = queue.pop();
+		order.push_back(entry->value);
+		queue.release(entry);
+	}
+	return order;
+}
+
+TEST(PIC_EventQueue, DispatchOrder)
+{
+	std::unique_ptr<PIC_EventQueue> queue(new PIC_EventQueue);
+	add_event(*queue, PICQueueTest_EventA, 0.50, 3);
+	add_event(*queue, PICQueueTest_EventB, 0.25, 1);
+	add_event(*queue, PICQueueTest_EventC, 0.75, 5);
+	add_event(*queue, PICQueueTest_EventA, 0.25, 2); // same time as value 1, added later
+	add_event(*queue, PICQueueTest_EventB, 0.50, 4);
+	EXPECT_EQ(5u, queue->size());
+	EXPECT_EQ(std::vector<Bitu>({1, 2, 3, 4, 5}), drain(*queue));
+	EXPECT_EQ(0u, queue->size());
+}
+
+TEST(PIC_EventQueue, RemoveByHandler)
+{
+	std::unique_ptr<PIC_EventQueue> queue(new PIC_EventQueue);
+	for (Bitu i = 0; i < 100; i++)
+		add_event(*queue, (i % 3) == 0 ? PICQueueTest_EventA : PICQueueTest_EventB, (pic_tickindex_t)(100 - i) / 100, i);
+
+	queue->remove(PICQueueTest_EventA);
+	EXPECT_EQ(66u, queue->size());
+	queue->remove(PICQueueTest_EventB, 50);
+	queue->remove(PICQueueTest_EventB, 51); // multiple of 3, belongs to EventA
+	EXPECT_EQ(65u, queue->size());
+	queue->remove(PICQueueTest_EventC);
+	EXPECT_EQ(65u, queue->size());
+
+	const std::vector<Bitu> order = drain(*queue);
+	ASSERT_EQ(65u, order.size());
+	for (size_t i = 1; i < order.size(); i++)
+		EXPECT_GT(order[i - 1], order[i]);
+	for (size_t i = 0; i < order.size(); i++) {
+		EXPECT_NE(0u, order[i] % 3);
+		EXPECT_NE(50u, order[i]);
+	}
+}
+
+TEST(PIC_EventQueue, ShiftAndRestore)
+{
+	std::unique_ptr<PIC_EventQueue> queue(new PIC_EventQueue);
+	add_event(*queue, PICQueueTest_EventA, 1.5, 2);
+	add_event(*queue, PICQueueTest_EventB, 1.25, 1);
+	queue->shift(1.0);
+	EXPECT_EQ((pic_tickindex_t)0.25, queue->top()->index);
+
+	// save state format: the events linked in dispatch order
+	uint16_t next_idx[PIC_QUEUESIZE];
+	for (unsigned int i = 0; i < PIC_QUEUESIZE; i++)
+		next_idx[i] = 0xffff;
+	const uint16_t first = (uint16_t)(queue->top() - queue->entries);
+	PICEntry *second = queue->at(1);
+	next_idx[first] = (uint16_t)(second - queue->entries);
+
+	queue->restore(next_idx, first);
+	EXPECT_EQ(2u, queue->size());
+	EXPECT_EQ(std::vector<Bitu>({1, 2}), drain(*queue));
+
+	// every entry must be back on the free list
+	unsigned int free_count = 0;
+	while (queue->alloc() != NULL)
+		free_count++;
+	EXPECT_EQ((unsigned int)PIC_QUEUESIZE, free_count);
+}
+
+TEST(PIC_EventQueue, Full)
+{
+	std::unique_ptr<PIC_EventQueue> queue(new PIC_EventQueue);
+	for (unsigned int i = 0; i < PIC_QUEUESIZE; i++)
+		ASSERT_NE((PICEntry *)NULL, add_event(*queue, PICQueueTest_EventA, 1.0, i));
+	EXPECT_EQ((PICEntry *)NULL, queue->alloc());
+	queue->remove(PICQueueTest_EventA, 7);
+	EXPECT_NE((PICEntry *)NULL, add_event(*queue, PICQueueTest_EventB, 0.5, 7));
+	EXPECT_EQ(7u, queue->top()->value);
+}
+
+// Microbenchmark, run with --gtest_also_run_disabled_tests: a steady state of "pending"
+// events from several devices, where each round adds one event, cancels one by handler
+// and value (what the sound cards and the PIT do when reprogrammed) and dispatches the
+// next one due.
+TEST(PIC_EventQueue, DISABLED_Throughput)
+{
+	const PIC_EventHandler handlers[3] = {PICQueueTest_EventA, PICQueueTest_EventB, PICQueueTest_EventC};
+	const unsigned int rounds = 1000000;
+	std::unique_ptr<PIC_EventQueue> queue(new PIC_EventQueue);
+
+	for (unsigned int pending = 16; pending <= 1024; pending *= 4) {
+		queue->clear();
+		pic_tickindex_t now = 0;
+		for (unsigned int i = 0; i < pending; i++)
+			add_event(*queue, handlers[i % 3], (pic_tickindex_t)((i * 7919u) % pending) / pending, i);
+
+		const auto start = std::chrono::steady_clock::now();
+		for (unsigned int r = 0; r < rounds; r++) {
+			const Bitu val = pending + r;
+			add_event(*queue, handlers[r % 3], now + (pic_tickindex_t)((r * 7919u) % pending) / pending, val);
+			add_event(*queue, handlers[(r + 1) % 3], now + 2.0, val);
+			queue->remove(handlers[(r + 1) % 3], val);
+
+			PICEntry *entry = queue->pop();
+			now = entry->index;
+			queue->release(entry);
+		}
+		const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		EXPECT_EQ(pending, queue->size());
+		printf("PIC event queue, %4u pending: %.1f ns per add+cancel+dispatch round\n", pending, secs * 1e9 / rounds);
+	}
+}
+
+} // namespace
@@ -0,0 +1,266 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "qcow2_disk.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+namespace {
+
+// 64KB clusters, 32MB disk: header, refcount table, one refcount block and the L1 table
+const uint32_t qc_cluster = 65536;
+const uint64_t qc_size = 32ull * 1024 * 1024;
+const uint32_t qc_sectors = (uint32_t)(qc_size / 512);
+
+void QC_Put32(uint8_t *p, uint32_t v)
+{
+	for (int i = 3; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+}
+
+void QC_Put64(uint8_t *p, uint64_t v)
+{
+	for (int i = 7; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+}
+
+uint64_t QC_Get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+	return v;
+}
+
+// an empty image, laid out the way qemu-img lays out a new one, with room for more
+std::vector<uint8_t> QC_Layout(uint32_t version, unsigned int clusters)
+{
+	std::vector<uint8_t> img(clusters * qc_cluster, 0);
+	uint8_t *h = img.data();
+	QC_Put32(h + 0, QCow2Image::magic);
+	QC_Put32(h + 4, version);
+	QC_Put32(h + 20, 16);               // cluster bits
+	QC_Put64(h + 24, qc_size);
+	QC_Put32(h + 36, 1);                // L1 entries, each L2 table covers 512MB
+	QC_Put64(h + 40, 3 * qc_cluster);   // L1 table
+	QC_Put64(h + 48, 1 * qc_cluster);   // refcount table
+	QC_Put32(h + 56, 1);                // refcount table clusters
+	if (version >= 3) {
+		QC_Put32(h + 96, 4);            // refcount order, 16 bits
+		QC_Put32(h + 100, 104);         // header length
+	}
+
+	QC_Put64(&img[1 * qc_cluster], 2 * qc_cluster);
+	for (unsigned int c = 0; c < 4; c++) img[2 * qc_cluster + c * 2 + 1] = 1;
+	return img;
+}
+
+FILE *QC_Write(const std::vector<uint8_t> &img)
+{
+	FILE *f = tmpfile();
+	if (f == NULL) return NULL;
+	if (fwrite(img.data(), img.size(), 1, f) != 1) {
+		fclose(f);
+		return NULL;
+	}
+	fflush(f);
+	return f;
+}
+
+void QC_FillSector(uint8_t *p, uint32_t sect)
+{
+	for (unsigned int i = 0; i < 512; i++) p[i] = (uint8_t)((sect * 11u) + (i * 3u) + 1u);
+	memcpy(p, &sect, sizeof(sect));
+}
+
+TEST(QCow2Image, WriteReadBack)
+{
+	FILE *f = QC_Write(QC_Layout(2, 4));
+	ASSERT_NE((FILE *)NULL, f);
+	QCow2Image::QCow2Header header = QCow2Image::read_header(f);
+	ASSERT_EQ(QCow2Image::magic, header.magic);
+
+	// runs across cluster boundaries, one at a time and many at a time, and one far away
+	const uint32_t far_sect = qc_sectors - 5;
+	std::vector<uint8_t> buf(512 * 300), want(512 * 300);
+	for (uint32_t i = 0; i < 300; i++) QC_FillSector(&want[i * 512], 100 + i);
+	{
+		QCow2Image img(header, f, "test.qcow2", 512);
+		uint8_t sector[512];
+		ASSERT_EQ(0, img.read_sector(100, sector));
+		EXPECT_EQ(std::vector<uint8_t>(512, 0), std::vector<uint8_t>(sector, sector + 512));
+
+		for (uint32_t i = 0; i < 20; i++) ASSERT_EQ(0, img.write_sector(100 + i, &want[i * 512]));
+		ASSERT_EQ(0, img.write_sectors(120, 280, &want[20 * 512]));
+		QC_FillSector(sector, far_sect);
+		ASSERT_EQ(0, img.write_sector(far_sect, sector));
+
+		ASSERT_EQ(0, img.read_sectors(100, 300, buf.data()));
+		EXPECT_EQ(0, memcmp(want.data(), buf.data(), buf.size()));
+		EXPECT_GT(img.stats.l2_hits, img.stats.l2_misses);
+	}
+
+	// the metadata has to be in the file for a new instance to find the data
+	header = QCow2Image::read_header(f);
+	QCow2Image img(header, f, "test.qcow2", 512);
+	for (uint32_t i = 0; i < 300; i++) {
+		ASSERT_EQ(0, img.read_sector(100 + i, &buf[i * 512]));
+	}
+	EXPECT_EQ(0, memcmp(want.data(), buf.data(), buf.size()));
+	EXPECT_GT(img.stats.cluster_hits, 0u);
+	uint8_t sector[512], far_want[512];
+	QC_FillSector(far_want, far_sect);
+	ASSERT_EQ(0, img.read_sector(far_sect, sector));
+	EXPECT_EQ(0, memcmp(far_want, sector, 512));
+	ASSERT_EQ(0, img.read_sector(99, sector));
+	EXPECT_EQ(std::vector<uint8_t>(512, 0), std::vector<uint8_t>(sector, sector + 512));
+	EXPECT_NE(0, img.read_sector(qc_sectors, sector));
+
+	// one L2 table and five data clusters were added, each with a reference
+	fflush(f);
+	ASSERT_EQ(0, fseek(f, 0, SEEK_END));
+	EXPECT_EQ((long)(10 * qc_cluster), ftell(f));
+	std::vector<uint8_t> refcounts(qc_cluster);
+	ASSERT_EQ(0, fseek(f, 2 * qc_cluster, SEEK_SET));
+	ASSERT_EQ(1u, fread(refcounts.data(), refcounts.size(), 1, f));
+	for (unsigned int c = 0; c < 10; c++) EXPECT_EQ(1, refcounts[c * 2 + 1]) << "cluster " << c;
+	EXPECT_EQ(0, refcounts[10 * 2 + 1]);
+
+	uint8_t l1[8];
+	ASSERT_EQ(0, fseek(f, 3 * qc_cluster, SEEK_SET));
+	ASSERT_EQ(1u, fread(l1, sizeof(l1), 1, f));
+	EXPECT_EQ(4ull * qc_cluster, QC_Get64(l1) & 0x00FFFFFFFFFFFFFFull);
+
+	fclose(f);
+}
+
+} // namespace
+
+namespace {
+
+// raw deflate with the 4KB window qemu-img uses for compressed clusters
+std::vector<uint8_t> QC_Deflate(const std::vector<uint8_t> &in)
+{
+	std::vector<uint8_t> out(in.size() + 1024);
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	EXPECT_EQ(Z_OK, deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -12, 9, Z_DEFAULT_STRATEGY));
+	z.next_in = const_cast<uint8_t *>(in.data());
+	z.avail_in = (uInt)in.size();
+	z.next_out = out.data();
+	z.avail_out = (uInt)out.size();
+	EXPECT_EQ(Z_STREAM_END, deflate(&z, Z_FINISH));
+	out.resize(z.total_out);
+	deflateEnd(&z);
+	return out;
+}
+
+// L2 entry of a compressed cluster: offset, then the count of 512 byte sectors after the first
+uint64_t QC_CompressedEntry(uint64_t offset, size_t len)
+{
+	const uint64_t extra = ((offset & 511) + len + 511) / 512 - 1;
+	return (1ull << 62) | offset | (extra << (62 - (16 - 8)));
+}
+
+TEST(QCow2Image, CompressedAndZeroClusters)
+{
+	// clusters 4: L2 table, 5: preallocated for a zero cluster, 6: two compressed clusters
+	std::vector<uint8_t> img = QC_Layout(3, 7);
+	QC_Put64(&img[3 * qc_cluster], (1ull << 63) | (4 * qc_cluster));
+
+	std::vector<uint8_t> plain[2];
+	std::vector<uint8_t> packed[2];
+	for (int i = 0; i < 2; i++) {
+		plain[i].resize(qc_cluster);
+		for (uint32_t sect = 0; sect < qc_cluster / 512; sect++)
+			QC_FillSector(&plain[i][sect * 512], i * 384 + sect);
+		packed[i] = QC_Deflate(plain[i]);
+		ASSERT_LT(packed[i].size(), (size_t)qc_cluster / 4);
+	}
+	const uint64_t packed_at[2] = { 6 * qc_cluster + 100, 6 * qc_cluster + 100 + packed[0].size() };
+	for (int i = 0; i < 2; i++) memcpy(&img[packed_at[i]], packed[i].data(), packed[i].size());
+	memset(&img[5 * qc_cluster], 0xAA, qc_cluster);
+
+	uint8_t *l2 = &img[4 * qc_cluster];
+	QC_Put64(l2 + 0 * 8, QC_CompressedEntry(packed_at[0], packed[0].size()));
+	QC_Put64(l2 + 1 * 8, 1);                                       // zero, nothing allocated
+	QC_Put64(l2 + 2 * 8, (1ull << 63) | (5 * qc_cluster) | 1);     // zero, preallocated
+	QC_Put64(l2 + 3 * 8, QC_CompressedEntry(packed_at[1], packed[1].size()));
+	uint8_t *refcounts = &img[2 * qc_cluster];
+	refcounts[4 * 2 + 1] = 1;
+	refcounts[5 * 2 + 1] = 1;
+	refcounts[6 * 2 + 1] = 2;
+
+	// the second compressed cluster ends the file partway through a sector
+	img.resize(packed_at[1] + packed[1].size());
+	FILE *f = QC_Write(img);
+	ASSERT_NE((FILE *)NULL, f);
+	QCow2Image::QCow2Header header = QCow2Image::read_header(f);
+
+	const uint32_t spc = qc_cluster / 512;
+	std::vector<uint8_t> want(4 * qc_cluster, 0), buf(4 * qc_cluster);
+	memcpy(&want[0], plain[0].data(), qc_cluster);
+	memcpy(&want[3 * qc_cluster], plain[1].data(), qc_cluster);
+	uint8_t sector[512], zeros[512] = {0};
+	{
+		QCow2Image image(header, f, "test.qcow2", 512);
+		ASSERT_EQ(0, image.read_sectors(0, 4 * spc, buf.data()));
+		EXPECT_EQ(0, memcmp(want.data(), buf.data(), buf.size()));
+		for (uint32_t sect = 0; sect < 4 * spc; sect += 7) {
+			ASSERT_EQ(0, image.read_sector(sect, sector));
+			ASSERT_EQ(0, memcmp(&want[sect * 512], sector, 512)) << "sector " << sect;
+		}
+		EXPECT_EQ(2u, image.stats.compressed_reads);
+		EXPECT_GT(image.stats.compressed_hits, 0u);
+
+		// a write takes the compressed cluster into a new one, the zero cluster into its own
+		QC_FillSector(sector, 5000);
+		ASSERT_EQ(0, image.write_sector(3, sector));
+		memcpy(&want[3 * 512], sector, 512);
+		QC_FillSector(sector, 5001);
+		ASSERT_EQ(0, image.write_sector(2 * spc + 1, sector));
+		memcpy(&want[(2 * spc + 1) * 512], sector, 512);
+
+		// zeros where there already are zeros take no space
+		ASSERT_EQ(0, image.write_sector(spc + 5, zeros));
+		ASSERT_EQ(0, image.write_sector(10 * spc, zeros));
+	}
+
+	QCow2Image image(header, f, "test.qcow2", 512);
+	ASSERT_EQ(0, image.read_sectors(0, 4 * spc, buf.data()));
+	EXPECT_EQ(0, memcmp(want.data(), buf.data(), buf.size()));
+	ASSERT_EQ(0, image.read_sector(10 * spc, sector));
+	EXPECT_EQ(0, memcmp(zeros, sector, 512));
+
+	// only the compressed cluster that was written to needed a cluster of its own
+	fflush(f);
+	ASSERT_EQ(0, fseek(f, 0, SEEK_END));
+	EXPECT_EQ((long)(8 * qc_cluster), ftell(f));
+	std::vector<uint8_t> file_refcounts(64);
+	ASSERT_EQ(0, fseek(f, 2 * qc_cluster, SEEK_SET));
+	ASSERT_EQ(1u, fread(file_refcounts.data(), file_refcounts.size(), 1, f));
+	EXPECT_EQ(1, file_refcounts[5 * 2 + 1]);
+	EXPECT_EQ(2, file_refcounts[6 * 2 + 1]);
+	EXPECT_EQ(1, file_refcounts[7 * 2 + 1]);
+	EXPECT_EQ(0, file_refcounts[8 * 2 + 1]);
+
+	fclose(f);
+}
+
+} // namespace
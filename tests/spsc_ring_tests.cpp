@@ -0,0 +1,104 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "spsc_ring.h"
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+#include <thread>
+#endif
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(SPSCRing, Wraparound)
+{
+	SPSCRing ring;
+	ring.resize(100); // rounded up
+	ASSERT_EQ(128u, ring.capacity());
+	EXPECT_EQ(128u, ring.writable());
+	EXPECT_EQ(0u, ring.readable());
+
+	// walk the positions around the end of the buffer a few times
+	uint8_t in[48], out[48];
+	for (unsigned int round = 0; round < 20; round++) {
+		for (unsigned int i = 0; i < sizeof(in); i++) in[i] = (uint8_t)(round * 31 + i);
+		ASSERT_TRUE(ring.write(in, 20, in + 20, 28));
+		EXPECT_EQ(48u, ring.readable());
+		EXPECT_EQ(80u, ring.writable());
+		memset(out, 0, sizeof(out));
+		ASSERT_EQ(48u, ring.read(out, 100));
+		EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+		EXPECT_EQ(0u, ring.readable());
+	}
+}
+
+TEST(SPSCRing, AllOrNothing)
+{
+	SPSCRing ring;
+	ring.resize(64);
+
+	uint8_t buf[64] = {0};
+	ASSERT_TRUE(ring.write(buf, 40));
+	EXPECT_FALSE(ring.write(buf, 16, buf, 16)); // 32 > 24, nothing written
+	EXPECT_EQ(40u, ring.readable());
+	EXPECT_TRUE(ring.write(buf, 24));
+	EXPECT_EQ(0u, ring.writable());
+
+	EXPECT_EQ(10u, ring.skip(10));
+	EXPECT_EQ(54u, ring.readable());
+	EXPECT_EQ(54u, ring.skip(1000));
+	EXPECT_EQ(0u, ring.read(buf, sizeof(buf)));
+}
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+// one thread writes a counting sequence in odd sized pieces, the other reads it
+// back in other odd sized pieces and must see every value once and in order
+TEST(SPSCRing, TwoThreads)
+{
+	const uint32_t count = 1000000;
+	SPSCRing ring;
+	ring.resize(4096);
+
+	std::thread producer([&ring, count] {
+		uint32_t next = 0, piece[37];
+		while (next < count) {
+			uint32_t n = 1 + (next % 37);
+			if (n > count - next) n = count - next;
+			for (uint32_t i = 0; i < n; i++) piece[i] = next + i;
+			if (ring.write(piece, n * sizeof(uint32_t))) next += n;
+			else std::this_thread::yield();
+		}
+	});
+
+	uint32_t expect = 0, piece[53];
+	bool ordered = true;
+	while (expect < count) {
+		// whole values only, the producer writes nothing else
+		const size_t got = ring.read(piece, (1 + (expect % 53)) * sizeof(uint32_t));
+		if (got == 0) std::this_thread::yield();
+		for (size_t i = 0; i < got / sizeof(uint32_t); i++)
+			if (piece[i] != expect++) ordered = false;
+	}
+
+	producer.join();
+	EXPECT_TRUE(ordered);
+	EXPECT_EQ(count, expect);
+}
+#endif
+
+} // namespace
@@ -21,10 +21,21 @@
 
 // The following are source files containing unit tests.
 
+#include "bios_disk_io_tests.cpp"
+#include "bios_vhd_tests.cpp"
 #include "dos_files_tests.cpp"
+#include "drive_cache_tests.cpp"
+#include "drive_fat_tests.cpp"
 #include "drives_tests.cpp"
+#include "iohandler_tests.cpp"
+#include "mixer_kernels_tests.cpp"
+#include "pic_queue_tests.cpp"
+#include "qcow2_disk_tests.cpp"
 #include "shell_cmds_tests.cpp"
 #include "shell_redirection_tests.cpp"
+#include "spsc_ring_tests.cpp"
+#include "xbrz_tests.cpp"
+#include "zmbv_tests.cpp"
 
 #else
 //google test code causes problem on win9x, remove them and add empty implementations for linkage.
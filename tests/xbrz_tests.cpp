@@ -0,0 +1,162 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "sdlmain.h"
+
+#if C_XBRZ
+#include <output/output_tools_xbrz.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const int xb_width = 640;
+const int xb_height = 480;
+
+// blocky shapes with antialiased looking edges, so that xBRZ has something to blend
+std::vector<uint32_t> XB_Frame(uint32_t seed)
+{
+	std::vector<uint32_t> frame((size_t)(xb_width * xb_height));
+	for (int y = 0; y < xb_height; y++) {
+		for (int x = 0; x < xb_width; x++) {
+			const uint32_t cell = ((uint32_t)(x / 7) * 2654435761u) ^ ((uint32_t)(y / 5) * 40503u) ^ seed;
+			frame[(size_t)(y * xb_width + x)] = (cell & 0x3) ? 0x000000u : (cell & 0xFFFFFFu);
+		}
+	}
+	return frame;
+}
+
+std::vector<uint32_t> XB_Render(const std::vector<uint32_t> &frame, const uint16_t *changedLines, int threads, int factor)
+{
+	std::vector<uint32_t> out((size_t)(xb_width * xb_height * factor * factor), 0xDEADBEEFu);
+	xBRZ_SetThreads(threads);
+	xBRZ_Render(frame.data(), out.data(), changedLines, xb_width, xb_height, factor);
+	return out;
+}
+
+class xBRZ : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		saved_height = sdl.draw.height;
+		saved_granularity = sdl_xbrz.task_granularity;
+		sdl.draw.height = xb_height;
+		sdl_xbrz.task_granularity = 16;
+	}
+	void TearDown() override
+	{
+		sdl.draw.height = saved_height;
+		sdl_xbrz.task_granularity = saved_granularity;
+		xBRZ_SetThreads(0);
+	}
+	Bitu saved_height = 0;
+	int saved_granularity = 0;
+};
+
+// every split of the frame gives the same picture as scaling it in one go
+TEST_F(xBRZ, ThreadsMatchSingle)
+{
+	const std::vector<uint32_t> frame = XB_Frame(1);
+	for (int factor = 2; factor <= 5; factor++) {
+		const std::vector<uint32_t> single = XB_Render(frame, NULL, 1, factor);
+		EXPECT_EQ(single, XB_Render(frame, NULL, 4, factor)) << factor << "x";
+		EXPECT_EQ(single, XB_Render(frame, NULL, 0, factor)) << factor << "x";
+	}
+}
+
+// only the changed lines and the two lines around them are scaled again
+TEST_F(xBRZ, ChangedLines)
+{
+	const std::vector<uint32_t> before = XB_Frame(1);
+	std::vector<uint32_t> after = before;
+	const std::vector<uint32_t> other = XB_Frame(2);
+	for (int y = 100; y < 140; y++)
+		for (int x = 0; x < xb_width; x++) after[(size_t)(y * xb_width + x)] = other[(size_t)(y * xb_width + x)];
+	for (int y = 300; y < 301; y++)
+		for (int x = 0; x < xb_width; x++) after[(size_t)(y * xb_width + x)] = other[(size_t)(y * xb_width + x)];
+
+	// skip 100, change 40, skip 160, change 1, skip the rest
+	const uint16_t changed[] = { 100, 40, 160, 1, xb_height - 301 };
+	const int factor = 3;
+	const std::vector<uint32_t> full = XB_Render(after, NULL, 1, factor);
+
+	for (int threads = 1; threads <= 4; threads += 3) {
+		std::vector<uint32_t> out = XB_Render(before, NULL, 1, factor);
+		xBRZ_SetThreads(threads);
+		xBRZ_Render(after.data(), out.data(), changed, xb_width, xb_height, factor);
+		EXPECT_EQ(full, out) << threads << " threads";
+	}
+}
+
+TEST_F(xBRZ, PostScale)
+{
+	const std::vector<uint32_t> frame = XB_Frame(3);
+	const int tw = 1024, th = 768;
+	for (int bilinear = 0; bilinear < 2; bilinear++) {
+		std::vector<uint32_t> single((size_t)(tw * th)), pooled((size_t)(tw * th));
+		xBRZ_SetThreads(1);
+		xBRZ_PostScale(frame.data(), xb_width, xb_height, xb_width * 4, single.data(), tw, th, tw * 4, bilinear != 0, 16);
+		xBRZ_SetThreads(4);
+		xBRZ_PostScale(frame.data(), xb_width, xb_height, xb_width * 4, pooled.data(), tw, th, tw * 4, bilinear != 0, 16);
+		EXPECT_EQ(single, pooled) << (bilinear ? "bilinear" : "nearest");
+	}
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests: frame time of a whole 640x480
+// frame, scaled on one thread and on every core
+TEST_F(xBRZ, DISABLED_FrameTime)
+{
+	const std::vector<uint32_t> frame = XB_Frame(4);
+	const int frames = 5;
+
+	for (int factor = 2; factor <= 5; factor++) {
+		std::vector<uint32_t> out((size_t)(xb_width * xb_height * factor * factor));
+		double ms[2];
+		for (int pass = 0; pass < 2; pass++) {
+			xBRZ_SetThreads(pass ? 0 : 1);
+			xBRZ_Render(frame.data(), out.data(), NULL, xb_width, xb_height, factor); // starts the threads
+
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; i++)
+				xBRZ_Render(frame.data(), out.data(), NULL, xb_width, xb_height, factor);
+			ms[pass] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+		}
+		printf("xBRZ %dx %dx%d: %7.2f ms per frame on 1 thread, %7.2f ms on every core\n",
+		       factor, xb_width, xb_height, ms[0], ms[1]);
+	}
+
+	const int tw = 1920, th = 1440;
+	std::vector<uint32_t> out((size_t)(tw * th));
+	double ms[2];
+	for (int pass = 0; pass < 2; pass++) {
+		xBRZ_SetThreads(pass ? 0 : 1);
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++)
+			xBRZ_PostScale(frame.data(), xb_width, xb_height, xb_width * 4, out.data(), tw, th, tw * 4, true, 16);
+		ms[pass] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	}
+	printf("xBRZ bilinear post scale to %dx%d: %7.2f ms per frame on 1 thread, %7.2f ms on every core\n",
+	       tw, th, ms[0], ms[1]);
+}
+
+} // namespace
+
+#endif // C_XBRZ
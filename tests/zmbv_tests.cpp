@@ -0,0 +1,199 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+
+#if (C_SSHOT)
+#include <zlib.h>
+#include "../src/libs/zmbv/zmbv.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+uint32_t zm_seed = 1;
+
+uint32_t ZM_Random(void)
+{
+	zm_seed = zm_seed * 1103515245u + 12345u;
+	return (zm_seed >> 16) | (zm_seed << 16);
+}
+
+// Frames that move like a game does: a background scrolling by a few pixels, sprites
+// moving over it, a counter that changes every frame and, now and then, noise. Pixels
+// are packed rows of width * bytes, the top byte of 32 bit pixels is left random.
+std::vector<std::vector<uint8_t>> ZM_Frames(int width, int height, int bytes, int count)
+{
+	std::vector<std::vector<uint8_t>> frames;
+	for (int f = 0; f < count; f++) {
+		std::vector<uint8_t> frame((size_t)(width * height * bytes));
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				const int sx = x + f * 3, sy = y + f;
+				uint32_t c = ((uint32_t)(sx / 24) * 2654435761u) ^ ((uint32_t)(sy / 16) * 40503u);
+				if (((sx % 24) < 2) || ((sy % 16) < 1)) c = 0x202020u;
+				for (int s = 0; s < 6; s++) {
+					const int px = (s * 173 + f * (5 + s)) % width, py = (s * 97 + f * (3 - s)) % height;
+					if (x >= px && x < px + 40 && y >= ((py + height) % height) && y < ((py + height) % height) + 32)
+						c = 0xF0E010u * (uint32_t)(s + 1);
+				}
+				if (y < 8 && x < 64) c = (uint32_t)(f * 7919) ^ (uint32_t)(x / 8);
+				if ((f % 10) == 9 && y >= height / 2 && y < height / 2 + 8) c = ZM_Random();
+				uint8_t *p = &frame[(size_t)((y * width + x) * bytes)];
+				for (int b = 0; b < bytes; b++) p[b] = (uint8_t)(c >> (b * 8));
+				if (bytes == 4) p[3] = (uint8_t)ZM_Random();
+			}
+		}
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+struct ZM_Stream {
+	std::vector<std::vector<uint8_t>> chunks;
+	double ms = 0;
+};
+
+ZM_Stream ZM_Encode(const ZMBVKernels *k, const std::vector<std::vector<uint8_t>> &frames,
+                    int width, int height, int bytes, zmbv_format_t format)
+{
+	ZM_Stream stream;
+	VideoCodec codec;
+	codec.SetKernels(k);
+	EXPECT_TRUE(codec.SetupCompress(width, height));
+	const int size = codec.NeededSize(width, height, format);
+	std::vector<uint8_t> buf((size_t)size);
+	char pal[256 * 4];
+	for (int i = 0; i < 256 * 4; i++) pal[i] = (char)i;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t f = 0; f < frames.size(); f++) {
+		EXPECT_TRUE(codec.PrepareCompressFrame(f % 300 == 0 ? 1 : 0, format, pal, buf.data(), size));
+		for (int y = 0; y < height; y++) {
+			void *row = (void *)&frames[f][(size_t)(y * width * bytes)];
+			codec.CompressLines(1, &row);
+		}
+		const int written = codec.FinishCompressFrame();
+		EXPECT_GT(written, 0);
+		stream.chunks.push_back(std::vector<uint8_t>(buf.begin(), buf.begin() + written));
+	}
+	stream.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return stream;
+}
+
+// the same counts and the same early stops as the plain C version, for every block size
+// the codec uses and the odd sizes at the right and bottom edge
+TEST(ZMBVKernels, CompareMatchPlainC)
+{
+	const ZMBVKernels *ref = ZMBV_GetKernels(0);
+	ASSERT_NE((const ZMBVKernels *)NULL, ref);
+
+	const int pitch = 64 * 4;
+	std::vector<uint8_t> a((size_t)(pitch * 16)), b((size_t)(pitch * 16));
+	for (size_t i = 0; i < a.size(); i++) {
+		a[i] = (uint8_t)ZM_Random();
+		b[i] = (ZM_Random() & 7) ? a[i] : (uint8_t)ZM_Random();
+	}
+	// some pixels that only differ in the top byte, which 32 bit compares ignore
+	for (size_t i = 3; i < a.size(); i += 28) b[i] = (uint8_t)~a[i];
+
+	const ZMBVKernels *k;
+	for (unsigned int ki = 1; (k = ZMBV_GetKernels(ki)) != NULL; ki++) {
+		SCOPED_TRACE(k->name);
+		for (int dx = 1; dx <= 16; dx++) {
+			for (int dy = 1; dy <= 16; dy += 5) {
+				for (int limit = 1; limit <= 256; limit *= 4) {
+					EXPECT_EQ(ref->compare8(a.data(), b.data(), pitch, dx, dy, limit), k->compare8(a.data(), b.data(), pitch, dx, dy, limit)) << dx << "x" << dy;
+					EXPECT_EQ(ref->compare16(a.data(), b.data(), pitch, dx, dy, limit), k->compare16(a.data(), b.data(), pitch, dx, dy, limit)) << dx << "x" << dy;
+					EXPECT_EQ(ref->compare32(a.data(), b.data(), pitch, dx, dy, limit), k->compare32(a.data(), b.data(), pitch, dx, dy, limit)) << dx << "x" << dy;
+				}
+			}
+		}
+
+		std::vector<uint8_t> ref_out(a.size(), 0x55), out(a.size(), 0x55);
+		for (int bytes = 1; bytes <= 64; bytes += 7) {
+			ref->xor_block(ref_out.data(), bytes, a.data(), pitch, b.data(), pitch, bytes, 16);
+			k->xor_block(out.data(), bytes, a.data(), pitch, b.data(), pitch, bytes, 16);
+			EXPECT_EQ(ref_out, out) << bytes << " bytes";
+		}
+	}
+}
+
+// every version writes the same stream, and it decodes to the frames that went in
+TEST(ZMBVKernels, EncodeMatchPlainC)
+{
+	const int width = 320, height = 200;
+	const struct { int bytes; zmbv_format_t format; } formats[] = {
+		{ 1, ZMBV_FORMAT_8BPP }, { 2, ZMBV_FORMAT_16BPP }, { 4, ZMBV_FORMAT_32BPP }
+	};
+
+	for (const auto &fmt : formats) {
+		const std::vector<std::vector<uint8_t>> frames = ZM_Frames(width, height, fmt.bytes, 12);
+		const ZM_Stream ref = ZM_Encode(ZMBV_GetKernels(0), frames, width, height, fmt.bytes, fmt.format);
+
+		const ZMBVKernels *k;
+		for (unsigned int ki = 0; (k = ZMBV_GetKernels(ki)) != NULL; ki++) {
+			SCOPED_TRACE(k->name);
+			const ZM_Stream stream = ZM_Encode(k, frames, width, height, fmt.bytes, fmt.format);
+			EXPECT_TRUE(ref.chunks == stream.chunks) << fmt.bytes << " bytes per pixel";
+
+			VideoCodec decoder;
+			decoder.SetKernels(k);
+			ASSERT_TRUE(decoder.SetupDecompress(width, height));
+			const int rowlen = width * 3 + (width & 3);
+			std::vector<uint8_t> out((size_t)(rowlen * height));
+			for (size_t f = 0; f < frames.size(); f++) {
+				std::vector<uint8_t> chunk = stream.chunks[f];
+				ASSERT_TRUE(decoder.DecompressFrame(chunk.data(), (int)chunk.size()));
+				if (fmt.bytes != 4) continue;
+				decoder.Output_UpsideDown_24(out.data());
+				for (int y = 0; y < height; y++) {
+					const uint8_t *src = &frames[f][(size_t)(y * width * 4)];
+					const uint8_t *dst = &out[(size_t)((height - 1 - y) * rowlen)];
+					for (int x = 0; x < width; x++)
+						ASSERT_EQ(0, memcmp(src + x * 4, dst + x * 3, 3)) << "frame " << f << " at " << x << "," << y;
+				}
+			}
+		}
+	}
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests: lossless 1024x768x32 capture,
+// which has to keep up with 60 or 70 frames a second
+TEST(ZMBVKernels, DISABLED_EncodeThroughput)
+{
+	const int width = 1024, height = 768;
+	const std::vector<std::vector<uint8_t>> frames = ZM_Frames(width, height, 4, 30);
+
+	const ZMBVKernels *k;
+	for (unsigned int ki = 0; (k = ZMBV_GetKernels(ki)) != NULL; ki++) {
+		const ZM_Stream stream = ZM_Encode(k, frames, width, height, 4, ZMBV_FORMAT_32BPP);
+		size_t total = 0;
+		for (const auto &chunk : stream.chunks) total += chunk.size();
+		printf("ZMBV %-4s %dx%dx32: %6.2f ms per frame, %6.1f frames per second, %zu bytes per frame\n",
+		       k->name, width, height, stream.ms / (double)frames.size(),
+		       (double)frames.size() * 1000.0 / stream.ms, total / frames.size());
+	}
+}
+
+} // namespace
+
+#endif // C_SSHOT
@@ -115,6 +115,10 @@
 /* Define to 1 if you have the mprotect function */
 #undef C_HAVE_MPROTECT
 
+/* Define to 1 to record call counts and host time of PIC event and timer tick
+   handlers */
+#undef C_EVENT_PROFILE
+
 /* Define to 1 to enable heavy debugging, also have to enable C_DEBUG */
 #define C_HEAVY_DEBUG 1
 